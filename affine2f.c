@@ -0,0 +1,387 @@
+/**
+ * File: affine2f.c
+ * Description:
+ * * 2D affine transforms stored as the top two rows of
+ * * a 3x3 matrix, and the batch kernels that apply
+ * * them: packed vec2f arrays, and sprites expanded into
+ * * the four corners of a quad written straight into a
+ * * strided vertex buffer. The sprite kernels compose
+ * * four (SSE2) or eight (AVX2) sprite transforms with
+ * * the view at a time, and large batches are split
+ * * across the worker pool.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+/**
+ * d = a * b on the six elements a, b, tx, c, d, ty of
+ * each operand, so b is applied first. d must not
+ * alias a or b.
+ */
+#define AFFINE2F_MULTIPLY_LANES(NAME, TARGET, V) \
+TARGET static inline void NAME(V* a, V* b, V* d) \
+{ \
+        d[0] = a[0] * b[0] + a[1] * b[3]; \
+        d[1] = a[0] * b[1] + a[1] * b[4]; \
+        d[2] = a[0] * b[2] + a[1] * b[5] + a[2]; \
+        d[3] = a[3] * b[0] + a[4] * b[3]; \
+        d[4] = a[3] * b[1] + a[4] * b[4]; \
+        d[5] = a[3] * b[2] + a[4] * b[5] + a[5]; \
+}
+
+/* the four corners of each sprite, c holding x0 y0 .. x3 y3 */
+#define AFFINE2F_CORNER_LANES(NAME, TARGET, V) \
+TARGET static inline void NAME(V* m, float* c, V* x, V* y) \
+{ \
+        int k; \
+\
+        for(k = 0; k < 4; k++) { \
+                x[k] = m[0] * c[2 * k] + m[1] * c[2 * k + 1] + m[2]; \
+                y[k] = m[3] * c[2 * k] + m[4] * c[2 * k + 1] + m[5]; \
+        } \
+}
+
+AFFINE2F_MULTIPLY_LANES(_affine2f_multiply_lanes, , float)
+AFFINE2F_CORNER_LANES(_affine2f_corner_lanes, , float)
+
+static float _sprite_unit_quad[8] = {
+        -0.5f, -0.5f,
+        0.5f, -0.5f,
+        0.5f, 0.5f,
+        -0.5f, 0.5f
+};
+
+void affine2f_identity(affine2f* dest)
+{
+        CGMATH_PROFILE_SCOPE(affine2f_identity, 1);
+        memset(dest->m, 0, AFFINE2F_SIZE);
+        dest->m[0][0] = 1.0f;
+        dest->m[1][1] = 1.0f;
+}
+
+/* translation may be NULL for none */
+void affine2f_from_mat2f(mat2f* mat, vec2f* translation, affine2f* dest)
+{
+        CGMATH_PROFILE_SCOPE(affine2f_from_mat2f, 1);
+        int r;
+
+        for(r = 0; r < 2; r++) {
+                dest->m[r][0] = mat->m[r][0];
+                dest->m[r][1] = mat->m[r][1];
+                dest->m[r][2] = translation != NULL ? translation->m[r] : 0.0f;
+        }
+}
+
+void affine2f_multiply(affine2f* a, affine2f* b, affine2f* dest)
+{
+        CGMATH_PROFILE_SCOPE(affine2f_multiply, 1);
+        float m[6];
+
+        _affine2f_multiply_lanes(a->m[0], b->m[0], m);
+        memcpy(dest->m, m, AFFINE2F_SIZE);
+}
+
+/**
+ * Returns -1 and leaves dest alone when the linear
+ * part is singular or the inverse would not be finite.
+ */
+int affine2f_inverse(affine2f* a, affine2f* dest)
+{
+        CGMATH_PROFILE_SCOPE(affine2f_inverse, 1);
+        float dt;
+        float m[6];
+
+        dt = a->m[0][0] * a->m[1][1] - a->m[0][1] * a->m[1][0];
+        if(dt == 0.0f || !isfinite(1.0f / dt)) {
+                return -1;
+        }
+        dt = 1.0f / dt;
+
+        m[0] = a->m[1][1] * dt;
+        m[1] = -a->m[0][1] * dt;
+        m[3] = -a->m[1][0] * dt;
+        m[4] = a->m[0][0] * dt;
+        m[2] = -(m[0] * a->m[0][2] + m[1] * a->m[1][2]);
+        m[5] = -(m[3] * a->m[0][2] + m[4] * a->m[1][2]);
+        memcpy(dest->m, m, AFFINE2F_SIZE);
+        return 0;
+}
+
+void _affine2f_transform_array_scalar(affine2f* a, vec2f* src, vec2f* dest, size_t count)
+{
+        size_t i;
+        float x;
+        float y;
+
+        for(i = 0; i < count; i++) {
+                x = src[i].m[VEC_X];
+                y = src[i].m[VEC_Y];
+                dest[i].m[VEC_X] = a->m[0][0] * x + a->m[0][1] * y + a->m[0][2];
+                dest[i].m[VEC_Y] = a->m[1][0] * x + a->m[1][1] * y + a->m[1][2];
+        }
+}
+
+void _sprite_expand_array_scalar(affine2f* view, affine2f* sprites, float* corners,
+                char* dest, size_t stride, size_t count)
+{
+        int k;
+        size_t i;
+        float m[6];
+        float x[4];
+        float y[4];
+        float* v;
+
+        for(i = 0; i < count; i++) {
+                _affine2f_multiply_lanes(view->m[0], sprites[i].m[0], m);
+                _affine2f_corner_lanes(m, corners, x, y);
+                for(k = 0; k < 4; k++) {
+                        v = (float*)(dest + (4 * i + k) * stride);
+                        v[0] = x[k];
+                        v[1] = y[k];
+                }
+        }
+}
+
+typedef struct {
+        affine2f*       mat;
+        affine2f*       sprites;
+        vec2f*          src;
+        vec2f*          dest;
+        float*          corners;
+        char*           vertices;
+        size_t          stride;
+} _affine2f_job;
+
+static void _affine2f_transform_range(void* ctx, size_t begin, size_t end)
+{
+        _affine2f_job* job;
+
+        job = ctx;
+        _cgmath_kern.affine2f_transform_array(job->mat, job->src + begin, job->dest + begin, end - begin);
+}
+
+static void _sprite_expand_range(void* ctx, size_t begin, size_t end)
+{
+        _affine2f_job* job;
+
+        job = ctx;
+        _cgmath_kern.sprite_expand_array(job->mat, job->sprites + begin, job->corners,
+                        job->vertices + 4 * begin * job->stride, job->stride, end - begin);
+}
+
+/* dest may equal src */
+void affine2f_transform_array(affine2f* a, vec2f* src, vec2f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(affine2f_transform_array, count);
+        _affine2f_job job;
+
+        job.mat = a;
+        job.src = src;
+        job.dest = dest;
+        _cgmath_parallel_for(count, CGMATH_BATCH_GRAIN, _affine2f_transform_range, &job);
+}
+
+/**
+ * Vertex 4 * i + k gets view * sprites[i] * corners[k]
+ * as two floats at byte offset (4 * i + k) * stride of
+ * dest, leaving the rest of each vertex alone. view may
+ * be NULL for the identity and corners NULL for the
+ * unit quad centered on the origin, wound
+ * counter-clockwise from (-0.5, -0.5).
+ */
+void sprite_expand_array(affine2f* view, affine2f* sprites, vec2f* corners,
+                void* dest, size_t stride, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(sprite_expand_array, count);
+        affine2f identity;
+        _affine2f_job job;
+
+        if(view == NULL) {
+                affine2f_identity(&identity);
+                view = &identity;
+        }
+
+        job.mat = view;
+        job.sprites = sprites;
+        job.corners = corners != NULL ? corners[0].m : _sprite_unit_quad;
+        job.vertices = dest;
+        job.stride = stride;
+        _cgmath_parallel_for(count, CGMATH_BATCH_GRAIN / 4, _sprite_expand_range, &job);
+}
+
+
+#if defined(CGMATH_X86)
+
+AFFINE2F_MULTIPLY_LANES(_affine2f_multiply_lanes_sse2, CGMATH_TARGET_SSE2, __m128)
+AFFINE2F_CORNER_LANES(_affine2f_corner_lanes_sse2, CGMATH_TARGET_SSE2, __m128)
+
+/**
+ * Four transforms are eight rows of three floats, so
+ * two vec3f loads give the rows interleaved by sprite;
+ * the shuffles split them into one register per element.
+ */
+CGMATH_TARGET_SSE2
+static inline void _affine2f_load4_sse2(affine2f* a, __m128* m)
+{
+        int k;
+        __m128 lo[3];
+        __m128 hi[3];
+
+        _cgmath_load3x4_sse2(a[0].m[0], &lo[0], &lo[1], &lo[2]);
+        _cgmath_load3x4_sse2(a[2].m[0], &hi[0], &hi[1], &hi[2]);
+        for(k = 0; k < 3; k++) {
+                m[k] = _mm_shuffle_ps(lo[k], hi[k], _MM_SHUFFLE(2, 0, 2, 0));
+                m[k + 3] = _mm_shuffle_ps(lo[k], hi[k], _MM_SHUFFLE(3, 1, 3, 1));
+        }
+}
+
+/* corners x[k], y[k] of four sprites to 16 strided vertices */
+CGMATH_TARGET_SSE2
+static inline void _sprite_store4_sse2(__m128* x, __m128* y, char* dest, size_t stride)
+{
+        int j;
+        __m128 lo;
+        __m128 hi;
+        char* v;
+
+        _MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+        _MM_TRANSPOSE4_PS(y[0], y[1], y[2], y[3]);
+        for(j = 0; j < 4; j++) {
+                lo = _mm_unpacklo_ps(x[j], y[j]);
+                hi = _mm_unpackhi_ps(x[j], y[j]);
+                v = dest + 4 * j * stride;
+                if(stride == sizeof(vec2f)) {
+                        _mm_storeu_ps((float*)v, lo);
+                        _mm_storeu_ps((float*)v + 4, hi);
+                } else {
+                        _mm_storel_pi((__m64*)v, lo);
+                        _mm_storeh_pi((__m64*)(v + stride), lo);
+                        _mm_storel_pi((__m64*)(v + 2 * stride), hi);
+                        _mm_storeh_pi((__m64*)(v + 3 * stride), hi);
+                }
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _affine2f_transform_array_sse2(affine2f* a, vec2f* src, vec2f* dest, size_t count)
+{
+        size_t i;
+        __m128 mx;
+        __m128 my;
+        __m128 t;
+        __m128 p;
+
+        mx = _mm_setr_ps(a->m[0][0], a->m[1][0], a->m[0][0], a->m[1][0]);
+        my = _mm_setr_ps(a->m[0][1], a->m[1][1], a->m[0][1], a->m[1][1]);
+        t = _mm_setr_ps(a->m[0][2], a->m[1][2], a->m[0][2], a->m[1][2]);
+
+        for(i = 0; i + 2 <= count; i += 2) {
+                p = _mm_loadu_ps(src[i].m);
+                _mm_storeu_ps(dest[i].m, _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 0, 0)), mx),
+                                _mm_mul_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 1, 1)), my)), t));
+        }
+        _affine2f_transform_array_scalar(a, src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_SSE2
+void _sprite_expand_array_sse2(affine2f* view, affine2f* sprites, float* corners,
+                char* dest, size_t stride, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 v[6];
+        __m128 s[6];
+        __m128 m[6];
+        __m128 x[4];
+        __m128 y[4];
+
+        for(k = 0; k < 6; k++) {
+                v[k] = _mm_set1_ps(view->m[k / 3][k % 3]);
+        }
+        for(i = 0; i + 4 <= count; i += 4) {
+                _affine2f_load4_sse2(sprites + i, s);
+                _affine2f_multiply_lanes_sse2(v, s, m);
+                _affine2f_corner_lanes_sse2(m, corners, x, y);
+                _sprite_store4_sse2(x, y, dest + 4 * i * stride, stride);
+        }
+        _sprite_expand_array_scalar(view, sprites + i, corners, dest + 4 * i * stride, stride, count - i);
+}
+
+AFFINE2F_MULTIPLY_LANES(_affine2f_multiply_lanes_avx2, CGMATH_TARGET_AVX2, __m256)
+AFFINE2F_CORNER_LANES(_affine2f_corner_lanes_avx2, CGMATH_TARGET_AVX2, __m256)
+
+CGMATH_TARGET_AVX2
+void _affine2f_transform_array_avx2(affine2f* a, vec2f* src, vec2f* dest, size_t count)
+{
+        size_t i;
+        __m256 mx;
+        __m256 my;
+        __m256 t;
+        __m256 p;
+
+        mx = _mm256_setr_ps(a->m[0][0], a->m[1][0], a->m[0][0], a->m[1][0],
+                        a->m[0][0], a->m[1][0], a->m[0][0], a->m[1][0]);
+        my = _mm256_setr_ps(a->m[0][1], a->m[1][1], a->m[0][1], a->m[1][1],
+                        a->m[0][1], a->m[1][1], a->m[0][1], a->m[1][1]);
+        t = _mm256_setr_ps(a->m[0][2], a->m[1][2], a->m[0][2], a->m[1][2],
+                        a->m[0][2], a->m[1][2], a->m[0][2], a->m[1][2]);
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                p = _mm256_loadu_ps(src[i].m);
+                _mm256_storeu_ps(dest[i].m, _mm256_add_ps(_mm256_add_ps(
+                                _mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(2, 2, 0, 0)), mx),
+                                _mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(3, 3, 1, 1)), my)), t));
+        }
+        _affine2f_transform_array_sse2(a, src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _sprite_expand_array_avx2(affine2f* view, affine2f* sprites, float* corners,
+                char* dest, size_t stride, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 lo[6];
+        __m128 hi[6];
+        __m128 xl[4];
+        __m128 yl[4];
+        __m256 v[6];
+        __m256 s[6];
+        __m256 m[6];
+        __m256 x[4];
+        __m256 y[4];
+
+        for(k = 0; k < 6; k++) {
+                v[k] = _mm256_set1_ps(view->m[k / 3][k % 3]);
+        }
+        for(i = 0; i + 8 <= count; i += 8) {
+                _affine2f_load4_sse2(sprites + i, lo);
+                _affine2f_load4_sse2(sprites + i + 4, hi);
+                for(k = 0; k < 6; k++) {
+                        s[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[k]), hi[k], 1);
+                }
+                _affine2f_multiply_lanes_avx2(v, s, m);
+                _affine2f_corner_lanes_avx2(m, corners, x, y);
+
+                for(k = 0; k < 4; k++) {
+                        xl[k] = _mm256_castps256_ps128(x[k]);
+                        yl[k] = _mm256_castps256_ps128(y[k]);
+                }
+                _sprite_store4_sse2(xl, yl, dest + 4 * i * stride, stride);
+                for(k = 0; k < 4; k++) {
+                        xl[k] = _mm256_extractf128_ps(x[k], 1);
+                        yl[k] = _mm256_extractf128_ps(y[k], 1);
+                }
+                _sprite_store4_sse2(xl, yl, dest + 4 * (i + 4) * stride, stride);
+        }
+        _sprite_expand_array_sse2(view, sprites + i, corners, dest + 4 * i * stride, stride, count - i);
+}
+
+#endif
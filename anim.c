@@ -0,0 +1,244 @@
+/**
+ * File: anim.c
+ * Description:
+ * * Keyframe animation clips. All channels of a clip
+ * * share one allocation: key times and values are
+ * * packed channel after channel, and each channel
+ * * remembers the key interval it sampled last so
+ * * that forward playback never searches.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+
+#define CGMATH_ANIM_ALIGN       64
+
+/* below this angle slerp is replaced by a normalized lerp */
+#define CGMATH_ANIM_SLERP_DOT   0.9995f
+
+static size_t _anim_round(size_t n)
+{
+        return (n + CGMATH_ANIM_ALIGN - 1) & ~(size_t)(CGMATH_ANIM_ALIGN - 1);
+}
+
+int anim_clip_init(anim_clip* clip, int type, int channels, int* key_counts)
+{
+        int c;
+        int keys;
+        int width;
+        size_t size;
+        size_t times;
+        size_t values;
+        size_t offsets;
+        size_t cursors;
+        char* block;
+
+        if(channels <= 0 || (type != CGMATH_ANIM_VEC3F && type != CGMATH_ANIM_QUAT)) {
+                return -1;
+        }
+
+        keys = 0;
+        for(c = 0; c < channels; c++) {
+                if(key_counts[c] <= 0) {
+                        return -1;
+                }
+                keys += key_counts[c];
+        }
+
+        width = type == CGMATH_ANIM_QUAT ? 4 : 3;
+        times = _anim_round(keys * sizeof(float));
+        values = _anim_round((size_t)keys * width * sizeof(float));
+        offsets = _anim_round((channels + 1) * sizeof(int));
+        cursors = _anim_round(channels * sizeof(int));
+        size = times + values + offsets + cursors + _anim_round(channels * sizeof(float));
+
+        block = aligned_alloc(CGMATH_ANIM_ALIGN, size);
+        if(block == NULL) {
+                return -1;
+        }
+        memset(block, 0, size);
+
+        clip->type = type;
+        clip->channels = channels;
+        clip->times = (float*)block;
+        clip->values = (float*)(block + times);
+        clip->offset = (int*)(block + times + values);
+        clip->cursor = (int*)(block + times + values + offsets);
+        clip->alpha = (float*)(block + times + values + offsets + cursors);
+
+        clip->offset[0] = 0;
+        for(c = 0; c < channels; c++) {
+                clip->offset[c + 1] = clip->offset[c] + key_counts[c];
+        }
+        return 0;
+}
+
+void anim_clip_free(anim_clip* clip)
+{
+        free(clip->times);
+        memset(clip, 0, sizeof(*clip));
+}
+
+float* anim_clip_times(anim_clip* clip, int channel)
+{
+        return clip->times + clip->offset[channel];
+}
+
+float* anim_clip_values(anim_clip* clip, int channel)
+{
+        return clip->values + clip->offset[channel] * (clip->type == CGMATH_ANIM_QUAT ? 4 : 3);
+}
+
+void anim_clip_rewind(anim_clip* clip)
+{
+        memset(clip->cursor, 0, clip->channels * sizeof(int));
+}
+
+/**
+ * Finds, for every channel, the key k with
+ * times[k] <= t < times[k + 1] and the blend factor
+ * within it, starting from the cached key. Moving
+ * forward steps linearly, which is O(1) per sample for
+ * playback; moving backward falls back to a binary
+ * search. Times outside the curve clamp to its ends.
+ * Cursors hold key indices relative to offset[c].
+ */
+static void _anim_locate(anim_clip* clip, float t)
+{
+        int c;
+        int k;
+        int lo;
+        int hi;
+        int mid;
+        int first;
+        int last;
+        float* ts;
+
+        ts = clip->times;
+        for(c = 0; c < clip->channels; c++) {
+                first = clip->offset[c];
+                last = clip->offset[c + 1] - 1;
+                k = first + clip->cursor[c];
+
+                if(first == last || t <= ts[first]) {
+                        clip->cursor[c] = 0;
+                        clip->alpha[c] = 0.0f;
+                        continue;
+                }
+                if(t >= ts[last]) {
+                        clip->cursor[c] = last - 1 - first;
+                        clip->alpha[c] = 1.0f;
+                        continue;
+                }
+
+                if(ts[k] <= t) {
+                        while(ts[k + 1] <= t) {
+                                k++;
+                        }
+                } else {
+                        lo = first;
+                        hi = k;
+                        while(hi - lo > 1) {
+                                mid = (lo + hi) >> 1;
+                                if(ts[mid] <= t) {
+                                        lo = mid;
+                                } else {
+                                        hi = mid;
+                                }
+                        }
+                        k = lo;
+                }
+
+                clip->cursor[c] = k - first;
+                clip->alpha[c] = (t - ts[k]) / (ts[k + 1] - ts[k]);
+        }
+}
+
+/**
+ * Writes one vec3f per channel into the x/y/z streams
+ * of dest. The second pass is a branch free loop over
+ * channels so it can be vectorized.
+ */
+void anim_sample_vec3f(anim_clip* clip, float t, vec3f_soa* dest)
+{
+        CGMATH_PROFILE_SCOPE(anim_sample_vec3f, clip->channels);
+        int c;
+        int i;
+        int j;
+        float a;
+        float* v;
+
+        _anim_locate(clip, t);
+
+        v = clip->values;
+        for(c = 0; c < clip->channels; c++) {
+                i = (clip->offset[c] + clip->cursor[c]) * 3;
+                j = clip->offset[c + 1] - clip->offset[c] > 1 ? i + 3 : i;
+                a = clip->alpha[c];
+                dest->m[VEC_X][c] = v[i + VEC_X] + (v[j + VEC_X] - v[i + VEC_X]) * a;
+                dest->m[VEC_Y][c] = v[i + VEC_Y] + (v[j + VEC_Y] - v[i + VEC_Y]) * a;
+                dest->m[VEC_Z][c] = v[i + VEC_Z] + (v[j + VEC_Z] - v[i + VEC_Z]) * a;
+        }
+}
+
+/**
+ * Shortest arc slerp between neighbouring keys, one
+ * quat per channel into the x/y/z/w streams of dest.
+ * Nearly parallel keys use a normalized lerp instead,
+ * which also avoids dividing by a vanishing sine.
+ */
+void anim_sample_quat(anim_clip* clip, float t, quat_soa* dest)
+{
+        CGMATH_PROFILE_SCOPE(anim_sample_quat, clip->channels);
+        int c;
+        int i;
+        int j;
+        int k;
+        float a;
+        float d;
+        float w0;
+        float w1;
+        float th;
+        float s;
+        float q[4];
+        float* v;
+
+        _anim_locate(clip, t);
+
+        v = clip->values;
+        for(c = 0; c < clip->channels; c++) {
+                i = (clip->offset[c] + clip->cursor[c]) * 4;
+                j = clip->offset[c + 1] - clip->offset[c] > 1 ? i + 4 : i;
+                a = clip->alpha[c];
+
+                d = v[i] * v[j] + v[i + 1] * v[j + 1] + v[i + 2] * v[j + 2] + v[i + 3] * v[j + 3];
+                w1 = d < 0.0f ? -1.0f : 1.0f;
+                d = _cgmath_absf(d);
+
+                if(d > CGMATH_ANIM_SLERP_DOT) {
+                        w0 = 1.0f - a;
+                        w1 *= a;
+                } else {
+                        th = acosf(d);
+                        s = 1.0f / sinf(th);
+                        w0 = sinf((1.0f - a) * th) * s;
+                        w1 *= sinf(a * th) * s;
+                }
+
+                for(k = 0; k < 4; k++) {
+                        q[k] = w0 * v[i + k] + w1 * v[j + k];
+                }
+
+                s = _cgmath_invsqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+                s = s * (1.5f - 0.5f * (q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]) * s * s);
+
+                dest->m[VEC_X][c] = q[0] * s;
+                dest->m[VEC_Y][c] = q[1] * s;
+                dest->m[VEC_Z][c] = q[2] * s;
+                dest->m[VEC_W][c] = q[3] * s;
+        }
+}
@@ -0,0 +1,205 @@
+/**
+ * File: bench.c
+ * Description:
+ * * A small transform/inverse/normalize workload. It is
+ * * both the training run for the profile guided build
+ * * and the yardstick for the other build profiles:
+ * * -o FILE saves the timings, -b FILE prints the
+ * * speedup of this build over the saved ones.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cgmath.h"
+
+#define BENCH_COUNT     4096
+#define BENCH_ROUNDS    200
+
+typedef struct {
+        const char*     name;
+        double          ns;
+} bench_result;
+
+static mat4f    mats[BENCH_COUNT];
+static vec3f    v3[BENCH_COUNT];
+static vec4f    v4[BENCH_COUNT];
+static volatile float sink;
+
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static float frand(void)
+{
+        return (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+}
+
+static void setup(void)
+{
+        int i;
+        int j;
+        int k;
+
+        srand(1);
+        for(i = 0; i < BENCH_COUNT; i++) {
+                mat4f_identity(&mats[i]);
+                for(j = 0; j < 4; j++) {
+                        for(k = 0; k < 4; k++) {
+                                mats[i].m[j][k] += 0.25f * frand();
+                        }
+                }
+                for(j = 0; j < 3; j++) {
+                        v3[i].m[j] = frand();
+                }
+                for(j = 0; j < 4; j++) {
+                        v4[i].m[j] = frand();
+                }
+        }
+}
+
+/**
+ * Chains of matrix products, as when composing a
+ * hierarchy of local transforms into world space.
+ */
+static double bench_transform(void)
+{
+        int i;
+        int r;
+        mat4f acc;
+        double t0;
+
+        t0 = now();
+        for(r = 0; r < BENCH_ROUNDS; r++) {
+                mat4f_identity(&acc);
+                for(i = 0; i < BENCH_COUNT; i++) {
+                        mat4f_multiply(&acc, &mats[i], &acc);
+                        if((i & 15) == 15) {
+                                mat4f_identity(&acc);
+                        }
+                }
+                sink = acc.m[0][0];
+        }
+        return (now() - t0) / ((double)BENCH_ROUNDS * BENCH_COUNT);
+}
+
+static double bench_inverse(void)
+{
+        int i;
+        int r;
+        mat4f inv;
+        double t0;
+
+        t0 = now();
+        for(r = 0; r < BENCH_ROUNDS / 4; r++) {
+                for(i = 0; i < BENCH_COUNT; i++) {
+                        mat4f_inverse(&mats[i], &inv);
+                        sink = inv.m[3][3];
+                }
+        }
+        return (now() - t0) / ((double)(BENCH_ROUNDS / 4) * BENCH_COUNT);
+}
+
+static double bench_inverse3(void)
+{
+        int i;
+        int r;
+        mat3f m;
+        mat3f inv;
+        double t0;
+
+        t0 = now();
+        for(r = 0; r < BENCH_ROUNDS / 4; r++) {
+                for(i = 0; i < BENCH_COUNT; i++) {
+                        memcpy(m.m[0], mats[i].m[0], 3 * sizeof(float));
+                        memcpy(m.m[1], mats[i].m[1], 3 * sizeof(float));
+                        memcpy(m.m[2], mats[i].m[2], 3 * sizeof(float));
+                        mat3f_inverse(&m, &inv);
+                        sink = inv.m[2][2];
+                }
+        }
+        return (now() - t0) / ((double)(BENCH_ROUNDS / 4) * BENCH_COUNT);
+}
+
+static double bench_normalize(void)
+{
+        int i;
+        int r;
+        vec3f a;
+        vec4f b;
+        double t0;
+
+        t0 = now();
+        for(r = 0; r < BENCH_ROUNDS; r++) {
+                for(i = 0; i < BENCH_COUNT; i++) {
+                        vec3f_normalize(&v3[i], &a);
+                        vec4f_normalize(&v4[i], &b);
+                        sink = a.m[0] + b.m[0];
+                }
+        }
+        return (now() - t0) / ((double)BENCH_ROUNDS * BENCH_COUNT);
+}
+
+int main(int argc, char* argv[])
+{
+        int i;
+        int n;
+        FILE* f;
+        char name[64];
+        double ns;
+        const char* out;
+        const char* base;
+        bench_result res[4];
+
+        out = NULL;
+        base = NULL;
+        for(i = 1; i < argc - 1; i++) {
+                if(strcmp(argv[i], "-o") == 0) {
+                        out = argv[++i];
+                } else if(strcmp(argv[i], "-b") == 0) {
+                        base = argv[++i];
+                }
+        }
+
+        setup();
+        res[0].name = "transform";
+        res[0].ns = bench_transform();
+        res[1].name = "inverse4";
+        res[1].ns = bench_inverse();
+        res[2].name = "inverse3";
+        res[2].ns = bench_inverse3();
+        res[3].name = "normalize";
+        res[3].ns = bench_normalize();
+        n = 4;
+
+        printf("isa: %s\n", cgmath_isa_name(cgmath_isa_level()));
+        for(i = 0; i < n; i++) {
+                printf("%-12s %10.2f ns/op\n", res[i].name, res[i].ns);
+        }
+
+        if(out != NULL && (f = fopen(out, "w")) != NULL) {
+                for(i = 0; i < n; i++) {
+                        fprintf(f, "%s %f\n", res[i].name, res[i].ns);
+                }
+                fclose(f);
+        }
+
+        if(base != NULL && (f = fopen(base, "r")) != NULL) {
+                printf("speedup over %s:\n", base);
+                while(fscanf(f, "%63s %lf", name, &ns) == 2) {
+                        for(i = 0; i < n; i++) {
+                                if(strcmp(name, res[i].name) == 0) {
+                                        printf("%-12s %10.2fx\n", name, ns / res[i].ns);
+                                }
+                        }
+                }
+                fclose(f);
+        }
+
+        return 0;
+}
@@ -0,0 +1,2448 @@
+/**
+ * File: check.c
+ * Description:
+ * * Behavioural checks that ulp.c cannot express:
+ * * output order, truncation, results against a brute
+ * * force reference, bits against the scalar level,
+ * * error reporting, and agreement between the batch
+ * * and one-at-a-time forms. Every check runs at
+ * * every dispatch level the CPU supports and prints one
+ * * line; the exit status is the number of failures.
+ * *
+ * * Usage: check [-s seed]
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cgmath.h"
+
+static unsigned long long rng_state;
+static int failures;
+
+static unsigned int rng(void)
+{
+        rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (unsigned int)(rng_state >> 33);
+}
+
+static float uniform(void)
+{
+        return (float)rng() / (float)(1U << 31) * 2.0f - 1.0f;
+}
+
+static void report(int level, const char* name, int ok, const char* detail)
+{
+        printf("%-8s %-24s %s%s%s\n", cgmath_isa_name(level), name, ok ? "ok" : "FAIL",
+                detail != NULL ? "  " : "", detail != NULL ? detail : "");
+        failures += !ok;
+}
+
+/**
+ * Compares size bytes at out with what the scalar level
+ * left in base, which the scalar level fills instead.
+ */
+static void same_as_scalar(int level, const char* name, void* out, void* base, size_t size)
+{
+        if(level == CGMATH_ISA_SCALAR) {
+                memcpy(base, out, size);
+        } else {
+                report(level, name, memcmp(out, base, size) == 0, NULL);
+        }
+}
+
+/* ---- vec4f_clip_triangles ---- */
+
+/*
+ * Enough triangles for several slices of the parallel
+ * pass. Each is small and centered anywhere in about
+ * twice the view volume, some with a vertex behind the
+ * eye, so all of accept, reject and clip occur.
+ */
+#define CLIP_TRIS       40000
+
+/* a clipped triangle fans into at most seven */
+#define CLIP_FAN        7
+
+static vec4f clip_rounding[3] = {
+        {{ -0x1.147ee2p+0f, 0x1.147ee2p+0f, 0x1.147ee2p+0f, 0x1.147eep+0f }},
+        {{ 0x1.48bf86p+0f, -0x1.48bf86p+0f, 0x1.48bf82p+0f, 0x1.48bf84p+0f }},
+        {{ 0x1.0eaed2p-1f, 0x1.0eaed6p-1f, -0x1.0eaed8p-1f, 0x1.0eaed4p-1f }}
+};
+
+typedef struct {
+        vec4f*          src;
+        vec4f*          dest;
+        unsigned int*   source;
+        vec4f*          ref;
+        unsigned int*   ref_source;
+        vec4f*          base;
+        size_t          base_count;
+} clip_state;
+
+static void clip_input(vec4f* src)
+{
+        int k;
+        int j;
+        size_t i;
+        float c[3];
+        float w;
+
+        for(i = 0; i < CLIP_TRIS; i++) {
+                w = 0.25f + 1.75f * (0.5f + 0.5f * uniform());
+                for(k = 0; k < 3; k++) {
+                        c[k] = 2.0f * w * uniform();
+                }
+                for(j = 0; j < 3; j++) {
+                        for(k = 0; k < 3; k++) {
+                                src[3 * i + j].m[k] = c[k] + 0.3f * uniform();
+                        }
+                        src[3 * i + j].m[VEC_W] = rng() % 16 == 0 ? -0.1f : w + 0.1f * uniform();
+                }
+        }
+}
+
+static void clip_check(int level, clip_state* s)
+{
+        size_t i;
+        size_t n;
+        size_t total;
+        size_t max;
+        size_t written;
+        unsigned int t;
+        int ok;
+        char detail[96];
+
+        memset(s->dest, 0xff, 3 * CLIP_FAN * CLIP_TRIS * sizeof(vec4f));
+        total = vec4f_clip_triangles(s->src, CLIP_TRIS, s->dest, s->source, CLIP_FAN * CLIP_TRIS);
+
+        /* the batch equals the triangles clipped one at a time, in input order */
+        n = 0;
+        for(i = 0; i < CLIP_TRIS; i++) {
+                written = vec4f_clip_triangles(s->src + 3 * i, 1, s->ref + 3 * n, NULL, CLIP_FAN);
+                for(t = 0; t < written; t++) {
+                        s->ref_source[n + t] = (unsigned int)i;
+                }
+                n += written;
+        }
+        ok = n == total && memcmp(s->dest, s->ref, 3 * total * sizeof(vec4f)) == 0 &&
+                memcmp(s->source, s->ref_source, total * sizeof(unsigned int)) == 0;
+        snprintf(detail, sizeof(detail), "%zu triangles out", total);
+        report(level, "clip order", ok, detail);
+
+        /* output is in the view volume after the divide */
+        ok = 1;
+        for(i = 0; i < 3 * total; i++) {
+                ok &= fabsf(s->dest[i].m[VEC_X]) <= 1.0f + 1e-5f && fabsf(s->dest[i].m[VEC_Y]) <= 1.0f + 1e-5f &&
+                        fabsf(s->dest[i].m[VEC_Z]) <= 1.0f + 1e-5f && s->dest[i].m[VEC_W] > 0.0f;
+        }
+        report(level, "clip volume", ok, NULL);
+
+        /* a short buffer gets a prefix of the full output and nothing past max */
+        max = total / 3;
+        memset(s->ref, 0xff, 3 * CLIP_FAN * CLIP_TRIS * sizeof(vec4f));
+        memset(s->ref_source, 0xff, CLIP_FAN * CLIP_TRIS * sizeof(unsigned int));
+        n = vec4f_clip_triangles(s->src, CLIP_TRIS, s->ref, s->ref_source, max);
+        ok = n == total && memcmp(s->ref, s->dest, 3 * max * sizeof(vec4f)) == 0 &&
+                memcmp(s->ref_source, s->source, max * sizeof(unsigned int)) == 0;
+        for(i = 3 * max; i < 3 * total; i++) {
+                ok &= s->ref[i].m[VEC_X] != s->ref[i].m[VEC_X];
+        }
+        for(i = max; i < total; i++) {
+                ok &= s->ref_source[i] == 0xffffffffu;
+        }
+        report(level, "clip prefix", ok, NULL);
+
+        /* one thread and the pool agree */
+        t = (unsigned int)cgmath_threads();
+        cgmath_set_threads(1);
+        n = vec4f_clip_triangles(s->src, CLIP_TRIS, s->ref, s->ref_source, CLIP_FAN * CLIP_TRIS);
+        cgmath_set_threads((int)t);
+        ok = n == total && memcmp(s->ref, s->dest, 3 * total * sizeof(vec4f)) == 0 &&
+                memcmp(s->ref_source, s->source, total * sizeof(unsigned int)) == 0;
+        report(level, "clip threads", ok, NULL);
+
+        /* rounding leaves this one non-convex after a plane, with ten vertices before merging */
+        memcpy(s->ref, clip_rounding, sizeof(clip_rounding));
+        memset(s->ref + 3, 0xff, 3 * (CLIP_FAN + 1) * sizeof(vec4f));
+        n = vec4f_clip_triangles(s->ref, 1, s->ref + 3, NULL, CLIP_FAN + 1);
+        ok = n > 0 && n <= CLIP_FAN && s->ref[3 + 3 * CLIP_FAN].m[VEC_X] != s->ref[3 + 3 * CLIP_FAN].m[VEC_X];
+        for(i = 3; i < 3 + 3 * n; i++) {
+                ok &= fabsf(s->ref[i].m[VEC_X]) <= 1.0f + 1e-5f && fabsf(s->ref[i].m[VEC_Y]) <= 1.0f + 1e-5f &&
+                        fabsf(s->ref[i].m[VEC_Z]) <= 1.0f + 1e-5f && s->ref[i].m[VEC_W] > 0.0f;
+        }
+        report(level, "clip rounding", ok, NULL);
+
+        /* every level clips to the same bits as scalar */
+        if(level == CGMATH_ISA_SCALAR) {
+                memcpy(s->base, s->dest, 3 * total * sizeof(vec4f));
+                s->base_count = total;
+        } else {
+                ok = total == s->base_count && memcmp(s->base, s->dest, 3 * total * sizeof(vec4f)) == 0;
+                report(level, "clip vs scalar", ok, NULL);
+        }
+}
+
+/* ---- depth_buffer_render and depth_buffer_test_aabb ---- */
+
+/*
+ * The identity takes positions straight to clip space,
+ * so pixel coverage can be brute forced in double from
+ * the same floats. A few large occluders and many small
+ * triangles of either winding, some crossing the sides
+ * of the screen; depths stay inside the view volume so
+ * only the side planes clip.
+ */
+#define RASTER_W        128
+#define RASTER_H        96
+#define RASTER_TRIS     600
+#define RASTER_BOXES    4000
+
+/* pixels this close to an edge may go either way */
+#define RASTER_TIE      1e-3
+
+/* depth plane setup and evaluation in float */
+#define RASTER_DEPTH    1e-4
+
+typedef struct {
+        vec3f*          pos;
+        unsigned int*   indices;
+        aabb*           boxes;
+        unsigned char*  visible;
+        float*          depth;
+} raster_state;
+
+static void raster_input(raster_state* s)
+{
+        int j;
+        int k;
+        size_t i;
+        float c[3];
+        float size;
+
+        for(i = 0; i < RASTER_TRIS; i++) {
+                size = i < 8 ? 1.5f : 0.02f + 0.2f * (0.5f + 0.5f * uniform());
+                c[0] = 1.2f * uniform();
+                c[1] = 1.2f * uniform();
+                c[2] = i < 8 ? 0.2f * uniform() : 0.6f * uniform();
+                for(j = 0; j < 3; j++) {
+                        s->pos[3 * i + j].m[VEC_X] = c[0] + size * uniform();
+                        s->pos[3 * i + j].m[VEC_Y] = c[1] + size * uniform();
+                        s->pos[3 * i + j].m[VEC_Z] = c[2] + 0.25f * uniform();
+                        s->indices[3 * i + j] = (unsigned int)(3 * i + j);
+                }
+        }
+        for(i = 0; i < RASTER_BOXES; i++) {
+                for(k = 0; k < 3; k++) {
+                        c[k] = k < 2 ? 1.2f * uniform() : 1.1f * uniform();
+                        size = 0.01f + 0.15f * (0.5f + 0.5f * uniform());
+                        s->boxes[i].min.m[k] = c[k] - size;
+                        s->boxes[i].max.m[k] = c[k] + size;
+                }
+        }
+}
+
+/* the edge of a b as a signed distance of x y in pixels, positive to the left */
+static double raster_edge(double* a, double* b, double x, double y)
+{
+        double dx;
+        double dy;
+
+        dx = b[0] - a[0];
+        dy = b[1] - a[1];
+        return (dx * (y - a[1]) - dy * (x - a[0])) / sqrt(dx * dx + dy * dy);
+}
+
+/**
+ * Whether every pixel is between the nearest triangle
+ * certainly covering its center and the nearest one
+ * that might, far plane if none.
+ */
+static int raster_coverage(raster_state* s, depth_buffer* db)
+{
+        int x;
+        int y;
+        int j;
+        size_t i;
+        double v[3][3];
+        double e[3];
+        double area;
+        double z;
+        double lo;
+        double hi;
+        double xc;
+        double yc;
+        float d;
+
+        for(y = 0; y < RASTER_H; y++) {
+                for(x = 0; x < RASTER_W; x++) {
+                        xc = x + 0.5;
+                        yc = y + 0.5;
+                        lo = 1.0;
+                        hi = 1.0;
+                        for(i = 0; i < RASTER_TRIS; i++) {
+                                for(j = 0; j < 3; j++) {
+                                        v[j][0] = (double)s->pos[3 * i + j].m[VEC_X] * (RASTER_W / 2) + RASTER_W / 2;
+                                        v[j][1] = (double)s->pos[3 * i + j].m[VEC_Y] * (RASTER_H / 2) + RASTER_H / 2;
+                                        v[j][2] = (double)s->pos[3 * i + j].m[VEC_Z] * 0.5 + 0.5;
+                                }
+                                area = (v[1][0] - v[0][0]) * (v[2][1] - v[0][1]) -
+                                        (v[2][0] - v[0][0]) * (v[1][1] - v[0][1]);
+                                if(area <= 0.0) {
+                                        continue;
+                                }
+                                for(j = 0; j < 3; j++) {
+                                        e[j] = raster_edge(v[j], v[(j + 1) % 3], xc, yc);
+                                }
+                                if(e[0] < -RASTER_TIE || e[1] < -RASTER_TIE || e[2] < -RASTER_TIE) {
+                                        continue;
+                                }
+                                z = v[0][2] + ((v[1][2] - v[0][2]) * ((v[2][0] - v[0][0]) * (yc - v[0][1]) -
+                                        (v[2][1] - v[0][1]) * (xc - v[0][0])) + (v[2][2] - v[0][2]) *
+                                        ((v[1][1] - v[0][1]) * (xc - v[0][0]) -
+                                        (v[1][0] - v[0][0]) * (yc - v[0][1]))) / -area;
+                                lo = z < lo ? z : lo;
+                                if(e[0] > RASTER_TIE && e[1] > RASTER_TIE && e[2] > RASTER_TIE) {
+                                        hi = z < hi ? z : hi;
+                                }
+                        }
+                        d = depth_buffer_read(db, x, y);
+                        if(!(d >= lo - RASTER_DEPTH && d <= hi + RASTER_DEPTH)) {
+                                return 0;
+                        }
+                }
+        }
+        return 1;
+}
+
+/* every hiz entry is the farthest depth of its tile */
+static int raster_hiz(depth_buffer* db)
+{
+        int x;
+        int y;
+        int tx;
+        int ty;
+        float m;
+
+        for(ty = 0; ty < db->tiles_y; ty++) {
+                for(tx = 0; tx < db->tiles_x; tx++) {
+                        m = -INFINITY;
+                        for(y = 8 * ty; y < 8 * ty + 8; y++) {
+                                for(x = 8 * tx; x < 8 * tx + 8; x++) {
+                                        m = fmaxf(m, depth_buffer_read(db, x, y));
+                                }
+                        }
+                        if(db->hiz[ty * db->tiles_x + tx] != m) {
+                                return 0;
+                        }
+                }
+        }
+        return 1;
+}
+
+/**
+ * A hidden box has every pixel center of its screen
+ * rectangle nearer than its nearest corner, and is not
+ * crossing the near plane. Counts the hidden boxes.
+ */
+static int raster_boxes(raster_state* s, depth_buffer* db, size_t* hidden)
+{
+        int x;
+        int y;
+        size_t i;
+        aabb* b;
+        float z;
+
+        *hidden = 0;
+        for(i = 0; i < RASTER_BOXES; i++) {
+                if(s->visible[i]) {
+                        continue;
+                }
+                ++*hidden;
+                b = s->boxes + i;
+                if(b->max.m[VEC_X] < -1.0f || b->min.m[VEC_X] > 1.0f || b->max.m[VEC_Y] < -1.0f ||
+                                b->min.m[VEC_Y] > 1.0f || b->max.m[VEC_Z] < -1.0f || b->min.m[VEC_Z] > 1.0f) {
+                        continue;
+                }
+                if(b->min.m[VEC_Z] < -1.0f) {
+                        return 0;
+                }
+                z = b->min.m[VEC_Z] * 0.5f + 0.5f;
+                for(y = 0; y < RASTER_H; y++) {
+                        for(x = 0; x < RASTER_W; x++) {
+                                if((x + 0.5) / (RASTER_W / 2) - 1.0 < b->min.m[VEC_X] ||
+                                                (x + 0.5) / (RASTER_W / 2) - 1.0 > b->max.m[VEC_X] ||
+                                                (y + 0.5) / (RASTER_H / 2) - 1.0 < b->min.m[VEC_Y] ||
+                                                (y + 0.5) / (RASTER_H / 2) - 1.0 > b->max.m[VEC_Y]) {
+                                        continue;
+                                }
+                                if(!(depth_buffer_read(db, x, y) < z)) {
+                                        return 0;
+                                }
+                        }
+                }
+        }
+        return 1;
+}
+
+static void raster_check(int level, raster_state* s, depth_buffer* db)
+{
+        int t;
+        int ok;
+        size_t n;
+        size_t i;
+        size_t seen;
+        size_t hidden;
+        mat4f mat;
+        char detail[96];
+
+        memset(&mat, 0, sizeof(mat));
+        for(t = 0; t < 4; t++) {
+                mat.m[t][t] = 1.0f;
+        }
+
+        depth_buffer_clear(db);
+        ok = depth_buffer_render(db, &mat, s->pos, 3 * RASTER_TRIS, s->indices, RASTER_TRIS) == 0;
+        report(level, "raster coverage", ok && raster_coverage(s, db), NULL);
+        report(level, "raster hiz", raster_hiz(db), NULL);
+
+        /* one thread and the pool agree */
+        n = (size_t)RASTER_W * RASTER_H;
+        memcpy(s->depth, db->depth, n * sizeof(float));
+        t = cgmath_threads();
+        cgmath_set_threads(1);
+        depth_buffer_clear(db);
+        depth_buffer_render(db, &mat, s->pos, 3 * RASTER_TRIS, s->indices, RASTER_TRIS);
+        cgmath_set_threads(t);
+        report(level, "raster threads", memcmp(s->depth, db->depth, n * sizeof(float)) == 0, NULL);
+
+        seen = depth_buffer_test_aabb(db, &mat, s->boxes, s->visible, RASTER_BOXES);
+        n = 0;
+        for(i = 0; i < RASTER_BOXES; i++) {
+                n += s->visible[i];
+        }
+        hidden = 0;
+        ok = n == seen && raster_boxes(s, db, &hidden);
+        snprintf(detail, sizeof(detail), "%zu of %d hidden", hidden, RASTER_BOXES);
+        report(level, "raster test_aabb", ok, detail);
+}
+
+/* ---- kdtree_nearest ---- */
+
+/*
+ * Points on a coarse lattice so that ties occur, and
+ * queries around them; the reference is a linear scan
+ * with the same float expression as the leaf kernels.
+ */
+#define KDTREE_POINTS   5000
+#define KDTREE_QUERIES  2000
+
+static vec3f kdtree_points[KDTREE_POINTS];
+static vec3f kdtree_queries[KDTREE_QUERIES];
+static unsigned int kdtree_ids[KDTREE_QUERIES];
+static float kdtree_dist2[KDTREE_QUERIES];
+
+static void kdtree_input(void)
+{
+        int k;
+        size_t i;
+
+        for(i = 0; i < KDTREE_POINTS; i++) {
+                for(k = 0; k < 3; k++) {
+                        kdtree_points[i].m[k] = (float)(rng() % 64) * 0.25f;
+                }
+        }
+        for(i = 0; i < KDTREE_QUERIES; i++) {
+                for(k = 0; k < 3; k++) {
+                        kdtree_queries[i].m[k] = 8.0f + 10.0f * uniform();
+                }
+        }
+}
+
+static void kdtree_check(int level)
+{
+        int ok;
+        size_t i;
+        size_t j;
+        unsigned int best;
+        unsigned int id;
+        float dx;
+        float dy;
+        float dz;
+        float d2;
+        float least;
+        kdtree tree;
+        vec3f far[2];
+        vec3f origin;
+
+        if(kdtree_init(&tree, KDTREE_POINTS) != 0 || kdtree_build(&tree, kdtree_points, KDTREE_POINTS) != 0) {
+                report(level, "kdtree nearest", 0, "init failed");
+                return;
+        }
+        kdtree_nearest_array(&tree, kdtree_queries, KDTREE_QUERIES, kdtree_ids, kdtree_dist2);
+        ok = 1;
+        for(i = 0; i < KDTREE_QUERIES; i++) {
+                best = 0xFFFFFFFFu;
+                least = INFINITY;
+                for(j = 0; j < KDTREE_POINTS; j++) {
+                        dx = kdtree_points[j].m[VEC_X] - kdtree_queries[i].m[VEC_X];
+                        dy = kdtree_points[j].m[VEC_Y] - kdtree_queries[i].m[VEC_Y];
+                        dz = kdtree_points[j].m[VEC_Z] - kdtree_queries[i].m[VEC_Z];
+                        d2 = dx * dx + dy * dy + dz * dz;
+                        if(d2 < least) {
+                                least = d2;
+                                best = (unsigned int)j;
+                        }
+                }
+                id = kdtree_nearest(&tree, kdtree_queries + i, &d2);
+                ok &= kdtree_ids[i] == best && kdtree_dist2[i] == least && id == best && d2 == least;
+        }
+        report(level, "kdtree nearest", ok, NULL);
+
+        /* squared distances past FLT_MAX are still distances */
+        far[0].m[VEC_X] = 3e19f;
+        far[1].m[VEC_X] = -3e19f;
+        far[0].m[VEC_Y] = far[0].m[VEC_Z] = far[1].m[VEC_Y] = far[1].m[VEC_Z] = 0.0f;
+        origin.m[VEC_X] = origin.m[VEC_Y] = origin.m[VEC_Z] = 0.0f;
+        ok = kdtree_build(&tree, far, 2) == 0 && kdtree_nearest(&tree, &origin, &d2) == 0 && isinf(d2);
+        report(level, "kdtree overflow", ok, NULL);
+        kdtree_free(&tree);
+}
+
+/* ---- quant.c encoders and decoders ---- */
+
+/*
+ * Unit quaternions and directions, a few of them on
+ * the ties between the largest components, and the same
+ * vectors for the half conversions. An odd count runs
+ * the scalar tail of every kernel.
+ */
+#define QUANT_COUNT     10007
+
+typedef struct {
+        quat            q[QUANT_COUNT];
+        vec3f           v[QUANT_COUNT];
+        vec3f           h3in[QUANT_COUNT];
+        vec4f           h[QUANT_COUNT];
+        uint32_t        q32[QUANT_COUNT];
+        quat48          q48[QUANT_COUNT];
+        uint16_t        o16[QUANT_COUNT];
+        uint32_t        o32[QUANT_COUNT];
+        vec3h           h3[QUANT_COUNT];
+        vec4h           h4[QUANT_COUNT];
+        quat            dq32[QUANT_COUNT];
+        quat            dq48[QUANT_COUNT];
+        vec3f           dv16[QUANT_COUNT];
+        vec3f           dv32[QUANT_COUNT];
+        vec3f           dh3[QUANT_COUNT];
+        vec4f           dh4[QUANT_COUNT];
+} quant_state;
+
+static void quant_input(quant_state* s)
+{
+        int k;
+        size_t i;
+        float n;
+
+        for(i = 0; i < QUANT_COUNT; i++) {
+                for(k = 0; k < 4; k++) {
+                        s->q[i].m[k] = i % 8 == 0 ? (float)(rng() % 3) - 1.0f : uniform();
+                        s->h[i].m[k] = uniform() * (float)(1u << (rng() % 20));
+                }
+                for(k = 0; k < 3; k++) {
+                        s->h3in[i].m[k] = s->h[i].m[k] * 0x1p-20f;
+                }
+                n = 1.0f / sqrtf(s->q[i].m[0] * s->q[i].m[0] + s->q[i].m[1] * s->q[i].m[1] +
+                                s->q[i].m[2] * s->q[i].m[2] + s->q[i].m[3] * s->q[i].m[3]);
+                for(k = 0; k < 4; k++) {
+                        s->q[i].m[k] = isfinite(n) ? s->q[i].m[k] * n : (k == 3 ? 1.0f : 0.0f);
+                }
+                n = 1.0f / sqrtf(s->q[i].m[0] * s->q[i].m[0] + s->q[i].m[1] * s->q[i].m[1] +
+                                s->q[i].m[2] * s->q[i].m[2]);
+                for(k = 0; k < 3; k++) {
+                        s->v[i].m[k] = isfinite(n) ? s->q[i].m[k] * n : (k == 2 ? 1.0f : 0.0f);
+                }
+        }
+}
+
+static void quant_check(int level, quant_state* s, quant_state* base)
+{
+        quat_encode32_array(s->q, s->q32, QUANT_COUNT);
+        quat_encode48_array(s->q, s->q48, QUANT_COUNT);
+        vec3f_encode_oct16_array(s->v, s->o16, QUANT_COUNT);
+        vec3f_encode_oct32_array(s->v, s->o32, QUANT_COUNT);
+        vec3f_to_half_array(s->h3in, s->h3, QUANT_COUNT);
+        vec4f_to_half_array(s->h, s->h4, QUANT_COUNT);
+        same_as_scalar(level, "quat_encode32 bits", s->q32, base->q32, sizeof(s->q32));
+        same_as_scalar(level, "quat_encode48 bits", s->q48, base->q48, sizeof(s->q48));
+        same_as_scalar(level, "encode_oct16 bits", s->o16, base->o16, sizeof(s->o16));
+        same_as_scalar(level, "encode_oct32 bits", s->o32, base->o32, sizeof(s->o32));
+        same_as_scalar(level, "vec3f_to_half bits", s->h3, base->h3, sizeof(s->h3));
+        same_as_scalar(level, "vec4f_to_half bits", s->h4, base->h4, sizeof(s->h4));
+
+        /* decode the scalar encoding, so only the decoders differ */
+        quat_decode32_array(base->q32, s->dq32, QUANT_COUNT);
+        quat_decode48_array(base->q48, s->dq48, QUANT_COUNT);
+        vec3f_decode_oct16_array(base->o16, s->dv16, QUANT_COUNT);
+        vec3f_decode_oct32_array(base->o32, s->dv32, QUANT_COUNT);
+        vec3f_from_half_array(base->h3, s->dh3, QUANT_COUNT);
+        vec4f_from_half_array(base->h4, s->dh4, QUANT_COUNT);
+        same_as_scalar(level, "quat_decode32 bits", s->dq32, base->dq32, sizeof(s->dq32));
+        same_as_scalar(level, "quat_decode48 bits", s->dq48, base->dq48, sizeof(s->dq48));
+        same_as_scalar(level, "decode_oct16 bits", s->dv16, base->dv16, sizeof(s->dv16));
+        same_as_scalar(level, "decode_oct32 bits", s->dv32, base->dv32, sizeof(s->dv32));
+        same_as_scalar(level, "vec3f_from_half bits", s->dh3, base->dh3, sizeof(s->dh3));
+        same_as_scalar(level, "vec4f_from_half bits", s->dh4, base->dh4, sizeof(s->dh4));
+}
+
+/* ---- affine2f.c batch kernels ---- */
+
+/*
+ * Sprites written into 20 byte vertices, so each corner
+ * is unaligned and the bytes between corners must be
+ * left alone.
+ */
+#define SPRITE_COUNT    10007
+#define SPRITE_STRIDE   20
+
+typedef struct {
+        affine2f        sprites[SPRITE_COUNT];
+        vec2f           points[SPRITE_COUNT];
+        vec2f           moved[SPRITE_COUNT];
+        unsigned char   quads[4 * SPRITE_COUNT * SPRITE_STRIDE];
+        unsigned char   unit[4 * SPRITE_COUNT * SPRITE_STRIDE];
+} sprite_state;
+
+static void sprite_input(sprite_state* s)
+{
+        int r;
+        int c;
+        size_t i;
+
+        for(i = 0; i < SPRITE_COUNT; i++) {
+                for(r = 0; r < 2; r++) {
+                        for(c = 0; c < 3; c++) {
+                                s->sprites[i].m[r][c] = uniform() * (c == 2 ? 1000.0f : 4.0f);
+                        }
+                        s->points[i].m[r] = 100.0f * uniform();
+                }
+        }
+}
+
+/* whether the 12 bytes after each corner still hold the fill */
+static int sprite_untouched(unsigned char* v)
+{
+        size_t i;
+        size_t k;
+
+        for(i = 0; i < 4 * SPRITE_COUNT; i++) {
+                for(k = 2 * sizeof(float); k < SPRITE_STRIDE; k++) {
+                        if(v[i * SPRITE_STRIDE + k] != 0xA5) {
+                                return 0;
+                        }
+                }
+        }
+        return 1;
+}
+
+static void sprite_check(int level, sprite_state* s, sprite_state* base)
+{
+        affine2f view;
+        vec2f corners[4] = { {{ 0.0f, 0.0f }}, {{ 1.0f, 0.0f }}, {{ 1.0f, 1.0f }}, {{ 0.0f, 1.0f }} };
+
+        view.m[0][0] = 0.75f;
+        view.m[0][1] = -0.3f;
+        view.m[0][2] = 12.5f;
+        view.m[1][0] = 0.3f;
+        view.m[1][1] = 0.75f;
+        view.m[1][2] = -7.25f;
+        memset(s->quads, 0xA5, sizeof(s->quads));
+        memset(s->unit, 0xA5, sizeof(s->unit));
+        sprite_expand_array(&view, s->sprites, corners, s->quads, SPRITE_STRIDE, SPRITE_COUNT);
+        sprite_expand_array(NULL, s->sprites, NULL, s->unit, SPRITE_STRIDE, SPRITE_COUNT);
+        affine2f_transform_array(&view, s->points, s->moved, SPRITE_COUNT);
+        report(level, "sprite_expand stride", sprite_untouched(s->quads) && sprite_untouched(s->unit), NULL);
+        same_as_scalar(level, "sprite_expand bits", s->quads, base->quads, sizeof(s->quads));
+        same_as_scalar(level, "sprite_expand unit bits", s->unit, base->unit, sizeof(s->unit));
+        same_as_scalar(level, "affine2f_transform bits", s->moved, base->moved, sizeof(s->moved));
+}
+
+/* ---- anim_sample_vec3f and anim_sample_quat ---- */
+
+/*
+ * Channels of different lengths, so cursors relative to
+ * the wrong offset would read another channel's keys,
+ * sampled along a path that plays forward in small
+ * steps, lands on keys, jumps back and clamps at both
+ * ends.
+ */
+#define ANIM_CHANNELS   4
+#define ANIM_STEPS      160
+
+static int anim_keys[ANIM_CHANNELS] = { 1, 2, 7, 5 };
+
+static float anim_path[] = {
+        1.3f, 0.2f, -3.0f, 2.7f, 100.0f, 4.4f, 0.25f, 5.0f, 0.0f, 3.55f, 3.5f, 1.0e-3f
+};
+
+typedef struct {
+        anim_clip       vec;
+        anim_clip       rot;
+        anim_clip       fresh;
+        float           t[ANIM_STEPS + sizeof(anim_path) / sizeof(anim_path[0])];
+        int             steps;
+} anim_state;
+
+static int anim_input(anim_state* s)
+{
+        int c;
+        int i;
+        int k;
+        double n;
+        float* v;
+        float* q;
+        float* f;
+
+        if(anim_clip_init(&s->vec, CGMATH_ANIM_VEC3F, ANIM_CHANNELS, anim_keys) != 0 ||
+                        anim_clip_init(&s->rot, CGMATH_ANIM_QUAT, ANIM_CHANNELS, anim_keys) != 0 ||
+                        anim_clip_init(&s->fresh, CGMATH_ANIM_QUAT, ANIM_CHANNELS, anim_keys) != 0) {
+                return -1;
+        }
+        for(c = 0; c < ANIM_CHANNELS; c++) {
+                for(k = 0; k < anim_keys[c]; k++) {
+                        anim_clip_times(&s->vec, c)[k] = 0.25f * c + (0.5f + 0.125f * c) * k + 0.0625f * (k & 1);
+                        anim_clip_times(&s->rot, c)[k] = anim_clip_times(&s->vec, c)[k];
+                        anim_clip_times(&s->fresh, c)[k] = anim_clip_times(&s->vec, c)[k];
+                }
+                v = anim_clip_values(&s->vec, c);
+                q = anim_clip_values(&s->rot, c);
+                f = anim_clip_values(&s->fresh, c);
+                for(k = 0; k < 3 * anim_keys[c]; k++) {
+                        v[k] = 10.0f * uniform();
+                }
+                for(k = 0; k < 4 * anim_keys[c]; k++) {
+                        q[k] = uniform();
+                }
+                for(k = 0; k < anim_keys[c]; k++) {
+                        n = sqrt((double)q[4 * k] * q[4 * k] + (double)q[4 * k + 1] * q[4 * k + 1] +
+                                (double)q[4 * k + 2] * q[4 * k + 2] + (double)q[4 * k + 3] * q[4 * k + 3]);
+                        for(i = 0; i < 4; i++) {
+                                q[4 * k + i] = (float)(q[4 * k + i] / n);
+                        }
+                }
+                memcpy(f, q, 4 * anim_keys[c] * sizeof(float));
+        }
+
+        for(s->steps = 0; s->steps < ANIM_STEPS; s->steps++) {
+                s->t[s->steps] = -1.0f + 0.0625f * s->steps;
+        }
+        memcpy(s->t + s->steps, anim_path, sizeof(anim_path));
+        s->steps += sizeof(anim_path) / sizeof(anim_path[0]);
+        return 0;
+}
+
+/* a linear scan and a double lerp, clamped at the ends */
+static void anim_ref(anim_clip* clip, int c, float t, double* out)
+{
+        int k;
+        int n;
+        int i;
+        double a;
+        float* ts;
+        float* v;
+
+        n = anim_keys[c];
+        ts = anim_clip_times(clip, c);
+        v = anim_clip_values(clip, c);
+        if(n == 1 || t <= ts[0] || t >= ts[n - 1]) {
+                k = n == 1 || t <= ts[0] ? 0 : n - 1;
+                for(i = 0; i < 3; i++) {
+                        out[i] = v[3 * k + i];
+                }
+                return;
+        }
+        for(k = 0; !(ts[k + 1] > t); k++) {
+        }
+        a = ((double)t - ts[k]) / ((double)ts[k + 1] - ts[k]);
+        for(i = 0; i < 3; i++) {
+                out[i] = v[3 * k + i] + (v[3 * k + 3 + i] - (double)v[3 * k + i]) * a;
+        }
+}
+
+static void anim_check(int level, anim_state* s)
+{
+        int c;
+        int i;
+        int k;
+        int n;
+        int lerp;
+        int path;
+        int ends;
+        float x[ANIM_CHANNELS];
+        float y[ANIM_CHANNELS];
+        float z[ANIM_CHANNELS];
+        float q[4][ANIM_CHANNELS];
+        float f[4][ANIM_CHANNELS];
+        double ref[3];
+        double d;
+        vec3f_soa out;
+        quat_soa rot;
+        quat_soa fresh;
+        float* key;
+
+        out.m[VEC_X] = x;
+        out.m[VEC_Y] = y;
+        out.m[VEC_Z] = z;
+        for(k = 0; k < 4; k++) {
+                rot.m[k] = q[k];
+                fresh.m[k] = f[k];
+        }
+
+        lerp = 1;
+        path = 1;
+        ends = 1;
+        anim_clip_rewind(&s->vec);
+        anim_clip_rewind(&s->rot);
+        for(i = 0; i < s->steps; i++) {
+                anim_sample_vec3f(&s->vec, s->t[i], &out);
+                for(c = 0; c < ANIM_CHANNELS; c++) {
+                        anim_ref(&s->vec, c, s->t[i], ref);
+                        for(k = 0; k < 3; k++) {
+                                d = out.m[k][c] - ref[k];
+                                lerp &= (d < 0.0 ? -d : d) <= 1e-5 * (1.0 + (ref[k] < 0.0 ? -ref[k] : ref[k]));
+                        }
+                }
+
+                /* the cursors left by the path must not change the result */
+                anim_sample_quat(&s->rot, s->t[i], &rot);
+                anim_clip_rewind(&s->fresh);
+                anim_sample_quat(&s->fresh, s->t[i], &fresh);
+                path &= memcmp(q, f, sizeof(q)) == 0;
+
+                for(c = 0; c < ANIM_CHANNELS; c++) {
+                        n = anim_keys[c];
+                        key = anim_clip_times(&s->rot, c);
+                        if(s->t[i] > key[0] && s->t[i] < key[n - 1]) {
+                                continue;
+                        }
+                        key = anim_clip_values(&s->rot, c) + (s->t[i] <= key[0] ? 0 : 4 * (n - 1));
+                        d = q[0][c] * key[0] + q[1][c] * key[1] + q[2][c] * key[2] + q[3][c] * key[3];
+                        ends &= (d < 0.0 ? -d : d) >= 1.0 - 1e-5;
+                }
+        }
+        report(level, "anim_sample_vec3f", lerp, NULL);
+        report(level, "anim_sample_quat path", path, NULL);
+        report(level, "anim_sample_quat clamp", ends, NULL);
+}
+
+/* ---- mesh_normals and mesh_tangents ---- */
+
+/*
+ * A latitude and longitude sphere, large enough for
+ * several tasks. The closed one wraps around and has a
+ * single vertex at each pole; the seamed one repeats
+ * the first column and the poles, with u running east
+ * and v north, so that dP/du is the east direction.
+ */
+#define MESH_STACKS     96
+#define MESH_SLICES     128
+#define MESH_CLOSED     (2 + (MESH_STACKS - 1) * MESH_SLICES)
+#define MESH_SEAMED     ((MESH_STACKS + 1) * (MESH_SLICES + 1))
+#define MESH_TRIS       (2 * MESH_STACKS * MESH_SLICES)
+
+typedef struct {
+        vec3f           sphere[MESH_CLOSED];
+        vec3f           pos[MESH_SEAMED];
+        vec3f           radial[MESH_SEAMED];
+        vec2f           uv[MESH_SEAMED];
+        vec3f           normals[MESH_SEAMED];
+        vec3f           one[MESH_SEAMED];
+        vec4f           tangents[MESH_SEAMED];
+        vec4f           tangents_one[MESH_SEAMED];
+        unsigned int    closed[3 * MESH_TRIS];
+        unsigned int    seamed[3 * MESH_TRIS];
+        size_t          closed_tris;
+} mesh_state;
+
+static unsigned int mesh_vertex(int closed, int i, int j)
+{
+        if(!closed) {
+                return (unsigned int)(i * (MESH_SLICES + 1) + j);
+        }
+        if(i == 0) {
+                return 0;
+        }
+        if(i == MESH_STACKS) {
+                return MESH_CLOSED - 1;
+        }
+        return (unsigned int)(1 + (i - 1) * MESH_SLICES + j % MESH_SLICES);
+}
+
+static void mesh_input(mesh_state* s)
+{
+        int i;
+        int j;
+        int c;
+        size_t t;
+        unsigned int q[4];
+        double th;
+        double ph;
+
+        for(i = 0; i <= MESH_STACKS; i++) {
+                for(j = 0; j <= MESH_SLICES; j++) {
+                        th = M_PI * i / MESH_STACKS;
+                        ph = 2.0 * M_PI * j / MESH_SLICES;
+                        c = mesh_vertex(0, i, j);
+                        s->radial[c].m[VEC_X] = (float)(sin(th) * cos(ph));
+                        s->radial[c].m[VEC_Y] = (float)(sin(th) * sin(ph));
+                        s->radial[c].m[VEC_Z] = (float)cos(th);
+                        s->pos[c] = s->radial[c];
+                        s->sphere[mesh_vertex(1, i, j)] = s->radial[c];
+                        s->uv[c].m[VEC_X] = (float)j / MESH_SLICES;
+                        s->uv[c].m[VEC_Y] = 1.0f - (float)i / MESH_STACKS;
+                }
+        }
+
+        t = 0;
+        for(i = 0; i < MESH_STACKS; i++) {
+                for(j = 0; j < MESH_SLICES; j++) {
+                        s->seamed[6 * (i * MESH_SLICES + j)] = mesh_vertex(0, i, j);
+                        s->seamed[6 * (i * MESH_SLICES + j) + 1] = mesh_vertex(0, i + 1, j);
+                        s->seamed[6 * (i * MESH_SLICES + j) + 2] = mesh_vertex(0, i + 1, j + 1);
+                        s->seamed[6 * (i * MESH_SLICES + j) + 3] = mesh_vertex(0, i, j);
+                        s->seamed[6 * (i * MESH_SLICES + j) + 4] = mesh_vertex(0, i + 1, j + 1);
+                        s->seamed[6 * (i * MESH_SLICES + j) + 5] = mesh_vertex(0, i, j + 1);
+
+                        q[0] = mesh_vertex(1, i, j);
+                        q[1] = mesh_vertex(1, i + 1, j);
+                        q[2] = mesh_vertex(1, i + 1, j + 1);
+                        q[3] = mesh_vertex(1, i, j + 1);
+                        if(q[1] != q[2]) {
+                                s->closed[3 * t] = q[0];
+                                s->closed[3 * t + 1] = q[1];
+                                s->closed[3 * t + 2] = q[2];
+                                t++;
+                        }
+                        if(q[0] != q[3]) {
+                                s->closed[3 * t] = q[0];
+                                s->closed[3 * t + 1] = q[2];
+                                s->closed[3 * t + 2] = q[3];
+                                t++;
+                        }
+                }
+        }
+        s->closed_tris = t;
+}
+
+/* unit, and within a few degrees of the radial direction */
+static int mesh_radial(vec3f* n, vec3f* pos, unsigned int* indices, size_t triangles)
+{
+        size_t t;
+        unsigned int v;
+        double l;
+        double d;
+
+        for(t = 0; t < 3 * triangles; t++) {
+                v = indices[t];
+                l = sqrt((double)n[v].m[0] * n[v].m[0] + (double)n[v].m[1] * n[v].m[1] +
+                        (double)n[v].m[2] * n[v].m[2]);
+                d = (double)n[v].m[0] * pos[v].m[0] + (double)n[v].m[1] * pos[v].m[1] +
+                        (double)n[v].m[2] * pos[v].m[2];
+                if(!(fabs(l - 1.0) <= 1e-5 && d >= 0.999)) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/*
+ * Away from the poles and the seam: unit, in the
+ * tangent plane, along dP/du and with the given sign.
+ */
+static int mesh_east(vec4f* tangents, float sign)
+{
+        int i;
+        int j;
+        unsigned int v;
+        float* t;
+        double ph;
+        double d;
+        double l;
+
+        for(i = 1; i < MESH_STACKS; i++) {
+                for(j = 1; j < MESH_SLICES; j++) {
+                        v = mesh_vertex(0, i, j);
+                        t = tangents[v].m;
+                        ph = 2.0 * M_PI * j / MESH_SLICES;
+                        l = sqrt((double)t[0] * t[0] + (double)t[1] * t[1] + (double)t[2] * t[2]);
+                        d = -sin(ph) * t[0] + cos(ph) * t[1];
+                        if(!(fabs(l - 1.0) <= 1e-5 && d >= 0.999 && t[3] == sign)) {
+                                return 0;
+                        }
+                }
+        }
+        return 1;
+}
+
+static void mesh_check(int level, mesh_state* s)
+{
+        int ok;
+        int i;
+        int c;
+        int threads;
+        mesh closed;
+        mesh seamed;
+        mesh huge;
+        unsigned int bad[3] = { 0, 1, 3 };
+        unsigned int tri[6] = { 0, 1, 2, 0, 3, 4 };
+        vec3f big[5] = { {{ 0.0f, 0.0f, 0.0f }}, {{ 1.0f, 0.0f, 0.0f }}, {{ 0.0f, 1.0f, 0.0f }},
+                {{ 1e20f, 1e20f, 0.0f }}, {{ -1e20f, 1e20f, 0.0f }} };
+        vec3f big_n[5];
+
+        threads = cgmath_threads();
+        if(mesh_init(&closed, s->closed, s->closed_tris, MESH_CLOSED) != 0 ||
+                        mesh_init(&seamed, s->seamed, MESH_TRIS, MESH_SEAMED) != 0 ||
+                        mesh_init(&huge, tri, 2, 5) != 0) {
+                report(level, "mesh_init", 0, "failed");
+                return;
+        }
+
+        ok = 1;
+        for(i = CGMATH_MESH_AREA; i <= CGMATH_MESH_ANGLE; i++) {
+                cgmath_set_threads(1);
+                mesh_normals(&closed, s->sphere, i, s->one);
+                cgmath_set_threads(4);
+                mesh_normals(&closed, s->sphere, i, s->normals);
+                ok &= memcmp(s->one, s->normals, MESH_CLOSED * sizeof(vec3f)) == 0;
+                report(level, i == CGMATH_MESH_AREA ? "mesh_normals area" : "mesh_normals angle",
+                        mesh_radial(s->normals, s->sphere, s->closed, s->closed_tris), NULL);
+        }
+
+        cgmath_set_threads(1);
+        mesh_tangents(&seamed, s->pos, s->radial, s->uv, s->tangents_one);
+        cgmath_set_threads(4);
+        mesh_tangents(&seamed, s->pos, s->radial, s->uv, s->tangents);
+        ok &= memcmp(s->tangents_one, s->tangents, sizeof(s->tangents)) == 0;
+        report(level, "mesh_tangents dP/du", mesh_east(s->tangents, 1.0f), NULL);
+
+        /* v running south mirrors the UVs and flips the bitangent */
+        for(i = 0; i < MESH_SEAMED; i++) {
+                s->uv[i].m[VEC_Y] = 1.0f - s->uv[i].m[VEC_Y];
+        }
+        mesh_tangents(&seamed, s->pos, s->radial, s->uv, s->tangents);
+        for(i = 0; i < MESH_SEAMED; i++) {
+                s->uv[i].m[VEC_Y] = 1.0f - s->uv[i].m[VEC_Y];
+        }
+        report(level, "mesh_tangents mirrored", mesh_east(s->tangents, -1.0f), NULL);
+        report(level, "mesh threads", ok, NULL);
+        cgmath_set_threads(threads);
+
+        /*
+         * The second triangle has edges whose squared
+         * lengths overflow (its area does too, so only
+         * angle weighting applies); every vertex must still
+         * get the normal of the plane both lie in.
+         */
+        ok = 1;
+        mesh_normals(&huge, big, CGMATH_MESH_ANGLE, big_n);
+        for(c = 0; c < 5; c++) {
+                ok &= fabsf(big_n[c].m[VEC_X]) <= 1e-6f && fabsf(big_n[c].m[VEC_Y]) <= 1e-6f &&
+                        fabsf(big_n[c].m[VEC_Z] - 1.0f) <= 1e-6f;
+        }
+        report(level, "mesh_normals overflow", ok, NULL);
+        mesh_free(&huge);
+        mesh_free(&closed);
+        mesh_free(&seamed);
+
+        report(level, "mesh_init range", mesh_init(&huge, bad, 1, 3) == -1, NULL);
+}
+
+/* ---- grid_query_radius_array and grid_query_pairs ---- */
+
+/*
+ * Enough points for several radix sort blocks and
+ * enough centers for several query tasks. Some points
+ * sit exactly on cell boundaries and some repeat, and
+ * the radii span one and several cells. The brute
+ * force references are built once; the grid must match
+ * them as sets and give the same bits at 1 and 4
+ * threads.
+ */
+#define GRID_POINTS     20000
+#define GRID_CENTERS    3000
+#define GRID_EXTENT     13.5f
+#define GRID_CELL       0.75f
+#define GRID_RADIUS     1.7f
+#define GRID_PAIR       1.1f
+
+typedef struct {
+        vec3f           points[GRID_POINTS];
+        vec3f           centers[GRID_CENTERS];
+        unsigned int    ref_offsets[GRID_CENTERS + 1];
+        unsigned int    offsets[2][GRID_CENTERS + 1];
+        unsigned int*   ref_ids;
+        unsigned int*   ref_pairs;
+        unsigned int*   ids[2];
+        unsigned int*   pairs[2];
+        size_t          hits;
+        size_t          npairs;
+} grid_state;
+
+static int grid_within(vec3f* p, vec3f* c, float radius)
+{
+        float dx;
+        float dy;
+        float dz;
+
+        dx = p->m[VEC_X] - c->m[VEC_X];
+        dy = p->m[VEC_Y] - c->m[VEC_Y];
+        dz = p->m[VEC_Z] - c->m[VEC_Z];
+        return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+static int grid_input(grid_state* s)
+{
+        int k;
+        size_t i;
+        size_t j;
+        size_t n;
+
+        for(i = 0; i < GRID_POINTS; i++) {
+                for(k = 0; k < 3; k++) {
+                        s->points[i].m[k] = GRID_EXTENT * uniform();
+                        if(i % 8 == 3) {
+                                s->points[i].m[k] = rintf(s->points[i].m[k] / GRID_CELL) * GRID_CELL;
+                        }
+                }
+                if(i % 16 == 5) {
+                        s->points[i] = s->points[rng() % i];
+                }
+        }
+        for(i = 0; i < GRID_CENTERS; i++) {
+                for(k = 0; k < 3; k++) {
+                        s->centers[i].m[k] = (GRID_EXTENT + 1.0f) * uniform();
+                }
+        }
+
+        for(n = 0; n < 2; n++) {
+                s->hits = 0;
+                for(i = 0; i < GRID_CENTERS; i++) {
+                        s->ref_offsets[i] = (unsigned int)s->hits;
+                        for(j = 0; j < GRID_POINTS; j++) {
+                                if(grid_within(&s->points[j], &s->centers[i], GRID_RADIUS)) {
+                                        if(n) {
+                                                s->ref_ids[s->hits] = (unsigned int)j;
+                                        }
+                                        s->hits++;
+                                }
+                        }
+                }
+                s->ref_offsets[GRID_CENTERS] = (unsigned int)s->hits;
+
+                s->npairs = 0;
+                for(i = 0; i < GRID_POINTS; i++) {
+                        for(j = i + 1; j < GRID_POINTS; j++) {
+                                if(grid_within(&s->points[j], &s->points[i], GRID_PAIR)) {
+                                        if(n) {
+                                                s->ref_pairs[2 * s->npairs] = (unsigned int)i;
+                                                s->ref_pairs[2 * s->npairs + 1] = (unsigned int)j;
+                                        }
+                                        s->npairs++;
+                                }
+                        }
+                }
+
+                if(!n) {
+                        s->ref_ids = malloc(s->hits * sizeof(unsigned int));
+                        s->ref_pairs = malloc(2 * s->npairs * sizeof(unsigned int));
+                        s->ids[0] = malloc(s->hits * sizeof(unsigned int));
+                        s->ids[1] = malloc(s->hits * sizeof(unsigned int));
+                        s->pairs[0] = malloc(2 * s->npairs * sizeof(unsigned int));
+                        s->pairs[1] = malloc(2 * s->npairs * sizeof(unsigned int));
+                        if(s->ref_ids == NULL || s->ref_pairs == NULL || s->ids[0] == NULL ||
+                                        s->ids[1] == NULL || s->pairs[0] == NULL || s->pairs[1] == NULL) {
+                                return -1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static int grid_cmp_id(const void* a, const void* b)
+{
+        unsigned int x;
+        unsigned int y;
+
+        x = *(const unsigned int*)a;
+        y = *(const unsigned int*)b;
+        return x < y ? -1 : x > y;
+}
+
+static int grid_cmp_pair(const void* a, const void* b)
+{
+        int c;
+
+        c = grid_cmp_id(a, b);
+        return c != 0 ? c : grid_cmp_id((const unsigned int*)a + 1, (const unsigned int*)b + 1);
+}
+
+static void grid_check(int level, grid_state* s)
+{
+        int t;
+        int ok;
+        int same;
+        int threads;
+        size_t i;
+        size_t n[2];
+        size_t m[2];
+        grid g;
+
+        if(grid_init(&g, GRID_CELL, GRID_POINTS) != 0) {
+                report(level, "grid_init", 0, "failed");
+                return;
+        }
+
+        threads = cgmath_threads();
+        for(t = 0; t < 2; t++) {
+                cgmath_set_threads(t ? 4 : 1);
+                grid_build(&g, s->points, GRID_POINTS);
+                n[t] = grid_query_radius_array(&g, s->centers, GRID_CENTERS, GRID_RADIUS,
+                                s->offsets[t], s->ids[t], s->hits);
+                m[t] = grid_query_pairs(&g, GRID_PAIR, s->pairs[t], 2 * s->npairs);
+        }
+        cgmath_set_threads(threads);
+
+        same = n[0] == n[1] && m[0] == m[1] &&
+                memcmp(s->offsets[0], s->offsets[1], sizeof(s->offsets[0])) == 0 &&
+                memcmp(s->ids[0], s->ids[1], s->hits * sizeof(unsigned int)) == 0 &&
+                memcmp(s->pairs[0], s->pairs[1], 2 * s->npairs * sizeof(unsigned int)) == 0;
+
+        ok = n[1] == s->hits && memcmp(s->offsets[1], s->ref_offsets, sizeof(s->ref_offsets)) == 0;
+        for(i = 0; ok && i < GRID_CENTERS; i++) {
+                qsort(s->ids[1] + s->ref_offsets[i], s->ref_offsets[i + 1] - s->ref_offsets[i],
+                        sizeof(unsigned int), grid_cmp_id);
+        }
+        ok = ok && memcmp(s->ids[1], s->ref_ids, s->hits * sizeof(unsigned int)) == 0;
+        report(level, "grid_query_radius_array", ok, NULL);
+
+        /* the single query agrees with the batch */
+        ok = grid_query_radius(&g, &s->centers[7], GRID_RADIUS, s->ids[1], s->hits) ==
+                s->ref_offsets[8] - s->ref_offsets[7];
+        report(level, "grid_query_radius", ok, NULL);
+
+        ok = m[1] == s->npairs;
+        for(i = 0; ok && i < s->npairs; i++) {
+                ok = s->pairs[1][2 * i] < s->pairs[1][2 * i + 1];
+        }
+        if(ok) {
+                qsort(s->pairs[1], s->npairs, 2 * sizeof(unsigned int), grid_cmp_pair);
+        }
+        ok = ok && memcmp(s->pairs[1], s->ref_pairs, 2 * s->npairs * sizeof(unsigned int)) == 0;
+        report(level, "grid_query_pairs", ok, NULL);
+        report(level, "grid threads", same, NULL);
+        grid_free(&g);
+}
+
+/* ---- vec3f_weld ---- */
+
+/*
+ * Copies of a few thousand base points, most of them
+ * exact (some with -0 where the base has +0) and one
+ * in four jittered by up to 0.8 times the tolerance
+ * per axis, so that tolerance balls overlap in chains.
+ * The reference is the sequential loop: each vertex
+ * maps to the first kept vertex within tolerance, or
+ * is kept.
+ */
+#define WELD_COUNT      24000
+#define WELD_BASE       4000
+#define WELD_TOL        0.01f
+
+typedef struct {
+        vec3f           src[WELD_COUNT];
+        vec3f           dest[WELD_COUNT];
+        vec3f           ref_dest[2][WELD_COUNT];
+        unsigned int    remap[WELD_COUNT];
+        unsigned int    ref_remap[2][WELD_COUNT];
+        size_t          ref_kept[2];
+} weld_state;
+
+static void weld_input(weld_state* s)
+{
+        int k;
+        int t;
+        size_t i;
+        size_t j;
+        size_t n;
+        float x;
+        float y;
+        float z;
+        float tol;
+        vec3f* base;
+
+        base = s->dest;
+        for(i = 0; i < WELD_BASE; i++) {
+                for(k = 0; k < 3; k++) {
+                        base[i].m[k] = 4.0f * uniform();
+                }
+                if(i % 7 == 0) {
+                        base[i].m[VEC_Y] = 0.0f;
+                }
+        }
+        for(i = 0; i < WELD_COUNT; i++) {
+                s->src[i] = base[rng() % WELD_BASE];
+                if(i % 4 == 1) {
+                        for(k = 0; k < 3; k++) {
+                                s->src[i].m[k] += 0.8f * WELD_TOL * uniform();
+                        }
+                } else if(i % 3 == 0 && s->src[i].m[VEC_Y] == 0.0f) {
+                        s->src[i].m[VEC_Y] = -0.0f;
+                }
+        }
+
+        for(t = 0; t < 2; t++) {
+                tol = t ? WELD_TOL : 0.0f;
+                n = 0;
+                for(i = 0; i < WELD_COUNT; i++) {
+                        for(j = 0; j < n; j++) {
+                                x = s->src[i].m[VEC_X] - s->ref_dest[t][j].m[VEC_X];
+                                y = s->src[i].m[VEC_Y] - s->ref_dest[t][j].m[VEC_Y];
+                                z = s->src[i].m[VEC_Z] - s->ref_dest[t][j].m[VEC_Z];
+                                if(x * x + y * y + z * z <= tol * tol) {
+                                        break;
+                                }
+                        }
+                        if(j == n) {
+                                s->ref_dest[t][n++] = s->src[i];
+                        }
+                        s->ref_remap[t][i] = (unsigned int)j;
+                }
+                s->ref_kept[t] = n;
+        }
+}
+
+static int weld_same(weld_state* s, int t, size_t kept, vec3f* dest)
+{
+        return kept == s->ref_kept[t] &&
+                memcmp(s->remap, s->ref_remap[t], sizeof(s->remap)) == 0 &&
+                memcmp(dest, s->ref_dest[t], kept * sizeof(vec3f)) == 0;
+}
+
+static void weld_check(int level, weld_state* s)
+{
+        int t;
+        int n;
+        int ok[2];
+        int place;
+        int threads;
+        size_t kept;
+
+        threads = cgmath_threads();
+        ok[0] = ok[1] = 1;
+        place = 1;
+        for(n = 1; n <= 4; n += 3) {
+                cgmath_set_threads(n);
+                for(t = 0; t < 2; t++) {
+                        kept = vec3f_weld(s->src, WELD_COUNT, t ? WELD_TOL : 0.0f, s->remap, s->dest);
+                        ok[t] &= weld_same(s, t, kept, s->dest);
+
+                        memcpy(s->dest, s->src, sizeof(s->src));
+                        kept = vec3f_weld(s->dest, WELD_COUNT, t ? WELD_TOL : 0.0f, s->remap, s->dest);
+                        place &= weld_same(s, t, kept, s->dest);
+                }
+        }
+        cgmath_set_threads(threads);
+        report(level, "vec3f_weld exact", ok[0], NULL);
+        report(level, "vec3f_weld tolerance", ok[1], NULL);
+        report(level, "vec3f_weld in place", place, NULL);
+}
+
+/* ---- singular lanes of the batch inverses ---- */
+
+/*
+ * Well conditioned symmetric matrices with a singular
+ * one in some of the lanes, including the scalar tail:
+ * a zero determinant, a determinant that overflows with
+ * finite cofactors, a NaN entry, and cofactors that
+ * overflow. Each must be flagged and come back as a
+ * zero matrix, with every other lane left unflagged.
+ * The one-matrix mat4f_inverse must also give the
+ * scalar bits on these and on general matrices.
+ */
+#define INVERSE_COUNT   37
+
+static size_t inverse_bad[] = { 0, 5, 13, 22, 36 };
+
+typedef struct {
+        mat3f           m3[INVERSE_COUNT];
+        mat3f           i3[INVERSE_COUNT];
+        mat3f           s3[INVERSE_COUNT];
+        unsigned char   f3[INVERSE_COUNT];
+        unsigned char   g3[INVERSE_COUNT];
+        mat4f           m4[INVERSE_COUNT];
+        mat4f           i4[INVERSE_COUNT];
+        mat4f           g4[INVERSE_COUNT];
+        mat4f           j4[2 * INVERSE_COUNT];
+        unsigned char   f4[INVERSE_COUNT];
+} inverse_state;
+
+static void inverse_input(inverse_state* s)
+{
+        int r;
+        int c;
+        size_t i;
+
+        for(i = 0; i < INVERSE_COUNT; i++) {
+                for(r = 0; r < 3; r++) {
+                        for(c = r; c < 3; c++) {
+                                s->m3[i].m[r][c] = uniform() + (r == c ? 3.0f : 0.0f);
+                                s->m3[i].m[c][r] = s->m3[i].m[r][c];
+                        }
+                }
+                for(r = 0; r < 4; r++) {
+                        for(c = r; c < 4; c++) {
+                                s->m4[i].m[r][c] = uniform() + (r == c ? 4.0f : 0.0f);
+                                s->m4[i].m[c][r] = s->m4[i].m[r][c];
+                        }
+                }
+                for(r = 0; r < 16; r++) {
+                        s->g4[i].m[r >> 2][r & 3] = uniform();
+                }
+        }
+        memset(&s->m3[inverse_bad[0]], 0, sizeof(mat3f));
+        memset(&s->m3[inverse_bad[1]], 0, sizeof(mat3f));
+        memset(&s->m3[inverse_bad[3]], 0, sizeof(mat3f));
+        memset(&s->m3[inverse_bad[4]], 0, sizeof(mat3f));
+        memset(&s->m4[inverse_bad[0]], 0, sizeof(mat4f));
+        memset(&s->m4[inverse_bad[1]], 0, sizeof(mat4f));
+        memset(&s->m4[inverse_bad[3]], 0, sizeof(mat4f));
+        memset(&s->m4[inverse_bad[4]], 0, sizeof(mat4f));
+        for(r = 0; r < 3; r++) {
+                s->m3[inverse_bad[1]].m[r][r] = 1e13f;
+                s->m3[inverse_bad[4]].m[r][r] = -1e13f;
+                s->m3[inverse_bad[3]].m[r][r] = r < 2 ? 1e20f : 0.0f;
+        }
+        for(r = 0; r < 4; r++) {
+                s->m4[inverse_bad[1]].m[r][r] = 1e10f;
+                s->m4[inverse_bad[4]].m[r][r] = r == 0 ? -1e10f : 1e10f;
+                s->m4[inverse_bad[3]].m[r][r] = r < 3 ? 1e15f : 0.0f;
+        }
+        s->m3[inverse_bad[2]].m[1][1] = NAN;
+        s->m4[inverse_bad[2]].m[2][1] = NAN;
+}
+
+/* whether exactly the inverse_bad lanes are flagged and zero */
+static int inverse_flags(unsigned char* flags, void* out, size_t size, size_t count, size_t bad)
+{
+        size_t i;
+        size_t k;
+        size_t next;
+        unsigned char* bytes;
+
+        if(count != sizeof(inverse_bad) / sizeof(inverse_bad[0])) {
+                return 0;
+        }
+        bytes = out;
+        next = 0;
+        for(i = 0; i < INVERSE_COUNT; i++) {
+                if(flags[i] != (next < count && inverse_bad[next] == i)) {
+                        return 0;
+                }
+                if(flags[i]) {
+                        for(k = 0; k < size; k++) {
+                                if(bytes[i * size + k] != 0) {
+                                        return 0;
+                                }
+                        }
+                        next++;
+                }
+        }
+        return bad == count;
+}
+
+static void inverse_check(int level, inverse_state* s, inverse_state* base)
+{
+        size_t n;
+        size_t count;
+
+        count = sizeof(inverse_bad) / sizeof(inverse_bad[0]);
+        n = mat3f_inverse_array(s->m3, s->i3, s->f3, INVERSE_COUNT);
+        report(level, "mat3f_inverse singular", inverse_flags(s->f3, s->i3, sizeof(mat3f), count, n), NULL);
+        n = mat3f_inverse_sym_array(s->m3, s->s3, s->g3, INVERSE_COUNT);
+        report(level, "mat3f_inverse_sym singular", inverse_flags(s->g3, s->s3, sizeof(mat3f), count, n), NULL);
+        same_as_scalar(level, "mat3f_inverse bits", s->i3, base->i3, sizeof(s->i3));
+        same_as_scalar(level, "mat3f_inverse_sym bits", s->s3, base->s3, sizeof(s->s3));
+        n = mat4f_inverse_array(s->m4, s->i4, s->f4, INVERSE_COUNT);
+        report(level, "mat4f_inverse singular", inverse_flags(s->f4, s->i4, sizeof(mat4f), count, n), NULL);
+        same_as_scalar(level, "mat4f_inverse bits", s->i4, base->i4, sizeof(s->i4));
+
+        /* one at a time, where a zero determinant leaves the identity in place */
+        for(n = 0; n < 2 * INVERSE_COUNT; n++) {
+                mat4f_identity(&s->j4[n]);
+                mat4f_inverse(n < INVERSE_COUNT ? &s->m4[n] : &s->g4[n - INVERSE_COUNT], &s->j4[n]);
+        }
+        /* only the payload of the NaN lane may differ */
+        for(n = 0; n < 2 * INVERSE_COUNT * 16; n++) {
+                if(isnan(s->j4[n >> 4].m[(n >> 2) & 3][n & 3])) {
+                        s->j4[n >> 4].m[(n >> 2) & 3][n & 3] = NAN;
+                }
+        }
+        same_as_scalar(level, "mat4f_inverse one bits", s->j4, base->j4, sizeof(s->j4));
+}
+
+/* ---- mat4f_transform_normal_array and xform_file ---- */
+
+#define NORMAL_COUNT    4099
+
+/*
+ * Vertex records of a position, four bytes of padding
+ * and a normal, after a header and before a partial
+ * record, in chunks small enough that several buffers
+ * are in flight.
+ */
+#define XFORM_RECORDS   5000
+#define XFORM_STRIDE    28
+#define XFORM_HEADER    16
+#define XFORM_TAIL      5
+#define XFORM_BYTES     (XFORM_HEADER + XFORM_RECORDS * XFORM_STRIDE + XFORM_TAIL)
+
+typedef struct {
+        vec3f           src[NORMAL_COUNT];
+        vec3f           dest[NORMAL_COUNT];
+        vec3f           pos[XFORM_RECORDS];
+        vec3f           nrm[XFORM_RECORDS];
+        unsigned char   file[XFORM_BYTES];
+        unsigned char   out[XFORM_BYTES];
+        char            in_path[64];
+        char            out_path[64];
+} normal_state;
+
+static void normal_input(normal_state* s)
+{
+        int k;
+        size_t i;
+        FILE* f;
+
+        for(i = 0; i < NORMAL_COUNT; i++) {
+                for(k = 0; k < 3; k++) {
+                        s->src[i].m[k] = uniform();
+                }
+        }
+        for(i = 0; i < XFORM_BYTES; i++) {
+                s->file[i] = (unsigned char)rng();
+        }
+        for(i = 0; i < XFORM_RECORDS; i++) {
+                for(k = 0; k < 3; k++) {
+                        s->pos[i].m[k] = 10.0f * uniform();
+                        s->nrm[i].m[k] = uniform();
+                }
+                memcpy(s->file + XFORM_HEADER + i * XFORM_STRIDE, s->pos[i].m, sizeof(vec3f));
+                memcpy(s->file + XFORM_HEADER + i * XFORM_STRIDE + 16, s->nrm[i].m, sizeof(vec3f));
+        }
+        snprintf(s->in_path, sizeof(s->in_path), "/tmp/cgmath-check-%d.in", (int)getpid());
+        snprintf(s->out_path, sizeof(s->out_path), "/tmp/cgmath-check-%d.out", (int)getpid());
+        f = fopen(s->in_path, "wb");
+        if(f != NULL) {
+                fwrite(s->file, 1, XFORM_BYTES, f);
+                fclose(f);
+        }
+}
+
+/* reads path into buf and returns its size, or -1 if it does not exist */
+static long read_file(const char* path, unsigned char* buf, size_t max)
+{
+        long n;
+        FILE* f;
+
+        f = fopen(path, "rb");
+        if(f == NULL) {
+                return -1;
+        }
+        n = (long)fread(buf, 1, max, f);
+        fclose(f);
+        return n;
+}
+
+/* mat times (x, y, z, 0) in double, normalized */
+static void normal_ref(mat4f* mat, float* v, double* r)
+{
+        int k;
+        double l;
+
+        l = 0.0;
+        for(k = 0; k < 3; k++) {
+                r[k] = (double)mat->m[k][0] * v[0] + (double)mat->m[k][1] * v[1] + (double)mat->m[k][2] * v[2];
+                l += r[k] * r[k];
+        }
+        for(k = 0; k < 3; k++) {
+                r[k] = l > 0.0 ? r[k] / sqrt(l) : 0.0;
+        }
+}
+
+static void normal_check(int level, normal_state* s)
+{
+        int k;
+        int ok;
+        int t;
+        int ret;
+        size_t i;
+        double r[3];
+        mat4f mat;
+        mat4f nrm;
+        xform_layout layout;
+        static const float scale[4] = { 1.0f, 1e30f, 1e-30f, 1e-35f };
+
+        /* a rotation with a non-uniform scale and a translation */
+        memset(&mat, 0, sizeof(mat));
+        mat.m[0][0] = 0.0f;
+        mat.m[0][1] = -3.0f;
+        mat.m[1][0] = 0.5f;
+        mat.m[2][2] = 2.0f;
+        mat.m[0][3] = 4.0f;
+        mat.m[1][3] = -1.0f;
+        mat.m[3][3] = 1.0f;
+        mat.m[0][2] = 0.25f;
+
+        /* full precision at lengths whose square overflows or underflows */
+        ok = 1;
+        for(t = 0; t < 4; t++) {
+                for(i = 0; i < NORMAL_COUNT; i++) {
+                        for(k = 0; k < 3; k++) {
+                                s->dest[i].m[k] = s->src[i].m[k] * scale[t];
+                        }
+                }
+                ok &= mat4f_transform_normal_array(&mat, s->dest, s->dest, NORMAL_COUNT) == 0;
+                for(i = 0; i < NORMAL_COUNT; i++) {
+                        normal_ref(&mat, s->src[i].m, r);
+                        for(k = 0; k < 3; k++) {
+                                ok &= fabs(s->dest[i].m[k] - r[k]) <= 1e-6;
+                        }
+                }
+        }
+        report(level, "normal length", ok, NULL);
+
+        /* zero and non-finite vectors become zero */
+        s->dest[0].m[VEC_X] = s->dest[0].m[VEC_Y] = s->dest[0].m[VEC_Z] = 0.0f;
+        s->dest[1].m[VEC_X] = INFINITY;
+        s->dest[2].m[VEC_Y] = NAN;
+        s->dest[3].m[VEC_Z] = 3e38f;
+        mat4f_transform_normal_array(&mat, s->dest, s->dest, 4);
+        ok = 1;
+        for(i = 0; i < 3; i++) {
+                for(k = 0; k < 3; k++) {
+                        ok &= s->dest[i].m[k] == 0.0f;
+                }
+        }
+        report(level, "normal zero", ok, NULL);
+
+        /* a singular upper 3x3 is reported, and the normals are still written */
+        nrm = mat;
+        nrm.m[2][0] = nrm.m[2][1] = nrm.m[2][2] = 0.0f;
+        ret = mat4f_transform_normal_array(&nrm, s->src, s->dest, NORMAL_COUNT);
+        ok = ret == -1;
+        for(i = 0; i < NORMAL_COUNT; i++) {
+                ok &= s->dest[i].m[VEC_Z] == 0.0f;
+        }
+        report(level, "normal singular", ok, NULL);
+
+        /*
+         * xform_file against the batch kernels, at one and at
+         * four threads. Chunks are a multiple of eight records
+         * so that they split into SIMD groups and scalar tails
+         * the same way as the whole array does.
+         */
+        mat4f_inverse_array(&mat, &nrm, NULL, 1);
+        mat4f_transpose(&nrm, &nrm);
+        mat4f_transform_point_array(&mat, s->pos, s->pos, XFORM_RECORDS);
+        mat4f_transform_normal_array(&nrm, s->nrm, s->nrm, XFORM_RECORDS);
+        xform_layout_init(&layout, XFORM_STRIDE);
+        layout.normal = 16;
+        layout.header = XFORM_HEADER;
+        layout.chunk = 96;
+        layout.buffers = 3;
+        ok = 1;
+        for(t = 1; t <= 4; t += 3) {
+                layout.threads = t;
+                memset(s->out, 0, XFORM_BYTES);
+                ok &= xform_file(s->in_path, s->out_path, &mat, &layout) == 0 &&
+                        read_file(s->out_path, s->out, XFORM_BYTES) == XFORM_BYTES;
+                ok &= memcmp(s->out, s->file, XFORM_HEADER) == 0 &&
+                        memcmp(s->out + XFORM_BYTES - XFORM_TAIL, s->file + XFORM_BYTES - XFORM_TAIL, XFORM_TAIL) == 0;
+                for(i = 0; i < XFORM_RECORDS; i++) {
+                        ok &= memcmp(s->out + XFORM_HEADER + i * XFORM_STRIDE, s->pos[i].m, sizeof(vec3f)) == 0 &&
+                                memcmp(s->out + XFORM_HEADER + i * XFORM_STRIDE + 12,
+                                        s->file + XFORM_HEADER + i * XFORM_STRIDE + 12, 4) == 0 &&
+                                memcmp(s->out + XFORM_HEADER + i * XFORM_STRIDE + 16, s->nrm[i].m, sizeof(vec3f)) == 0;
+                }
+        }
+        report(level, "xform_file", ok, NULL);
+
+        /* onto its own input, and with normals through a singular matrix */
+        errno = 0;
+        ok = xform_file(s->in_path, s->in_path, &mat, &layout) == -1 && errno == EINVAL &&
+                read_file(s->in_path, s->out, XFORM_BYTES) == XFORM_BYTES && memcmp(s->out, s->file, XFORM_BYTES) == 0;
+        unlink(s->out_path);
+        mat.m[2][2] = 0.0f;
+        errno = 0;
+        ok &= xform_file(s->in_path, s->out_path, &mat, &layout) == -1 && errno == EDOM &&
+                read_file(s->out_path, s->out, XFORM_BYTES) == -1;
+        report(level, "xform_file refuses", ok, NULL);
+
+        /* the reference above was transformed in place */
+        for(i = 0; i < XFORM_RECORDS; i++) {
+                memcpy(s->pos[i].m, s->file + XFORM_HEADER + i * XFORM_STRIDE, sizeof(vec3f));
+                memcpy(s->nrm[i].m, s->file + XFORM_HEADER + i * XFORM_STRIDE + 16, sizeof(vec3f));
+        }
+}
+
+/* ---- pack.c writer and reader ---- */
+
+/*
+ * A file with a packed, an empty, a SoA and a section
+ * larger than one checksum block. It must read back
+ * bit for bit and aligned, and copies of it that are
+ * truncated or have one byte flipped must be caught.
+ */
+#define PACK_POINTS     1000
+#define PACK_SOA        513
+#define PACK_BIG        300000
+#define PACK_MAX        (2 * PACK_BIG * sizeof(float))
+
+typedef struct {
+        vec3f           points[PACK_POINTS];
+        float           soa[3][PACK_SOA];
+        float           big[PACK_BIG];
+        unsigned char   file[PACK_MAX];
+        unsigned char   copy[PACK_MAX];
+        char            path[64];
+        char            bad_path[64];
+} pack_state;
+
+static void pack_input(pack_state* s)
+{
+        int k;
+        size_t i;
+
+        for(i = 0; i < PACK_POINTS; i++) {
+                for(k = 0; k < 3; k++) {
+                        s->points[i].m[k] = uniform();
+                }
+        }
+        for(i = 0; i < PACK_SOA; i++) {
+                for(k = 0; k < 3; k++) {
+                        s->soa[k][i] = uniform();
+                }
+        }
+        for(i = 0; i < PACK_BIG; i++) {
+                s->big[i] = uniform();
+        }
+        snprintf(s->path, sizeof(s->path), "/tmp/cgmath-check-%d.pack", (int)getpid());
+        snprintf(s->bad_path, sizeof(s->bad_path), "/tmp/cgmath-check-%d.bad", (int)getpid());
+}
+
+static int write_file(const char* path, unsigned char* buf, size_t size)
+{
+        int ok;
+        FILE* f;
+
+        f = fopen(path, "wb");
+        if(f == NULL) {
+                return 0;
+        }
+        ok = fwrite(buf, 1, size, f) == size;
+        return fclose(f) == 0 && ok;
+}
+
+static int pack_aligned(const void* p)
+{
+        return p != NULL && (size_t)p % CGMATH_PACK_ALIGN == 0;
+}
+
+/* whether pack_open accepts a copy of the file with byte at flipped, or cut to size */
+static int pack_accepts(pack_state* s, size_t size, long at, int flags)
+{
+        int ok;
+        pack_file f;
+
+        memcpy(s->copy, s->file, size);
+        if(at >= 0) {
+                s->copy[at] ^= 0x10;
+        }
+        if(!write_file(s->bad_path, s->copy, size)) {
+                return -1;
+        }
+        ok = pack_open(&f, s->bad_path, flags) == 0;
+        pack_close(&f);
+        return ok;
+}
+
+static void pack_check(int level, pack_state* s)
+{
+        int ok;
+        int type;
+        long size;
+        long at;
+        size_t count;
+        const char* name;
+        const void* view;
+        float* planes[3];
+        vec3f_soa soa;
+        pack_writer w;
+        pack_file f;
+
+        soa.m[VEC_X] = s->soa[0];
+        soa.m[VEC_Y] = s->soa[1];
+        soa.m[VEC_Z] = s->soa[2];
+        ok = pack_writer_init(&w, s->path) == 0 &&
+                pack_write(&w, "points", CGMATH_PACK_VEC3F, s->points, PACK_POINTS) == 0 &&
+                pack_write(&w, "empty", CGMATH_PACK_MAT4F, NULL, 0) == 0 &&
+                pack_write(&w, "points", CGMATH_PACK_FLOAT, s->big, 1) == -1 &&
+                pack_write(&w, "soa", CGMATH_PACK_VEC3F_SOA, &soa, PACK_SOA) == 0 &&
+                pack_write(&w, "big", CGMATH_PACK_FLOAT, s->big, PACK_BIG) == 0 &&
+                pack_writer_finish(&w) == 0;
+        report(level, "pack_write duplicate", ok, NULL);
+        if(!ok || pack_open(&f, s->path, CGMATH_PACK_VERIFY) != 0) {
+                report(level, "pack_open", 0, NULL);
+                unlink(s->path);
+                return;
+        }
+
+        ok = f.sections == 4 && pack_find(&f, "empty") == 1 && pack_find(&f, "missing") == -1 &&
+                pack_section_info(&f, 2, &name, &type, &count) == 0 &&
+                strcmp(name, "soa") == 0 && type == CGMATH_PACK_VEC3F_SOA && count == PACK_SOA;
+        view = pack_view(&f, "points", CGMATH_PACK_VEC3F, &count);
+        ok &= pack_aligned(view) && count == PACK_POINTS && memcmp(view, s->points, sizeof(s->points)) == 0;
+        view = pack_view(&f, "big", CGMATH_PACK_FLOAT, &count);
+        ok &= pack_aligned(view) && count == PACK_BIG && memcmp(view, s->big, sizeof(s->big)) == 0;
+        ok &= pack_view(&f, "empty", CGMATH_PACK_MAT4F, &count) != NULL && count == 0;
+        ok &= pack_view(&f, "points", CGMATH_PACK_VEC4F, NULL) == NULL &&
+                pack_view(&f, "soa", CGMATH_PACK_VEC3F_SOA, NULL) == NULL;
+        report(level, "pack round trip", ok, NULL);
+
+        ok = pack_view_soa(&f, "soa", CGMATH_PACK_VEC3F_SOA, planes, &count) == 0 && count == PACK_SOA;
+        for(type = 0; ok && type < 3; type++) {
+                ok = pack_aligned(planes[type]) && memcmp(planes[type], s->soa[type], sizeof(s->soa[type])) == 0;
+        }
+        ok = ok && pack_view_soa(&f, "points", CGMATH_PACK_VEC3F, planes, NULL) == -1 &&
+                pack_view_soa(&f, "soa", CGMATH_PACK_VEC4F_SOA, planes, NULL) == -1;
+        report(level, "pack_view_soa", ok, NULL);
+
+        /* a data byte of the big section, near its end */
+        view = pack_view(&f, "big", CGMATH_PACK_FLOAT, NULL);
+        at = (long)((const unsigned char*)view - f.map) + PACK_BIG * sizeof(float) - 3;
+        pack_close(&f);
+
+        size = read_file(s->path, s->file, PACK_MAX);
+        ok = size > 0 && size < (long)PACK_MAX && pack_accepts(s, size, -1, CGMATH_PACK_VERIFY) == 1;
+        ok = ok && pack_accepts(s, size - 1, -1, 0) == 0 && pack_accepts(s, size / 2, -1, 0) == 0 &&
+                pack_accepts(s, 32, -1, 0) == 0;
+        report(level, "pack truncated", ok, NULL);
+
+        /* a flipped data byte passes the header and table checks, but not the section's */
+        ok = ok && pack_accepts(s, size, at, 0) == 1 && pack_accepts(s, size, at, CGMATH_PACK_VERIFY) == 0;
+        if(ok && pack_open(&f, s->bad_path, 0) == 0) {
+                ok = pack_verify(&f, "points") == 0 && pack_verify(&f, "big") == -1 &&
+                        pack_verify(&f, NULL) == -1;
+                pack_close(&f);
+        }
+        /* the table is at the end and the header first */
+        ok = ok && pack_accepts(s, size, size - 1, 0) == 0 && pack_accepts(s, size, 20, 0) == 0;
+        report(level, "pack checksum", ok, NULL);
+
+        unlink(s->path);
+        unlink(s->bad_path);
+}
+
+/* ---- mat4f_stack ---- */
+
+/*
+ * A random run of stack operations, reading the top
+ * after some of them, against a stack of double
+ * matrices that forms every product as soon as an
+ * operation is applied. Pushes past the capacity and
+ * pops past the root must fail, and popping back down
+ * at the end must restore every level that was
+ * pushed over.
+ */
+#define STACK_OPS       4000
+#define STACK_DEPTH     6
+
+typedef double stack_mat[4][4];
+
+/* a = a * b */
+static void stack_mul(stack_mat a, stack_mat b)
+{
+        int r;
+        int c;
+        int k;
+        stack_mat t;
+
+        for(r = 0; r < 4; r++) {
+                for(c = 0; c < 4; c++) {
+                        t[r][c] = 0.0;
+                        for(k = 0; k < 4; k++) {
+                                t[r][c] += a[r][k] * b[k][c];
+                        }
+                }
+        }
+        memcpy(a, t, sizeof(t));
+}
+
+static void stack_identity(stack_mat a)
+{
+        int r;
+        int c;
+
+        for(r = 0; r < 4; r++) {
+                for(c = 0; c < 4; c++) {
+                        a[r][c] = r == c;
+                }
+        }
+}
+
+/* whether m is within 1e-4 of r relative to the largest entry of r */
+static int stack_close(mat4f* m, stack_mat r)
+{
+        int i;
+        int j;
+        double e;
+        double big;
+
+        e = 0.0;
+        big = 1.0;
+        for(i = 0; i < 4; i++) {
+                for(j = 0; j < 4; j++) {
+                        e = fmax(e, fabs(m->m[i][j] - r[i][j]));
+                        big = fmax(big, fabs(r[i][j]));
+                }
+        }
+        return e <= 1e-4 * big;
+}
+
+/* identity plus a small perturbation, loaded or multiplied in */
+static void stack_random(mat4f* m, stack_mat r)
+{
+        int i;
+        int j;
+
+        for(i = 0; i < 4; i++) {
+                for(j = 0; j < 4; j++) {
+                        m->m[i][j] = (i == j ? 1.0f : 0.0f) + 0.25f * uniform();
+                        r[i][j] = m->m[i][j];
+                }
+        }
+}
+
+static void stack_check(int level)
+{
+        int i;
+        int ok;
+        int depth;
+        int reads;
+        float x;
+        float y;
+        float z;
+        float a;
+        double n;
+        mat4f m;
+        stack_mat op;
+        stack_mat ref[STACK_DEPTH];
+        mat4f_stack s;
+
+        if(mat4f_stack_init(&s, STACK_DEPTH) != 0) {
+                report(level, "mat4f_stack", 0, "out of memory");
+                return;
+        }
+
+        ok = mat4f_stack_pop(&s) == -1;
+        depth = 0;
+        reads = 0;
+        stack_identity(ref[0]);
+        for(i = 0; i < STACK_OPS && ok; i++) {
+                x = uniform();
+                y = uniform();
+                z = uniform();
+                stack_identity(op);
+                switch(rng() % 9) {
+                case 0:
+                        ok = mat4f_stack_push(&s) == (depth + 1 < STACK_DEPTH ? 0 : -1);
+                        if(depth + 1 < STACK_DEPTH) {
+                                depth++;
+                                memcpy(ref[depth], ref[depth - 1], sizeof(stack_mat));
+                        }
+                        break;
+                case 1:
+                        ok = mat4f_stack_pop(&s) == (depth > 0 ? 0 : -1);
+                        depth -= depth > 0;
+                        break;
+                case 2:
+                        stack_random(&m, op);
+                        mat4f_stack_load(&s, &m);
+                        memcpy(ref[depth], op, sizeof(stack_mat));
+                        break;
+                case 3:
+                        mat4f_stack_load_identity(&s);
+                        stack_identity(ref[depth]);
+                        break;
+                case 4:
+                        stack_random(&m, op);
+                        mat4f_stack_mult(&s, &m);
+                        stack_mul(ref[depth], op);
+                        break;
+                case 5:
+                        mat4f_stack_translate(&s, x, y, z);
+                        op[0][3] = x;
+                        op[1][3] = y;
+                        op[2][3] = z;
+                        stack_mul(ref[depth], op);
+                        break;
+                case 6:
+                        /* a zero axis leaves the top alone */
+                        if(rng() % 8 == 0) {
+                                x = y = z = 0.0f;
+                        }
+                        a = 3.0f * uniform();
+                        mat4f_stack_rotate(&s, a, x, y, z);
+                        n = sqrt((double)x * x + (double)y * y + (double)z * z);
+                        if(n > 0.0) {
+                                op[0][0] = cos(a) + (1.0 - cos(a)) * x * x / (n * n);
+                                op[0][1] = (1.0 - cos(a)) * x * y / (n * n) - sin(a) * z / n;
+                                op[0][2] = (1.0 - cos(a)) * x * z / (n * n) + sin(a) * y / n;
+                                op[1][0] = (1.0 - cos(a)) * x * y / (n * n) + sin(a) * z / n;
+                                op[1][1] = cos(a) + (1.0 - cos(a)) * y * y / (n * n);
+                                op[1][2] = (1.0 - cos(a)) * y * z / (n * n) - sin(a) * x / n;
+                                op[2][0] = (1.0 - cos(a)) * x * z / (n * n) - sin(a) * y / n;
+                                op[2][1] = (1.0 - cos(a)) * y * z / (n * n) + sin(a) * x / n;
+                                op[2][2] = cos(a) + (1.0 - cos(a)) * z * z / (n * n);
+                        }
+                        stack_mul(ref[depth], op);
+                        break;
+                case 7:
+                        x = 1.0f + 0.25f * x;
+                        y = 1.0f + 0.25f * y;
+                        z = 1.0f + 0.25f * z;
+                        mat4f_stack_scale(&s, x, y, z);
+                        op[0][0] = x;
+                        op[1][1] = y;
+                        op[2][2] = z;
+                        stack_mul(ref[depth], op);
+                        break;
+                default:
+                        break;
+                }
+                /* reads are sparse so that several levels go stale between them */
+                if(ok && rng() % 4 == 0) {
+                        ok = stack_close(mat4f_stack_top(&s), ref[depth]);
+                        reads++;
+                }
+        }
+        for(; ok && depth >= 0; depth--) {
+                ok = stack_close(mat4f_stack_top(&s), ref[depth]) &&
+                        mat4f_stack_pop(&s) == (depth > 0 ? 0 : -1);
+        }
+        report(level, "mat4f_stack", ok && reads > 0, NULL);
+        mat4f_stack_free(&s);
+}
+
+/* ---- camera ---- */
+
+/*
+ * A random run of setter calls, some of which hand
+ * back the input the camera already holds, with a
+ * random subset of the derived outputs read after
+ * each. Every read is compared with the product,
+ * inverse or planes recomputed in double from the
+ * current view and projection, so an output a setter
+ * failed to invalidate shows up as a stale read.
+ */
+#define CAMERA_OPS      2000
+
+/* Gauss-Jordan with partial pivoting; a is destroyed */
+static void camera_invert(stack_mat a, stack_mat dest)
+{
+        int r;
+        int c;
+        int k;
+        int p;
+        double t;
+
+        stack_identity(dest);
+        for(c = 0; c < 4; c++) {
+                p = c;
+                for(r = c + 1; r < 4; r++) {
+                        if(fabs(a[r][c]) > fabs(a[p][c])) {
+                                p = r;
+                        }
+                }
+                for(k = 0; k < 4; k++) {
+                        t = a[c][k];
+                        a[c][k] = a[p][k];
+                        a[p][k] = t;
+                        t = dest[c][k];
+                        dest[c][k] = dest[p][k];
+                        dest[p][k] = t;
+                }
+                t = 1.0 / a[c][c];
+                for(k = 0; k < 4; k++) {
+                        a[c][k] *= t;
+                        dest[c][k] *= t;
+                }
+                for(r = 0; r < 4; r++) {
+                        if(r != c) {
+                                t = a[r][c];
+                                for(k = 0; k < 4; k++) {
+                                        a[r][k] -= t * a[c][k];
+                                        dest[r][k] -= t * dest[c][k];
+                                }
+                        }
+                }
+        }
+}
+
+static void camera_copy(mat4f* m, stack_mat dest)
+{
+        int r;
+        int c;
+
+        for(r = 0; r < 4; r++) {
+                for(c = 0; c < 4; c++) {
+                        dest[r][c] = m->m[r][c];
+                }
+        }
+}
+
+/* whether each plane is within tolerance of the one taken from the rows of vp */
+static int camera_planes(vec4f* planes, stack_mat vp)
+{
+        int i;
+        int j;
+        double n;
+        double p[4];
+
+        for(i = 0; i < 6; i++) {
+                for(j = 0; j < 4; j++) {
+                        p[j] = vp[3][j] + (i & 1 ? -vp[i >> 1][j] : vp[i >> 1][j]);
+                }
+                n = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                for(j = 0; j < 4; j++) {
+                        if(fabs(planes[i].m[j] - p[j] / n) > 1e-3 * (1.0 + fabs(p[3] / n))) {
+                                return 0;
+                        }
+                }
+        }
+        return 1;
+}
+
+static void camera_check(int level)
+{
+        int i;
+        int ok;
+        unsigned int reads;
+        float near;
+        mat4f m;
+        vec3f eye;
+        vec3f target;
+        vec3f up;
+        stack_mat v;
+        stack_mat p;
+        stack_mat vp;
+        stack_mat t;
+        stack_mat inv;
+        camera cam;
+
+        camera_init(&cam);
+        ok = 1;
+        for(i = 0; i < CAMERA_OPS && ok; i++) {
+                switch(rng() % 7) {
+                case 0:
+                        stack_random(&m, t);
+                        m.m[0][3] = 4.0f * uniform();
+                        m.m[1][3] = 4.0f * uniform();
+                        m.m[2][3] = 4.0f * uniform();
+                        m.m[3][0] = m.m[3][1] = m.m[3][2] = 0.0f;
+                        m.m[3][3] = 1.0f;
+                        camera_set_view(&cam, &m);
+                        ok = memcmp(camera_view(&cam), &m, sizeof(m)) == 0;
+                        break;
+                case 1:
+                        stack_random(&m, t);
+                        camera_set_projection(&cam, &m);
+                        ok = memcmp(camera_projection(&cam), &m, sizeof(m)) == 0;
+                        break;
+                case 2:
+                        eye.m[VEC_X] = 4.0f * uniform();
+                        eye.m[VEC_Y] = 4.0f * uniform();
+                        eye.m[VEC_Z] = 4.0f * uniform() + 8.0f;
+                        target.m[VEC_X] = uniform();
+                        target.m[VEC_Y] = uniform();
+                        target.m[VEC_Z] = uniform();
+                        up.m[VEC_X] = 0.25f * uniform();
+                        up.m[VEC_Y] = 1.0f;
+                        up.m[VEC_Z] = 0.25f * uniform();
+                        camera_look_at(&cam, &eye, &target, &up);
+                        break;
+                case 3:
+                        near = 0.1f + 0.5f * (uniform() + 1.0f);
+                        camera_perspective(&cam, 1.0f + 0.5f * uniform(), 1.0f + 0.5f * uniform(),
+                                        near, near + 50.0f + 40.0f * uniform());
+                        break;
+                case 4:
+                        near = uniform();
+                        camera_ortho(&cam, -2.0f + uniform(), 2.0f + uniform(), -2.0f + uniform(),
+                                        2.0f + uniform(), near, near + 10.0f + 5.0f * uniform());
+                        break;
+                case 5:
+                        /* the input it already holds, as a general matrix */
+                        m = *camera_view(&cam);
+                        camera_set_view(&cam, &m);
+                        break;
+                default:
+                        m = *camera_projection(&cam);
+                        camera_set_projection(&cam, &m);
+                        break;
+                }
+
+                camera_copy(camera_view(&cam), v);
+                camera_copy(camera_projection(&cam), p);
+                memcpy(vp, p, sizeof(vp));
+                stack_mul(vp, v);
+                reads = rng();
+                if(ok && (reads & 1)) {
+                        ok = stack_close(camera_view_proj(&cam), vp);
+                }
+                if(ok && (reads & 2)) {
+                        memcpy(t, v, sizeof(t));
+                        camera_invert(t, inv);
+                        ok = stack_close(camera_inv_view(&cam), inv);
+                }
+                if(ok && (reads & 4)) {
+                        memcpy(t, p, sizeof(t));
+                        camera_invert(t, inv);
+                        ok = stack_close(camera_inv_projection(&cam), inv);
+                }
+                if(ok && (reads & 8)) {
+                        memcpy(t, vp, sizeof(t));
+                        camera_invert(t, inv);
+                        ok = stack_close(camera_inv_view_proj(&cam), inv);
+                }
+                if(ok && (reads & 16)) {
+                        ok = camera_planes(camera_frustum(&cam), vp);
+                }
+        }
+        report(level, "camera", ok, NULL);
+
+        /* no basis: the view must be left as it was */
+        m = *camera_view(&cam);
+        up = target;
+        ok = camera_look_at(&cam, &target, &target, &up) == -1;
+        up.m[VEC_X] = 2.0f * (target.m[VEC_X] - eye.m[VEC_X]);
+        up.m[VEC_Y] = 2.0f * (target.m[VEC_Y] - eye.m[VEC_Y]);
+        up.m[VEC_Z] = 2.0f * (target.m[VEC_Z] - eye.m[VEC_Z]);
+        ok = ok && camera_look_at(&cam, &eye, &target, &up) == -1 &&
+                memcmp(camera_view(&cam), &m, sizeof(m)) == 0;
+
+        /* a singular view reads back an identity inverse */
+        mat4f_zero(&m);
+        camera_set_view(&cam, &m);
+        stack_identity(inv);
+        ok = ok && stack_close(camera_inv_view(&cam), inv);
+        report(level, "camera degenerate", ok, NULL);
+}
+
+/* ---- matf_gemm and matf_gemv ---- */
+
+/*
+ * Products of a few shapes, in an order that makes the
+ * per thread workspace shrink and grow between calls,
+ * must come out bit for bit the same every time they
+ * are repeated, at one thread and at four. Shapes that
+ * do not agree must be refused without touching the
+ * output.
+ */
+#define MATF_M          200
+#define MATF_K          300
+#define MATF_N          150
+
+typedef struct {
+        float   a[MATF_M * MATF_K];
+        float   b[MATF_K * MATF_N];
+        float   c[MATF_M * MATF_N];
+        float   first[MATF_M * MATF_N];
+        float   y[MATF_M];
+} matf_state;
+
+static void matf_input(matf_state* s)
+{
+        size_t i;
+
+        for(i = 0; i < MATF_M * MATF_K; i++) {
+                s->a[i] = uniform();
+        }
+        for(i = 0; i < MATF_K * MATF_N; i++) {
+                s->b[i] = uniform();
+        }
+}
+
+/* C = A B over the leading k columns of A and rows of B */
+static int matf_product(matf_state* s, int k)
+{
+        matf a;
+        matf b;
+        matf c;
+
+        matf_view(&a, s->a, MATF_M, k, MATF_K);
+        matf_view(&b, s->b, k, MATF_N, 0);
+        matf_view(&c, s->c, MATF_M, MATF_N, 0);
+        return matf_multiply(&a, &b, &c);
+}
+
+static void matf_check(int level, matf_state* s)
+{
+        int ok;
+        int t;
+        int threads;
+        matf a;
+        matf b;
+        matf c;
+
+        threads = cgmath_threads();
+        ok = matf_product(s, MATF_K) == 0;
+        memcpy(s->first, s->c, sizeof(s->c));
+        for(t = 0; ok && t < 2; t++) {
+                cgmath_set_threads(t == 0 ? 1 : 4);
+                ok = matf_product(s, 7) == 0 && matf_product(s, MATF_K) == 0 &&
+                        memcmp(s->c, s->first, sizeof(s->c)) == 0;
+        }
+        cgmath_set_threads(threads);
+        report(level, "matf_gemm repeat", ok, NULL);
+
+        matf_view(&a, s->a, MATF_M, MATF_K, 0);
+        matf_view(&b, s->b, MATF_K, MATF_N, 0);
+        matf_view(&c, s->c, MATF_M, MATF_N, 0);
+        memset(s->c, 0, sizeof(s->c));
+        memset(s->y, 0, sizeof(s->y));
+        ok = matf_gemm(CGMATH_TRANS, CGMATH_NO_TRANS, 1.0f, &a, &b, 0.0f, &c) == -1;
+        matf_view(&a, s->a, MATF_M, MATF_K, MATF_K - 1);
+        ok = ok && matf_gemm(CGMATH_NO_TRANS, CGMATH_NO_TRANS, 1.0f, &a, &b, 0.0f, &c) == -1;
+        matf_view(&a, s->a, MATF_M, MATF_K, 0);
+        ok = ok && matf_gemv(CGMATH_NO_TRANS, 1.0f, &a, s->b, MATF_K - 1, 0.0f, s->y, MATF_M) == -1 &&
+                matf_gemv(CGMATH_NO_TRANS, 1.0f, &a, s->b, MATF_K, 0.0f, s->y, MATF_K) == -1 &&
+                matf_gemv(CGMATH_TRANS, 1.0f, &a, s->b, MATF_K, 0.0f, s->y, MATF_M) == -1;
+        for(t = 0; t < MATF_M * MATF_N; t++) {
+                ok = ok && s->c[t] == 0.0f;
+        }
+        for(t = 0; t < MATF_M; t++) {
+                ok = ok && s->y[t] == 0.0f;
+        }
+        ok = ok && matf_gemv(CGMATH_NO_TRANS, 1.0f, &a, s->b, MATF_K, 0.0f, s->y, MATF_M) == 0;
+        report(level, "matf shapes", ok, NULL);
+}
+
+static quant_state quant;
+static quant_state quant_base;
+static sprite_state sprite;
+static sprite_state sprite_base;
+static normal_state normal;
+static inverse_state inverse;
+static inverse_state inverse_base;
+static anim_state anim;
+static mesh_state mesh_sphere;
+static grid_state grid_points;
+static weld_state weld;
+static pack_state pack;
+static matf_state dense;
+
+int main(int argc, char* argv[])
+{
+        int i;
+        int level;
+        unsigned long long seed;
+        clip_state clip;
+        raster_state raster;
+        depth_buffer db;
+
+        seed = 1;
+        for(i = 1; i < argc - 1; i++) {
+                if(strcmp(argv[i], "-s") == 0) {
+                        seed = strtoull(argv[++i], NULL, 10);
+                }
+        }
+
+        rng_state = seed;
+        clip.src = malloc(3 * CLIP_TRIS * sizeof(vec4f));
+        clip.dest = malloc(3 * CLIP_FAN * CLIP_TRIS * sizeof(vec4f));
+        clip.ref = malloc(3 * CLIP_FAN * CLIP_TRIS * sizeof(vec4f));
+        clip.base = malloc(3 * CLIP_FAN * CLIP_TRIS * sizeof(vec4f));
+        clip.source = malloc(CLIP_FAN * CLIP_TRIS * sizeof(unsigned int));
+        clip.ref_source = malloc(CLIP_FAN * CLIP_TRIS * sizeof(unsigned int));
+        if(clip.src == NULL || clip.dest == NULL || clip.ref == NULL || clip.base == NULL ||
+                        clip.source == NULL || clip.ref_source == NULL) {
+                fprintf(stderr, "check: out of memory\n");
+                return 1;
+        }
+        clip_input(clip.src);
+
+        raster.pos = malloc(3 * RASTER_TRIS * sizeof(vec3f));
+        raster.indices = malloc(3 * RASTER_TRIS * sizeof(unsigned int));
+        raster.boxes = malloc(RASTER_BOXES * sizeof(aabb));
+        raster.visible = malloc(RASTER_BOXES);
+        raster.depth = malloc(RASTER_W * RASTER_H * sizeof(float));
+        if(raster.pos == NULL || raster.indices == NULL || raster.boxes == NULL ||
+                        raster.visible == NULL || raster.depth == NULL ||
+                        depth_buffer_init(&db, RASTER_W, RASTER_H) != 0) {
+                fprintf(stderr, "check: out of memory\n");
+                return 1;
+        }
+        raster_input(&raster);
+        kdtree_input();
+        quant_input(&quant);
+        sprite_input(&sprite);
+        normal_input(&normal);
+        inverse_input(&inverse);
+        mesh_input(&mesh_sphere);
+        weld_input(&weld);
+        pack_input(&pack);
+        matf_input(&dense);
+        if(anim_input(&anim) != 0 || grid_input(&grid_points) != 0) {
+                fprintf(stderr, "check: out of memory\n");
+                return 1;
+        }
+
+        for(level = CGMATH_ISA_SCALAR; level <= cgmath_isa_detected(); level++) {
+                cgmath_isa_select(level);
+                clip_check(level, &clip);
+                raster_check(level, &raster, &db);
+                kdtree_check(level);
+                quant_check(level, &quant, &quant_base);
+                sprite_check(level, &sprite, &sprite_base);
+                normal_check(level, &normal);
+                inverse_check(level, &inverse, &inverse_base);
+                anim_check(level, &anim);
+                mesh_check(level, &mesh_sphere);
+                grid_check(level, &grid_points);
+                weld_check(level, &weld);
+                pack_check(level, &pack);
+                stack_check(level);
+                camera_check(level);
+                matf_check(level, &dense);
+        }
+
+        unlink(normal.in_path);
+        depth_buffer_free(&db);
+        free(raster.pos);
+        free(raster.indices);
+        free(raster.boxes);
+        free(raster.visible);
+        free(raster.depth);
+        free(clip.src);
+        free(clip.dest);
+        free(clip.ref);
+        free(clip.base);
+        free(clip.source);
+        free(clip.ref_source);
+        return failures;
+}
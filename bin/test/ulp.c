@@ -0,0 +1,2199 @@
+/**
+ * File: ulp.c
+ * Description:
+ * * Differential accuracy harness. Every case runs a
+ * * library function on float inputs and a double
+ * * precision reference on the same inputs, at every
+ * * dispatch level the CPU supports, and reports the
+ * * max and mean error in ULPs for random inputs and
+ * * for an adversarial set (wide exponents, zeros,
+ * * denormals, near and exactly singular matrices).
+ * *
+ * * Errors are measured in ULPs of the largest
+ * * reference component of each result, so that
+ * * cancellation in one element of an inverse does
+ * * not drown out the rest of the table. Cases with
+ * * an abs scale (the lossy encoders) report the
+ * * absolute error in units of that scale instead.
+ * *
+ * * Every level above scalar is also run against the
+ * * scalar path on the same inputs: "vs scalar" is the
+ * * largest difference in the same units, "mismatch"
+ * * counts samples where one wrote a result (or a
+ * * finite one) and the other did not.
+ * *
+ * * A row whose random set max or mean exceeds its
+ * * budget is marked, and the exit status is the number
+ * * of such rows.
+ * *
+ * * Usage: ulp [-n samples] [-l level] [-s seed]
+ * *            [-f name]
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+
+#define ULP_MAX_IN      256
+#define ULP_MAX_OUT     128
+
+#define ULP_RANDOM      0
+#define ULP_ADVERSARIAL 1
+
+/**
+ * run() calls the library; ref() fills the double
+ * reference and returns nonzero when the result is
+ * undefined for the input (a singular matrix), in
+ * which case only whether dest was written is noted.
+ * A nonzero abs measures |out - ref| / abs instead of
+ * ULPs.
+ */
+typedef struct {
+        const char*     name;
+        int             in;
+        int             out;
+        void            (*run)(float* in, float* out);
+        int             (*ref)(float* in, double* out);
+        double          abs;
+} ulp_case;
+
+typedef struct {
+        double          max;
+        double          sum;
+        long            count;
+        long            nonfinite;
+        long            untouched;
+        long            singular;
+        double          scalar;
+        long            mismatch;
+} ulp_stats;
+
+/* ---- library wrappers and double references ---- */
+
+static double dabs(double d)
+{
+        return d < 0.0 ? -d : d;
+}
+
+static double det2(double a, double b, double c, double d)
+{
+        return a * d - b * c;
+}
+
+static double det3(double* m)
+{
+        return  m[0] * det2(m[4], m[5], m[7], m[8]) -
+                m[1] * det2(m[3], m[5], m[6], m[8]) +
+                m[2] * det2(m[3], m[4], m[6], m[7]);
+}
+
+static void minor(double* m, int n, int r, int c, double* dest)
+{
+        int i;
+        int j;
+        int k;
+
+        k = 0;
+        for(i = 0; i < n; i++) {
+                for(j = 0; j < n; j++) {
+                        if(i != r && j != c) {
+                                dest[k++] = m[i * n + j];
+                        }
+                }
+        }
+}
+
+static double detn(double* m, int n)
+{
+        int j;
+        double s;
+        double sm[9];
+
+        if(n == 2) {
+                return det2(m[0], m[1], m[2], m[3]);
+        }
+        if(n == 3) {
+                return det3(m);
+        }
+
+        s = 0.0;
+        for(j = 0; j < n; j++) {
+                minor(m, n, 0, j, sm);
+                s += (j & 1 ? -1.0 : 1.0) * m[j] * det3(sm);
+        }
+        return s;
+}
+
+static int inversen(float* in, int n, double* out)
+{
+        int i;
+        int j;
+        double dt;
+        double m[16];
+        double sm[9];
+
+        for(i = 0; i < n * n; i++) {
+                m[i] = in[i];
+        }
+
+        dt = detn(m, n);
+        if(dt == 0.0) {
+                return 1;
+        }
+
+        for(i = 0; i < n; i++) {
+                for(j = 0; j < n; j++) {
+                        minor(m, n, j, i, sm);
+                        out[i * n + j] = ((i + j) & 1 ? -1.0 : 1.0) *
+                                (n == 2 ? sm[0] : detn(sm, n - 1)) / dt;
+                }
+        }
+        return 0;
+}
+
+#define VEC_CASES(N) \
+static void run_vec##N##f_add(float* in, float* out) \
+{ vec##N##f_add((vec##N##f*)in, (vec##N##f*)(in + N), (vec##N##f*)out); } \
+static int ref_vec##N##f_add(float* in, double* out) \
+{ int i; for(i = 0; i < N; i++) out[i] = (double)in[i] + in[N + i]; return 0; } \
+static void run_vec##N##f_scale(float* in, float* out) \
+{ vec##N##f_scale((vec##N##f*)in, in[N], (vec##N##f*)out); } \
+static int ref_vec##N##f_scale(float* in, double* out) \
+{ int i; for(i = 0; i < N; i++) out[i] = (double)in[i] * in[N]; return 0; } \
+static void run_vec##N##f_scalar_prod(float* in, float* out) \
+{ out[0] = vec##N##f_scalar_prod((vec##N##f*)in, (vec##N##f*)(in + N)); } \
+static int ref_vec##N##f_scalar_prod(float* in, double* out) \
+{ int i; out[0] = 0.0; for(i = 0; i < N; i++) out[0] += (double)in[i] * in[N + i]; return 0; } \
+static void run_vec##N##f_sqr_mag(float* in, float* out) \
+{ out[0] = vec##N##f_sqr_mag((vec##N##f*)in); } \
+static int ref_vec##N##f_sqr_mag(float* in, double* out) \
+{ int i; out[0] = 0.0; for(i = 0; i < N; i++) out[0] += (double)in[i] * in[i]; return 0; } \
+static void run_vec##N##f_normalize(float* in, float* out) \
+{ vec##N##f_normalize((vec##N##f*)in, (vec##N##f*)out); } \
+static int ref_vec##N##f_normalize(float* in, double* out) \
+{ int i; double s = 0.0; for(i = 0; i < N; i++) s += (double)in[i] * in[i]; \
+  if(s == 0.0) return 1; \
+  for(i = 0; i < N; i++) out[i] = in[i] / sqrt(s); return 0; }
+
+#define MAT_CASES(N) \
+static void run_mat##N##f_add(float* in, float* out) \
+{ mat##N##f_add((mat##N##f*)in, (mat##N##f*)(in + N * N), (mat##N##f*)out); } \
+static int ref_mat##N##f_add(float* in, double* out) \
+{ int i; for(i = 0; i < N * N; i++) out[i] = (double)in[i] + in[N * N + i]; return 0; } \
+static void run_mat##N##f_scale(float* in, float* out) \
+{ mat##N##f_scale((mat##N##f*)in, in[N * N], (mat##N##f*)out); } \
+static int ref_mat##N##f_scale(float* in, double* out) \
+{ int i; for(i = 0; i < N * N; i++) out[i] = (double)in[i] * in[N * N]; return 0; } \
+static void run_mat##N##f_multiply(float* in, float* out) \
+{ mat##N##f_multiply((mat##N##f*)in, (mat##N##f*)(in + N * N), (mat##N##f*)out); } \
+static int ref_mat##N##f_multiply(float* in, double* out) \
+{ int i; int j; int k; for(i = 0; i < N; i++) for(j = 0; j < N; j++) { out[i * N + j] = 0.0; \
+  for(k = 0; k < N; k++) out[i * N + j] += (double)in[i * N + k] * in[N * N + k * N + j]; } return 0; } \
+static void run_mat##N##f_determinant(float* in, float* out) \
+{ out[0] = mat##N##f_determinant((mat##N##f*)in); } \
+static int ref_mat##N##f_determinant(float* in, double* out) \
+{ int i; double m[16]; for(i = 0; i < N * N; i++) m[i] = in[i]; out[0] = detn(m, N); return 0; } \
+static void run_mat##N##f_transpose(float* in, float* out) \
+{ mat##N##f_transpose((mat##N##f*)in, (mat##N##f*)out); } \
+static int ref_mat##N##f_transpose(float* in, double* out) \
+{ int i; int j; for(i = 0; i < N; i++) for(j = 0; j < N; j++) out[i * N + j] = in[j * N + i]; return 0; } \
+static void run_mat##N##f_inverse(float* in, float* out) \
+{ mat##N##f_inverse((mat##N##f*)in, (mat##N##f*)out); } \
+static int ref_mat##N##f_inverse(float* in, double* out) \
+{ return inversen(in, N, out); }
+
+VEC_CASES(2)
+VEC_CASES(3)
+VEC_CASES(4)
+MAT_CASES(2)
+MAT_CASES(3)
+MAT_CASES(4)
+
+static void run_vec3f_vector_prod(float* in, float* out)
+{
+        vec3f_vector_prod((vec3f*)in, (vec3f*)(in + 3), (vec3f*)out);
+}
+
+static int ref_vec3f_vector_prod(float* in, double* out)
+{
+        out[0] = (double)in[1] * in[5] - (double)in[2] * in[4];
+        out[1] = (double)in[2] * in[3] - (double)in[0] * in[5];
+        out[2] = (double)in[0] * in[4] - (double)in[1] * in[3];
+        return 0;
+}
+
+/*
+ * The batch transforms take a matrix and eight points,
+ * enough to go through the widest SIMD loop once.
+ */
+#define XFORM_POINTS    8
+
+static void run_mat4f_transform_point_array(float* in, float* out)
+{
+        mat4f_transform_point_array((mat4f*)in, (vec3f*)(in + 16), (vec3f*)out, XFORM_POINTS);
+}
+
+static int ref_mat4f_transform_point_array(float* in, double* out)
+{
+        int i;
+        int j;
+        float* p;
+
+        for(i = 0; i < XFORM_POINTS; i++) {
+                p = in + 16 + 3 * i;
+                for(j = 0; j < 3; j++) {
+                        out[3 * i + j] = (double)in[4 * j] * p[0] + (double)in[4 * j + 1] * p[1] +
+                                (double)in[4 * j + 2] * p[2] + in[4 * j + 3];
+                }
+        }
+        return 0;
+}
+
+static void run_vec3f_normalize_array(float* in, float* out)
+{
+        vec3f_normalize_array((vec3f*)in, (vec3f*)out, XFORM_POINTS);
+}
+
+static int ref_vec3f_normalize_array(float* in, double* out)
+{
+        int i;
+        int j;
+        double l;
+
+        for(i = 0; i < XFORM_POINTS; i++) {
+                l = 0.0;
+                for(j = 0; j < 3; j++) {
+                        l += (double)in[3 * i + j] * in[3 * i + j];
+                }
+                if(l == 0.0) {
+                        return 1;
+                }
+                for(j = 0; j < 3; j++) {
+                        out[3 * i + j] = in[3 * i + j] / sqrt(l);
+                }
+        }
+        return 0;
+}
+
+static void run_mat4f_transform_normal_array(float* in, float* out)
+{
+        mat4f_transform_normal_array((mat4f*)in, (vec3f*)(in + 16), (vec3f*)out, XFORM_POINTS);
+}
+
+static int ref_mat4f_transform_normal_array(float* in, double* out)
+{
+        int i;
+        int j;
+        float* p;
+        double l;
+
+        for(i = 0; i < XFORM_POINTS; i++) {
+                p = in + 16 + 3 * i;
+                l = 0.0;
+                for(j = 0; j < 3; j++) {
+                        out[3 * i + j] = (double)in[4 * j] * p[0] + (double)in[4 * j + 1] * p[1] +
+                                (double)in[4 * j + 2] * p[2];
+                        l += out[3 * i + j] * out[3 * i + j];
+                }
+                if(l == 0.0) {
+                        return 1;
+                }
+                for(j = 0; j < 3; j++) {
+                        out[3 * i + j] /= sqrt(l);
+                }
+        }
+        return 0;
+}
+
+/*
+ * The input is replicated across a group of eight so
+ * that it goes through the lane-parallel path.
+ */
+static void run_mat4f_inverse_array(float* in, float* out)
+{
+        int i;
+        mat4f m[8];
+
+        for(i = 0; i < 8; i++) {
+                memcpy(m[i].m, in, MAT4F_SIZE);
+        }
+        if(mat4f_inverse_array(m, m, NULL, 8) == 0) {
+                memcpy(out, m[5].m, MAT4F_SIZE);
+        }
+}
+
+static int ref_mat4f_inverse_array(float* in, double* out)
+{
+        return inversen(in, 4, out);
+}
+
+static void run_mat3f_inverse_array(float* in, float* out)
+{
+        int i;
+        mat3f m[8];
+
+        for(i = 0; i < 8; i++) {
+                memcpy(m[i].m, in, MAT3F_SIZE);
+        }
+        if(mat3f_inverse_array(m, m, NULL, 8) == 0) {
+                memcpy(out, m[5].m, MAT3F_SIZE);
+        }
+}
+
+static int ref_mat3f_inverse_array(float* in, double* out)
+{
+        return inversen(in, 3, out);
+}
+
+/* only the upper triangle of the input is used */
+static void run_mat3f_inverse_sym_soa(float* in, float* out)
+{
+        int i;
+        int k;
+        float s[9][8];
+        float d[9][8];
+        mat3f_soa src;
+        mat3f_soa dest;
+
+        for(k = 0; k < 9; k++) {
+                for(i = 0; i < 8; i++) {
+                        s[k][i] = in[k];
+                }
+                src.m[k] = s[k];
+                dest.m[k] = d[k];
+        }
+        if(mat3f_inverse_sym_soa(&src, &dest, NULL, 8) == 0) {
+                for(k = 0; k < 9; k++) {
+                        out[k] = d[k][5];
+                }
+        }
+}
+
+static int ref_mat3f_inverse_sym_soa(float* in, double* out)
+{
+        float sym[9];
+
+        memcpy(sym, in, sizeof(sym));
+        sym[3] = in[1];
+        sym[6] = in[2];
+        sym[7] = in[5];
+        return inversen(sym, 3, out);
+}
+
+/* eigenvalues of the symmetric upper triangle, largest first */
+static void run_mat3f_eigen_sym_array(float* in, float* out)
+{
+        int i;
+        mat3f m[8];
+        mat3f v[8];
+        vec3f w[8];
+
+        for(i = 0; i < 8; i++) {
+                memcpy(m[i].m, in, MAT3F_SIZE);
+        }
+        mat3f_eigen_sym_array(m, w, v, 8);
+        memcpy(out, w[5].m, sizeof(vec3f));
+}
+
+static int ref_mat3f_eigen_sym_array(float* in, double* out)
+{
+        int i;
+        int j;
+        int p;
+        int q;
+        int sweep;
+        double a[3][3];
+        double t;
+        double c;
+        double s;
+        double x;
+        double y;
+        double theta;
+
+        for(i = 0; i < 3; i++) {
+                for(j = i; j < 3; j++) {
+                        a[i][j] = a[j][i] = in[3 * i + j];
+                }
+        }
+        for(sweep = 0; sweep < 50; sweep++) {
+                for(p = 0; p < 2; p++) {
+                        for(q = p + 1; q < 3; q++) {
+                                if(a[p][q] == 0.0) {
+                                        continue;
+                                }
+                                theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                                t = (theta < 0.0 ? -1.0 : 1.0) / (dabs(theta) + sqrt(theta * theta + 1.0));
+                                c = 1.0 / sqrt(t * t + 1.0);
+                                s = t * c;
+                                for(i = 0; i < 3; i++) {
+                                        x = a[i][p];
+                                        y = a[i][q];
+                                        a[i][p] = c * x - s * y;
+                                        a[i][q] = s * x + c * y;
+                                }
+                                for(i = 0; i < 3; i++) {
+                                        x = a[p][i];
+                                        y = a[q][i];
+                                        a[p][i] = c * x - s * y;
+                                        a[q][i] = s * x + c * y;
+                                }
+                        }
+                }
+        }
+        for(i = 0; i < 3; i++) {
+                out[i] = a[i][i];
+        }
+        for(i = 0; i < 3; i++) {
+                for(j = i + 1; j < 3; j++) {
+                        if(out[j] > out[i]) {
+                                t = out[i];
+                                out[i] = out[j];
+                                out[j] = t;
+                        }
+                }
+        }
+        return 0;
+}
+
+#define COV_POINTS      8
+
+static void run_vec3f_covariance_array(float* in, float* out)
+{
+        mat3f c;
+
+        vec3f_covariance_array((vec3f*)in, NULL, &c, COV_POINTS);
+        memcpy(out, c.m, MAT3F_SIZE);
+}
+
+static int ref_vec3f_covariance_array(float* in, double* out)
+{
+        int i;
+        int r;
+        int k;
+        double mean[3];
+
+        for(k = 0; k < 3; k++) {
+                mean[k] = 0.0;
+                for(i = 0; i < COV_POINTS; i++) {
+                        mean[k] += in[3 * i + k];
+                }
+                mean[k] /= COV_POINTS;
+        }
+        for(r = 0; r < 3; r++) {
+                for(k = 0; k < 3; k++) {
+                        out[3 * r + k] = 0.0;
+                        for(i = 0; i < COV_POINTS; i++) {
+                                out[3 * r + k] += (in[3 * i + r] - mean[r]) * (in[3 * i + k] - mean[k]);
+                        }
+                        out[3 * r + k] /= COV_POINTS;
+                }
+        }
+        return 0;
+}
+
+/* eight lanes, so the SIMD paths are measured and not just the tail */
+#define TRIG_LANES      8
+#define TRIG_SCALE      8.0f
+
+static void run_cgmath_sincos_array(float* in, float* out)
+{
+        int i;
+        float x[TRIG_LANES];
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                x[i] = in[i] * TRIG_SCALE;
+        }
+        cgmath_sincos_array(x, out, out + TRIG_LANES, TRIG_LANES);
+}
+
+static int ref_cgmath_sincos_array(float* in, double* out)
+{
+        int i;
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                out[i] = sin((double)(in[i] * TRIG_SCALE));
+                out[i + TRIG_LANES] = cos((double)(in[i] * TRIG_SCALE));
+        }
+        return 0;
+}
+
+static void run_cgmath_atan2_array(float* in, float* out)
+{
+        cgmath_atan2_array(in, in + TRIG_LANES, out, TRIG_LANES);
+}
+
+static int ref_cgmath_atan2_array(float* in, double* out)
+{
+        int i;
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                out[i] = atan2(in[i], in[i + TRIG_LANES]);
+        }
+        return 0;
+}
+
+static void run_cgmath_acos_array(float* in, float* out)
+{
+        cgmath_acos_array(in, out, TRIG_LANES);
+}
+
+static int ref_cgmath_acos_array(float* in, double* out)
+{
+        int i;
+
+        /* the library clamps to [-1, 1] */
+        for(i = 0; i < TRIG_LANES; i++) {
+                out[i] = acos(in[i] < -1.0f ? -1.0 : in[i] > 1.0f ? 1.0 : in[i]);
+        }
+        return 0;
+}
+
+static void run_mat3f_rotation_axis_angle(float* in, float* out)
+{
+        mat3f m;
+
+        mat3f_rotation_axis_angle((vec3f*)in, in[3] * TRIG_SCALE, &m);
+        memcpy(out, m.m, MAT3F_SIZE);
+}
+
+static int ref_mat3f_rotation_axis_angle(float* in, double* out)
+{
+        int i;
+        double a[3];
+        double n;
+        double s;
+        double c;
+        double t;
+
+        n = sqrt((double)in[0] * in[0] + (double)in[1] * in[1] + (double)in[2] * in[2]);
+        if(n < sqrt(FLT_MIN)) {
+                return 1;
+        }
+        for(i = 0; i < 3; i++) {
+                a[i] = in[i] / n;
+        }
+        s = sin((double)(in[3] * TRIG_SCALE));
+        c = cos((double)(in[3] * TRIG_SCALE));
+        t = 1.0 - c;
+        out[0] = t * a[0] * a[0] + c;
+        out[1] = t * a[0] * a[1] - s * a[2];
+        out[2] = t * a[0] * a[2] + s * a[1];
+        out[3] = t * a[0] * a[1] + s * a[2];
+        out[4] = t * a[1] * a[1] + c;
+        out[5] = t * a[1] * a[2] - s * a[0];
+        out[6] = t * a[0] * a[2] - s * a[1];
+        out[7] = t * a[1] * a[2] + s * a[0];
+        out[8] = t * a[2] * a[2] + c;
+        return 0;
+}
+
+#define EULER_COUNT     4
+
+static void run_quat_from_euler_array(float* in, float* out)
+{
+        int i;
+        vec3f e[EULER_COUNT];
+
+        for(i = 0; i < 3 * EULER_COUNT; i++) {
+                e[i / 3].m[i % 3] = in[i] * TRIG_SCALE;
+        }
+        quat_from_euler_array(e, (quat*)out, EULER_COUNT);
+}
+
+static int ref_quat_from_euler_array(float* in, double* out)
+{
+        int i;
+        int k;
+        double s[3];
+        double c[3];
+
+        for(i = 0; i < EULER_COUNT; i++) {
+                for(k = 0; k < 3; k++) {
+                        s[k] = sin(0.5 * (double)(in[3 * i + k] * TRIG_SCALE));
+                        c[k] = cos(0.5 * (double)(in[3 * i + k] * TRIG_SCALE));
+                }
+                out[4 * i] = s[0] * c[1] * c[2] - c[0] * s[1] * s[2];
+                out[4 * i + 1] = c[0] * s[1] * c[2] + s[0] * c[1] * s[2];
+                out[4 * i + 2] = c[0] * c[1] * s[2] - s[0] * s[1] * c[2];
+                out[4 * i + 3] = c[0] * c[1] * c[2] + s[0] * s[1] * s[2];
+        }
+        return 0;
+}
+
+/*
+ * The batch rotation builders, eight lanes at a time,
+ * with angles scaled either like the rows above or by
+ * TRIG_FAR, which puts half of them past the 8192 limit
+ * of the Cody-Waite reduction in trig.c, where lanes
+ * fall back to libm.
+ */
+#define TRIG_FAR        16384.0f
+
+static void rotation_euler_ref(float* in, float scale, double* m)
+{
+        int k;
+        double s[3];
+        double c[3];
+
+        for(k = 0; k < 3; k++) {
+                s[k] = sin((double)(in[k] * scale));
+                c[k] = cos((double)(in[k] * scale));
+        }
+        m[0] = c[2] * c[1];
+        m[1] = c[2] * s[1] * s[0] - s[2] * c[0];
+        m[2] = c[2] * s[1] * c[0] + s[2] * s[0];
+        m[3] = s[2] * c[1];
+        m[4] = s[2] * s[1] * s[0] + c[2] * c[0];
+        m[5] = s[2] * s[1] * c[0] - c[2] * s[0];
+        m[6] = -s[1];
+        m[7] = c[1] * s[0];
+        m[8] = c[1] * c[0];
+}
+
+static void run_mat2f_rotation(float* in, float* out, float scale)
+{
+        int i;
+        float a[TRIG_LANES];
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                a[i] = in[i] * scale;
+        }
+        mat2f_rotation_array(a, (mat2f*)out, TRIG_LANES);
+}
+
+static int ref_mat2f_rotation(float* in, double* out, float scale)
+{
+        int i;
+        double s;
+        double c;
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                s = sin((double)(in[i] * scale));
+                c = cos((double)(in[i] * scale));
+                out[4 * i] = c;
+                out[4 * i + 1] = -s;
+                out[4 * i + 2] = s;
+                out[4 * i + 3] = c;
+        }
+        return 0;
+}
+
+static void run_axis_angle(float* in, float* out, float scale)
+{
+        int i;
+        vec3f axis[TRIG_LANES];
+        float a[TRIG_LANES];
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                memcpy(axis[i].m, in + 4 * i, sizeof(vec3f));
+                a[i] = in[4 * i + 3] * scale;
+        }
+        mat3f_rotation_axis_angle_array(axis, a, (mat3f*)out, TRIG_LANES);
+}
+
+/* an axis too short to normalize gives the identity */
+static int ref_axis_angle(float* in, double* out, float scale)
+{
+        int i;
+        int k;
+        double a[3];
+        double n;
+        double s;
+        double c;
+        double t;
+        double* m;
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                n = 0.0;
+                for(k = 0; k < 3; k++) {
+                        a[k] = in[4 * i + k];
+                        n += a[k] * a[k];
+                }
+                s = 0.0;
+                c = 1.0;
+                if(n >= FLT_MIN && n <= FLT_MAX) {
+                        for(k = 0; k < 3; k++) {
+                                a[k] /= sqrt(n);
+                        }
+                        s = sin((double)(in[4 * i + 3] * scale));
+                        c = cos((double)(in[4 * i + 3] * scale));
+                }
+                t = 1.0 - c;
+                m = out + 9 * i;
+                m[0] = t * a[0] * a[0] + c;
+                m[1] = t * a[0] * a[1] - s * a[2];
+                m[2] = t * a[0] * a[2] + s * a[1];
+                m[3] = t * a[0] * a[1] + s * a[2];
+                m[4] = t * a[1] * a[1] + c;
+                m[5] = t * a[1] * a[2] - s * a[0];
+                m[6] = t * a[0] * a[2] - s * a[1];
+                m[7] = t * a[1] * a[2] + s * a[0];
+                m[8] = t * a[2] * a[2] + c;
+        }
+        return 0;
+}
+
+static void run_euler(float* in, float* out, float scale, int four)
+{
+        int i;
+        vec3f e[TRIG_LANES];
+
+        for(i = 0; i < 3 * TRIG_LANES; i++) {
+                e[i / 3].m[i % 3] = in[i] * scale;
+        }
+        if(four) {
+                mat4f_from_euler_array(e, (mat4f*)out, TRIG_LANES);
+        } else {
+                mat3f_from_euler_array(e, (mat3f*)out, TRIG_LANES);
+        }
+}
+
+static int ref_euler(float* in, double* out, float scale, int four)
+{
+        int i;
+        int r;
+        int k;
+        double m[9];
+
+        for(i = 0; i < TRIG_LANES; i++) {
+                rotation_euler_ref(in + 3 * i, scale, m);
+                if(!four) {
+                        memcpy(out + 9 * i, m, sizeof(m));
+                        continue;
+                }
+                for(r = 0; r < 4; r++) {
+                        for(k = 0; k < 4; k++) {
+                                out[16 * i + 4 * r + k] = r < 3 && k < 3 ? m[3 * r + k] : r == k;
+                        }
+                }
+        }
+        return 0;
+}
+
+#define TRIG_ROTATION_CASE(NAME, SCALE, RUN, REF) \
+static void run_##NAME(float* in, float* out) { RUN(in, out, SCALE); } \
+static int ref_##NAME(float* in, double* out) { return REF(in, out, SCALE); }
+
+#define TRIG_EULER_CASE(NAME, SCALE, FOUR) \
+static void run_##NAME(float* in, float* out) { run_euler(in, out, SCALE, FOUR); } \
+static int ref_##NAME(float* in, double* out) { return ref_euler(in, out, SCALE, FOUR); }
+
+TRIG_ROTATION_CASE(mat2f_rotation_array, TRIG_SCALE, run_mat2f_rotation, ref_mat2f_rotation)
+TRIG_ROTATION_CASE(mat2f_rotation_array_far, TRIG_FAR, run_mat2f_rotation, ref_mat2f_rotation)
+TRIG_ROTATION_CASE(mat3f_rotation_axis_angle_array, TRIG_SCALE, run_axis_angle, ref_axis_angle)
+TRIG_ROTATION_CASE(mat3f_rotation_axis_angle_array_far, TRIG_FAR, run_axis_angle, ref_axis_angle)
+TRIG_EULER_CASE(mat3f_from_euler_array, TRIG_SCALE, 0)
+TRIG_EULER_CASE(mat3f_from_euler_array_far, TRIG_FAR, 0)
+TRIG_EULER_CASE(mat4f_from_euler_array, TRIG_SCALE, 1)
+TRIG_EULER_CASE(mat4f_from_euler_array_far, TRIG_FAR, 1)
+
+/*
+ * Thirteen points, so the bounding kernels go through
+ * the eight and four wide loops and a scalar tail.
+ */
+#define BOUNDS_POINTS   13
+
+static void bounds_ref_box(double* p, int count, double* box)
+{
+        int i;
+        int k;
+
+        for(k = 0; k < 3; k++) {
+                box[k] = p[k];
+                box[k + 3] = p[k];
+        }
+        for(i = 1; i < count; i++) {
+                for(k = 0; k < 3; k++) {
+                        box[k] = p[3 * i + k] < box[k] ? p[3 * i + k] : box[k];
+                        box[k + 3] = p[3 * i + k] > box[k + 3] ? p[3 * i + k] : box[k + 3];
+                }
+        }
+}
+
+static void run_aabb_from_array(float* in, float* out)
+{
+        aabb box;
+
+        aabb_from_array((vec3f*)in, &box, BOUNDS_POINTS);
+        memcpy(out, box.min.m, sizeof(vec3f));
+        memcpy(out + 3, box.max.m, sizeof(vec3f));
+}
+
+static int ref_aabb_from_array(float* in, double* out)
+{
+        int i;
+        double p[3 * BOUNDS_POINTS];
+
+        for(i = 0; i < 3 * BOUNDS_POINTS; i++) {
+                p[i] = in[i];
+        }
+        bounds_ref_box(p, BOUNDS_POINTS, out);
+        return 0;
+}
+
+static void run_aabb_from_soa(float* in, float* out)
+{
+        int i;
+        int k;
+        float s[3][BOUNDS_POINTS];
+        vec3f_soa src;
+        aabb box;
+
+        for(k = 0; k < 3; k++) {
+                for(i = 0; i < BOUNDS_POINTS; i++) {
+                        s[k][i] = in[3 * i + k];
+                }
+                src.m[k] = s[k];
+        }
+        aabb_from_soa(&src, &box, BOUNDS_POINTS);
+        memcpy(out, box.min.m, sizeof(vec3f));
+        memcpy(out + 3, box.max.m, sizeof(vec3f));
+}
+
+/* transformed points followed by their box */
+static void run_aabb_transform_array(float* in, float* out)
+{
+        aabb box;
+
+        aabb_transform_array((mat4f*)in, (vec3f*)(in + 16), (vec3f*)out, &box, BOUNDS_POINTS);
+        memcpy(out + 3 * BOUNDS_POINTS, box.min.m, sizeof(vec3f));
+        memcpy(out + 3 * BOUNDS_POINTS + 3, box.max.m, sizeof(vec3f));
+}
+
+static int ref_aabb_transform_array(float* in, double* out)
+{
+        int i;
+        int j;
+        float* p;
+
+        for(i = 0; i < BOUNDS_POINTS; i++) {
+                p = in + 16 + 3 * i;
+                for(j = 0; j < 3; j++) {
+                        out[3 * i + j] = (double)in[4 * j] * p[0] + (double)in[4 * j + 1] * p[1] +
+                                (double)in[4 * j + 2] * p[2] + in[4 * j + 3];
+                }
+        }
+        bounds_ref_box(out, BOUNDS_POINTS, out + 3 * BOUNDS_POINTS);
+        return 0;
+}
+
+static void run_sphere_from_array(float* in, float* out)
+{
+        sphere s;
+
+        sphere_from_array((vec3f*)in, &s, BOUNDS_POINTS);
+        memcpy(out, s.center.m, sizeof(vec3f));
+        out[3] = s.radius;
+}
+
+/*
+ * The same Ritter pass in double: the box's widest
+ * axis seeds the sphere, the points grow it in order,
+ * the box's own sphere wins if smaller, and the radius
+ * gets the library's rounding pad. With wide exponents
+ * the float growth steps move the center differently,
+ * which the adversarial max shows.
+ */
+static int ref_sphere_from_array(float* in, double* out)
+{
+        int i;
+        int k;
+        int w;
+        double p[3 * BOUNDS_POINTS];
+        double box[6];
+        double d[3];
+        double d2;
+        double r;
+        double dist;
+        double boxed;
+
+        for(i = 0; i < 3 * BOUNDS_POINTS; i++) {
+                p[i] = in[i];
+        }
+        bounds_ref_box(p, BOUNDS_POINTS, box);
+
+        w = 0;
+        boxed = 0.0;
+        for(k = 0; k < 3; k++) {
+                out[k] = 0.5 * (box[k] + box[k + 3]);
+                boxed += 0.25 * (box[k + 3] - box[k]) * (box[k + 3] - box[k]);
+                if(box[k + 3] - box[k] > box[w + 3] - box[w]) {
+                        w = k;
+                }
+        }
+        boxed = sqrt(boxed);
+        out[3] = 0.5 * (box[w + 3] - box[w]);
+
+        for(i = 0; i < BOUNDS_POINTS; i++) {
+                d2 = 0.0;
+                for(k = 0; k < 3; k++) {
+                        d[k] = p[3 * i + k] - out[k];
+                        d2 += d[k] * d[k];
+                }
+                if(d2 <= out[3] * out[3]) {
+                        continue;
+                }
+                dist = sqrt(d2);
+                r = 0.5 * (out[3] + dist);
+                for(k = 0; k < 3; k++) {
+                        out[k] += d[k] * ((r - out[3]) / dist);
+                }
+                out[3] = r;
+        }
+
+        if(!(out[3] < boxed)) {
+                for(k = 0; k < 3; k++) {
+                        out[k] = 0.5 * (box[k] + box[k + 3]);
+                }
+                out[3] = boxed;
+        }
+        r = out[3];
+        for(k = 0; k < 3; k++) {
+                r = dabs(out[k]) + out[3] > r ? dabs(out[k]) + out[3] : r;
+        }
+        out[3] += 4.0 * FLT_EPSILON * r;
+        return 0;
+}
+
+#define AFFINE_POINTS   13
+
+static void run_affine2f_transform_array(float* in, float* out)
+{
+        affine2f_transform_array((affine2f*)in, (vec2f*)(in + 6), (vec2f*)out, AFFINE_POINTS);
+}
+
+static int ref_affine2f_transform_array(float* in, double* out)
+{
+        int i;
+        int r;
+        float* p;
+
+        for(i = 0; i < AFFINE_POINTS; i++) {
+                p = in + 6 + 2 * i;
+                for(r = 0; r < 2; r++) {
+                        out[2 * i + r] = (double)in[3 * r] * p[0] + (double)in[3 * r + 1] * p[1] +
+                                in[3 * r + 2];
+                }
+        }
+        return 0;
+}
+
+/*
+ * Nine sprites (the eight wide loop and a tail) are
+ * expanded into vertices of four floats, x and y then
+ * two that must be left alone; a write to those turns
+ * the result into NaN. The input is the sprites, then
+ * the view and the corners when they are given.
+ */
+#define SPRITE_COUNT    9
+
+static void sprite_run(float* in, float* out, int defaults)
+{
+        int i;
+        float v[4 * SPRITE_COUNT][4];
+        affine2f* view;
+        vec2f* corners;
+
+        view = defaults ? NULL : (affine2f*)(in + 6 * SPRITE_COUNT);
+        corners = defaults ? NULL : (vec2f*)(in + 6 * SPRITE_COUNT + 6);
+        for(i = 0; i < 4 * SPRITE_COUNT; i++) {
+                v[i][0] = v[i][1] = v[i][2] = v[i][3] = 1234.5f;
+        }
+        sprite_expand_array(view, (affine2f*)in, corners, v, sizeof(v[0]), SPRITE_COUNT);
+        for(i = 0; i < 4 * SPRITE_COUNT; i++) {
+                out[2 * i] = v[i][0];
+                out[2 * i + 1] = v[i][1];
+                if(v[i][2] != 1234.5f || v[i][3] != 1234.5f) {
+                        out[2 * i] = NAN;
+                }
+        }
+}
+
+static int sprite_ref(float* in, double* out, int defaults)
+{
+        int i;
+        int k;
+        int r;
+        double c[8];
+        double s[2];
+        float* m;
+        float* view;
+        static const double unit[8] = { -0.5, -0.5, 0.5, -0.5, 0.5, 0.5, -0.5, 0.5 };
+
+        view = in + 6 * SPRITE_COUNT;
+        for(k = 0; k < 8; k++) {
+                c[k] = defaults ? unit[k] : in[6 * SPRITE_COUNT + 6 + k];
+        }
+        for(i = 0; i < SPRITE_COUNT; i++) {
+                m = in + 6 * i;
+                for(k = 0; k < 4; k++) {
+                        for(r = 0; r < 2; r++) {
+                                s[r] = m[3 * r] * c[2 * k] + m[3 * r + 1] * c[2 * k + 1] + m[3 * r + 2];
+                        }
+                        for(r = 0; r < 2; r++) {
+                                out[8 * i + 2 * k + r] = defaults ? s[r] :
+                                        view[3 * r] * s[0] + view[3 * r + 1] * s[1] + view[3 * r + 2];
+                        }
+                }
+        }
+        return 0;
+}
+
+static void run_sprite_expand_array(float* in, float* out)
+{
+        sprite_run(in, out, 0);
+}
+
+static int ref_sprite_expand_array(float* in, double* out)
+{
+        return sprite_ref(in, out, 0);
+}
+
+/* identity view and the unit quad */
+static void run_sprite_expand_array_defaults(float* in, float* out)
+{
+        sprite_run(in, out, 1);
+}
+
+static int ref_sprite_expand_array_defaults(float* in, double* out)
+{
+        return sprite_ref(in, out, 1);
+}
+
+/*
+ * One body replicated across eight lanes: position,
+ * velocity, acceleration, orientation, angular velocity
+ * and angular acceleration, then gravity and dt. The
+ * output is the stepped state and the top three rows
+ * of the world matrix.
+ */
+#define RIGID_LANES     8
+
+static void rigid_run(float* in, float* out, int accel)
+{
+        int i;
+        int k;
+        float s[19][RIGID_LANES];
+        mat4f world[RIGID_LANES];
+        rigid_bodies b;
+
+        for(k = 0; k < 19; k++) {
+                for(i = 0; i < RIGID_LANES; i++) {
+                        s[k][i] = in[k];
+                }
+        }
+        b.count = RIGID_LANES;
+        for(k = 0; k < 3; k++) {
+                b.position.m[k] = s[k];
+                b.velocity.m[k] = s[3 + k];
+                b.accel.m[k] = accel ? s[6 + k] : NULL;
+                b.angular.m[k] = s[13 + k];
+                b.angular_accel.m[k] = accel ? s[16 + k] : NULL;
+        }
+        for(k = 0; k < 4; k++) {
+                b.orientation.m[k] = s[9 + k];
+        }
+        rigid_integrate(&b, (vec3f*)(in + 19), in[22], world);
+
+        for(k = 0; k < 3; k++) {
+                out[k] = s[k][5];
+                out[3 + k] = s[3 + k][5];
+                out[10 + k] = s[13 + k][5];
+        }
+        for(k = 0; k < 4; k++) {
+                out[6 + k] = s[9 + k][5];
+        }
+        memcpy(out + 13, world[5].m, 12 * sizeof(float));
+}
+
+static int rigid_ref(float* in, double* out, int accel)
+{
+        int k;
+        double dt;
+        double h;
+        double l;
+        double q[4];
+        double w[3];
+        double* p;
+
+        dt = in[22];
+        h = 0.5 * dt;
+        for(k = 0; k < 3; k++) {
+                out[3 + k] = in[3 + k] + ((double)in[19 + k] + (accel ? in[6 + k] : 0.0)) * dt;
+                out[k] = in[k] + out[3 + k] * dt;
+                w[k] = in[13 + k] + (accel ? in[16 + k] : 0.0) * dt;
+                out[10 + k] = w[k];
+        }
+        q[0] = in[9] + h * (in[12] * w[0] + w[1] * in[11] - w[2] * in[10]);
+        q[1] = in[10] + h * (in[12] * w[1] + w[2] * in[9] - w[0] * in[11]);
+        q[2] = in[11] + h * (in[12] * w[2] + w[0] * in[10] - w[1] * in[9]);
+        q[3] = in[12] - h * (w[0] * in[9] + w[1] * in[10] + w[2] * in[11]);
+        l = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        if(l == 0.0) {
+                return 1;
+        }
+        for(k = 0; k < 4; k++) {
+                q[k] /= l;
+                out[6 + k] = q[k];
+        }
+
+        p = out + 13;
+        p[0] = 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]);
+        p[1] = 2.0 * (q[0] * q[1] - q[3] * q[2]);
+        p[2] = 2.0 * (q[0] * q[2] + q[3] * q[1]);
+        p[3] = out[0];
+        p[4] = 2.0 * (q[0] * q[1] + q[3] * q[2]);
+        p[5] = 1.0 - 2.0 * (q[0] * q[0] + q[2] * q[2]);
+        p[6] = 2.0 * (q[1] * q[2] - q[3] * q[0]);
+        p[7] = out[1];
+        p[8] = 2.0 * (q[0] * q[2] - q[3] * q[1]);
+        p[9] = 2.0 * (q[1] * q[2] + q[3] * q[0]);
+        p[10] = 1.0 - 2.0 * (q[0] * q[0] + q[1] * q[1]);
+        p[11] = out[2];
+        return 0;
+}
+
+static void run_rigid_integrate(float* in, float* out)
+{
+        rigid_run(in, out, 1);
+}
+
+static int ref_rigid_integrate(float* in, double* out)
+{
+        return rigid_ref(in, out, 1);
+}
+
+/* accel and angular_accel left out */
+static void run_rigid_integrate_gravity(float* in, float* out)
+{
+        rigid_run(in, out, 0);
+}
+
+static int ref_rigid_integrate_gravity(float* in, double* out)
+{
+        return rigid_ref(in, out, 0);
+}
+
+/*
+ * The batch solves run nine systems, so the eight and
+ * four wide paths and the tail are all used. Lanes 3
+ * and 7 hold 2 * I, which must solve, and the rest the
+ * sample; the output is lane 5's x when its singular
+ * flag is clear, so the flags of every level show up
+ * in the singular, untouched and mismatch columns. A
+ * count that disagrees with the flags, a flagged
+ * diagonal lane or a flagged system whose x is not zero
+ * turns the output into NaN.
+ */
+#define SOLVE_LANES     9
+
+/*
+ * M^T * M + I of the sample, so that the SPD rows get
+ * positive definite input that is well conditioned in
+ * the random set; wide adversarial samples still swamp
+ * the identity and exercise the flags.
+ */
+static void solve_spd_input(float* in, int n, float* a)
+{
+        int i;
+        int j;
+        int k;
+        double s;
+
+        for(i = 0; i < n; i++) {
+                for(j = 0; j < n; j++) {
+                        s = i == j ? 1.0 : 0.0;
+                        for(k = 0; k < n; k++) {
+                                s += (double)in[k * n + i] * in[k * n + j];
+                        }
+                        a[i * n + j] = (float)s;
+                }
+        }
+}
+
+static void solve_run(float* in, float* out, int n, int spd)
+{
+        int i;
+        int k;
+        size_t bad;
+        size_t flagged;
+        float a[16];
+        float m[SOLVE_LANES][16];
+        float b[SOLVE_LANES][4];
+        float x[SOLVE_LANES][4];
+        unsigned char singular[SOLVE_LANES];
+
+        if(spd) {
+                solve_spd_input(in, n, a);
+        } else {
+                memcpy(a, in, n * n * sizeof(float));
+        }
+        for(i = 0; i < SOLVE_LANES; i++) {
+                for(k = 0; k < n * n; k++) {
+                        m[i][k] = i % 4 != 3 ? a[k] : k % (n + 1) == 0 ? 2.0f : 0.0f;
+                }
+                memcpy(b[i], in + n * n, n * sizeof(float));
+        }
+
+        /* the n x n and n-vector arrays are packed, so pack the lanes */
+        for(i = 1; i < SOLVE_LANES; i++) {
+                memmove((float*)m + i * n * n, m[i], n * n * sizeof(float));
+                memmove((float*)b + i * n, b[i], n * sizeof(float));
+        }
+        switch(n) {
+        case 2:
+                bad = spd ? mat2f_solve_spd_array((mat2f*)m, (vec2f*)b, (vec2f*)x, singular, SOLVE_LANES) :
+                        mat2f_solve_array((mat2f*)m, (vec2f*)b, (vec2f*)x, singular, SOLVE_LANES);
+                break;
+        case 3:
+                bad = spd ? mat3f_solve_spd_array((mat3f*)m, (vec3f*)b, (vec3f*)x, singular, SOLVE_LANES) :
+                        mat3f_solve_array((mat3f*)m, (vec3f*)b, (vec3f*)x, singular, SOLVE_LANES);
+                break;
+        default:
+                bad = spd ? mat4f_solve_spd_array((mat4f*)m, (vec4f*)b, (vec4f*)x, singular, SOLVE_LANES) :
+                        mat4f_solve_array((mat4f*)m, (vec4f*)b, (vec4f*)x, singular, SOLVE_LANES);
+                break;
+        }
+
+        flagged = 0;
+        for(i = 0; i < SOLVE_LANES; i++) {
+                flagged += singular[i] != 0;
+                for(k = 0; k < n && singular[i]; k++) {
+                        if(((float*)x)[i * n + k] != 0.0f) {
+                                out[0] = NAN;
+                                return;
+                        }
+                }
+        }
+        if(bad != flagged || singular[3] || singular[7]) {
+                out[0] = NAN;
+                return;
+        }
+        if(!singular[5]) {
+                memcpy(out, (float*)x + 5 * n, n * sizeof(float));
+        }
+}
+
+/* Gaussian elimination with partial pivoting in double */
+static int solve_ref(float* in, double* out, int n, int spd)
+{
+        int i;
+        int j;
+        int k;
+        int p;
+        double t;
+        double m[4][5];
+        float a[16];
+
+        if(spd) {
+                solve_spd_input(in, n, a);
+        } else {
+                memcpy(a, in, n * n * sizeof(float));
+        }
+        for(i = 0; i < n; i++) {
+                for(j = 0; j < n; j++) {
+                        m[i][j] = a[i * n + j];
+                }
+                m[i][n] = in[n * n + i];
+        }
+        for(k = 0; k < n; k++) {
+                p = k;
+                for(i = k + 1; i < n; i++) {
+                        if(dabs(m[i][k]) > dabs(m[p][k])) {
+                                p = i;
+                        }
+                }
+                if(m[p][k] == 0.0) {
+                        return 1;
+                }
+                for(j = 0; j <= n; j++) {
+                        t = m[k][j];
+                        m[k][j] = m[p][j];
+                        m[p][j] = t;
+                }
+                for(i = k + 1; i < n; i++) {
+                        t = m[i][k] / m[k][k];
+                        for(j = k; j <= n; j++) {
+                                m[i][j] -= t * m[k][j];
+                        }
+                }
+        }
+        for(i = n - 1; i >= 0; i--) {
+                out[i] = m[i][n];
+                for(j = i + 1; j < n; j++) {
+                        out[i] -= m[i][j] * out[j];
+                }
+                out[i] /= m[i][i];
+        }
+        return 0;
+}
+
+#define SOLVE_CASES(N) \
+static void run_mat##N##f_solve_array(float* in, float* out) \
+{ solve_run(in, out, N, 0); } \
+static int ref_mat##N##f_solve_array(float* in, double* out) \
+{ return solve_ref(in, out, N, 0); } \
+static void run_mat##N##f_solve_spd_array(float* in, float* out) \
+{ solve_run(in, out, N, 1); } \
+static int ref_mat##N##f_solve_spd_array(float* in, double* out) \
+{ return solve_ref(in, out, N, 1); }
+
+SOLVE_CASES(2)
+SOLVE_CASES(3)
+SOLVE_CASES(4)
+
+/*
+ * GEMM on 5 x 7 times 7 x 17, so both the MR and NR
+ * tiles have a tail. The input is op(A) and op(B) row
+ * major, then C. Every view has GEMM_PAD extra columns:
+ * NaN in A and B, which must not be read, and a
+ * sentinel in C, which must not be written (a write
+ * turns the row into NaN). With beta zero C starts as
+ * NaN, since it must not be read either.
+ */
+#define GEMM_M          5
+#define GEMM_N          17
+#define GEMM_K          7
+#define GEMM_PAD        3
+#define GEMM_STORE      ((GEMM_N + GEMM_PAD) * GEMM_N)
+#define GEMM_IN(K)      (GEMM_M * (K) + (K) * GEMM_N + GEMM_M * GEMM_N)
+
+static void gemm_run(float* in, float* out, int ta, int tb, int k, float alpha, float beta)
+{
+        int i;
+        int j;
+        int p;
+        int lda;
+        int ldb;
+        float sa[GEMM_STORE];
+        float sb[GEMM_STORE];
+        float sc[GEMM_STORE];
+        float* c;
+        matf a;
+        matf b;
+        matf dest;
+
+        for(i = 0; i < GEMM_STORE; i++) {
+                sa[i] = NAN;
+                sb[i] = NAN;
+                sc[i] = 1234.5f;
+        }
+        lda = (ta ? GEMM_M : k) + GEMM_PAD;
+        ldb = (tb ? k : GEMM_N) + GEMM_PAD;
+        c = in + GEMM_M * k + k * GEMM_N;
+        for(i = 0; i < GEMM_M; i++) {
+                for(p = 0; p < k; p++) {
+                        sa[ta ? p * lda + i : i * lda + p] = in[i * k + p];
+                }
+        }
+        for(p = 0; p < k; p++) {
+                for(j = 0; j < GEMM_N; j++) {
+                        sb[tb ? j * ldb + p : p * ldb + j] = in[GEMM_M * k + p * GEMM_N + j];
+                }
+        }
+        for(i = 0; i < GEMM_M; i++) {
+                for(j = 0; j < GEMM_N; j++) {
+                        sc[i * (GEMM_N + GEMM_PAD) + j] = beta == 0.0f ? NAN : c[i * GEMM_N + j];
+                }
+        }
+
+        matf_view(&a, sa, ta ? k : GEMM_M, ta ? GEMM_M : k, lda);
+        matf_view(&b, sb, tb ? GEMM_N : k, tb ? k : GEMM_N, ldb);
+        matf_view(&dest, sc, GEMM_M, GEMM_N, GEMM_N + GEMM_PAD);
+        if(matf_gemm(ta, tb, alpha, &a, &b, beta, &dest) != 0) {
+                return;
+        }
+
+        for(i = 0; i < GEMM_M; i++) {
+                for(j = 0; j < GEMM_N; j++) {
+                        out[i * GEMM_N + j] = sc[i * (GEMM_N + GEMM_PAD) + j];
+                }
+                for(j = GEMM_N; j < GEMM_N + GEMM_PAD; j++) {
+                        if(sc[i * (GEMM_N + GEMM_PAD) + j] != 1234.5f) {
+                                out[i * GEMM_N] = NAN;
+                        }
+                }
+        }
+}
+
+static int gemm_ref(float* in, double* out, int k, double alpha, double beta)
+{
+        int i;
+        int j;
+        int p;
+        double s;
+        float* c;
+
+        c = in + GEMM_M * k + k * GEMM_N;
+        for(i = 0; i < GEMM_M; i++) {
+                for(j = 0; j < GEMM_N; j++) {
+                        s = 0.0;
+                        for(p = 0; p < k; p++) {
+                                s += (double)in[i * k + p] * in[GEMM_M * k + p * GEMM_N + j];
+                        }
+                        out[i * GEMM_N + j] = alpha * s + (beta != 0.0 ? beta * c[i * GEMM_N + j] : 0.0);
+                }
+        }
+        return 0;
+}
+
+#define GEMM_CASE(NAME, TA, TB, K, ALPHA, BETA) \
+static void run_##NAME(float* in, float* out) \
+{ gemm_run(in, out, TA, TB, K, ALPHA, BETA); } \
+static int ref_##NAME(float* in, double* out) \
+{ return gemm_ref(in, out, K, ALPHA, BETA); }
+
+GEMM_CASE(gemm_nn, CGMATH_NO_TRANS, CGMATH_NO_TRANS, GEMM_K, -0.75f, 0.5f)
+GEMM_CASE(gemm_nt, CGMATH_NO_TRANS, CGMATH_TRANS, GEMM_K, -0.75f, 0.5f)
+GEMM_CASE(gemm_tn, CGMATH_TRANS, CGMATH_NO_TRANS, GEMM_K, -0.75f, 0.5f)
+GEMM_CASE(gemm_tt, CGMATH_TRANS, CGMATH_TRANS, GEMM_K, -0.75f, 0.5f)
+GEMM_CASE(gemm_nn_beta0, CGMATH_NO_TRANS, CGMATH_NO_TRANS, GEMM_K, 1.0f, 0.0f)
+GEMM_CASE(gemm_tt_beta0, CGMATH_TRANS, CGMATH_TRANS, GEMM_K, 1.0f, 0.0f)
+GEMM_CASE(gemm_nn_beta1, CGMATH_NO_TRANS, CGMATH_NO_TRANS, GEMM_K, 2.0f, 1.0f)
+GEMM_CASE(gemm_k0, CGMATH_NO_TRANS, CGMATH_NO_TRANS, 0, 1.0f, -0.75f)
+GEMM_CASE(gemm_k0_beta0, CGMATH_TRANS, CGMATH_TRANS, 0, 1.0f, 0.0f)
+
+/*
+ * GEMV on a padded 13 x 11 matrix, odd in both
+ * directions for the row and column kernels. The input
+ * is A, then x, then y, both sized for the larger
+ * dimension.
+ */
+#define GEMV_M          13
+#define GEMV_N          11
+#define GEMV_PAD        3
+#define GEMV_IN         (GEMV_M * GEMV_N + 2 * GEMV_M)
+
+static void gemv_run(float* in, float* out, int trans, float alpha, float beta)
+{
+        int i;
+        int j;
+        int len;
+        float sa[GEMV_M * (GEMV_N + GEMV_PAD)];
+        float y[GEMV_M + GEMV_PAD];
+        matf a;
+
+        for(i = 0; i < GEMV_M; i++) {
+                for(j = 0; j < GEMV_N + GEMV_PAD; j++) {
+                        sa[i * (GEMV_N + GEMV_PAD) + j] = j < GEMV_N ? in[i * GEMV_N + j] : NAN;
+                }
+        }
+        len = trans ? GEMV_N : GEMV_M;
+        for(i = 0; i < GEMV_M + GEMV_PAD; i++) {
+                y[i] = i >= len ? 1234.5f : beta == 0.0f ? NAN : in[GEMV_M * GEMV_N + GEMV_M + i];
+        }
+
+        matf_view(&a, sa, GEMV_M, GEMV_N, GEMV_N + GEMV_PAD);
+        if(matf_gemv(trans, alpha, &a, in + GEMV_M * GEMV_N, trans ? GEMV_M : GEMV_N, beta, y, len) != 0) {
+                return;
+        }
+
+        memcpy(out, y, len * sizeof(float));
+        for(i = len; i < GEMV_M + GEMV_PAD; i++) {
+                if(y[i] != 1234.5f) {
+                        out[0] = NAN;
+                }
+        }
+}
+
+static int gemv_ref(float* in, double* out, int trans, double alpha, double beta)
+{
+        int i;
+        int j;
+        int len;
+        float* x;
+        float* y;
+
+        x = in + GEMV_M * GEMV_N;
+        y = x + GEMV_M;
+        len = trans ? GEMV_N : GEMV_M;
+        for(i = 0; i < len; i++) {
+                out[i] = 0.0;
+                for(j = 0; j < (trans ? GEMV_M : GEMV_N); j++) {
+                        out[i] += trans ? (double)in[j * GEMV_N + i] * x[j] : (double)in[i * GEMV_N + j] * x[j];
+                }
+                out[i] = alpha * out[i] + (beta != 0.0 ? beta * y[i] : 0.0);
+        }
+        return 0;
+}
+
+#define GEMV_CASE(NAME, TRANS, ALPHA, BETA) \
+static void run_##NAME(float* in, float* out) \
+{ gemv_run(in, out, TRANS, ALPHA, BETA); } \
+static int ref_##NAME(float* in, double* out) \
+{ return gemv_ref(in, out, TRANS, ALPHA, BETA); }
+
+GEMV_CASE(gemv_n, CGMATH_NO_TRANS, -0.75f, 0.5f)
+GEMV_CASE(gemv_t, CGMATH_TRANS, -0.75f, 0.5f)
+GEMV_CASE(gemv_n_beta0, CGMATH_NO_TRANS, 1.0f, 0.0f)
+GEMV_CASE(gemv_t_beta0, CGMATH_TRANS, 1.0f, 0.0f)
+GEMV_CASE(gemv_t_beta1, CGMATH_TRANS, 2.0f, 1.0f)
+
+/*
+ * The lossy encoders are measured on a round trip of
+ * eight distinct unit inputs, so both SIMD widths and
+ * every dropped-component case are exercised. Errors
+ * are absolute (components) or in degrees.
+ */
+#define QUANT_LANES     8
+
+static int quant_unit(float* in, int n, float* dest)
+{
+        int i;
+        int j;
+        double l;
+
+        for(i = 0; i < QUANT_LANES; i++) {
+                l = 0.0;
+                for(j = 0; j < n; j++) {
+                        l += (double)in[n * i + j] * in[n * i + j];
+                }
+                if(l == 0.0) {
+                        return 1;
+                }
+                for(j = 0; j < n; j++) {
+                        dest[n * i + j] = (float)(in[n * i + j] / sqrt(l));
+                }
+        }
+        return 0;
+}
+
+/* the angle between a and b in degrees, stable near zero */
+static double quant_angle(float* a, float* b, int n)
+{
+        int j;
+        double la;
+        double lb;
+        double d;
+        double s;
+
+        la = 0.0;
+        lb = 0.0;
+        for(j = 0; j < n; j++) {
+                la += (double)a[j] * a[j];
+                lb += (double)b[j] * b[j];
+        }
+        la = sqrt(la);
+        lb = sqrt(lb);
+
+        d = 0.0;
+        s = 0.0;
+        for(j = 0; j < n; j++) {
+                d += (a[j] / la - b[j] / lb) * (a[j] / la - b[j] / lb);
+                s += (a[j] / la + b[j] / lb) * (a[j] / la + b[j] / lb);
+        }
+        return 2.0 * atan2(sqrt(d), sqrt(s)) * (180.0 / M_PI);
+}
+
+/* decoded quaternions are flipped onto the input's side */
+static int quant_quat_trip(float* in, int bits, float* unit, float* dest)
+{
+        int i;
+        int j;
+        double d;
+        quat q[QUANT_LANES];
+        quat r[QUANT_LANES];
+        uint32_t c32[QUANT_LANES];
+        quat48 c48[QUANT_LANES];
+
+        if(quant_unit(in, 4, q[0].m)) {
+                return 1;
+        }
+        if(bits == 32) {
+                quat_encode32_array(q, c32, QUANT_LANES);
+                quat_decode32_array(c32, r, QUANT_LANES);
+        } else {
+                quat_encode48_array(q, c48, QUANT_LANES);
+                quat_decode48_array(c48, r, QUANT_LANES);
+        }
+        for(i = 0; i < QUANT_LANES; i++) {
+                d = 0.0;
+                for(j = 0; j < 4; j++) {
+                        d += (double)q[i].m[j] * r[i].m[j];
+                }
+                for(j = 0; j < 4; j++) {
+                        unit[4 * i + j] = q[i].m[j];
+                        dest[4 * i + j] = d < 0.0 ? -r[i].m[j] : r[i].m[j];
+                }
+        }
+        return 0;
+}
+
+static int quant_oct_trip(float* in, int bits, float* unit, float* dest)
+{
+        vec3f v[QUANT_LANES];
+        vec3f r[QUANT_LANES];
+        uint16_t c16[QUANT_LANES];
+        uint32_t c32[QUANT_LANES];
+
+        if(quant_unit(in, 3, v[0].m)) {
+                return 1;
+        }
+        if(bits == 16) {
+                vec3f_encode_oct16_array(v, c16, QUANT_LANES);
+                vec3f_decode_oct16_array(c16, r, QUANT_LANES);
+        } else {
+                vec3f_encode_oct32_array(v, c32, QUANT_LANES);
+                vec3f_decode_oct32_array(c32, r, QUANT_LANES);
+        }
+        memcpy(unit, v, sizeof(v));
+        memcpy(dest, r, sizeof(r));
+        return 0;
+}
+
+#define QUANT_CASES(NAME, TRIP, BITS, N) \
+static void run_##NAME(float* in, float* out) \
+{ float u[N * QUANT_LANES]; TRIP(in, BITS, u, out); } \
+static void run_##NAME##_deg(float* in, float* out) \
+{ int i; float u[N * QUANT_LANES]; float r[N * QUANT_LANES]; \
+  if(TRIP(in, BITS, u, r)) return; \
+  for(i = 0; i < QUANT_LANES; i++) out[i] = (N == 4 ? 2.0 : 1.0) * quant_angle(u + N * i, r + N * i, N); }
+
+QUANT_CASES(quat_encode32_array, quant_quat_trip, 32, 4)
+QUANT_CASES(quat_encode48_array, quant_quat_trip, 48, 4)
+QUANT_CASES(vec3f_encode_oct16_array, quant_oct_trip, 16, 3)
+QUANT_CASES(vec3f_encode_oct32_array, quant_oct_trip, 32, 3)
+
+/* the angle rows are compared against zero */
+#define QUANT_REF(N) \
+static int ref_quant_unit##N(float* in, double* out) \
+{ int i; float u[N * QUANT_LANES]; if(quant_unit(in, N, u)) return 1; \
+  for(i = 0; i < N * QUANT_LANES; i++) { out[i] = u[i]; } return 0; } \
+static int ref_quant_deg##N(float* in, double* out) \
+{ int i; float u[N * QUANT_LANES]; if(quant_unit(in, N, u)) return 1; \
+  for(i = 0; i < QUANT_LANES; i++) { out[i] = 0.0; } return 0; }
+
+QUANT_REF(3)
+QUANT_REF(4)
+
+/**
+ * Spreads a sample over the half range, from values
+ * that round to zero through subnormals to 2^15, with
+ * its low mantissa bits picking the exponent.
+ */
+static float half_input(float x)
+{
+        int e;
+        unsigned int b;
+
+        memcpy(&b, &x, sizeof(b));
+        return ldexpf(frexpf(x, &e), (int)(b % 41) - 25);
+}
+
+/* exactly rounded to half, ties to even */
+static double half_round(double d)
+{
+        int e;
+        double q;
+
+        frexp(d, &e);
+        q = ldexp(1.0, e - 11 < -24 ? -24 : e - 11);
+        return nearbyint(d / q) * q;
+}
+
+#define HALF_CASES(N) \
+static void run_vec##N##f_to_half_array(float* in, float* out) \
+{ int i; vec##N##f v[QUANT_LANES]; vec##N##h h[QUANT_LANES]; \
+  for(i = 0; i < N * QUANT_LANES; i++) v[i / N].m[i % N] = half_input(in[i]); \
+  vec##N##f_to_half_array(v, h, QUANT_LANES); \
+  vec##N##f_from_half_array(h, (vec##N##f*)out, QUANT_LANES); } \
+static int ref_vec##N##f_to_half_array(float* in, double* out) \
+{ int i; for(i = 0; i < N * QUANT_LANES; i++) out[i] = half_round(half_input(in[i])); return 0; }
+
+HALF_CASES(3)
+HALF_CASES(4)
+
+static void run_invsqrt(float* in, float* out)
+{
+        out[0] = _cgmath_invsqrt(dabs(in[0]));
+}
+
+static int ref_invsqrt(float* in, double* out)
+{
+        if(in[0] == 0.0f) {
+                return 1;
+        }
+        out[0] = 1.0 / sqrt(dabs(in[0]));
+        return 0;
+}
+
+#define VEC_ENTRIES(N) \
+        { "vec" #N "f_add", 2 * N, N, run_vec##N##f_add, ref_vec##N##f_add }, \
+        { "vec" #N "f_scale", N + 1, N, run_vec##N##f_scale, ref_vec##N##f_scale }, \
+        { "vec" #N "f_scalar_prod", 2 * N, 1, run_vec##N##f_scalar_prod, ref_vec##N##f_scalar_prod }, \
+        { "vec" #N "f_sqr_mag", N, 1, run_vec##N##f_sqr_mag, ref_vec##N##f_sqr_mag }, \
+        { "vec" #N "f_normalize", N, N, run_vec##N##f_normalize, ref_vec##N##f_normalize },
+
+#define MAT_ENTRIES(N) \
+        { "mat" #N "f_add", 2 * N * N, N * N, run_mat##N##f_add, ref_mat##N##f_add }, \
+        { "mat" #N "f_scale", N * N + 1, N * N, run_mat##N##f_scale, ref_mat##N##f_scale }, \
+        { "mat" #N "f_multiply", 2 * N * N, N * N, run_mat##N##f_multiply, ref_mat##N##f_multiply }, \
+        { "mat" #N "f_determinant", N * N, 1, run_mat##N##f_determinant, ref_mat##N##f_determinant }, \
+        { "mat" #N "f_transpose", N * N, N * N, run_mat##N##f_transpose, ref_mat##N##f_transpose }, \
+        { "mat" #N "f_inverse", N * N, N * N, run_mat##N##f_inverse, ref_mat##N##f_inverse },
+
+/**
+ * New entry points, SIMD variants included, only need
+ * a run/ref pair and a line here to be covered.
+ */
+static ulp_case cases[] = {
+        { "_cgmath_invsqrt", 1, 1, run_invsqrt, ref_invsqrt },
+        VEC_ENTRIES(2)
+        VEC_ENTRIES(3)
+        VEC_ENTRIES(4)
+        { "vec3f_vector_prod", 6, 3, run_vec3f_vector_prod, ref_vec3f_vector_prod },
+        MAT_ENTRIES(2)
+        MAT_ENTRIES(3)
+        MAT_ENTRIES(4)
+        { "mat3f_inverse_array", 9, 9, run_mat3f_inverse_array, ref_mat3f_inverse_array },
+        { "mat3f_inverse_sym_soa", 9, 9, run_mat3f_inverse_sym_soa, ref_mat3f_inverse_sym_soa },
+        { "mat3f_eigen_sym_array", 9, 3, run_mat3f_eigen_sym_array, ref_mat3f_eigen_sym_array },
+        { "vec3f_covariance_array", 3 * COV_POINTS, 9,
+                run_vec3f_covariance_array, ref_vec3f_covariance_array },
+        { "mat4f_inverse_array", 16, 16, run_mat4f_inverse_array, ref_mat4f_inverse_array },
+        { "mat4f_transform_point_array", 16 + 3 * XFORM_POINTS, 3 * XFORM_POINTS,
+                run_mat4f_transform_point_array, ref_mat4f_transform_point_array },
+        { "mat4f_transform_normal_array", 16 + 3 * XFORM_POINTS, 3 * XFORM_POINTS,
+                run_mat4f_transform_normal_array, ref_mat4f_transform_normal_array },
+        { "vec3f_normalize_array", 3 * XFORM_POINTS, 3 * XFORM_POINTS,
+                run_vec3f_normalize_array, ref_vec3f_normalize_array },
+        { "cgmath_sincos_array", TRIG_LANES, 2 * TRIG_LANES,
+                run_cgmath_sincos_array, ref_cgmath_sincos_array },
+        { "cgmath_atan2_array", 2 * TRIG_LANES, TRIG_LANES,
+                run_cgmath_atan2_array, ref_cgmath_atan2_array },
+        { "cgmath_acos_array", TRIG_LANES, TRIG_LANES, run_cgmath_acos_array, ref_cgmath_acos_array },
+        { "mat3f_rotation_axis_angle", 4, 9, run_mat3f_rotation_axis_angle, ref_mat3f_rotation_axis_angle },
+        { "quat_from_euler_array", 3 * EULER_COUNT, 4 * EULER_COUNT,
+                run_quat_from_euler_array, ref_quat_from_euler_array },
+        { "mat2f_rotation_array", TRIG_LANES, 4 * TRIG_LANES,
+                run_mat2f_rotation_array, ref_mat2f_rotation_array },
+        { "mat2f_rotation_array far", TRIG_LANES, 4 * TRIG_LANES,
+                run_mat2f_rotation_array_far, ref_mat2f_rotation_array_far },
+        { "mat3f_rotation_axis_angle_array", 4 * TRIG_LANES, 9 * TRIG_LANES,
+                run_mat3f_rotation_axis_angle_array, ref_mat3f_rotation_axis_angle_array },
+        { "mat3f_rotation_axis_angle_array far", 4 * TRIG_LANES, 9 * TRIG_LANES,
+                run_mat3f_rotation_axis_angle_array_far, ref_mat3f_rotation_axis_angle_array_far },
+        { "mat3f_from_euler_array", 3 * TRIG_LANES, 9 * TRIG_LANES,
+                run_mat3f_from_euler_array, ref_mat3f_from_euler_array },
+        { "mat3f_from_euler_array far", 3 * TRIG_LANES, 9 * TRIG_LANES,
+                run_mat3f_from_euler_array_far, ref_mat3f_from_euler_array_far },
+        { "mat4f_from_euler_array", 3 * TRIG_LANES, 16 * TRIG_LANES,
+                run_mat4f_from_euler_array, ref_mat4f_from_euler_array },
+        { "mat4f_from_euler_array far", 3 * TRIG_LANES, 16 * TRIG_LANES,
+                run_mat4f_from_euler_array_far, ref_mat4f_from_euler_array_far },
+        { "aabb_from_array", 3 * BOUNDS_POINTS, 6, run_aabb_from_array, ref_aabb_from_array },
+        { "aabb_from_soa", 3 * BOUNDS_POINTS, 6, run_aabb_from_soa, ref_aabb_from_array },
+        { "aabb_transform_array", 16 + 3 * BOUNDS_POINTS, 3 * BOUNDS_POINTS + 6,
+                run_aabb_transform_array, ref_aabb_transform_array },
+        { "sphere_from_array", 3 * BOUNDS_POINTS, 4, run_sphere_from_array, ref_sphere_from_array },
+        { "affine2f_transform_array", 6 + 2 * AFFINE_POINTS, 2 * AFFINE_POINTS,
+                run_affine2f_transform_array, ref_affine2f_transform_array },
+        { "sprite_expand_array", 6 * SPRITE_COUNT + 14, 8 * SPRITE_COUNT,
+                run_sprite_expand_array, ref_sprite_expand_array },
+        { "sprite_expand_array defaults", 6 * SPRITE_COUNT, 8 * SPRITE_COUNT,
+                run_sprite_expand_array_defaults, ref_sprite_expand_array_defaults },
+        { "rigid_integrate", 23, 25, run_rigid_integrate, ref_rigid_integrate },
+        { "rigid_integrate gravity only", 23, 25,
+                run_rigid_integrate_gravity, ref_rigid_integrate_gravity },
+        { "mat2f_solve_array", 6, 2, run_mat2f_solve_array, ref_mat2f_solve_array },
+        { "mat2f_solve_spd_array", 6, 2, run_mat2f_solve_spd_array, ref_mat2f_solve_spd_array },
+        { "mat3f_solve_array", 12, 3, run_mat3f_solve_array, ref_mat3f_solve_array },
+        { "mat3f_solve_spd_array", 12, 3, run_mat3f_solve_spd_array, ref_mat3f_solve_spd_array },
+        { "mat4f_solve_array", 20, 4, run_mat4f_solve_array, ref_mat4f_solve_array },
+        { "mat4f_solve_spd_array", 20, 4, run_mat4f_solve_spd_array, ref_mat4f_solve_spd_array },
+        { "matf_gemm nn", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_nn, ref_gemm_nn },
+        { "matf_gemm nt", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_nt, ref_gemm_nt },
+        { "matf_gemm tn", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_tn, ref_gemm_tn },
+        { "matf_gemm tt", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_tt, ref_gemm_tt },
+        { "matf_gemm nn beta 0", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_nn_beta0, ref_gemm_nn_beta0 },
+        { "matf_gemm tt beta 0", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_tt_beta0, ref_gemm_tt_beta0 },
+        { "matf_gemm nn beta 1", GEMM_IN(GEMM_K), GEMM_M * GEMM_N, run_gemm_nn_beta1, ref_gemm_nn_beta1 },
+        { "matf_gemm k 0", GEMM_IN(0), GEMM_M * GEMM_N, run_gemm_k0, ref_gemm_k0 },
+        { "matf_gemm k 0 beta 0", GEMM_IN(0), GEMM_M * GEMM_N, run_gemm_k0_beta0, ref_gemm_k0_beta0 },
+        { "matf_gemv n", GEMV_IN, GEMV_M, run_gemv_n, ref_gemv_n },
+        { "matf_gemv t", GEMV_IN, GEMV_N, run_gemv_t, ref_gemv_t },
+        { "matf_gemv n beta 0", GEMV_IN, GEMV_M, run_gemv_n_beta0, ref_gemv_n_beta0 },
+        { "matf_gemv t beta 0", GEMV_IN, GEMV_N, run_gemv_t_beta0, ref_gemv_t_beta0 },
+        { "matf_gemv t beta 1", GEMV_IN, GEMV_N, run_gemv_t_beta1, ref_gemv_t_beta1 },
+        { "quat_encode32_array", 4 * QUANT_LANES, 4 * QUANT_LANES,
+                run_quat_encode32_array, ref_quant_unit4, 1.0 },
+        { "quat_encode32_array deg", 4 * QUANT_LANES, QUANT_LANES,
+                run_quat_encode32_array_deg, ref_quant_deg4, 1.0 },
+        { "quat_encode48_array", 4 * QUANT_LANES, 4 * QUANT_LANES,
+                run_quat_encode48_array, ref_quant_unit4, 1.0 },
+        { "quat_encode48_array deg", 4 * QUANT_LANES, QUANT_LANES,
+                run_quat_encode48_array_deg, ref_quant_deg4, 1.0 },
+        { "vec3f_encode_oct16_array", 3 * QUANT_LANES, 3 * QUANT_LANES,
+                run_vec3f_encode_oct16_array, ref_quant_unit3, 1.0 },
+        { "vec3f_encode_oct16_array deg", 3 * QUANT_LANES, QUANT_LANES,
+                run_vec3f_encode_oct16_array_deg, ref_quant_deg3, 1.0 },
+        { "vec3f_encode_oct32_array", 3 * QUANT_LANES, 3 * QUANT_LANES,
+                run_vec3f_encode_oct32_array, ref_quant_unit3, 1.0 },
+        { "vec3f_encode_oct32_array deg", 3 * QUANT_LANES, QUANT_LANES,
+                run_vec3f_encode_oct32_array_deg, ref_quant_deg3, 1.0 },
+        { "vec3f_to_half_array", 3 * QUANT_LANES, 3 * QUANT_LANES,
+                run_vec3f_to_half_array, ref_vec3f_to_half_array },
+        { "vec4f_to_half_array", 4 * QUANT_LANES, 4 * QUANT_LANES,
+                run_vec4f_to_half_array, ref_vec4f_to_half_array },
+};
+
+/* ---- budgets ---- */
+
+/*
+ * Bounds on the random set errors of a row; ulp exits
+ * with the number of rows over theirs. Rows not listed
+ * get ULP_BUDGET_MAX and ULP_BUDGET_MEAN. invsqrt and
+ * the normalizes built on it are an approximation good
+ * to about 2e-3. Results that cancel (dots, cross
+ * products, determinants, cofactor inverses and the
+ * general solves) have no bound in ULPs of their own
+ * small value, so only their mean is held, and loosely,
+ * since a single bad sample moves it.
+ */
+#define ULP_BUDGET_MAX  16.0
+#define ULP_BUDGET_MEAN 1.0
+#define ULP_APPROX_MAX  4e4
+#define ULP_APPROX_MEAN 1.6e4
+#define ULP_CANCEL_MEAN 64.0
+
+typedef struct {
+        const char*     name;
+        double          max;
+        double          mean;
+} ulp_budget;
+
+static ulp_budget budgets[] = {
+        { "_cgmath_invsqrt", ULP_APPROX_MAX, ULP_APPROX_MEAN },
+        { "vec2f_normalize", ULP_APPROX_MAX, ULP_APPROX_MEAN },
+        { "vec3f_normalize", ULP_APPROX_MAX, ULP_APPROX_MEAN },
+        { "vec4f_normalize", ULP_APPROX_MAX, ULP_APPROX_MEAN },
+        { "vec2f_scalar_prod", INFINITY, ULP_CANCEL_MEAN },
+        { "vec3f_scalar_prod", INFINITY, ULP_CANCEL_MEAN },
+        { "vec4f_scalar_prod", INFINITY, ULP_CANCEL_MEAN },
+        { "vec3f_vector_prod", INFINITY, ULP_CANCEL_MEAN },
+        { "mat2f_multiply", INFINITY, ULP_CANCEL_MEAN },
+        { "mat2f_determinant", INFINITY, ULP_CANCEL_MEAN },
+        { "mat3f_determinant", INFINITY, ULP_CANCEL_MEAN },
+        { "mat4f_determinant", INFINITY, ULP_CANCEL_MEAN },
+        { "mat2f_inverse", INFINITY, ULP_CANCEL_MEAN },
+        { "mat3f_inverse", INFINITY, ULP_CANCEL_MEAN },
+        { "mat4f_inverse", INFINITY, ULP_CANCEL_MEAN },
+        { "mat3f_inverse_array", INFINITY, ULP_CANCEL_MEAN },
+        { "mat3f_inverse_sym_soa", INFINITY, ULP_CANCEL_MEAN },
+        { "mat4f_inverse_array", INFINITY, ULP_CANCEL_MEAN },
+        { "mat2f_solve_array", INFINITY, ULP_CANCEL_MEAN },
+        { "mat3f_solve_array", INFINITY, ULP_CANCEL_MEAN },
+        { "mat4f_solve_array", INFINITY, ULP_CANCEL_MEAN },
+        /* position plus a small step cancels when gravity is all that moves it */
+        { "rigid_integrate gravity only", INFINITY, ULP_CANCEL_MEAN },
+        { "rigid_integrate", 64.0, ULP_BUDGET_MEAN },
+        { "mat4f_transform_normal_array", 64.0, ULP_BUDGET_MEAN }
+};
+
+/* whether the random set stats of c are within its budget */
+static int within_budget(ulp_case* c, ulp_stats* s)
+{
+        int i;
+        double max;
+        double mean;
+
+        max = ULP_BUDGET_MAX;
+        mean = ULP_BUDGET_MEAN;
+        for(i = 0; i < (int)(sizeof(budgets) / sizeof(budgets[0])); i++) {
+                if(strcmp(budgets[i].name, c->name) == 0) {
+                        max = budgets[i].max;
+                        mean = budgets[i].mean;
+                        break;
+                }
+        }
+        return s->max <= max && (s->count == 0 || s->sum / s->count <= mean);
+}
+
+/* ---- input generation ---- */
+
+static unsigned long long rng_seed;
+static unsigned long long rng_state;
+
+static unsigned int rng(void)
+{
+        rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (unsigned int)(rng_state >> 33);
+}
+
+static float uniform(void)
+{
+        return (float)rng() / (float)(1U << 31) * 2.0f - 1.0f;
+}
+
+static float wide(void)
+{
+        return ldexpf(uniform(), (int)(rng() % 121) - 60);
+}
+
+/**
+ * Picks one of several hostile patterns per sample.
+ * The matrix patterns assume the first operand is a
+ * row-major n x n block, which is harmless for the
+ * vector cases.
+ */
+static void adversarial(float* in, int count, int n)
+{
+        int i;
+        int j;
+        int pick;
+
+        pick = rng() % 6;
+        for(i = 0; i < count; i++) {
+                in[i] = uniform();
+        }
+
+        switch(pick) {
+        case 0:
+                for(i = 0; i < count; i++) {
+                        in[i] = wide();
+                }
+                break;
+        case 1:
+                for(i = 0; i < count; i++) {
+                        if(rng() % 3 == 0) {
+                                in[i] = 0.0f;
+                        } else if(rng() % 3 == 0) {
+                                in[i] = uniform() * FLT_MIN;
+                        }
+                }
+                break;
+        case 2:
+                for(i = 0; i < count; i++) {
+                        in[i] = uniform() * (rng() & 1 ? 1e18f : 1e-18f);
+                }
+                break;
+        case 3:
+                /* exactly singular: last row copies the first */
+                if(n > 1) {
+                        for(j = 0; j < n; j++) {
+                                in[(n - 1) * n + j] = in[j];
+                        }
+                }
+                break;
+        case 4:
+                /* nearly singular: last row is a combination plus a few ULPs */
+                if(n > 1) {
+                        for(j = 0; j < n; j++) {
+                                in[(n - 1) * n + j] = 0.5f * in[j] + 0.25f * in[n + j];
+                                in[(n - 1) * n + j] *= 1.0f + FLT_EPSILON * (rng() % 4);
+                        }
+                }
+                break;
+        default:
+                for(i = 0; i < count; i++) {
+                        in[i] = rng() & 1 ? 1.0f : -1.0f;
+                }
+                break;
+        }
+}
+
+static int case_dim(ulp_case* c)
+{
+        if(strncmp(c->name, "mat", 3) == 0 && c->name[3] >= '2' && c->name[3] <= '4') {
+                return c->name[3] - '0';
+        }
+        return 0;
+}
+
+/* ---- measurement ---- */
+
+static double ulp_of(double d)
+{
+        float f;
+        float u;
+
+        f = (float)dabs(d);
+        if(f < FLT_MIN) {
+                f = FLT_MIN;
+        }
+        if(isinf(f)) {
+                f = FLT_MAX;
+        }
+        u = nextafterf(f, INFINITY) - f;
+        return u;
+}
+
+/* one sample where the scalar path and this one disagree */
+static int differs(ulp_case* c, float* out, float* base, float sentinel)
+{
+        int i;
+
+        for(i = 0; i < c->out; i++) {
+                if((out[i] != sentinel) != (base[i] != sentinel) ||
+                                !isfinite(out[i]) != !isfinite(base[i])) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static void measure(ulp_case* c, int level, int set, long samples, ulp_stats* s)
+{
+        int i;
+        int n;
+        int undef;
+        int touched;
+        long k;
+        double err;
+        double big;
+        double ulp;
+        float in[ULP_MAX_IN];
+        float out[ULP_MAX_OUT];
+        float base[ULP_MAX_OUT];
+        double ref[ULP_MAX_OUT];
+        const float sentinel = 1234.5f;
+
+        memset(s, 0, sizeof(*s));
+        n = case_dim(c);
+
+        /* every level sees exactly the same inputs */
+        rng_state = rng_seed + set;
+
+        for(k = 0; k < samples; k++) {
+                if(set == ULP_RANDOM) {
+                        for(i = 0; i < c->in; i++) {
+                                in[i] = uniform();
+                        }
+                } else {
+                        adversarial(in, c->in, n);
+                }
+
+                for(i = 0; i < c->out; i++) {
+                        out[i] = sentinel;
+                        base[i] = sentinel;
+                }
+
+                undef = c->ref(in, ref);
+                c->run(in, out);
+                if(level != CGMATH_ISA_SCALAR) {
+                        cgmath_isa_select(CGMATH_ISA_SCALAR);
+                        c->run(in, base);
+                        cgmath_isa_select(level);
+                        if(differs(c, out, base, sentinel)) {
+                                s->mismatch++;
+                        }
+                } else {
+                        memcpy(base, out, sizeof(out));
+                }
+
+                touched = 0;
+                for(i = 0; i < c->out; i++) {
+                        touched |= out[i] != sentinel;
+                }
+
+                if(undef) {
+                        s->singular++;
+                        continue;
+                }
+                if(!touched) {
+                        s->untouched++;
+                        continue;
+                }
+
+                big = 0.0;
+                for(i = 0; i < c->out; i++) {
+                        if(dabs(ref[i]) > big) {
+                                big = dabs(ref[i]);
+                        }
+                }
+                /* the reference itself leaves float range */
+                if(big > FLT_MAX) {
+                        continue;
+                }
+                ulp = c->abs != 0.0 ? c->abs : ulp_of(big);
+
+                for(i = 0; i < c->out; i++) {
+                        if(isfinite(out[i]) && isfinite(base[i]) &&
+                                        dabs(out[i] - base[i]) / ulp > s->scalar) {
+                                s->scalar = dabs(out[i] - base[i]) / ulp;
+                        }
+                }
+                for(i = 0; i < c->out; i++) {
+                        if(!isfinite(out[i])) {
+                                s->nonfinite++;
+                                break;
+                        }
+                        err = dabs(out[i] - ref[i]) / ulp;
+                        if(err > s->max) {
+                                s->max = err;
+                        }
+                        s->sum += err;
+                        s->count++;
+                }
+        }
+}
+
+int main(int argc, char* argv[])
+{
+        int i;
+        int level;
+        int only;
+        int top;
+        int ok;
+        int over;
+        long samples;
+        const char* filter;
+        ulp_stats r;
+        ulp_stats a;
+
+        samples = 20000;
+        only = -1;
+        filter = NULL;
+        rng_seed = 1;
+        for(i = 1; i < argc - 1; i++) {
+                if(strcmp(argv[i], "-n") == 0) {
+                        samples = atol(argv[++i]);
+                } else if(strcmp(argv[i], "-l") == 0) {
+                        only = atoi(argv[++i]);
+                } else if(strcmp(argv[i], "-s") == 0) {
+                        rng_seed = strtoull(argv[++i], NULL, 10);
+                } else if(strcmp(argv[i], "-f") == 0) {
+                        filter = argv[++i];
+                }
+        }
+
+        over = 0;
+        top = cgmath_isa_detected();
+        printf("%-8s %-36s %12s %10s %12s %10s %9s %9s %9s %10s %9s\n",
+                "isa", "function", "rand max", "rand mean",
+                "adv max", "adv mean", "nonfinite", "singular", "untouched",
+                "vs scalar", "mismatch");
+
+        for(level = CGMATH_ISA_SCALAR; level <= top; level++) {
+                if(only >= 0 && level != only) {
+                        continue;
+                }
+                cgmath_isa_select(level);
+
+                for(i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+                        if(filter != NULL && strstr(cases[i].name, filter) == NULL) {
+                                continue;
+                        }
+                        measure(&cases[i], level, ULP_RANDOM, samples, &r);
+                        measure(&cases[i], level, ULP_ADVERSARIAL, samples, &a);
+                        ok = within_budget(&cases[i], &r);
+                        over += !ok;
+                        printf("%-8s %-36s %12.3g %10.3g %12.3g %10.3g %9ld %9ld %9ld %10.3g %9ld%s\n",
+                                cgmath_isa_name(level), cases[i].name,
+                                r.max, r.count ? r.sum / r.count : 0.0,
+                                a.max, a.count ? a.sum / a.count : 0.0,
+                                r.nonfinite + a.nonfinite,
+                                r.singular + a.singular,
+                                r.untouched + a.untouched,
+                                r.scalar > a.scalar ? r.scalar : a.scalar,
+                                r.mismatch + a.mismatch,
+                                ok ? "" : "  over budget");
+                }
+        }
+
+        return over;
+}
@@ -0,0 +1,146 @@
+/**
+ * File: cgmath-xform.c
+ * Description:
+ * * Transforms the positions (and optionally normals)
+ * * of a raw interleaved vertex file by a matrix,
+ * * streaming it through xform_file().
+ * *
+ * * cgmath-xform [options] IN OUT
+ * *   -s BYTES      record stride (default 12)
+ * *   -p OFFSET     position offset in a record, -1 for none (default 0)
+ * *   -n OFFSET     normal offset in a record (default none)
+ * *   -h BYTES      header bytes copied unchanged (default 0)
+ * *   -m a,b,...    16 row-major matrix elements
+ * *   -t x,y,z      translate
+ * *   -S x,y,z      scale
+ * *   -j THREADS    worker threads (default cgmath_threads())
+ * *   -c RECORDS    records per chunk
+ * *   -b BUFFERS    staging buffers in flight
+ * * -m, -t and -S are applied to the vertices in the
+ * * order given, each after the ones before it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cgmath.h"
+
+static int parse_floats(const char* s, float* dest, int count)
+{
+        int i;
+        char* end;
+
+        for(i = 0; i < count; i++) {
+                dest[i] = strtof(s, &end);
+                if(end == s) {
+                        return -1;
+                }
+                s = end;
+                if(i + 1 < count) {
+                        if(*s != ',') {
+                                return -1;
+                        }
+                        s++;
+                }
+        }
+        return *s == '\0' ? 0 : -1;
+}
+
+static void usage(const char* name)
+{
+        fprintf(stderr, "usage: %s [-s stride] [-p offset] [-n offset] [-h header]\n"
+                        "       [-m m00,m01,...,m33] [-t x,y,z] [-S x,y,z]\n"
+                        "       [-j threads] [-c records] [-b buffers] IN OUT\n", name);
+        exit(2);
+}
+
+int main(int argc, char** argv)
+{
+        int opt;
+        int i;
+        float f[16];
+        double t;
+        struct timespec t0;
+        struct timespec t1;
+        mat4f mat;
+        mat4f op;
+        xform_layout layout;
+
+        xform_layout_init(&layout, sizeof(vec3f));
+        mat4f_identity(&mat);
+
+        while((opt = getopt(argc, argv, "s:p:n:h:m:t:S:j:c:b:")) != -1) {
+                switch(opt) {
+                case 's':
+                        layout.stride = strtoul(optarg, NULL, 0);
+                        break;
+                case 'p':
+                        layout.position = atoi(optarg);
+                        break;
+                case 'n':
+                        layout.normal = atoi(optarg);
+                        break;
+                case 'h':
+                        layout.header = strtoul(optarg, NULL, 0);
+                        break;
+                case 'm':
+                        if(parse_floats(optarg, f, 16) != 0) {
+                                usage(argv[0]);
+                        }
+                        memcpy(op.m, f, MAT4F_SIZE);
+                        mat4f_multiply(&op, &mat, &mat);
+                        break;
+                case 't':
+                case 'S':
+                        if(parse_floats(optarg, f, 3) != 0) {
+                                usage(argv[0]);
+                        }
+                        mat4f_identity(&op);
+                        for(i = 0; i < 3; i++) {
+                                if(opt == 't') {
+                                        op.m[i][3] = f[i];
+                                } else {
+                                        op.m[i][i] = f[i];
+                                }
+                        }
+                        mat4f_multiply(&op, &mat, &mat);
+                        break;
+                case 'j':
+                        layout.threads = atoi(optarg);
+                        break;
+                case 'c':
+                        layout.chunk = strtoul(optarg, NULL, 0);
+                        break;
+                case 'b':
+                        layout.buffers = atoi(optarg);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+        if(argc - optind != 2) {
+                usage(argv[0]);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        errno = 0;
+        if(xform_file(argv[optind], argv[optind + 1], &mat, &layout) != 0) {
+                if(errno == EDOM) {
+                        fprintf(stderr, "%s: the matrix is singular, so normals cannot be transformed\n", argv[0]);
+                } else if(errno != 0) {
+                        fprintf(stderr, "%s: failed to transform %s: %s\n", argv[0], argv[optind], strerror(errno));
+                } else {
+                        fprintf(stderr, "%s: failed to transform %s\n", argv[0], argv[optind]);
+                }
+                return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+        fprintf(stderr, "%s -> %s in %.3f s\n", argv[optind], argv[optind + 1], t);
+        return 0;
+}
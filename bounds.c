@@ -0,0 +1,625 @@
+/**
+ * File: bounds.c
+ * Description:
+ * * Bounding volumes over point streams. Boxes are min
+ * * and max reductions run four or eight points at a
+ * * time; the fused kernel transforms the points and
+ * * bounds the results in the same pass, so re-bounding
+ * * a deformed mesh costs no extra trip through memory.
+ * * Spheres use Ritter's growth pass. Large inputs are
+ * * cut into at most BOUNDS_SLOTS fixed slices that run
+ * * on the worker pool, and the partial results are
+ * * merged in slice order, so the output does not
+ * * depend on the thread count.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+#define BOUNDS_SLOTS    64
+
+/* points per task; anything under two of these runs inline */
+#define BOUNDS_GRAIN    16384
+
+#define BOUNDS_ARRAY            0
+#define BOUNDS_SOA              1
+#define BOUNDS_TRANSFORM        2
+#define BOUNDS_SPHERE           3
+
+/**
+ * box is min x, y, z followed by max x, y, z and is
+ * widened to include the points; NaN coordinates are
+ * ignored.
+ */
+void _aabb_minmax_array_scalar(vec3f* src, float* box, size_t count)
+{
+        int k;
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                for(k = 0; k < 3; k++) {
+                        box[k] = src[i].m[k] < box[k] ? src[i].m[k] : box[k];
+                        box[k + 3] = src[i].m[k] > box[k + 3] ? src[i].m[k] : box[k + 3];
+                }
+        }
+}
+
+void _aabb_minmax_soa_scalar(float* x, float* y, float* z, float* box, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                box[0] = x[i] < box[0] ? x[i] : box[0];
+                box[1] = y[i] < box[1] ? y[i] : box[1];
+                box[2] = z[i] < box[2] ? z[i] : box[2];
+                box[3] = x[i] > box[3] ? x[i] : box[3];
+                box[4] = y[i] > box[4] ? y[i] : box[4];
+                box[5] = z[i] > box[5] ? z[i] : box[5];
+        }
+}
+
+/* dest may be NULL to bound the transformed points without storing them */
+void _aabb_transform_array_scalar(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        float p[3];
+
+        for(i = 0; i < count; i++) {
+                for(k = 0; k < 3; k++) {
+                        p[k] = mat->m[k][0] * src[i].m[VEC_X] + mat->m[k][1] * src[i].m[VEC_Y] +
+                                mat->m[k][2] * src[i].m[VEC_Z] + mat->m[k][3];
+                }
+                for(k = 0; k < 3; k++) {
+                        box[k] = p[k] < box[k] ? p[k] : box[k];
+                        box[k + 3] = p[k] > box[k + 3] ? p[k] : box[k + 3];
+                }
+                if(dest != NULL) {
+                        memcpy(dest[i].m, p, sizeof(p));
+                }
+        }
+}
+
+/**
+ * Ritter's growth step: s is center x, y, z and radius,
+ * and every point outside it moves the far side of the
+ * sphere out to the point.
+ */
+void _sphere_grow_scalar(vec3f* src, float* s, size_t count)
+{
+        int k;
+        size_t i;
+        float d[3];
+        float d2;
+        float dist;
+        float r;
+
+        for(i = 0; i < count; i++) {
+                d2 = 0.0f;
+                for(k = 0; k < 3; k++) {
+                        d[k] = src[i].m[k] - s[k];
+                        d2 += d[k] * d[k];
+                }
+                if(d2 <= s[3] * s[3]) {
+                        continue;
+                }
+                dist = sqrtf(d2);
+                r = 0.5f * (s[3] + dist);
+                for(k = 0; k < 3; k++) {
+                        s[k] += d[k] * ((r - s[3]) / dist);
+                }
+                s[3] = r;
+        }
+}
+
+#if defined(CGMATH_X86)
+CGMATH_TARGET_SSE2
+static void _bounds_fold_sse2(__m128* mn, __m128* mx, float* box)
+{
+        int k;
+        int j;
+        float lo[4];
+        float hi[4];
+
+        for(k = 0; k < 3; k++) {
+                _mm_storeu_ps(lo, mn[k]);
+                _mm_storeu_ps(hi, mx[k]);
+                for(j = 0; j < 4; j++) {
+                        box[k] = lo[j] < box[k] ? lo[j] : box[k];
+                        box[k + 3] = hi[j] > box[k + 3] ? hi[j] : box[k + 3];
+                }
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _aabb_minmax_array_sse2(vec3f* src, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 p[3];
+        __m128 mn[3];
+        __m128 mx[3];
+
+        for(k = 0; k < 3; k++) {
+                mn[k] = _mm_set1_ps(box[k]);
+                mx[k] = _mm_set1_ps(box[k + 3]);
+        }
+        for(i = 0; i + 4 <= count; i += 4) {
+                _cgmath_load3x4_sse2(src[i].m, &p[0], &p[1], &p[2]);
+                for(k = 0; k < 3; k++) {
+                        mn[k] = _mm_min_ps(p[k], mn[k]);
+                        mx[k] = _mm_max_ps(p[k], mx[k]);
+                }
+        }
+        _bounds_fold_sse2(mn, mx, box);
+        _aabb_minmax_array_scalar(src + i, box, count - i);
+}
+
+CGMATH_TARGET_SSE2
+void _aabb_minmax_soa_sse2(float* x, float* y, float* z, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        float* c[3];
+        __m128 p;
+        __m128 mn[3];
+        __m128 mx[3];
+
+        c[0] = x;
+        c[1] = y;
+        c[2] = z;
+        for(k = 0; k < 3; k++) {
+                mn[k] = _mm_set1_ps(box[k]);
+                mx[k] = _mm_set1_ps(box[k + 3]);
+        }
+        for(i = 0; i + 4 <= count; i += 4) {
+                for(k = 0; k < 3; k++) {
+                        p = _mm_loadu_ps(c[k] + i);
+                        mn[k] = _mm_min_ps(p, mn[k]);
+                        mx[k] = _mm_max_ps(p, mx[k]);
+                }
+        }
+        _bounds_fold_sse2(mn, mx, box);
+        _aabb_minmax_soa_scalar(x + i, y + i, z + i, box, count - i);
+}
+
+CGMATH_TARGET_SSE2
+void _aabb_transform_array_sse2(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 m[12];
+        __m128 p[3];
+        __m128 r[3];
+        __m128 mn[3];
+        __m128 mx[3];
+
+        for(k = 0; k < 12; k++) {
+                m[k] = _mm_set1_ps(mat->m[k >> 2][k & 3]);
+        }
+        for(k = 0; k < 3; k++) {
+                mn[k] = _mm_set1_ps(box[k]);
+                mx[k] = _mm_set1_ps(box[k + 3]);
+        }
+        for(i = 0; i + 4 <= count; i += 4) {
+                _cgmath_load3x4_sse2(src[i].m, &p[0], &p[1], &p[2]);
+                for(k = 0; k < 3; k++) {
+                        r[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4 * k], p[0]),
+                                        _mm_mul_ps(m[4 * k + 1], p[1])),
+                                        _mm_add_ps(_mm_mul_ps(m[4 * k + 2], p[2]), m[4 * k + 3]));
+                        mn[k] = _mm_min_ps(r[k], mn[k]);
+                        mx[k] = _mm_max_ps(r[k], mx[k]);
+                }
+                if(dest != NULL) {
+                        _cgmath_store3x4_sse2(dest[i].m, r[0], r[1], r[2]);
+                }
+        }
+        _bounds_fold_sse2(mn, mx, box);
+        _aabb_transform_array_scalar(mat, src + i, dest != NULL ? dest + i : NULL, box, count - i);
+}
+
+/**
+ * Once the sphere has settled almost every point is
+ * inside, so four are tested at once and only a group
+ * with a point outside goes through the scalar step.
+ */
+CGMATH_TARGET_SSE2
+void _sphere_grow_sse2(vec3f* src, float* s, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 p[3];
+        __m128 d;
+        __m128 d2;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                _cgmath_load3x4_sse2(src[i].m, &p[0], &p[1], &p[2]);
+                d2 = _mm_setzero_ps();
+                for(k = 0; k < 3; k++) {
+                        d = _mm_sub_ps(p[k], _mm_set1_ps(s[k]));
+                        d2 = _mm_add_ps(d2, _mm_mul_ps(d, d));
+                }
+                if(_mm_movemask_ps(_mm_cmpgt_ps(d2, _mm_set1_ps(s[3] * s[3]))) != 0) {
+                        _sphere_grow_scalar(src + i, s, 4);
+                }
+        }
+        _sphere_grow_scalar(src + i, s, count - i);
+}
+
+CGMATH_TARGET_AVX2
+static void _bounds_fold_avx2(__m256* mn, __m256* mx, float* box)
+{
+        int k;
+        __m128 lo[3];
+        __m128 hi[3];
+
+        for(k = 0; k < 3; k++) {
+                lo[k] = _mm_min_ps(_mm256_castps256_ps128(mn[k]), _mm256_extractf128_ps(mn[k], 1));
+                hi[k] = _mm_max_ps(_mm256_castps256_ps128(mx[k]), _mm256_extractf128_ps(mx[k], 1));
+        }
+        _bounds_fold_sse2(lo, hi, box);
+}
+
+CGMATH_TARGET_AVX2
+void _aabb_minmax_array_avx2(vec3f* src, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 p[3];
+        __m256 mn[3];
+        __m256 mx[3];
+
+        for(k = 0; k < 3; k++) {
+                mn[k] = _mm256_set1_ps(box[k]);
+                mx[k] = _mm256_set1_ps(box[k + 3]);
+        }
+        for(i = 0; i + 8 <= count; i += 8) {
+                _cgmath_load3x8_avx2(src + i, p);
+                for(k = 0; k < 3; k++) {
+                        mn[k] = _mm256_min_ps(p[k], mn[k]);
+                        mx[k] = _mm256_max_ps(p[k], mx[k]);
+                }
+        }
+        _bounds_fold_avx2(mn, mx, box);
+        _aabb_minmax_array_sse2(src + i, box, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _aabb_minmax_soa_avx2(float* x, float* y, float* z, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        float* c[3];
+        __m256 p;
+        __m256 mn[3];
+        __m256 mx[3];
+
+        c[0] = x;
+        c[1] = y;
+        c[2] = z;
+        for(k = 0; k < 3; k++) {
+                mn[k] = _mm256_set1_ps(box[k]);
+                mx[k] = _mm256_set1_ps(box[k + 3]);
+        }
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(k = 0; k < 3; k++) {
+                        p = _mm256_loadu_ps(c[k] + i);
+                        mn[k] = _mm256_min_ps(p, mn[k]);
+                        mx[k] = _mm256_max_ps(p, mx[k]);
+                }
+        }
+        _bounds_fold_avx2(mn, mx, box);
+        _aabb_minmax_soa_sse2(x + i, y + i, z + i, box, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _aabb_transform_array_avx2(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 m[12];
+        __m256 p[3];
+        __m256 r[3];
+        __m256 mn[3];
+        __m256 mx[3];
+
+        for(k = 0; k < 12; k++) {
+                m[k] = _mm256_set1_ps(mat->m[k >> 2][k & 3]);
+        }
+        for(k = 0; k < 3; k++) {
+                mn[k] = _mm256_set1_ps(box[k]);
+                mx[k] = _mm256_set1_ps(box[k + 3]);
+        }
+        for(i = 0; i + 8 <= count; i += 8) {
+                _cgmath_load3x8_avx2(src + i, p);
+                for(k = 0; k < 3; k++) {
+                        r[k] = _mm256_fmadd_ps(m[4 * k], p[0], m[4 * k + 3]);
+                        r[k] = _mm256_fmadd_ps(m[4 * k + 1], p[1], r[k]);
+                        r[k] = _mm256_fmadd_ps(m[4 * k + 2], p[2], r[k]);
+                        mn[k] = _mm256_min_ps(r[k], mn[k]);
+                        mx[k] = _mm256_max_ps(r[k], mx[k]);
+                }
+                if(dest != NULL) {
+                        _cgmath_store3x4_sse2(dest[i].m, _mm256_castps256_ps128(r[0]),
+                                        _mm256_castps256_ps128(r[1]), _mm256_castps256_ps128(r[2]));
+                        _cgmath_store3x4_sse2(dest[i + 4].m, _mm256_extractf128_ps(r[0], 1),
+                                        _mm256_extractf128_ps(r[1], 1), _mm256_extractf128_ps(r[2], 1));
+                }
+        }
+        _bounds_fold_avx2(mn, mx, box);
+        _aabb_transform_array_sse2(mat, src + i, dest != NULL ? dest + i : NULL, box, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _sphere_grow_avx2(vec3f* src, float* s, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 p[3];
+        __m256 d;
+        __m256 d2;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                _cgmath_load3x8_avx2(src + i, p);
+                d2 = _mm256_setzero_ps();
+                for(k = 0; k < 3; k++) {
+                        d = _mm256_sub_ps(p[k], _mm256_set1_ps(s[k]));
+                        d2 = _mm256_fmadd_ps(d, d, d2);
+                }
+                if(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_set1_ps(s[3] * s[3]), _CMP_GT_OQ)) != 0) {
+                        _sphere_grow_scalar(src + i, s, 8);
+                }
+        }
+        _sphere_grow_sse2(src + i, s, count - i);
+}
+#endif
+
+typedef struct {
+        int             op;
+        mat4f*          mat;
+        vec3f*          src;
+        vec3f*          dest;
+        vec3f_soa       soa;
+        size_t          grain;
+        float           sphere[4];
+        float           part[BOUNDS_SLOTS][6];
+} _bounds_job;
+
+static void _bounds_empty(float* box)
+{
+        int k;
+
+        for(k = 0; k < 3; k++) {
+                box[k] = FLT_MAX;
+                box[k + 3] = -FLT_MAX;
+        }
+}
+
+static void _bounds_range(void* ctx, size_t begin, size_t end)
+{
+        size_t b;
+        size_t n;
+        float* part;
+        _bounds_job* job;
+
+        job = ctx;
+        for(b = begin; b < end; b += job->grain) {
+                n = end - b < job->grain ? end - b : job->grain;
+                part = job->part[b / job->grain];
+
+                switch(job->op) {
+                case BOUNDS_ARRAY:
+                        _bounds_empty(part);
+                        _cgmath_kern.aabb_minmax_array(job->src + b, part, n);
+                        break;
+                case BOUNDS_SOA:
+                        _bounds_empty(part);
+                        _cgmath_kern.aabb_minmax_soa(job->soa.m[VEC_X] + b, job->soa.m[VEC_Y] + b,
+                                        job->soa.m[VEC_Z] + b, part, n);
+                        break;
+                case BOUNDS_TRANSFORM:
+                        _bounds_empty(part);
+                        _cgmath_kern.aabb_transform_array(job->mat, job->src + b,
+                                        job->dest != NULL ? job->dest + b : NULL, part, n);
+                        break;
+                default:
+                        memcpy(part, job->sphere, sizeof(job->sphere));
+                        _cgmath_kern.sphere_grow(job->src + b, part, n);
+                        break;
+                }
+        }
+}
+
+static size_t _bounds_run(_bounds_job* job, int op, size_t count)
+{
+        job->op = op;
+        job->grain = (count + BOUNDS_SLOTS - 1) / BOUNDS_SLOTS;
+        if(job->grain < BOUNDS_GRAIN) {
+                job->grain = BOUNDS_GRAIN;
+        }
+        _cgmath_parallel_for(count, job->grain, _bounds_range, job);
+        return (count + job->grain - 1) / job->grain;
+}
+
+static void _bounds_merge(_bounds_job* job, size_t slots, aabb* dest)
+{
+        int k;
+        size_t s;
+        float box[6];
+
+        _bounds_empty(box);
+        for(s = 0; s < slots; s++) {
+                for(k = 0; k < 3; k++) {
+                        box[k] = job->part[s][k] < box[k] ? job->part[s][k] : box[k];
+                        box[k + 3] = job->part[s][k + 3] > box[k + 3] ? job->part[s][k + 3] : box[k + 3];
+                }
+        }
+        memcpy(dest->min.m, box, sizeof(vec3f));
+        memcpy(dest->max.m, box + 3, sizeof(vec3f));
+}
+
+/**
+ * The box of an empty input has min FLT_MAX and max
+ * -FLT_MAX on every axis, so it can still be merged.
+ */
+void aabb_from_array(vec3f* src, aabb* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(aabb_from_array, count);
+        _bounds_job job;
+
+        job.src = src;
+        _bounds_merge(&job, _bounds_run(&job, BOUNDS_ARRAY, count), dest);
+}
+
+void aabb_from_soa(vec3f_soa* src, aabb* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(aabb_from_soa, count);
+        _bounds_job job;
+
+        job.soa = *src;
+        _bounds_merge(&job, _bounds_run(&job, BOUNDS_SOA, count), dest);
+}
+
+/**
+ * mat4f_transform_point_array() and aabb_from_array()
+ * on its output in one pass. dest may be NULL to get
+ * only the bounds, and may equal src.
+ */
+void aabb_transform_array(mat4f* mat, vec3f* src, vec3f* dest, aabb* bounds, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(aabb_transform_array, count);
+        _bounds_job job;
+
+        job.mat = mat;
+        job.src = src;
+        job.dest = dest;
+        _bounds_merge(&job, _bounds_run(&job, BOUNDS_TRANSFORM, count), bounds);
+}
+
+/**
+ * The sphere through the corners of box; an empty box
+ * gives a zero sphere at the origin.
+ */
+void sphere_from_aabb(aabb* box, sphere* dest)
+{
+        CGMATH_PROFILE_SCOPE(sphere_from_aabb, 1);
+        int k;
+        float d;
+        float r2;
+
+        r2 = 0.0f;
+        for(k = 0; k < 3; k++) {
+                if(!(box->min.m[k] <= box->max.m[k])) {
+                        memset(dest, 0, sizeof(*dest));
+                        return;
+                }
+                dest->center.m[k] = 0.5f * box->min.m[k] + 0.5f * box->max.m[k];
+                d = 0.5f * box->max.m[k] - 0.5f * box->min.m[k];
+                r2 += d * d;
+        }
+        dest->radius = sqrtf(r2);
+}
+
+/**
+ * Covers the rounding in the center and radius, which
+ * is relative to the magnitude of the coordinates.
+ */
+static void _sphere_pad(sphere* s)
+{
+        int k;
+        float m;
+
+        m = s->radius;
+        for(k = 0; k < 3; k++) {
+                m = fabsf(s->center.m[k]) + s->radius > m ? fabsf(s->center.m[k]) + s->radius : m;
+        }
+        s->radius += 4.0f * FLT_EPSILON * m;
+}
+
+/* grows a to enclose b */
+static void _sphere_union(float* a, float* b)
+{
+        int k;
+        float d[3];
+        float dist;
+        float r;
+
+        dist = 0.0f;
+        for(k = 0; k < 3; k++) {
+                d[k] = b[k] - a[k];
+                dist += d[k] * d[k];
+        }
+        dist = sqrtf(dist);
+        if(dist + b[3] <= a[3]) {
+                return;
+        }
+        if(dist + a[3] <= b[3]) {
+                memcpy(a, b, 4 * sizeof(float));
+                return;
+        }
+        r = 0.5f * (dist + a[3] + b[3]);
+        for(k = 0; k < 3; k++) {
+                a[k] += d[k] * ((r - a[3]) / dist);
+        }
+        a[3] = r;
+}
+
+/**
+ * Ritter's bounding sphere. The AABB pass supplies the
+ * starting sphere, the one spanning the widest axis of
+ * the box as Ritter's extreme point pair would; each
+ * slice then grows its own copy and the copies are
+ * merged in order. The result is checked against the
+ * box's own sphere and the smaller one kept, so it is
+ * never larger than sphere_from_aabb().
+ */
+void sphere_from_array(vec3f* src, sphere* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(sphere_from_array, count);
+        int k;
+        int w;
+        size_t s;
+        size_t slots;
+        aabb box;
+        sphere boxed;
+        float acc[4];
+        _bounds_job job;
+
+        if(count == 0) {
+                memset(dest, 0, sizeof(*dest));
+                return;
+        }
+
+        job.src = src;
+        _bounds_merge(&job, _bounds_run(&job, BOUNDS_ARRAY, count), &box);
+        sphere_from_aabb(&box, &boxed);
+
+        w = 0;
+        for(k = 0; k < 3; k++) {
+                job.sphere[k] = 0.5f * box.min.m[k] + 0.5f * box.max.m[k];
+                if(box.max.m[k] - box.min.m[k] > box.max.m[w] - box.min.m[w]) {
+                        w = k;
+                }
+        }
+        job.sphere[3] = 0.5f * box.max.m[w] - 0.5f * box.min.m[w];
+
+        slots = _bounds_run(&job, BOUNDS_SPHERE, count);
+        memcpy(acc, job.part[0], sizeof(acc));
+        for(s = 1; s < slots; s++) {
+                _sphere_union(acc, job.part[s]);
+        }
+
+        if(acc[3] < boxed.radius) {
+                memcpy(dest->center.m, acc, sizeof(vec3f));
+                dest->radius = acc[3];
+        } else {
+                *dest = boxed;
+        }
+        _sphere_pad(dest);
+}
@@ -0,0 +1,327 @@
+/**
+ * File: camera.c
+ * Description:
+ * * A camera that caches its derived transforms. The
+ * * setters only record their inputs and clear the
+ * * validity bits of whatever depends on them; each
+ * * getter computes its result the first time it is
+ * * read after a change. Setting an input to the value
+ * * it already holds invalidates nothing.
+ * *
+ * * The inverses use the structure of the inputs when
+ * * it is known: a look-at view is rigid, so its
+ * * inverse is a transpose; perspective and orthographic
+ * * projections have closed form inverses; and the
+ * * inverse view-projection is inv(P) composed with
+ * * inv(V). Only matrices loaded verbatim go through
+ * * the general mat4f_inverse, which leaves its dest
+ * * alone for a singular matrix, so such an input reads
+ * * back an identity inverse rather than an error.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+
+#define CAMERA_VIEW_PROJ        (1 << 0)
+#define CAMERA_INV_VIEW         (1 << 1)
+#define CAMERA_INV_PROJ         (1 << 2)
+#define CAMERA_INV_VIEW_PROJ    (1 << 3)
+#define CAMERA_FRUSTUM          (1 << 4)
+
+#define CAMERA_FROM_VIEW        (CAMERA_VIEW_PROJ | CAMERA_INV_VIEW | \
+                                CAMERA_INV_VIEW_PROJ | CAMERA_FRUSTUM)
+#define CAMERA_FROM_PROJ        (CAMERA_VIEW_PROJ | CAMERA_INV_PROJ | \
+                                CAMERA_INV_VIEW_PROJ | CAMERA_FRUSTUM)
+
+/* squared sine below which up counts as parallel to the view direction */
+#define CAMERA_PARALLEL         (256.0f * FLT_EPSILON * FLT_EPSILON)
+
+#define CAMERA_GENERAL          0
+#define CAMERA_RIGID            1
+#define CAMERA_PERSPECTIVE      2
+#define CAMERA_ORTHO            3
+
+static void _camera_cross(float* a, float* b, float* dest)
+{
+        dest[VEC_X] = a[VEC_Y] * b[VEC_Z] - a[VEC_Z] * b[VEC_Y];
+        dest[VEC_Y] = a[VEC_Z] * b[VEC_X] - a[VEC_X] * b[VEC_Z];
+        dest[VEC_Z] = a[VEC_X] * b[VEC_Y] - a[VEC_Y] * b[VEC_X];
+}
+
+/* normalizes v, failing with -1 when it has no direction */
+static int _camera_unit(float* v)
+{
+        float n;
+
+        n = v[VEC_X] * v[VEC_X] + v[VEC_Y] * v[VEC_Y] + v[VEC_Z] * v[VEC_Z];
+        if(!(n > 0.0f && n <= FLT_MAX)) {
+                return -1;
+        }
+        n = 1.0f / sqrtf(n);
+        v[VEC_X] *= n;
+        v[VEC_Y] *= n;
+        v[VEC_Z] *= n;
+        return 0;
+}
+
+static void _camera_set(camera* cam, mat4f* dest, mat4f* src, int kind, int* kind_dest, int mask)
+{
+        if(*kind_dest == kind && memcmp(dest->m, src->m, MAT4F_SIZE) == 0) {
+                return;
+        }
+        memcpy(dest->m, src->m, MAT4F_SIZE);
+        *kind_dest = kind;
+        cam->valid &= ~mask;
+}
+
+void camera_init(camera* cam)
+{
+        memset(cam, 0, sizeof(*cam));
+        mat4f_identity(&cam->view);
+        mat4f_identity(&cam->proj);
+        cam->view_kind = CAMERA_RIGID;
+        cam->proj_kind = CAMERA_ORTHO;
+        cam->valid = 0;
+}
+
+void camera_set_view(camera* cam, mat4f* view)
+{
+        CGMATH_PROFILE_SCOPE(camera_set_view, 1);
+        _camera_set(cam, &cam->view, view, CAMERA_GENERAL, &cam->view_kind, CAMERA_FROM_VIEW);
+}
+
+void camera_set_projection(camera* cam, mat4f* proj)
+{
+        CGMATH_PROFILE_SCOPE(camera_set_projection, 1);
+        _camera_set(cam, &cam->proj, proj, CAMERA_GENERAL, &cam->proj_kind, CAMERA_FROM_PROJ);
+}
+
+/**
+ * Fails with -1, leaving the view as it was, when eye
+ * and target coincide or up is parallel to the line
+ * between them to within a few ulps, since neither
+ * gives a basis.
+ */
+int camera_look_at(camera* cam, vec3f* eye, vec3f* target, vec3f* up)
+{
+        CGMATH_PROFILE_SCOPE(camera_look_at, 1);
+        float f[3];
+        float s[3];
+        float u[3];
+        float n;
+        mat4f v;
+
+        f[VEC_X] = target->m[VEC_X] - eye->m[VEC_X];
+        f[VEC_Y] = target->m[VEC_Y] - eye->m[VEC_Y];
+        f[VEC_Z] = target->m[VEC_Z] - eye->m[VEC_Z];
+        if(_camera_unit(f) != 0) {
+                return -1;
+        }
+        /* up within rounding of f leaves s pointing anywhere */
+        _camera_cross(f, up->m, s);
+        n = up->m[VEC_X] * up->m[VEC_X] + up->m[VEC_Y] * up->m[VEC_Y] + up->m[VEC_Z] * up->m[VEC_Z];
+        if(!(s[VEC_X] * s[VEC_X] + s[VEC_Y] * s[VEC_Y] + s[VEC_Z] * s[VEC_Z] >
+                                CAMERA_PARALLEL * n) || _camera_unit(s) != 0) {
+                return -1;
+        }
+        _camera_cross(s, f, u);
+
+        mat4f_identity(&v);
+        v.m[0][0] = s[VEC_X];
+        v.m[0][1] = s[VEC_Y];
+        v.m[0][2] = s[VEC_Z];
+        v.m[1][0] = u[VEC_X];
+        v.m[1][1] = u[VEC_Y];
+        v.m[1][2] = u[VEC_Z];
+        v.m[2][0] = -f[VEC_X];
+        v.m[2][1] = -f[VEC_Y];
+        v.m[2][2] = -f[VEC_Z];
+        v.m[0][3] = -(s[VEC_X] * eye->m[VEC_X] + s[VEC_Y] * eye->m[VEC_Y] + s[VEC_Z] * eye->m[VEC_Z]);
+        v.m[1][3] = -(u[VEC_X] * eye->m[VEC_X] + u[VEC_Y] * eye->m[VEC_Y] + u[VEC_Z] * eye->m[VEC_Z]);
+        v.m[2][3] = f[VEC_X] * eye->m[VEC_X] + f[VEC_Y] * eye->m[VEC_Y] + f[VEC_Z] * eye->m[VEC_Z];
+
+        _camera_set(cam, &cam->view, &v, CAMERA_RIGID, &cam->view_kind, CAMERA_FROM_VIEW);
+        return 0;
+}
+
+/**
+ * GL conventions: right handed eye space looking down
+ * -z, clip z in [-w, w], fovy in radians.
+ */
+void camera_perspective(camera* cam, float fovy, float aspect, float near, float far)
+{
+        CGMATH_PROFILE_SCOPE(camera_perspective, 1);
+        float f;
+        mat4f p;
+
+        f = 1.0f / tanf(0.5f * fovy);
+
+        mat4f_zero(&p);
+        p.m[0][0] = f / aspect;
+        p.m[1][1] = f;
+        p.m[2][2] = (far + near) / (near - far);
+        p.m[2][3] = 2.0f * far * near / (near - far);
+        p.m[3][2] = -1.0f;
+
+        _camera_set(cam, &cam->proj, &p, CAMERA_PERSPECTIVE, &cam->proj_kind, CAMERA_FROM_PROJ);
+}
+
+void camera_ortho(camera* cam, float left, float right, float bottom, float top, float near, float far)
+{
+        CGMATH_PROFILE_SCOPE(camera_ortho, 1);
+        mat4f p;
+
+        mat4f_identity(&p);
+        p.m[0][0] = 2.0f / (right - left);
+        p.m[1][1] = 2.0f / (top - bottom);
+        p.m[2][2] = -2.0f / (far - near);
+        p.m[0][3] = -(right + left) / (right - left);
+        p.m[1][3] = -(top + bottom) / (top - bottom);
+        p.m[2][3] = -(far + near) / (far - near);
+
+        _camera_set(cam, &cam->proj, &p, CAMERA_ORTHO, &cam->proj_kind, CAMERA_FROM_PROJ);
+}
+
+mat4f* camera_view(camera* cam)
+{
+        return &cam->view;
+}
+
+mat4f* camera_projection(camera* cam)
+{
+        return &cam->proj;
+}
+
+mat4f* camera_view_proj(camera* cam)
+{
+        CGMATH_PROFILE_SCOPE(camera_view_proj, 1);
+        if(!(cam->valid & CAMERA_VIEW_PROJ)) {
+                mat4f_multiply(&cam->proj, &cam->view, &cam->view_proj);
+                cam->valid |= CAMERA_VIEW_PROJ;
+        }
+        return &cam->view_proj;
+}
+
+mat4f* camera_inv_view(camera* cam)
+{
+        CGMATH_PROFILE_SCOPE(camera_inv_view, 1);
+        int i;
+        int j;
+        mat4f* v;
+        mat4f* d;
+
+        if(cam->valid & CAMERA_INV_VIEW) {
+                return &cam->inv_view;
+        }
+
+        v = &cam->view;
+        d = &cam->inv_view;
+        if(cam->view_kind == CAMERA_RIGID) {
+                mat4f_identity(d);
+                for(i = 0; i < 3; i++) {
+                        for(j = 0; j < 3; j++) {
+                                d->m[i][j] = v->m[j][i];
+                        }
+                }
+                for(i = 0; i < 3; i++) {
+                        d->m[i][3] = -(d->m[i][0] * v->m[0][3] +
+                                        d->m[i][1] * v->m[1][3] +
+                                        d->m[i][2] * v->m[2][3]);
+                }
+        } else {
+                mat4f_identity(d);
+                mat4f_inverse(v, d);
+        }
+
+        cam->valid |= CAMERA_INV_VIEW;
+        return d;
+}
+
+mat4f* camera_inv_projection(camera* cam)
+{
+        CGMATH_PROFILE_SCOPE(camera_inv_projection, 1);
+        mat4f* p;
+        mat4f* d;
+
+        if(cam->valid & CAMERA_INV_PROJ) {
+                return &cam->inv_proj;
+        }
+
+        p = &cam->proj;
+        d = &cam->inv_proj;
+        if(cam->proj_kind == CAMERA_PERSPECTIVE) {
+                mat4f_zero(d);
+                d->m[0][0] = 1.0f / p->m[0][0];
+                d->m[1][1] = 1.0f / p->m[1][1];
+                d->m[2][3] = -1.0f;
+                d->m[3][2] = 1.0f / p->m[2][3];
+                d->m[3][3] = p->m[2][2] / p->m[2][3];
+        } else if(cam->proj_kind == CAMERA_ORTHO) {
+                mat4f_identity(d);
+                d->m[0][0] = 1.0f / p->m[0][0];
+                d->m[1][1] = 1.0f / p->m[1][1];
+                d->m[2][2] = 1.0f / p->m[2][2];
+                d->m[0][3] = -p->m[0][3] * d->m[0][0];
+                d->m[1][3] = -p->m[1][3] * d->m[1][1];
+                d->m[2][3] = -p->m[2][3] * d->m[2][2];
+        } else {
+                mat4f_identity(d);
+                mat4f_inverse(p, d);
+        }
+
+        cam->valid |= CAMERA_INV_PROJ;
+        return d;
+}
+
+mat4f* camera_inv_view_proj(camera* cam)
+{
+        CGMATH_PROFILE_SCOPE(camera_inv_view_proj, 1);
+        if(!(cam->valid & CAMERA_INV_VIEW_PROJ)) {
+                mat4f_multiply(camera_inv_view(cam), camera_inv_projection(cam),
+                                &cam->inv_view_proj);
+                cam->valid |= CAMERA_INV_VIEW_PROJ;
+        }
+        return &cam->inv_view_proj;
+}
+
+/**
+ * Planes are extracted from the rows of the view-
+ * projection (Gribb and Hartmann) in the order left,
+ * right, bottom, top, near, far, and normalized so
+ * that dot(plane.xyz, p) + plane.w is the signed world
+ * space distance, positive inside.
+ */
+vec4f* camera_frustum(camera* cam)
+{
+        CGMATH_PROFILE_SCOPE(camera_frustum, 6);
+        int i;
+        int j;
+        float n;
+        mat4f* m;
+
+        if(cam->valid & CAMERA_FRUSTUM) {
+                return cam->frustum;
+        }
+
+        m = camera_view_proj(cam);
+        for(i = 0; i < 6; i++) {
+                for(j = 0; j < 4; j++) {
+                        cam->frustum[i].m[j] = m->m[3][j] +
+                                (i & 1 ? -m->m[i >> 1][j] : m->m[i >> 1][j]);
+                }
+
+                n = cam->frustum[i].m[VEC_X] * cam->frustum[i].m[VEC_X] +
+                        cam->frustum[i].m[VEC_Y] * cam->frustum[i].m[VEC_Y] +
+                        cam->frustum[i].m[VEC_Z] * cam->frustum[i].m[VEC_Z];
+                if(n > 0.0f) {
+                        vec4f_scale(&cam->frustum[i], 1.0f / sqrtf(n), &cam->frustum[i]);
+                }
+        }
+
+        cam->valid |= CAMERA_FRUSTUM;
+        return cam->frustum;
+}
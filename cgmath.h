@@ -9,6 +9,9 @@
 #ifndef CGMATH_H
 #define CGMATH_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "cgmath_core.h"
 
 #define VEC_X   0
@@ -19,6 +22,7 @@
 #define MAT2F_SIZE      (2 * 2 * sizeof(float))
 #define MAT3F_SIZE      (3 * 3 * sizeof(float))
 #define MAT4F_SIZE      (4 * 4 * sizeof(float))
+#define AFFINE2F_SIZE   (2 * 3 * sizeof(float))
 
 typedef struct {
         float m[2];
@@ -32,6 +36,27 @@ typedef struct {
         float m[4];
 } vec4f, quat;
 
+/**
+ * Structure of arrays views over streams of vectors,
+ * one pointer per component, indexed with VEC_X etc.
+ * The caller owns the storage.
+ */
+typedef struct {
+        float* m[3];
+} vec3f_soa;
+
+typedef struct {
+        float* m[4];
+} vec4f_soa, quat_soa;
+
+/**
+ * m[3 * row + col] points at element [row][col] of
+ * every matrix in the stream.
+ */
+typedef struct {
+        float* m[9];
+} mat3f_soa;
+
 typedef struct {
         float m[2][2];
 } mat2f;
@@ -44,6 +69,38 @@ typedef struct {
         float m[4][4];
 } mat4f;
 
+/**
+ * The top two rows of a 3x3 matrix, so m[r][2] holds
+ * the translation.
+ */
+typedef struct {
+        float m[2][3];
+} affine2f;
+
+/**
+ * Compressed storage formats, see quant.c. quat48 is a
+ * smallest three quaternion in three 16 bit words;
+ * vec3h and vec4h hold IEEE half floats.
+ */
+typedef struct {
+        uint16_t m[3];
+} quat48, vec3h;
+
+typedef struct {
+        uint16_t m[4];
+} vec4h;
+
+/**
+ * A rows x cols row-major view of caller owned floats;
+ * row r starts stride floats after row r - 1.
+ */
+typedef struct {
+        float*  m;
+        int     rows;
+        int     cols;
+        int     stride;
+} matf;
+
 /**
  * Implementation: vec2f.c
  * Description:
@@ -74,6 +131,13 @@ void    vec3f_vector_prod(vec3f* a, vec3f* b, vec3f* dest);
 
 float   vec3f_sqr_mag(vec3f* vec);
 void    vec3f_normalize(vec3f* vec, vec3f* dest);
+void    vec3f_normalize_array(vec3f* src, vec3f* dest, size_t count);
+
+void    vec3f_sum_array(vec3f* src, vec3f* dest, size_t count);
+void    vec3f_centroid_array(vec3f* src, vec3f* dest, size_t count);
+void    vec3f_covariance_array(vec3f* src, vec3f* centroid, mat3f* dest, size_t count);
+void    vec3f_covariance_gather(vec3f* points, unsigned int* offsets, unsigned int* ids,
+                vec3f* centroid, mat3f* dest, size_t count);
 
 /**
  * Implementation: vec4f.c
@@ -136,6 +200,17 @@ void    mat3f_get_col(mat3f* mat, vec3f* dest, int col);
 void    mat3f_set_row(mat3f* mat, vec3f* src, int row);
 void    mat3f_set_col(mat3f* mat, vec3f* src, int col);
 
+void    mat3f_determinant_array(mat3f* mat, float* dest, size_t count);
+size_t  mat3f_inverse_array(mat3f* mat, mat3f* dest, unsigned char* singular, size_t count);
+size_t  mat3f_inverse_sym_array(mat3f* mat, mat3f* dest, unsigned char* singular, size_t count);
+void    mat3f_determinant_soa(mat3f_soa* mat, float* dest, size_t count);
+size_t  mat3f_inverse_soa(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+size_t  mat3f_inverse_sym_soa(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+
+void    mat3f_eigen_sym(mat3f* mat, vec3f* values, mat3f* vectors);
+void    mat3f_eigen_sym_array(mat3f* mat, vec3f* values, mat3f* vectors, size_t count);
+void    mat3f_eigen_sym_soa(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count);
+
 /**
  * Implementation: mat4f.c
  * Description:
@@ -159,5 +234,647 @@ void    mat4f_get_col(mat4f* mat, vec4f* dest, int col);
 void    mat4f_set_row(mat4f* mat, vec4f* src, int row);
 void    mat4f_set_col(mat4f* mat, vec4f* src, int col);
 
+void    mat4f_transform_point_array(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+int     mat4f_transform_normal_array(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+size_t  mat4f_inverse_array(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count);
+
+/**
+ * local[i] is the transform applied at level i since
+ * it was pushed; world[0..clean-1] hold the running
+ * products and are only refreshed by the top read.
+ */
+typedef struct {
+        int             depth;
+        int             capacity;
+        int             clean;
+        mat4f*          local;
+        mat4f*          world;
+        unsigned char*  flags;
+} mat4f_stack;
+
+/**
+ * Implementation: mat4f_stack.c
+ * Description:
+ * * Push/pop matrix stack in the style of fixed
+ * * function GL. Operations post-multiply the top and
+ * * angles are in radians. push and pop fail with -1
+ * * on overflow or underflow instead of allocating.
+ */
+int     mat4f_stack_init(mat4f_stack* s, int capacity);
+void    mat4f_stack_free(mat4f_stack* s);
+int     mat4f_stack_push(mat4f_stack* s);
+int     mat4f_stack_pop(mat4f_stack* s);
+void    mat4f_stack_load(mat4f_stack* s, mat4f* mat);
+void    mat4f_stack_load_identity(mat4f_stack* s);
+void    mat4f_stack_mult(mat4f_stack* s, mat4f* mat);
+void    mat4f_stack_translate(mat4f_stack* s, float x, float y, float z);
+void    mat4f_stack_rotate(mat4f_stack* s, float angle, float x, float y, float z);
+void    mat4f_stack_scale(mat4f_stack* s, float x, float y, float z);
+mat4f*  mat4f_stack_top(mat4f_stack* s);
+
+/**
+ * Inputs, cached outputs and a bit per output telling
+ * whether it is current. Read through the getters.
+ */
+typedef struct {
+        mat4f   view;
+        mat4f   proj;
+        mat4f   view_proj;
+        mat4f   inv_view;
+        mat4f   inv_proj;
+        mat4f   inv_view_proj;
+        vec4f   frustum[6];
+        int     view_kind;
+        int     proj_kind;
+        int     valid;
+} camera;
+
+/**
+ * Implementation: camera.c
+ * Description:
+ * * Dirty tracked view/projection cache. Derived
+ * * matrices and frustum planes are computed when first
+ * * read after an input changed. Returned pointers
+ * * stay valid until the next setter call.
+ * * camera_look_at fails with -1 and keeps the old view
+ * * when eye equals target or up is parallel to the
+ * * view direction. A singular matrix passed to
+ * * set_view or set_projection has no inverse: the
+ * * inverse getters that depend on it return identity.
+ */
+void    camera_init(camera* cam);
+void    camera_set_view(camera* cam, mat4f* view);
+void    camera_set_projection(camera* cam, mat4f* proj);
+int     camera_look_at(camera* cam, vec3f* eye, vec3f* target, vec3f* up);
+void    camera_perspective(camera* cam, float fovy, float aspect, float near, float far);
+void    camera_ortho(camera* cam, float left, float right, float bottom, float top, float near, float far);
+mat4f*  camera_view(camera* cam);
+mat4f*  camera_projection(camera* cam);
+mat4f*  camera_view_proj(camera* cam);
+mat4f*  camera_inv_view(camera* cam);
+mat4f*  camera_inv_projection(camera* cam);
+mat4f*  camera_inv_view_proj(camera* cam);
+vec4f*  camera_frustum(camera* cam);
+
+#define CGMATH_ANIM_VEC3F       0
+#define CGMATH_ANIM_QUAT        1
+
+/**
+ * A set of keyframed channels of one kind, stored
+ * packed in a single aligned block. offset[c] is the
+ * first key of channel c; cursor[c] is the key that
+ * channel last sampled, relative to offset[c].
+ */
+typedef struct {
+        int     type;
+        int     channels;
+        float*  times;
+        float*  values;
+        int*    offset;
+        int*    cursor;
+        float*  alpha;
+} anim_clip;
+
+/**
+ * Implementation: anim.c
+ * Description:
+ * * Batched keyframe sampling. Fill the keys of each
+ * * channel through anim_clip_times() and
+ * * anim_clip_values() (ascending times, 3 or 4 floats
+ * * per key), then sample every channel at once into
+ * * SoA streams of at least clip->channels elements.
+ * * Sampling updates the cursors, so a clip must not
+ * * be sampled from two threads at the same time.
+ */
+int     anim_clip_init(anim_clip* clip, int type, int channels, int* key_counts);
+void    anim_clip_free(anim_clip* clip);
+float*  anim_clip_times(anim_clip* clip, int channel);
+float*  anim_clip_values(anim_clip* clip, int channel);
+void    anim_clip_rewind(anim_clip* clip);
+void    anim_sample_vec3f(anim_clip* clip, float t, vec3f_soa* dest);
+void    anim_sample_quat(anim_clip* clip, float t, quat_soa* dest);
+
+/**
+ * Streams for count bodies. accel and angular_accel
+ * are optional (set m[VEC_X] to NULL): accel is added
+ * to gravity, angular_accel is the torque already
+ * multiplied by the world inverse inertia. Angular
+ * velocity is in world space, in radians per second.
+ */
+typedef struct {
+        size_t          count;
+        vec3f_soa       position;
+        vec3f_soa       velocity;
+        vec3f_soa       accel;
+        quat_soa        orientation;
+        vec3f_soa       angular;
+        vec3f_soa       angular_accel;
+} rigid_bodies;
+
+/**
+ * Implementation: rigid.c
+ * Description:
+ * * One semi-implicit Euler step for every body in a
+ * * single pass: velocities are advanced first and the
+ * * new ones move the positions and spin the
+ * * orientations, which are renormalized. If world is
+ * * not NULL it receives each body's rotation and
+ * * translation as a mat4f in the same pass.
+ */
+void    rigid_integrate(rigid_bodies* bodies, vec3f* gravity, float dt, mat4f* world);
+
+/**
+ * Uniform grid over a point set. Cells are cell units
+ * on a side and hashed into a power of two table, so
+ * the grid is unbounded. The points are kept sorted by
+ * cell together with their original ids.
+ */
+typedef struct {
+        float           cell;
+        float           inv_cell;
+        int             bits;
+        size_t          count;
+        size_t          capacity;
+        unsigned int*   start;
+        unsigned int*   index;
+        unsigned int*   key;
+        unsigned int*   tmp_index;
+        unsigned int*   tmp_key;
+        unsigned int*   rows;
+        unsigned int*   hist;
+        vec3f*          sorted;
+} grid;
+
+/**
+ * Implementation: grid.c
+ * Description:
+ * * Broad-phase and neighbor queries. grid_init()
+ * * allocates everything for up to capacity points,
+ * * so rebuilding every frame does not allocate.
+ * * Building and the batched queries run on the
+ * * worker pool and produce the same output for any
+ * * thread count. Queries return the number of hits
+ * * and store at most max of them in dest.
+ */
+int     grid_init(grid* g, float cell, size_t capacity);
+void    grid_free(grid* g);
+int     grid_build(grid* g, vec3f* points, size_t count);
+size_t  grid_query_radius(grid* g, vec3f* center, float radius, unsigned int* dest, size_t max);
+size_t  grid_query_radius_array(grid* g, vec3f* centers, size_t count, float radius,
+                unsigned int* offsets, unsigned int* dest, size_t max);
+size_t  grid_query_pairs(grid* g, float radius, unsigned int* dest, size_t max);
+
+/**
+ * Balanced k-d tree over a point set with an implicit
+ * layout: split and axis hold one plane per inner
+ * node, and the points are stored reordered by leaf in
+ * separate x, y and z streams alongside their ids.
+ */
+typedef struct {
+        size_t          count;
+        size_t          capacity;
+        int             depth;
+        float*          split;
+        unsigned char*  axis;
+        float*          x;
+        float*          y;
+        float*          z;
+        unsigned int*   index;
+} kdtree;
+
+/**
+ * Implementation: kdtree.c
+ * Description:
+ * * Nearest neighbor, k nearest and radius queries.
+ * * kdtree_init() allocates everything for up to
+ * * capacity points; building and queries allocate
+ * * nothing. The build and the batched queries run on
+ * * the worker pool with results independent of the
+ * * thread count. Ids are positions in the array
+ * * given to kdtree_build().
+ */
+int             kdtree_init(kdtree* tree, size_t capacity);
+void            kdtree_free(kdtree* tree);
+int             kdtree_build(kdtree* tree, vec3f* points, size_t count);
+unsigned int    kdtree_nearest(kdtree* tree, vec3f* q, float* dist2);
+size_t          kdtree_knn(kdtree* tree, vec3f* q, size_t k, unsigned int* dest, float* dist2);
+size_t          kdtree_query_radius(kdtree* tree, vec3f* center, float radius, unsigned int* dest, size_t max);
+void            kdtree_nearest_array(kdtree* tree, vec3f* q, size_t count, unsigned int* dest, float* dist2);
+void            kdtree_knn_array(kdtree* tree, vec3f* q, size_t count, size_t k,
+                        unsigned int* dest, float* dist2);
+size_t          kdtree_query_radius_array(kdtree* tree, vec3f* centers, size_t count, float radius,
+                        unsigned int* offsets, unsigned int* dest, size_t max);
+
+/**
+ * Axis aligned box and sphere. An empty box has min
+ * above max.
+ */
+typedef struct {
+        vec3f           min;
+        vec3f           max;
+} aabb;
+
+typedef struct {
+        vec3f           center;
+        float           radius;
+} sphere;
+
+/**
+ * Implementation: bounds.c
+ * Description:
+ * * Bounding volumes of point arrays and SoA streams,
+ * * with SIMD reductions that split large inputs
+ * * across the worker pool. aabb_transform_array()
+ * * transforms and bounds in one pass.
+ */
+void    aabb_from_array(vec3f* src, aabb* dest, size_t count);
+void    aabb_from_soa(vec3f_soa* src, aabb* dest, size_t count);
+void    aabb_transform_array(mat4f* mat, vec3f* src, vec3f* dest, aabb* bounds, size_t count);
+void    sphere_from_aabb(aabb* box, sphere* dest);
+void    sphere_from_array(vec3f* src, sphere* dest, size_t count);
+
+/**
+ * Implementation: trig.c
+ * Description:
+ * * Vectorized sin/cos, atan2 and acos over float
+ * * arrays, and batch rotation builders on top of them.
+ * * Euler angles are x, y, z in radians, applied in
+ * * that order. Error bounds are documented in trig.c.
+ */
+void    cgmath_sincos_array(float* src, float* s, float* c, size_t count);
+void    cgmath_atan2_array(float* y, float* x, float* dest, size_t count);
+void    cgmath_acos_array(float* src, float* dest, size_t count);
+
+void    mat2f_rotation(float angle, mat2f* dest);
+void    mat2f_rotation_array(float* angle, mat2f* dest, size_t count);
+void    mat3f_rotation_axis_angle(vec3f* axis, float angle, mat3f* dest);
+void    mat3f_rotation_axis_angle_array(vec3f* axis, float* angle, mat3f* dest, size_t count);
+void    mat3f_from_euler_array(vec3f* euler, mat3f* dest, size_t count);
+void    mat4f_from_euler_array(vec3f* euler, mat4f* dest, size_t count);
+void    quat_from_euler_array(vec3f* euler, quat* dest, size_t count);
+
+/**
+ * Implementation: affine2f.c
+ * Description:
+ * * 2D affine transforms, and batch kernels that apply
+ * * them to vec2f arrays and expand sprites into quad
+ * * corners written straight into a vertex buffer.
+ * * affine2f_inverse() returns -1 when the transform is
+ * * singular.
+ */
+void    affine2f_identity(affine2f* dest);
+void    affine2f_from_mat2f(mat2f* mat, vec2f* translation, affine2f* dest);
+void    affine2f_multiply(affine2f* a, affine2f* b, affine2f* dest);
+int     affine2f_inverse(affine2f* a, affine2f* dest);
+void    affine2f_transform_array(affine2f* a, vec2f* src, vec2f* dest, size_t count);
+void    sprite_expand_array(affine2f* view, affine2f* sprites, vec2f* corners,
+                void* dest, size_t stride, size_t count);
+
+/**
+ * Implementation: quant.c
+ * Description:
+ * * Batch encode and decode of compressed rotations and
+ * * directions: smallest three quaternions in 32 or 48
+ * * bits, octahedral unit vectors in 16 or 32 bits, and
+ * * half float vectors. Error bounds are documented in
+ * * quant.c.
+ */
+void    quat_encode32_array(quat* src, uint32_t* dest, size_t count);
+void    quat_decode32_array(uint32_t* src, quat* dest, size_t count);
+void    quat_encode48_array(quat* src, quat48* dest, size_t count);
+void    quat_decode48_array(quat48* src, quat* dest, size_t count);
+void    vec3f_encode_oct16_array(vec3f* src, uint16_t* dest, size_t count);
+void    vec3f_decode_oct16_array(uint16_t* src, vec3f* dest, size_t count);
+void    vec3f_encode_oct32_array(vec3f* src, uint32_t* dest, size_t count);
+void    vec3f_decode_oct32_array(uint32_t* src, vec3f* dest, size_t count);
+void    vec3f_to_half_array(vec3f* src, vec3h* dest, size_t count);
+void    vec3f_from_half_array(vec3h* src, vec3f* dest, size_t count);
+void    vec4f_to_half_array(vec4f* src, vec4h* dest, size_t count);
+void    vec4f_from_half_array(vec4h* src, vec4f* dest, size_t count);
+
+#define CGMATH_NO_TRANS         0
+#define CGMATH_TRANS            1
+
+/**
+ * Implementation: matf.c
+ * Description:
+ * * Dense matrices of any size through matf views.
+ * * matf_gemm() is a packed, cache-blocked GEMM with
+ * * SIMD micro-kernels, split across the worker pool;
+ * * matf_gemv() is its matrix-vector counterpart. Both
+ * * follow the BLAS conventions for alpha, beta and
+ * * transposition. All three return -1 on mismatched
+ * * shapes; matf_gemv() takes the vector lengths for
+ * * that.
+ */
+void    matf_view(matf* mat, float* data, int rows, int cols, int stride);
+void    matf_sub(matf* mat, int row, int col, int rows, int cols, matf* dest);
+int     matf_gemm(int trans_a, int trans_b, float alpha, matf* a, matf* b, float beta, matf* c);
+int     matf_multiply(matf* a, matf* b, matf* dest);
+int     matf_gemv(int trans, float alpha, matf* a, float* x, int nx, float beta, float* y, int ny);
+
+/**
+ * Implementation: solve.c
+ * Description:
+ * * Direct solves of mat * x = b for the fixed size
+ * * matrices, by LU with partial pivoting or Cholesky,
+ * * without forming the inverse. Every function reports
+ * * singular or indefinite matrices: the single system
+ * * forms return -1 and the batch forms flag the system
+ * * and count it, like mat4f_inverse_array().
+ */
+int     mat2f_lu(mat2f* mat, mat2f* dest, int* perm);
+void    mat2f_lu_solve(mat2f* lu, int* perm, vec2f* b, vec2f* x);
+int     mat2f_cholesky(mat2f* mat, mat2f* dest);
+void    mat2f_cholesky_solve(mat2f* l, vec2f* b, vec2f* x);
+int     mat2f_solve(mat2f* mat, vec2f* b, vec2f* x);
+int     mat2f_solve_spd(mat2f* mat, vec2f* b, vec2f* x);
+size_t  mat2f_solve_array(mat2f* mat, vec2f* b, vec2f* x, unsigned char* singular, size_t count);
+size_t  mat2f_solve_spd_array(mat2f* mat, vec2f* b, vec2f* x, unsigned char* singular, size_t count);
+
+int     mat3f_lu(mat3f* mat, mat3f* dest, int* perm);
+void    mat3f_lu_solve(mat3f* lu, int* perm, vec3f* b, vec3f* x);
+int     mat3f_cholesky(mat3f* mat, mat3f* dest);
+void    mat3f_cholesky_solve(mat3f* l, vec3f* b, vec3f* x);
+int     mat3f_solve(mat3f* mat, vec3f* b, vec3f* x);
+int     mat3f_solve_spd(mat3f* mat, vec3f* b, vec3f* x);
+size_t  mat3f_solve_array(mat3f* mat, vec3f* b, vec3f* x, unsigned char* singular, size_t count);
+size_t  mat3f_solve_spd_array(mat3f* mat, vec3f* b, vec3f* x, unsigned char* singular, size_t count);
+
+int     mat4f_lu(mat4f* mat, mat4f* dest, int* perm);
+void    mat4f_lu_solve(mat4f* lu, int* perm, vec4f* b, vec4f* x);
+int     mat4f_cholesky(mat4f* mat, mat4f* dest);
+void    mat4f_cholesky_solve(mat4f* l, vec4f* b, vec4f* x);
+int     mat4f_solve(mat4f* mat, vec4f* b, vec4f* x);
+int     mat4f_solve_spd(mat4f* mat, vec4f* b, vec4f* x);
+size_t  mat4f_solve_array(mat4f* mat, vec4f* b, vec4f* x, unsigned char* singular, size_t count);
+size_t  mat4f_solve_spd_array(mat4f* mat, vec4f* b, vec4f* x, unsigned char* singular, size_t count);
+
+/**
+ * Implementation: weld.c
+ * Description:
+ * * Vertex welding for mesh import: merges vertices
+ * * within a tolerance through a parallel hash of
+ * * quantized positions and returns a remap table and
+ * * the compacted vertices. The result is the same as
+ * * a sequential first-come weld on every run.
+ */
+size_t  vec3f_weld(vec3f* src, size_t count, float tolerance, unsigned int* remap, vec3f* dest);
+
+/**
+ * Triangle list with its corners (3 * triangle + k)
+ * sorted by vertex: the corners of vertex v are
+ * corner[start[v] .. start[v + 1]). a and b hold
+ * per triangle and weight per corner scratch for the
+ * passes below.
+ */
+typedef struct {
+        size_t          vertices;
+        size_t          triangles;
+        unsigned int*   start;
+        unsigned int*   index;
+        unsigned int*   corner;
+        vec3f*          a;
+        vec3f*          b;
+        float*          weight;
+} mesh;
+
+#define CGMATH_MESH_AREA        0
+#define CGMATH_MESH_ANGLE       1
+
+/**
+ * Implementation: mesh.c
+ * Description:
+ * * Vertex normals and MikkTSpace style tangents of an
+ * * indexed triangle list. mesh_init() builds the
+ * * vertex to corner table once for a topology, so
+ * * recomputing them for a deforming mesh every frame
+ * * does not allocate. Both passes run on the worker
+ * * pool and give the same result for any thread count.
+ */
+int     mesh_init(mesh* m, unsigned int* indices, size_t triangles, size_t vertices);
+void    mesh_free(mesh* m);
+void    mesh_normals(mesh* m, vec3f* pos, int weight, vec3f* dest);
+void    mesh_tangents(mesh* m, vec3f* pos, vec3f* normals, vec2f* uv, vec4f* dest);
+
+/**
+ * Implementation: clip.c
+ * Description:
+ * * Batched clipping of clip space triangles against
+ * * the view volume with the perspective divide, for
+ * * software rasterization and decal projection. Most
+ * * triangles are accepted or rejected by SIMD
+ * * outcodes; the rest are clipped on the stack. The
+ * * output goes to caller buffers in input order.
+ */
+size_t  vec4f_clip_triangles(vec4f* src, size_t count, vec4f* dest, unsigned int* source, size_t max);
+
+/**
+ * Depth-only render target of width x height pixels,
+ * stored in 8 x 8 tiles of 64 floats, with hiz holding
+ * the farthest depth of each tile. Depth is 0 at the
+ * near plane and 1 at the far plane. bins and scratch
+ * are for depth_buffer_render().
+ */
+typedef struct {
+        int             width;
+        int             height;
+        int             tiles_x;
+        int             tiles_y;
+        int             bins_x;
+        int             bins_y;
+        float*          depth;
+        float*          hiz;
+        unsigned int*   bins;
+        void*           scratch;
+        size_t          scratch_size;
+} depth_buffer;
+
+/**
+ * Implementation: raster.c
+ * Description:
+ * * Tiled depth-only software rasterizer for occlusion
+ * * culling. Occluder meshes are rendered into a low
+ * * resolution depth buffer in parallel by a SIMD kernel,
+ * * and batches of boxes are tested against its
+ * * hierarchical depth. Rendering the same occluders
+ * * gives the same buffer for any thread count.
+ */
+int     depth_buffer_init(depth_buffer* db, int width, int height);
+void    depth_buffer_free(depth_buffer* db);
+void    depth_buffer_clear(depth_buffer* db);
+float   depth_buffer_read(depth_buffer* db, int x, int y);
+int     depth_buffer_render(depth_buffer* db, mat4f* mat, vec3f* pos, size_t vertices,
+                unsigned int* indices, size_t triangles);
+size_t  depth_buffer_test_aabb(depth_buffer* db, mat4f* mat, aabb* boxes, unsigned char* visible, size_t count);
+
+#define CGMATH_ISA_SCALAR       0
+#define CGMATH_ISA_SSE2         1
+#define CGMATH_ISA_AVX2         2
+#define CGMATH_ISA_AVX512       3
+
+/**
+ * Implementation: dispatch.c
+ * Description:
+ * * Runtime selection of the instruction set used by
+ * * the dispatched entry points. The best supported
+ * * level is chosen at load time unless CGMATH_ISA is
+ * * set in the environment. cgmath_isa_select() clamps
+ * * to what the CPU supports and returns the level it
+ * * bound; it is not safe to call while other threads
+ * * are inside the library.
+ */
+int     cgmath_isa_detected(void);
+int     cgmath_isa_level(void);
+int     cgmath_isa_select(int level);
+const char* cgmath_isa_name(int level);
+
+/**
+ * Implementation: thread.c
+ * Description:
+ * * Number of threads the batch kernels may use,
+ * * counting the caller. Defaults to CGMATH_THREADS
+ * * from the environment, or the number of online
+ * * CPUs. Only takes effect before the first large
+ * * batch call, which starts the worker pool; later
+ * * calls can lower the count but not raise it.
+ */
+int     cgmath_threads(void);
+void    cgmath_set_threads(int count);
+
+/**
+ * Records are stride bytes apart after a header of
+ * header bytes. position and normal are byte offsets
+ * of a vec3f within a record, or -1 for none. chunk,
+ * buffers and threads may be 0 to use the defaults.
+ */
+typedef struct {
+        size_t  stride;
+        int     position;
+        int     normal;
+        size_t  header;
+        size_t  chunk;
+        int     buffers;
+        int     threads;
+} xform_layout;
+
+/**
+ * Implementation: xform.c
+ * Description:
+ * * Transforms the vertex file src into dest without
+ * * loading it: src is memory mapped, chunks of chunk
+ * * records are transformed by worker threads into one
+ * * of buffers staging buffers, and the calling thread
+ * * writes them out in order. Positions are transformed
+ * * by mat, normals by its inverse transpose. The
+ * * header and any trailing partial record are copied
+ * * unchanged. dest may not be src or another link to
+ * * it. Returns 0 on success and -1 on failure, with
+ * * errno set to EDOM if the layout has normals and mat
+ * * cannot be inverted.
+ */
+void    xform_layout_init(xform_layout* layout, size_t stride);
+int     xform_file(const char* src, const char* dest, mat4f* mat, xform_layout* layout);
+
+#define CGMATH_PACK_FLOAT       0
+#define CGMATH_PACK_VEC2F       1
+#define CGMATH_PACK_VEC3F       2
+#define CGMATH_PACK_VEC4F       3
+#define CGMATH_PACK_QUAT        4
+#define CGMATH_PACK_MAT2F       5
+#define CGMATH_PACK_MAT3F       6
+#define CGMATH_PACK_MAT4F       7
+#define CGMATH_PACK_AFFINE2F    8
+#define CGMATH_PACK_VEC3F_SOA   9
+#define CGMATH_PACK_VEC4F_SOA   10
+#define CGMATH_PACK_QUAT_SOA    11
+#define CGMATH_PACK_MAT3F_SOA   12
+#define CGMATH_PACK_TYPES       13
+
+/* section names are shorter than CGMATH_PACK_NAME */
+#define CGMATH_PACK_NAME        48
+#define CGMATH_PACK_ALIGN       64
+
+/* pack_open() flags */
+#define CGMATH_PACK_VERIFY      1
+
+typedef struct {
+        int     fd;
+        int     error;
+        int     sections;
+        int     capacity;
+        size_t  size;
+        void*   table;
+        char*   path;
+} pack_writer;
+
+/**
+ * A mapped pack file. Views returned from it point
+ * into the read only mapping and stay valid until
+ * pack_close().
+ */
+typedef struct {
+        unsigned char*  map;
+        size_t          size;
+        int             sections;
+        const void*     table;
+} pack_file;
+
+/**
+ * Implementation: pack.c
+ * Description:
+ * * Binary container of named, typed arrays that is
+ * * loaded by mapping it instead of parsing it. Every
+ * * array starts on a CGMATH_PACK_ALIGN boundary, so
+ * * views can go straight to the SIMD kernels. The
+ * * header records the byte order, version and a
+ * * checksum of the table, and each section its type,
+ * * count and checksum. Functions returning int return
+ * * 0 on success and -1 on failure; pack_find() returns
+ * * the section index or -1.
+ */
+int     pack_writer_init(pack_writer* w, const char* path);
+int     pack_write(pack_writer* w, const char* name, int type, const void* src, size_t count);
+int     pack_writer_finish(pack_writer* w);
+
+int     pack_open(pack_file* f, const char* path, int flags);
+void    pack_close(pack_file* f);
+int     pack_find(pack_file* f, const char* name);
+int     pack_section_info(pack_file* f, int section, const char** name, int* type, size_t* count);
+const void* pack_view(pack_file* f, const char* name, int type, size_t* count);
+int     pack_view_soa(pack_file* f, const char* name, int type, float** planes, size_t* count);
+int     pack_verify(pack_file* f, const char* name);
+
+#if defined(CGMATH_PROFILE)
+#include <stdio.h>
+
+#define CGMATH_PROFILE_BUCKETS  32
+
+#define CGMATH_PROFILE_TEXT     0
+#define CGMATH_PROFILE_JSON     1
+
+typedef struct {
+        const char*             name;
+        unsigned long long      calls;
+        unsigned long long      elems;
+        unsigned long long      cycles;
+        unsigned long long      hist[CGMATH_PROFILE_BUCKETS];
+} cgmath_profile_stats;
+
+/**
+ * Implementation: profile.c
+ * Description:
+ * * Only available when the library and its user are
+ * * both built with CGMATH_PROFILE. Counters are kept
+ * * per thread and summed on query; cycles are read
+ * * from the time stamp counter and bucketed by log2.
+ */
+int     cgmath_profile_count(void);
+int     cgmath_profile_find(const char* name);
+int     cgmath_profile_get(int index, cgmath_profile_stats* dest);
+void    cgmath_profile_reset(void);
+void    cgmath_profile_dump(FILE* stream, int format);
+#endif
+
 #endif
 
@@ -0,0 +1,229 @@
+/**
+ * File: cgmath_profile.h
+ * Description:
+ * * Private instrumentation hooks. Every public entry
+ * * point opens a profiling scope on its first line;
+ * * unless the library is built with CGMATH_PROFILE
+ * * the scope expands to nothing at all.
+ */
+
+#ifndef CGMATH_PROFILE_PRIVATE_H
+#define CGMATH_PROFILE_PRIVATE_H
+
+#if defined(CGMATH_PROFILE)
+
+/**
+ * One entry per instrumented function. The order
+ * here is the order used by cgmath_profile_get()
+ * and by the dumps, so keep it grouped by module.
+ */
+#define CGMATH_PROFILE_FUNCS(X) \
+        X(vec2f_zero) \
+        X(vec2f_identity) \
+        X(vec2f_add) \
+        X(vec2f_scale) \
+        X(vec2f_scalar_prod) \
+        X(vec2f_sqr_mag) \
+        X(vec2f_normalize) \
+        X(vec3f_zero) \
+        X(vec3f_identity) \
+        X(vec3f_add) \
+        X(vec3f_scale) \
+        X(vec3f_scalar_prod) \
+        X(vec3f_vector_prod) \
+        X(vec3f_sqr_mag) \
+        X(vec3f_normalize) \
+        X(vec4f_zero) \
+        X(vec4f_identity) \
+        X(vec4f_add) \
+        X(vec4f_scale) \
+        X(vec4f_scalar_prod) \
+        X(vec4f_sqr_mag) \
+        X(vec4f_normalize) \
+        X(mat2f_zero) \
+        X(mat2f_identity) \
+        X(mat2f_add) \
+        X(mat2f_scale) \
+        X(mat2f_multiply) \
+        X(mat2f_determinant) \
+        X(mat2f_transpose) \
+        X(mat2f_inverse) \
+        X(mat2f_get_row) \
+        X(mat2f_get_col) \
+        X(mat2f_set_row) \
+        X(mat2f_set_col) \
+        X(mat3f_zero) \
+        X(mat3f_identity) \
+        X(mat3f_add) \
+        X(mat3f_scale) \
+        X(mat3f_multiply) \
+        X(mat3f_determinant) \
+        X(mat3f_transpose) \
+        X(mat3f_inverse) \
+        X(mat3f_get_row) \
+        X(mat3f_get_col) \
+        X(mat3f_set_row) \
+        X(mat3f_set_col) \
+        X(mat3f_determinant_array) \
+        X(mat3f_inverse_array) \
+        X(mat3f_inverse_sym_array) \
+        X(mat3f_determinant_soa) \
+        X(mat3f_inverse_soa) \
+        X(mat3f_inverse_sym_soa) \
+        X(mat4f_zero) \
+        X(mat4f_identity) \
+        X(mat4f_add) \
+        X(mat4f_scale) \
+        X(mat4f_multiply) \
+        X(mat4f_determinant) \
+        X(mat4f_transpose) \
+        X(mat4f_inverse) \
+        X(mat4f_get_row) \
+        X(mat4f_get_col) \
+        X(mat4f_set_row) \
+        X(mat4f_set_col) \
+        X(mat4f_transform_point_array) \
+        X(mat4f_transform_normal_array) \
+        X(mat4f_inverse_array) \
+        X(mat4f_stack_push) \
+        X(mat4f_stack_pop) \
+        X(mat4f_stack_load) \
+        X(mat4f_stack_load_identity) \
+        X(mat4f_stack_mult) \
+        X(mat4f_stack_translate) \
+        X(mat4f_stack_rotate) \
+        X(mat4f_stack_scale) \
+        X(mat4f_stack_top) \
+        X(camera_set_view) \
+        X(camera_set_projection) \
+        X(camera_look_at) \
+        X(camera_perspective) \
+        X(camera_ortho) \
+        X(camera_view_proj) \
+        X(camera_inv_view) \
+        X(camera_inv_projection) \
+        X(camera_inv_view_proj) \
+        X(camera_frustum) \
+        X(anim_sample_vec3f) \
+        X(anim_sample_quat) \
+        X(rigid_integrate) \
+        X(grid_build) \
+        X(grid_query_radius) \
+        X(grid_query_radius_array) \
+        X(grid_query_pairs) \
+        X(kdtree_build) \
+        X(kdtree_nearest) \
+        X(kdtree_knn) \
+        X(kdtree_query_radius) \
+        X(kdtree_nearest_array) \
+        X(kdtree_knn_array) \
+        X(kdtree_query_radius_array) \
+        X(vec3f_sum_array) \
+        X(vec3f_centroid_array) \
+        X(vec3f_covariance_array) \
+        X(vec3f_covariance_gather) \
+        X(mat3f_eigen_sym) \
+        X(mat3f_eigen_sym_array) \
+        X(mat3f_eigen_sym_soa) \
+        X(aabb_from_array) \
+        X(aabb_from_soa) \
+        X(aabb_transform_array) \
+        X(sphere_from_aabb) \
+        X(sphere_from_array) \
+        X(cgmath_sincos_array) \
+        X(cgmath_atan2_array) \
+        X(cgmath_acos_array) \
+        X(mat2f_rotation) \
+        X(mat2f_rotation_array) \
+        X(mat3f_rotation_axis_angle) \
+        X(mat3f_rotation_axis_angle_array) \
+        X(mat3f_from_euler_array) \
+        X(mat4f_from_euler_array) \
+        X(quat_from_euler_array) \
+        X(affine2f_identity) \
+        X(affine2f_from_mat2f) \
+        X(affine2f_multiply) \
+        X(affine2f_inverse) \
+        X(affine2f_transform_array) \
+        X(sprite_expand_array) \
+        X(pack_open) \
+        X(pack_verify) \
+        X(quat_encode32_array) \
+        X(quat_decode32_array) \
+        X(quat_encode48_array) \
+        X(quat_decode48_array) \
+        X(vec3f_encode_oct16_array) \
+        X(vec3f_decode_oct16_array) \
+        X(vec3f_encode_oct32_array) \
+        X(vec3f_decode_oct32_array) \
+        X(vec3f_to_half_array) \
+        X(vec3f_from_half_array) \
+        X(vec4f_to_half_array) \
+        X(vec4f_from_half_array) \
+        X(matf_gemm) \
+        X(matf_gemv) \
+        X(mat2f_lu) \
+        X(mat2f_lu_solve) \
+        X(mat2f_cholesky) \
+        X(mat2f_cholesky_solve) \
+        X(mat2f_solve) \
+        X(mat2f_solve_spd) \
+        X(mat2f_solve_array) \
+        X(mat2f_solve_spd_array) \
+        X(mat3f_lu) \
+        X(mat3f_lu_solve) \
+        X(mat3f_cholesky) \
+        X(mat3f_cholesky_solve) \
+        X(mat3f_solve) \
+        X(mat3f_solve_spd) \
+        X(mat3f_solve_array) \
+        X(mat3f_solve_spd_array) \
+        X(mat4f_lu) \
+        X(mat4f_lu_solve) \
+        X(mat4f_cholesky) \
+        X(mat4f_cholesky_solve) \
+        X(mat4f_solve) \
+        X(mat4f_solve_spd) \
+        X(mat4f_solve_array) \
+        X(mat4f_solve_spd_array) \
+        X(vec3f_weld) \
+        X(vec3f_normalize_array) \
+        X(mesh_init) \
+        X(mesh_normals) \
+        X(mesh_tangents) \
+        X(vec4f_clip_triangles) \
+        X(depth_buffer_render) \
+        X(depth_buffer_test_aabb)
+
+#define CGMATH_PROFILE_ENUM(f) CGMATH_PROF_##f,
+enum {
+        CGMATH_PROFILE_FUNCS(CGMATH_PROFILE_ENUM)
+        CGMATH_PROF_COUNT
+};
+#undef CGMATH_PROFILE_ENUM
+
+struct _cgmath_prof_scope {
+        int id;
+        unsigned long long t0;
+};
+
+struct _cgmath_prof_scope _cgmath_prof_enter(int id, unsigned long long elems);
+void _cgmath_prof_leave(struct _cgmath_prof_scope* scope);
+
+/**
+ * Counts one call of f touching n elements, and the
+ * cycles spent until the enclosing block is left.
+ * Timings are inclusive of any nested cgmath calls.
+ */
+#define CGMATH_PROFILE_SCOPE(f, n) \
+        struct _cgmath_prof_scope _cgmath_prof_s \
+        __attribute__((cleanup(_cgmath_prof_leave))) = \
+        _cgmath_prof_enter(CGMATH_PROF_##f, (n))
+
+#else
+
+#define CGMATH_PROFILE_SCOPE(f, n)
+
+#endif
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * File: cgmath_simd.h
+ * Description:
+ * * Private kernel table used for runtime dispatch.
+ * * Each dispatched entry point has a portable scalar
+ * * implementation and zero or more ISA specific ones
+ * * compiled with target attributes, so the makefile
+ * * does not need per-file ISA flags. dispatch.c binds
+ * * the best variant for the running CPU at load time.
+ */
+
+#ifndef CGMATH_SIMD_H
+#define CGMATH_SIMD_H
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CGMATH_X86
+#include <float.h>
+#include <immintrin.h>
+
+#define CGMATH_TARGET_SSE2      __attribute__((target("sse2")))
+#define CGMATH_TARGET_AVX2      __attribute__((target("avx2,fma,f16c")))
+#define CGMATH_TARGET_AVX512    __attribute__((target("avx512f,avx512vl,avx2,fma,f16c")))
+#endif
+
+#if defined(CGMATH_X86)
+/**
+ * Converts four packed vec3f (three registers worth of
+ * x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) to and from
+ * one register per component.
+ */
+CGMATH_TARGET_SSE2
+static inline void _cgmath_load3x4_sse2(float* p, __m128* x, __m128* y, __m128* z)
+{
+        __m128 a;
+        __m128 b;
+        __m128 c;
+        __m128 t;
+
+        a = _mm_loadu_ps(p);
+        b = _mm_loadu_ps(p + 4);
+        c = _mm_loadu_ps(p + 8);
+
+        t = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));
+        *x = _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 3, 0));
+        *y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), t,
+                        _MM_SHUFFLE(3, 1, 2, 0));
+        *z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                        _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+                        _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+CGMATH_TARGET_SSE2
+static inline void _cgmath_store3x4_sse2(float* p, __m128 x, __m128 y, __m128 z)
+{
+        _mm_storeu_ps(p, _mm_shuffle_ps(
+                        _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)),
+                        _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)),
+                        _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(p + 4, _mm_shuffle_ps(
+                        _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)),
+                        _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)),
+                        _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(p + 8, _mm_shuffle_ps(
+                        _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)),
+                        _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)),
+                        _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/* eight packed vec3f to one register per component */
+CGMATH_TARGET_AVX2
+static inline void _cgmath_load3x8_avx2(vec3f* src, __m256* p)
+{
+        int k;
+        __m128 lo[3];
+        __m128 hi[3];
+
+        _cgmath_load3x4_sse2(src[0].m, &lo[0], &lo[1], &lo[2]);
+        _cgmath_load3x4_sse2(src[4].m, &hi[0], &hi[1], &hi[2]);
+        for(k = 0; k < 3; k++) {
+                p[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[k]), hi[k], 1);
+        }
+}
+
+CGMATH_TARGET_AVX2
+static inline void _cgmath_store3x8_avx2(vec3f* dest, __m256* p)
+{
+        _cgmath_store3x4_sse2(dest[0].m, _mm256_castps256_ps128(p[0]),
+                        _mm256_castps256_ps128(p[1]), _mm256_castps256_ps128(p[2]));
+        _cgmath_store3x4_sse2(dest[4].m, _mm256_extractf128_ps(p[0], 1),
+                        _mm256_extractf128_ps(p[1], 1), _mm256_extractf128_ps(p[2], 1));
+}
+
+/**
+ * In-place 8x8 transpose: afterwards r[k] holds what
+ * was element k of each of r[0..7].
+ */
+CGMATH_TARGET_AVX2
+static inline void _cgmath_transpose8_avx2(__m256* r)
+{
+        int k;
+        __m256 t[8];
+        __m256 u[8];
+
+        for(k = 0; k < 8; k += 2) {
+                t[k] = _mm256_unpacklo_ps(r[k], r[k + 1]);
+                t[k + 1] = _mm256_unpackhi_ps(r[k], r[k + 1]);
+        }
+        for(k = 0; k < 8; k += 4) {
+                u[k] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+                u[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+                u[k + 2] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+                u[k + 3] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        for(k = 0; k < 4; k++) {
+                r[k] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x20);
+                r[k + 4] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x31);
+        }
+}
+
+/**
+ * 1/sqrt(d) to about 23 bits, and 0 where d is zero,
+ * denormal or infinite, where the estimate would turn
+ * the Newton step into a NaN.
+ */
+CGMATH_TARGET_SSE2
+static inline __m128 _cgmath_rsqrt_sse2(__m128 d)
+{
+        __m128 r;
+
+        r = _mm_rsqrt_ps(d);
+        r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f),
+                        _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), d), _mm_mul_ps(r, r))));
+        return _mm_and_ps(r, _mm_and_ps(_mm_cmpge_ps(d, _mm_set1_ps(FLT_MIN)),
+                        _mm_cmple_ps(d, _mm_set1_ps(FLT_MAX))));
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _cgmath_rsqrt_avx2(__m256 d)
+{
+        __m256 r;
+
+        r = _mm256_rsqrt_ps(d);
+        r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), d),
+                        _mm256_mul_ps(r, r), _mm256_set1_ps(1.5f)));
+        return _mm256_and_ps(r, _mm256_and_ps(
+                        _mm256_cmp_ps(d, _mm256_set1_ps(FLT_MIN), _CMP_GE_OQ),
+                        _mm256_cmp_ps(d, _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ)));
+}
+#endif
+
+struct _cgmath_kernels {
+        void    (*vec4f_normalize)(vec4f* vec, vec4f* dest);
+        void    (*mat4f_multiply)(mat4f* a, mat4f* b, mat4f* dest);
+        float   (*mat4f_determinant)(mat4f* mat);
+        void    (*mat4f_transpose)(mat4f* mat, mat4f* dest);
+        void    (*mat4f_inverse)(mat4f* mat, mat4f* dest);
+        void    (*mat4f_transform_point_array)(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+        void    (*mat4f_transform_normal_array)(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+        size_t  (*mat4f_inverse_array)(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count);
+        void    (*mat3f_determinant_soa)(mat3f_soa* mat, float* dest, size_t count);
+        size_t  (*mat3f_inverse_soa)(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+        size_t  (*mat3f_inverse_sym_soa)(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+        void    (*rigid_integrate)(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                        size_t begin, size_t end);
+        void    (*kdtree_leaf_dist2)(float* x, float* y, float* z, float* q, float* dest, size_t count);
+        void    (*vec3f_moments)(vec3f* src, float* center, int order, double* dest, size_t count);
+        void    (*mat3f_eigen_sym_soa)(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count);
+        void    (*aabb_minmax_array)(vec3f* src, float* box, size_t count);
+        void    (*aabb_minmax_soa)(float* x, float* y, float* z, float* box, size_t count);
+        void    (*aabb_transform_array)(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count);
+        void    (*sphere_grow)(vec3f* src, float* s, size_t count);
+        void    (*sincos_array)(float* src, float* s, float* c, size_t count);
+        void    (*atan2_array)(float* y, float* x, float* dest, size_t count);
+        void    (*acos_array)(float* src, float* dest, size_t count);
+        void    (*mat2f_rotation_array)(float* angle, mat2f* dest, size_t count);
+        void    (*mat3f_rotation_axis_angle_array)(vec3f* axis, float* angle, mat3f* dest, size_t count);
+        void    (*mat3f_from_euler_array)(vec3f* src, mat3f* dest, size_t count);
+        void    (*mat4f_from_euler_array)(vec3f* src, mat4f* dest, size_t count);
+        void    (*quat_from_euler_array)(vec3f* src, quat* dest, size_t count);
+        void    (*affine2f_transform_array)(affine2f* a, vec2f* src, vec2f* dest, size_t count);
+        void    (*sprite_expand_array)(affine2f* view, affine2f* sprites, float* corners,
+                        char* dest, size_t stride, size_t count);
+        void    (*quat_encode_array)(quat* src, void* dest, int bits, size_t count);
+        void    (*quat_decode_array)(void* src, quat* dest, int bits, size_t count);
+        void    (*oct_encode_array)(vec3f* src, void* dest, int bits, size_t count);
+        void    (*oct_decode_array)(void* src, vec3f* dest, int bits, size_t count);
+        void    (*half_from_float_array)(float* src, uint16_t* dest, size_t count);
+        void    (*float_from_half_array)(uint16_t* src, float* dest, size_t count);
+        void    (*matf_gemm_kernel)(int k, float* a, float* b, float alpha, float beta,
+                        float* c, int ldc, int m, int n);
+        void    (*matf_gemv_rows)(float* a, int lda, int rows, int cols, float* x,
+                        float alpha, float beta, float* dest);
+        void    (*matf_gemv_cols)(float* a, int lda, int rows, int cols, float* x,
+                        float alpha, float beta, float* dest);
+        size_t  (*mat_solve_soa)(int n, int spd, float** a, float** b, float** x,
+                        unsigned char* singular, size_t count);
+        void    (*vec3f_normalize_array)(vec3f* src, vec3f* dest, size_t count);
+        void    (*clip_outcodes)(vec4f* src, unsigned char* dest, size_t count);
+        void    (*clip_project)(vec4f* src, vec4f* dest, size_t count);
+        void    (*raster_tri)(float* depth, int tiles_x, float* tri, int x0, int y0, int x1, int y1);
+        void    (*raster_boxes)(mat4f* mat, aabb* boxes, float* dest, size_t count);
+};
+
+extern struct _cgmath_kernels _cgmath_kern;
+
+void    _vec4f_normalize_scalar(vec4f* vec, vec4f* dest);
+void    _mat4f_multiply_scalar(mat4f* a, mat4f* b, mat4f* dest);
+float   _mat4f_determinant_scalar(mat4f* mat);
+void    _mat4f_transpose_scalar(mat4f* mat, mat4f* dest);
+void    _mat4f_inverse_scalar(mat4f* mat, mat4f* dest);
+void    _mat4f_transform_point_array_scalar(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+void    _mat4f_transform_normal_array_scalar(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+size_t  _mat4f_inverse_array_scalar(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count);
+void    _mat3f_determinant_soa_scalar(mat3f_soa* mat, float* dest, size_t count);
+size_t  _mat3f_inverse_soa_scalar(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+size_t  _mat3f_inverse_sym_soa_scalar(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+void    _rigid_integrate_scalar(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                size_t begin, size_t end);
+void    _kdtree_leaf_dist2_scalar(float* x, float* y, float* z, float* q, float* dest, size_t count);
+void    _vec3f_moments_scalar(vec3f* src, float* center, int order, double* dest, size_t count);
+void    _mat3f_eigen_sym_soa_scalar(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count);
+void    _aabb_minmax_array_scalar(vec3f* src, float* box, size_t count);
+void    _aabb_minmax_soa_scalar(float* x, float* y, float* z, float* box, size_t count);
+void    _aabb_transform_array_scalar(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count);
+void    _sphere_grow_scalar(vec3f* src, float* s, size_t count);
+void    _sincos_array_scalar(float* src, float* s, float* c, size_t count);
+void    _atan2_array_scalar(float* y, float* x, float* dest, size_t count);
+void    _acos_array_scalar(float* src, float* dest, size_t count);
+void    _mat2f_rotation_array_scalar(float* angle, mat2f* dest, size_t count);
+void    _mat3f_rotation_axis_angle_array_scalar(vec3f* axis, float* angle, mat3f* dest, size_t count);
+void    _mat3f_from_euler_array_scalar(vec3f* src, mat3f* dest, size_t count);
+void    _mat4f_from_euler_array_scalar(vec3f* src, mat4f* dest, size_t count);
+void    _quat_from_euler_array_scalar(vec3f* src, quat* dest, size_t count);
+void    _affine2f_transform_array_scalar(affine2f* a, vec2f* src, vec2f* dest, size_t count);
+void    _sprite_expand_array_scalar(affine2f* view, affine2f* sprites, float* corners,
+                char* dest, size_t stride, size_t count);
+void    _quat_encode_array_scalar(quat* src, void* dest, int bits, size_t count);
+void    _quat_decode_array_scalar(void* src, quat* dest, int bits, size_t count);
+void    _oct_encode_array_scalar(vec3f* src, void* dest, int bits, size_t count);
+void    _oct_decode_array_scalar(void* src, vec3f* dest, int bits, size_t count);
+void    _half_from_float_array_scalar(float* src, uint16_t* dest, size_t count);
+void    _float_from_half_array_scalar(uint16_t* src, float* dest, size_t count);
+void    _matf_gemm_kernel_scalar(int k, float* a, float* b, float alpha, float beta,
+                float* c, int ldc, int m, int n);
+void    _matf_gemv_rows_scalar(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest);
+void    _matf_gemv_cols_scalar(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest);
+size_t  _mat_solve_soa_scalar(int n, int spd, float** a, float** b, float** x,
+                unsigned char* singular, size_t count);
+void    _vec3f_normalize_array_scalar(vec3f* src, vec3f* dest, size_t count);
+void    _clip_outcodes_scalar(vec4f* src, unsigned char* dest, size_t count);
+void    _clip_project_scalar(vec4f* src, vec4f* dest, size_t count);
+void    _raster_tri_scalar(float* depth, int tiles_x, float* tri, int x0, int y0, int x1, int y1);
+void    _raster_boxes_scalar(mat4f* mat, aabb* boxes, float* dest, size_t count);
+
+#if defined(CGMATH_X86)
+void    _vec4f_normalize_sse2(vec4f* vec, vec4f* dest);
+void    _mat4f_multiply_sse2(mat4f* a, mat4f* b, mat4f* dest);
+float   _mat4f_determinant_sse2(mat4f* mat);
+void    _mat4f_transpose_sse2(mat4f* mat, mat4f* dest);
+void    _mat4f_inverse_sse2(mat4f* mat, mat4f* dest);
+void    _mat4f_transform_point_array_sse2(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+void    _mat4f_transform_normal_array_sse2(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+size_t  _mat4f_inverse_array_sse2(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count);
+void    _mat3f_determinant_soa_sse2(mat3f_soa* mat, float* dest, size_t count);
+size_t  _mat3f_inverse_soa_sse2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+size_t  _mat3f_inverse_sym_soa_sse2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+void    _rigid_integrate_sse2(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                size_t begin, size_t end);
+void    _kdtree_leaf_dist2_sse2(float* x, float* y, float* z, float* q, float* dest, size_t count);
+void    _vec3f_moments_sse2(vec3f* src, float* center, int order, double* dest, size_t count);
+void    _mat3f_eigen_sym_soa_sse2(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count);
+void    _aabb_minmax_array_sse2(vec3f* src, float* box, size_t count);
+void    _aabb_minmax_soa_sse2(float* x, float* y, float* z, float* box, size_t count);
+void    _aabb_transform_array_sse2(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count);
+void    _sphere_grow_sse2(vec3f* src, float* s, size_t count);
+void    _sincos_array_sse2(float* src, float* s, float* c, size_t count);
+void    _atan2_array_sse2(float* y, float* x, float* dest, size_t count);
+void    _acos_array_sse2(float* src, float* dest, size_t count);
+void    _mat2f_rotation_array_sse2(float* angle, mat2f* dest, size_t count);
+void    _mat3f_rotation_axis_angle_array_sse2(vec3f* axis, float* angle, mat3f* dest, size_t count);
+void    _mat3f_from_euler_array_sse2(vec3f* src, mat3f* dest, size_t count);
+void    _mat4f_from_euler_array_sse2(vec3f* src, mat4f* dest, size_t count);
+void    _quat_from_euler_array_sse2(vec3f* src, quat* dest, size_t count);
+void    _affine2f_transform_array_sse2(affine2f* a, vec2f* src, vec2f* dest, size_t count);
+void    _sprite_expand_array_sse2(affine2f* view, affine2f* sprites, float* corners,
+                char* dest, size_t stride, size_t count);
+void    _quat_encode_array_sse2(quat* src, void* dest, int bits, size_t count);
+void    _quat_decode_array_sse2(void* src, quat* dest, int bits, size_t count);
+void    _oct_encode_array_sse2(vec3f* src, void* dest, int bits, size_t count);
+void    _oct_decode_array_sse2(void* src, vec3f* dest, int bits, size_t count);
+void    _half_from_float_array_sse2(float* src, uint16_t* dest, size_t count);
+void    _float_from_half_array_sse2(uint16_t* src, float* dest, size_t count);
+void    _matf_gemm_kernel_sse2(int k, float* a, float* b, float alpha, float beta,
+                float* c, int ldc, int m, int n);
+void    _matf_gemv_rows_sse2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest);
+void    _matf_gemv_cols_sse2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest);
+size_t  _mat_solve_soa_sse2(int n, int spd, float** a, float** b, float** x,
+                unsigned char* singular, size_t count);
+void    _vec3f_normalize_array_sse2(vec3f* src, vec3f* dest, size_t count);
+void    _clip_outcodes_sse2(vec4f* src, unsigned char* dest, size_t count);
+void    _clip_project_sse2(vec4f* src, vec4f* dest, size_t count);
+void    _raster_tri_sse2(float* depth, int tiles_x, float* tri, int x0, int y0, int x1, int y1);
+void    _raster_boxes_sse2(mat4f* mat, aabb* boxes, float* dest, size_t count);
+
+void    _mat4f_multiply_avx2(mat4f* a, mat4f* b, mat4f* dest);
+void    _mat4f_transform_point_array_avx2(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+size_t  _mat4f_inverse_array_avx2(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count);
+void    _mat3f_determinant_soa_avx2(mat3f_soa* mat, float* dest, size_t count);
+size_t  _mat3f_inverse_soa_avx2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+size_t  _mat3f_inverse_sym_soa_avx2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count);
+void    _rigid_integrate_avx2(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                size_t begin, size_t end);
+void    _kdtree_leaf_dist2_avx2(float* x, float* y, float* z, float* q, float* dest, size_t count);
+void    _vec3f_moments_avx2(vec3f* src, float* center, int order, double* dest, size_t count);
+void    _mat3f_eigen_sym_soa_avx2(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count);
+void    _aabb_minmax_array_avx2(vec3f* src, float* box, size_t count);
+void    _aabb_minmax_soa_avx2(float* x, float* y, float* z, float* box, size_t count);
+void    _aabb_transform_array_avx2(mat4f* mat, vec3f* src, vec3f* dest, float* box, size_t count);
+void    _sphere_grow_avx2(vec3f* src, float* s, size_t count);
+void    _sincos_array_avx2(float* src, float* s, float* c, size_t count);
+void    _atan2_array_avx2(float* y, float* x, float* dest, size_t count);
+void    _acos_array_avx2(float* src, float* dest, size_t count);
+void    _mat2f_rotation_array_avx2(float* angle, mat2f* dest, size_t count);
+void    _mat3f_rotation_axis_angle_array_avx2(vec3f* axis, float* angle, mat3f* dest, size_t count);
+void    _mat3f_from_euler_array_avx2(vec3f* src, mat3f* dest, size_t count);
+void    _mat4f_from_euler_array_avx2(vec3f* src, mat4f* dest, size_t count);
+void    _quat_from_euler_array_avx2(vec3f* src, quat* dest, size_t count);
+void    _affine2f_transform_array_avx2(affine2f* a, vec2f* src, vec2f* dest, size_t count);
+void    _sprite_expand_array_avx2(affine2f* view, affine2f* sprites, float* corners,
+                char* dest, size_t stride, size_t count);
+void    _quat_encode_array_avx2(quat* src, void* dest, int bits, size_t count);
+void    _quat_decode_array_avx2(void* src, quat* dest, int bits, size_t count);
+void    _oct_encode_array_avx2(vec3f* src, void* dest, int bits, size_t count);
+void    _oct_decode_array_avx2(void* src, vec3f* dest, int bits, size_t count);
+void    _half_from_float_array_avx2(float* src, uint16_t* dest, size_t count);
+void    _float_from_half_array_avx2(uint16_t* src, float* dest, size_t count);
+void    _matf_gemm_kernel_avx2(int k, float* a, float* b, float alpha, float beta,
+                float* c, int ldc, int m, int n);
+void    _matf_gemv_rows_avx2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest);
+void    _matf_gemv_cols_avx2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest);
+size_t  _mat_solve_soa_avx2(int n, int spd, float** a, float** b, float** x,
+                unsigned char* singular, size_t count);
+void    _vec3f_normalize_array_avx2(vec3f* src, vec3f* dest, size_t count);
+void    _clip_outcodes_avx2(vec4f* src, unsigned char* dest, size_t count);
+void    _clip_project_avx2(vec4f* src, vec4f* dest, size_t count);
+void    _raster_tri_avx2(float* depth, int tiles_x, float* tri, int x0, int y0, int x1, int y1);
+void    _raster_boxes_avx2(mat4f* mat, aabb* boxes, float* dest, size_t count);
+
+void    _mat4f_multiply_avx512(mat4f* a, mat4f* b, mat4f* dest);
+#endif
+
+#endif
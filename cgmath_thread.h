@@ -0,0 +1,25 @@
+/**
+ * File: cgmath_thread.h
+ * Description:
+ * * Private fork-join helper used by the batch kernels.
+ * * fn is called on disjoint [begin, end) ranges that
+ * * together cover [0, count); ranges are multiples of
+ * * grain except possibly the last. Work smaller than
+ * * two grains, nested calls, and calls made while
+ * * another thread owns the pool all run inline on the
+ * * calling thread, so callers never need to care.
+ */
+
+#ifndef CGMATH_THREAD_H
+#define CGMATH_THREAD_H
+
+#include <stddef.h>
+
+/* elements per task for the streaming batch kernels */
+#define CGMATH_BATCH_GRAIN      8192
+
+typedef void (*_cgmath_range_fn)(void* ctx, size_t begin, size_t end);
+
+void    _cgmath_parallel_for(size_t count, size_t grain, _cgmath_range_fn fn, void* ctx);
+
+#endif
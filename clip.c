@@ -0,0 +1,462 @@
+/**
+ * File: clip.c
+ * Description:
+ * * Batched clipping of clip space triangles against
+ * * the view volume -w <= x, y, z <= w, followed by the
+ * * perspective divide. Vertex outcodes are computed
+ * * by a SIMD kernel, one bit per plane in the order
+ * * of camera_frustum(); a triangle is accepted when
+ * * none of its vertices has a bit set, rejected when
+ * * all share one, and only the rest go through
+ * * Sutherland-Hodgman, on the stack, against just the
+ * * planes they cross. Runs of accepted triangles are
+ * * divided by a second SIMD kernel.
+ * *
+ * * The input is split into at most CLIP_SLOTS fixed
+ * * slices. The first pass counts the output of each
+ * * slice and the second writes it at its prefix
+ * * offset, so the output order is the input order for
+ * * any thread count and nothing is allocated.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+#define CLIP_SLOTS      64
+
+/* triangles per outcode batch */
+#define CLIP_CHUNK      256
+
+/* a triangle clipped by six planes has at most nine vertices */
+#define CLIP_MAX_VERTS  9
+
+/*
+ * One plane at most doubles a polygon that rounding in
+ * _clip_lerp() has left slightly non-convex.
+ */
+#define CLIP_SCRATCH    (2 * CLIP_MAX_VERTS)
+
+#define CLIP_REJECT     0x80
+
+void _clip_outcodes_scalar(vec4f* src, unsigned char* dest, size_t count)
+{
+        size_t i;
+        float* p;
+        float w;
+
+        for(i = 0; i < count; i++) {
+                p = src[i].m;
+                w = p[VEC_W];
+                dest[i] = (!(p[VEC_X] >= -w)) | ((!(p[VEC_X] <= w)) << 1) |
+                        ((!(p[VEC_Y] >= -w)) << 2) | ((!(p[VEC_Y] <= w)) << 3) |
+                        ((!(p[VEC_Z] >= -w)) << 4) | ((!(p[VEC_Z] <= w)) << 5);
+        }
+}
+
+/* (x / w, y / w, z / w, 1 / w) */
+void _clip_project_scalar(vec4f* src, vec4f* dest, size_t count)
+{
+        size_t i;
+        float r;
+
+        for(i = 0; i < count; i++) {
+                r = 1.0f / src[i].m[VEC_W];
+                dest[i].m[VEC_X] = src[i].m[VEC_X] * r;
+                dest[i].m[VEC_Y] = src[i].m[VEC_Y] * r;
+                dest[i].m[VEC_Z] = src[i].m[VEC_Z] * r;
+                dest[i].m[VEC_W] = r;
+        }
+}
+
+#if defined(CGMATH_X86)
+/**
+ * Outcodes of four vertices whose components are in x,
+ * y, z and w. The comparisons are negated so that NaN
+ * counts as outside every plane.
+ */
+CGMATH_TARGET_SSE2
+static inline __m128i _clip_codes_sse2(__m128 x, __m128 y, __m128 z, __m128 w)
+{
+        __m128 n;
+        __m128 c;
+
+        n = _mm_sub_ps(_mm_setzero_ps(), w);
+        c = _mm_and_ps(_mm_cmpnge_ps(x, n), _mm_castsi128_ps(_mm_set1_epi32(1)));
+        c = _mm_or_ps(c, _mm_and_ps(_mm_cmpnle_ps(x, w), _mm_castsi128_ps(_mm_set1_epi32(2))));
+        c = _mm_or_ps(c, _mm_and_ps(_mm_cmpnge_ps(y, n), _mm_castsi128_ps(_mm_set1_epi32(4))));
+        c = _mm_or_ps(c, _mm_and_ps(_mm_cmpnle_ps(y, w), _mm_castsi128_ps(_mm_set1_epi32(8))));
+        c = _mm_or_ps(c, _mm_and_ps(_mm_cmpnge_ps(z, n), _mm_castsi128_ps(_mm_set1_epi32(16))));
+        c = _mm_or_ps(c, _mm_and_ps(_mm_cmpnle_ps(z, w), _mm_castsi128_ps(_mm_set1_epi32(32))));
+        return _mm_castps_si128(c);
+}
+
+/* the low byte of each of the four 32 bit lanes of c */
+CGMATH_TARGET_SSE2
+static inline void _clip_store4_sse2(unsigned char* dest, __m128i c)
+{
+        int b;
+
+        c = _mm_packs_epi32(c, c);
+        b = _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+        memcpy(dest, &b, 4);
+}
+
+CGMATH_TARGET_SSE2
+void _clip_outcodes_sse2(vec4f* src, unsigned char* dest, size_t count)
+{
+        size_t i;
+        __m128 r[4];
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                r[0] = _mm_loadu_ps(src[i].m);
+                r[1] = _mm_loadu_ps(src[i + 1].m);
+                r[2] = _mm_loadu_ps(src[i + 2].m);
+                r[3] = _mm_loadu_ps(src[i + 3].m);
+                _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+                _clip_store4_sse2(dest + i, _clip_codes_sse2(r[0], r[1], r[2], r[3]));
+        }
+        _clip_outcodes_scalar(src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_SSE2
+void _clip_project_sse2(vec4f* src, vec4f* dest, size_t count)
+{
+        size_t i;
+        __m128 p;
+        __m128 r;
+
+        for(i = 0; i < count; i++) {
+                p = _mm_loadu_ps(src[i].m);
+                r = _mm_div_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+                p = _mm_mul_ps(p, r);
+                /* (z, z, r, r), then x y from p and z r from that */
+                r = _mm_shuffle_ps(p, r, _MM_SHUFFLE(0, 0, 2, 2));
+                _mm_storeu_ps(dest[i].m, _mm_shuffle_ps(p, r, _MM_SHUFFLE(2, 0, 1, 0)));
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _clip_outcodes_avx2(vec4f* src, unsigned char* dest, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 r[4];
+        __m256 t[4];
+        __m256 n;
+        __m256 c;
+        __m256i b;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(k = 0; k < 4; k++) {
+                        r[k] = _mm256_loadu2_m128(src[i + 4 + k].m, src[i + k].m);
+                }
+                t[0] = _mm256_unpacklo_ps(r[0], r[1]);
+                t[1] = _mm256_unpackhi_ps(r[0], r[1]);
+                t[2] = _mm256_unpacklo_ps(r[2], r[3]);
+                t[3] = _mm256_unpackhi_ps(r[2], r[3]);
+                r[0] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(1, 0, 1, 0));
+                r[1] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(3, 2, 3, 2));
+                r[2] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(1, 0, 1, 0));
+                r[3] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(3, 2, 3, 2));
+
+                n = _mm256_sub_ps(_mm256_setzero_ps(), r[3]);
+                c = _mm256_and_ps(_mm256_cmp_ps(r[0], n, _CMP_NGE_UQ),
+                                _mm256_castsi256_ps(_mm256_set1_epi32(1)));
+                c = _mm256_or_ps(c, _mm256_and_ps(_mm256_cmp_ps(r[0], r[3], _CMP_NLE_UQ),
+                                _mm256_castsi256_ps(_mm256_set1_epi32(2))));
+                c = _mm256_or_ps(c, _mm256_and_ps(_mm256_cmp_ps(r[1], n, _CMP_NGE_UQ),
+                                _mm256_castsi256_ps(_mm256_set1_epi32(4))));
+                c = _mm256_or_ps(c, _mm256_and_ps(_mm256_cmp_ps(r[1], r[3], _CMP_NLE_UQ),
+                                _mm256_castsi256_ps(_mm256_set1_epi32(8))));
+                c = _mm256_or_ps(c, _mm256_and_ps(_mm256_cmp_ps(r[2], n, _CMP_NGE_UQ),
+                                _mm256_castsi256_ps(_mm256_set1_epi32(16))));
+                c = _mm256_or_ps(c, _mm256_and_ps(_mm256_cmp_ps(r[2], r[3], _CMP_NLE_UQ),
+                                _mm256_castsi256_ps(_mm256_set1_epi32(32))));
+                b = _mm256_castps_si256(c);
+                _clip_store4_sse2(dest + i, _mm256_castsi256_si128(b));
+                _clip_store4_sse2(dest + i + 4, _mm256_extracti128_si256(b, 1));
+        }
+        _clip_outcodes_sse2(src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _clip_project_avx2(vec4f* src, vec4f* dest, size_t count)
+{
+        size_t i;
+        __m256 p;
+        __m256 r;
+
+        for(i = 0; i + 2 <= count; i += 2) {
+                p = _mm256_loadu_ps(src[i].m);
+                r = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)));
+                _mm256_storeu_ps(dest[i].m, _mm256_blend_ps(_mm256_mul_ps(p, r), r, 0x88));
+        }
+        _clip_project_sse2(src + i, dest + i, count - i);
+}
+#endif
+
+/* signed distance to plane k, positive inside */
+static inline float _clip_dist(float* p, int k)
+{
+        return k & 1 ? p[VEC_W] - p[k >> 1] : p[VEC_W] + p[k >> 1];
+}
+
+/**
+ * The intersection is always interpolated from the
+ * inside vertex, so the two triangles sharing an edge
+ * get bit identical points on it.
+ */
+static inline void _clip_lerp(float* in, float* out, float din, float dout, float* dest)
+{
+        int j;
+        float t;
+
+        t = din / (din - dout);
+        for(j = 0; j < 4; j++) {
+                dest[j] = in[j] + t * (out[j] - in[j]);
+        }
+}
+
+/**
+ * Drops the vertex nearest to its predecessor until at
+ * most CLIP_MAX_VERTS are left. The extra vertices of a
+ * polygon that rounding made non-convex are within a
+ * few ULPs of a neighbour, so the shape does not change.
+ */
+static int _clip_merge(vec4f* poly, int n)
+{
+        int i;
+        int j;
+        int best;
+        float d;
+        float least;
+
+        while(n > CLIP_MAX_VERTS) {
+                best = 0;
+                least = INFINITY;
+                for(i = 0; i < n; i++) {
+                        d = 0.0f;
+                        for(j = 0; j < 4; j++) {
+                                d += fabsf(poly[(i + 1) % n].m[j] - poly[i].m[j]);
+                        }
+                        if(d < least) {
+                                least = d;
+                                best = (i + 1) % n;
+                        }
+                }
+                memmove(poly + best, poly + best + 1, (n - best - 1) * sizeof(vec4f));
+                n--;
+        }
+        return n;
+}
+
+/**
+ * Clips the triangle at src against the planes in mask
+ * into poly and returns its vertex count, at most
+ * CLIP_MAX_VERTS, 0 if nothing is left. Triangles with a
+ * NaN or infinite coordinate are dropped; NaN fails
+ * every outcode test, so those never take the accept
+ * path.
+ */
+static int _clip_polygon(vec4f* src, unsigned int mask, vec4f* poly)
+{
+        int k;
+        int i;
+        int n;
+        int m;
+        float d[CLIP_MAX_VERTS];
+        vec4f a[CLIP_SCRATCH];
+        vec4f b[CLIP_SCRATCH];
+        vec4f* in;
+        vec4f* out;
+        vec4f* swap;
+
+        for(i = 0; i < 12; i++) {
+                if(!isfinite(src[i / 4].m[i % 4])) {
+                        return 0;
+                }
+        }
+
+        memcpy(a, src, 3 * sizeof(vec4f));
+        in = a;
+        out = b;
+        n = 3;
+        for(k = 0; k < 6 && n > 0; k++) {
+                if(!(mask & (1u << k))) {
+                        continue;
+                }
+                for(i = 0; i < n; i++) {
+                        d[i] = _clip_dist(in[i].m, k);
+                }
+                m = 0;
+                for(i = 0; i < n; i++) {
+                        if(d[i] >= 0.0f) {
+                                out[m++] = in[i];
+                        }
+                        if((d[i] >= 0.0f) != (d[(i + 1) % n] >= 0.0f)) {
+                                if(d[i] >= 0.0f) {
+                                        _clip_lerp(in[i].m, in[(i + 1) % n].m, d[i], d[(i + 1) % n],
+                                                        out[m++].m);
+                                } else {
+                                        _clip_lerp(in[(i + 1) % n].m, in[i].m, d[(i + 1) % n], d[i],
+                                                        out[m++].m);
+                                }
+                        }
+                }
+                n = m < 3 ? 0 : _clip_merge(out, m);
+                swap = in;
+                in = out;
+                out = swap;
+        }
+        memcpy(poly, in, n * sizeof(vec4f));
+        return n;
+}
+
+typedef struct {
+        vec4f*          src;
+        vec4f*          dest;
+        unsigned int*   source;
+        size_t          max;
+        size_t          grain;
+        int             write;
+        size_t          part[CLIP_SLOTS];
+} _clip_job;
+
+/* 0 to accept, CLIP_REJECT, or the planes to clip against */
+static void _clip_classify(unsigned char* v, unsigned char* t, size_t count)
+{
+        size_t i;
+        unsigned int o;
+
+        for(i = 0; i < count; i++) {
+                o = v[3 * i] | v[3 * i + 1] | v[3 * i + 2];
+                t[i] = v[3 * i] & v[3 * i + 1] & v[3 * i + 2] ? CLIP_REJECT : o;
+        }
+}
+
+/* fans poly out as triangles out, out + 1, ... as far as max allows */
+static void _clip_emit(_clip_job* job, vec4f* poly, int n, size_t tri, size_t out)
+{
+        int i;
+        vec4f fan[3 * (CLIP_MAX_VERTS - 2)];
+
+        for(i = 0; i + 2 < n && out + i < job->max; i++) {
+                fan[3 * i] = poly[0];
+                fan[3 * i + 1] = poly[i + 1];
+                fan[3 * i + 2] = poly[i + 2];
+                if(job->source != NULL) {
+                        job->source[out + i] = (unsigned int)tri;
+                }
+        }
+        _cgmath_kern.clip_project(fan, job->dest + 3 * out, 3 * i);
+}
+
+/* one slice; the counting pass stores its output count in part */
+static void _clip_slice(_clip_job* job, size_t begin, size_t end)
+{
+        int n;
+        size_t b;
+        size_t i;
+        size_t j;
+        size_t e;
+        size_t k;
+        size_t r;
+        size_t out;
+        unsigned char vcode[3 * CLIP_CHUNK];
+        unsigned char code[CLIP_CHUNK];
+        vec4f poly[CLIP_MAX_VERTS];
+
+        out = job->write ? job->part[begin / job->grain] : 0;
+        for(b = begin; b < end; b += CLIP_CHUNK) {
+                e = end - b < CLIP_CHUNK ? end - b : CLIP_CHUNK;
+                _cgmath_kern.clip_outcodes(job->src + 3 * b, vcode, 3 * e);
+                _clip_classify(vcode, code, e);
+                for(i = 0; i < e;) {
+                        if(code[i] == 0) {
+                                for(j = i + 1; j < e && code[j] == 0; j++);
+                                if(job->write && out < job->max) {
+                                        r = j - i < job->max - out ? j - i : job->max - out;
+                                        _cgmath_kern.clip_project(job->src + 3 * (b + i),
+                                                        job->dest + 3 * out, 3 * r);
+                                        for(k = 0; job->source != NULL && k < r; k++) {
+                                                job->source[out + k] = (unsigned int)(b + i + k);
+                                        }
+                                }
+                                out += j - i;
+                                i = j;
+                                continue;
+                        }
+                        if(code[i] != CLIP_REJECT) {
+                                n = _clip_polygon(job->src + 3 * (b + i), code[i], poly);
+                                if(n > 0) {
+                                        if(job->write && out < job->max) {
+                                                _clip_emit(job, poly, n, b + i, out);
+                                        }
+                                        out += n - 2;
+                                }
+                        }
+                        i++;
+                }
+        }
+        if(!job->write) {
+                job->part[begin / job->grain] = out;
+        }
+}
+
+static void _clip_range(void* ctx, size_t begin, size_t end)
+{
+        size_t s;
+        _clip_job* job;
+
+        job = ctx;
+        for(s = begin; s < end; s += job->grain) {
+                _clip_slice(job, s, end - s < job->grain ? end : s + job->grain);
+        }
+}
+
+/**
+ * Clips count clip space triangles (3 * count vec4f)
+ * and stores the visible parts, in input order and
+ * divided by w as (x / w, y / w, z / w, 1 / w), as at
+ * most max triangles (3 * max vec4f) in dest. A
+ * clipped triangle is split into a fan. If source is
+ * not NULL it receives the input triangle of each
+ * output triangle. Returns the number of output
+ * triangles, which may exceed max.
+ */
+size_t vec4f_clip_triangles(vec4f* src, size_t count, vec4f* dest, unsigned int* source, size_t max)
+{
+        CGMATH_PROFILE_SCOPE(vec4f_clip_triangles, count);
+        size_t s;
+        size_t n;
+        size_t slots;
+        size_t total;
+        _clip_job job;
+
+        job.src = src;
+        job.dest = dest;
+        job.source = source;
+        job.max = max;
+        job.grain = (count + CLIP_SLOTS - 1) / CLIP_SLOTS;
+        if(job.grain < CGMATH_BATCH_GRAIN) {
+                job.grain = CGMATH_BATCH_GRAIN;
+        }
+        slots = (count + job.grain - 1) / job.grain;
+
+        job.write = 0;
+        _cgmath_parallel_for(count, job.grain, _clip_range, &job);
+        total = 0;
+        for(s = 0; s < slots; s++) {
+                n = job.part[s];
+                job.part[s] = total;
+                total += n;
+        }
+        job.write = 1;
+        _cgmath_parallel_for(count, job.grain, _clip_range, &job);
+        return total;
+}
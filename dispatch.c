@@ -0,0 +1,307 @@
+/**
+ * File: dispatch.c
+ * Description:
+ * * Detects the instruction set extensions of the
+ * * running CPU once at load time and binds the
+ * * kernel table to the best variant of each entry
+ * * point. Setting CGMATH_ISA in the environment to
+ * * scalar, sse2, avx2 or avx512 caps the level, which
+ * * is mostly useful for testing the slower paths.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_simd.h"
+
+/**
+ * Statically bound to the scalar kernels so that any
+ * call made before the constructor runs still works.
+ */
+struct _cgmath_kernels _cgmath_kern = {
+        _vec4f_normalize_scalar,
+        _mat4f_multiply_scalar,
+        _mat4f_determinant_scalar,
+        _mat4f_transpose_scalar,
+        _mat4f_inverse_scalar,
+        _mat4f_transform_point_array_scalar,
+        _mat4f_transform_normal_array_scalar,
+        _mat4f_inverse_array_scalar,
+        _mat3f_determinant_soa_scalar,
+        _mat3f_inverse_soa_scalar,
+        _mat3f_inverse_sym_soa_scalar,
+        _rigid_integrate_scalar,
+        _kdtree_leaf_dist2_scalar,
+        _vec3f_moments_scalar,
+        _mat3f_eigen_sym_soa_scalar,
+        _aabb_minmax_array_scalar,
+        _aabb_minmax_soa_scalar,
+        _aabb_transform_array_scalar,
+        _sphere_grow_scalar,
+        _sincos_array_scalar,
+        _atan2_array_scalar,
+        _acos_array_scalar,
+        _mat2f_rotation_array_scalar,
+        _mat3f_rotation_axis_angle_array_scalar,
+        _mat3f_from_euler_array_scalar,
+        _mat4f_from_euler_array_scalar,
+        _quat_from_euler_array_scalar,
+        _affine2f_transform_array_scalar,
+        _sprite_expand_array_scalar,
+        _quat_encode_array_scalar,
+        _quat_decode_array_scalar,
+        _oct_encode_array_scalar,
+        _oct_decode_array_scalar,
+        _half_from_float_array_scalar,
+        _float_from_half_array_scalar,
+        _matf_gemm_kernel_scalar,
+        _matf_gemv_rows_scalar,
+        _matf_gemv_cols_scalar,
+        _mat_solve_soa_scalar,
+        _vec3f_normalize_array_scalar,
+        _clip_outcodes_scalar,
+        _clip_project_scalar,
+        _raster_tri_scalar,
+        _raster_boxes_scalar
+};
+
+static const char* _cgmath_isa_names[] = {
+        "scalar",
+        "sse2",
+        "avx2",
+        "avx512"
+};
+
+static int _cgmath_isa_max = CGMATH_ISA_SCALAR;
+static int _cgmath_isa_cur = CGMATH_ISA_SCALAR;
+
+static int _cgmath_isa_detect(void)
+{
+#if defined(CGMATH_X86)
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f") &&
+                        __builtin_cpu_supports("avx512vl") &&
+                        __builtin_cpu_supports("fma") &&
+                        __builtin_cpu_supports("f16c")) {
+                return CGMATH_ISA_AVX512;
+        }
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+                        __builtin_cpu_supports("f16c")) {
+                return CGMATH_ISA_AVX2;
+        }
+        if(__builtin_cpu_supports("sse2")) {
+                return CGMATH_ISA_SSE2;
+        }
+#endif
+        return CGMATH_ISA_SCALAR;
+}
+
+static void _cgmath_isa_bind(int level)
+{
+        struct _cgmath_kernels k;
+
+        k.vec4f_normalize = _vec4f_normalize_scalar;
+        k.mat4f_multiply = _mat4f_multiply_scalar;
+        k.mat4f_determinant = _mat4f_determinant_scalar;
+        k.mat4f_transpose = _mat4f_transpose_scalar;
+        k.mat4f_inverse = _mat4f_inverse_scalar;
+        k.mat4f_transform_point_array = _mat4f_transform_point_array_scalar;
+        k.mat4f_transform_normal_array = _mat4f_transform_normal_array_scalar;
+        k.mat4f_inverse_array = _mat4f_inverse_array_scalar;
+        k.mat3f_determinant_soa = _mat3f_determinant_soa_scalar;
+        k.mat3f_inverse_soa = _mat3f_inverse_soa_scalar;
+        k.mat3f_inverse_sym_soa = _mat3f_inverse_sym_soa_scalar;
+        k.rigid_integrate = _rigid_integrate_scalar;
+        k.kdtree_leaf_dist2 = _kdtree_leaf_dist2_scalar;
+        k.vec3f_moments = _vec3f_moments_scalar;
+        k.mat3f_eigen_sym_soa = _mat3f_eigen_sym_soa_scalar;
+        k.aabb_minmax_array = _aabb_minmax_array_scalar;
+        k.aabb_minmax_soa = _aabb_minmax_soa_scalar;
+        k.aabb_transform_array = _aabb_transform_array_scalar;
+        k.sphere_grow = _sphere_grow_scalar;
+        k.sincos_array = _sincos_array_scalar;
+        k.atan2_array = _atan2_array_scalar;
+        k.acos_array = _acos_array_scalar;
+        k.mat2f_rotation_array = _mat2f_rotation_array_scalar;
+        k.mat3f_rotation_axis_angle_array = _mat3f_rotation_axis_angle_array_scalar;
+        k.mat3f_from_euler_array = _mat3f_from_euler_array_scalar;
+        k.mat4f_from_euler_array = _mat4f_from_euler_array_scalar;
+        k.quat_from_euler_array = _quat_from_euler_array_scalar;
+        k.affine2f_transform_array = _affine2f_transform_array_scalar;
+        k.sprite_expand_array = _sprite_expand_array_scalar;
+        k.quat_encode_array = _quat_encode_array_scalar;
+        k.quat_decode_array = _quat_decode_array_scalar;
+        k.oct_encode_array = _oct_encode_array_scalar;
+        k.oct_decode_array = _oct_decode_array_scalar;
+        k.half_from_float_array = _half_from_float_array_scalar;
+        k.float_from_half_array = _float_from_half_array_scalar;
+        k.matf_gemm_kernel = _matf_gemm_kernel_scalar;
+        k.matf_gemv_rows = _matf_gemv_rows_scalar;
+        k.matf_gemv_cols = _matf_gemv_cols_scalar;
+        k.mat_solve_soa = _mat_solve_soa_scalar;
+        k.vec3f_normalize_array = _vec3f_normalize_array_scalar;
+        k.clip_outcodes = _clip_outcodes_scalar;
+        k.clip_project = _clip_project_scalar;
+        k.raster_tri = _raster_tri_scalar;
+        k.raster_boxes = _raster_boxes_scalar;
+
+#if defined(CGMATH_X86)
+        if(level >= CGMATH_ISA_SSE2) {
+                k.vec4f_normalize = _vec4f_normalize_sse2;
+                k.mat4f_multiply = _mat4f_multiply_sse2;
+                k.mat4f_determinant = _mat4f_determinant_sse2;
+                k.mat4f_transpose = _mat4f_transpose_sse2;
+                k.mat4f_inverse = _mat4f_inverse_sse2;
+                k.mat4f_transform_point_array = _mat4f_transform_point_array_sse2;
+                k.mat4f_transform_normal_array = _mat4f_transform_normal_array_sse2;
+                k.mat4f_inverse_array = _mat4f_inverse_array_sse2;
+                k.mat3f_determinant_soa = _mat3f_determinant_soa_sse2;
+                k.mat3f_inverse_soa = _mat3f_inverse_soa_sse2;
+                k.mat3f_inverse_sym_soa = _mat3f_inverse_sym_soa_sse2;
+                k.rigid_integrate = _rigid_integrate_sse2;
+                k.kdtree_leaf_dist2 = _kdtree_leaf_dist2_sse2;
+                k.vec3f_moments = _vec3f_moments_sse2;
+                k.mat3f_eigen_sym_soa = _mat3f_eigen_sym_soa_sse2;
+                k.aabb_minmax_array = _aabb_minmax_array_sse2;
+                k.aabb_minmax_soa = _aabb_minmax_soa_sse2;
+                k.aabb_transform_array = _aabb_transform_array_sse2;
+                k.sphere_grow = _sphere_grow_sse2;
+                k.sincos_array = _sincos_array_sse2;
+                k.atan2_array = _atan2_array_sse2;
+                k.acos_array = _acos_array_sse2;
+                k.mat2f_rotation_array = _mat2f_rotation_array_sse2;
+                k.mat3f_rotation_axis_angle_array = _mat3f_rotation_axis_angle_array_sse2;
+                k.mat3f_from_euler_array = _mat3f_from_euler_array_sse2;
+                k.mat4f_from_euler_array = _mat4f_from_euler_array_sse2;
+                k.quat_from_euler_array = _quat_from_euler_array_sse2;
+                k.affine2f_transform_array = _affine2f_transform_array_sse2;
+                k.sprite_expand_array = _sprite_expand_array_sse2;
+                k.quat_encode_array = _quat_encode_array_sse2;
+                k.quat_decode_array = _quat_decode_array_sse2;
+                k.oct_encode_array = _oct_encode_array_sse2;
+                k.oct_decode_array = _oct_decode_array_sse2;
+                k.half_from_float_array = _half_from_float_array_sse2;
+                k.float_from_half_array = _float_from_half_array_sse2;
+                k.matf_gemm_kernel = _matf_gemm_kernel_sse2;
+                k.matf_gemv_rows = _matf_gemv_rows_sse2;
+                k.matf_gemv_cols = _matf_gemv_cols_sse2;
+                k.mat_solve_soa = _mat_solve_soa_sse2;
+                k.vec3f_normalize_array = _vec3f_normalize_array_sse2;
+                k.clip_outcodes = _clip_outcodes_sse2;
+                k.clip_project = _clip_project_sse2;
+                k.raster_tri = _raster_tri_sse2;
+                k.raster_boxes = _raster_boxes_sse2;
+        }
+        if(level >= CGMATH_ISA_AVX2) {
+                k.mat4f_multiply = _mat4f_multiply_avx2;
+                k.mat4f_transform_point_array = _mat4f_transform_point_array_avx2;
+                k.mat4f_inverse_array = _mat4f_inverse_array_avx2;
+                k.mat3f_determinant_soa = _mat3f_determinant_soa_avx2;
+                k.mat3f_inverse_soa = _mat3f_inverse_soa_avx2;
+                k.mat3f_inverse_sym_soa = _mat3f_inverse_sym_soa_avx2;
+                k.rigid_integrate = _rigid_integrate_avx2;
+                k.kdtree_leaf_dist2 = _kdtree_leaf_dist2_avx2;
+                k.vec3f_moments = _vec3f_moments_avx2;
+                k.mat3f_eigen_sym_soa = _mat3f_eigen_sym_soa_avx2;
+                k.aabb_minmax_array = _aabb_minmax_array_avx2;
+                k.aabb_minmax_soa = _aabb_minmax_soa_avx2;
+                k.aabb_transform_array = _aabb_transform_array_avx2;
+                k.sphere_grow = _sphere_grow_avx2;
+                k.sincos_array = _sincos_array_avx2;
+                k.atan2_array = _atan2_array_avx2;
+                k.acos_array = _acos_array_avx2;
+                k.mat2f_rotation_array = _mat2f_rotation_array_avx2;
+                k.mat3f_rotation_axis_angle_array = _mat3f_rotation_axis_angle_array_avx2;
+                k.mat3f_from_euler_array = _mat3f_from_euler_array_avx2;
+                k.mat4f_from_euler_array = _mat4f_from_euler_array_avx2;
+                k.quat_from_euler_array = _quat_from_euler_array_avx2;
+                k.affine2f_transform_array = _affine2f_transform_array_avx2;
+                k.sprite_expand_array = _sprite_expand_array_avx2;
+                k.quat_encode_array = _quat_encode_array_avx2;
+                k.quat_decode_array = _quat_decode_array_avx2;
+                k.oct_encode_array = _oct_encode_array_avx2;
+                k.oct_decode_array = _oct_decode_array_avx2;
+                k.half_from_float_array = _half_from_float_array_avx2;
+                k.float_from_half_array = _float_from_half_array_avx2;
+                k.matf_gemm_kernel = _matf_gemm_kernel_avx2;
+                k.matf_gemv_rows = _matf_gemv_rows_avx2;
+                k.matf_gemv_cols = _matf_gemv_cols_avx2;
+                k.mat_solve_soa = _mat_solve_soa_avx2;
+                k.vec3f_normalize_array = _vec3f_normalize_array_avx2;
+                k.clip_outcodes = _clip_outcodes_avx2;
+                k.clip_project = _clip_project_avx2;
+                k.raster_tri = _raster_tri_avx2;
+                k.raster_boxes = _raster_boxes_avx2;
+        }
+        if(level >= CGMATH_ISA_AVX512) {
+                k.mat4f_multiply = _mat4f_multiply_avx512;
+        }
+#endif
+
+        _cgmath_kern = k;
+        _cgmath_isa_cur = level;
+}
+
+static int _cgmath_isa_parse(const char* s)
+{
+        int i;
+
+        for(i = 0; i <= CGMATH_ISA_AVX512; i++) {
+                if(strcmp(s, _cgmath_isa_names[i]) == 0) {
+                        return i;
+                }
+        }
+        if(s[0] >= '0' && s[0] <= '3' && s[1] == '\0') {
+                return s[0] - '0';
+        }
+        return -1;
+}
+
+__attribute__((constructor))
+static void _cgmath_isa_init(void)
+{
+        int level;
+        const char* env;
+
+        _cgmath_isa_max = _cgmath_isa_detect();
+        level = _cgmath_isa_max;
+
+        env = getenv("CGMATH_ISA");
+        if(env != NULL && _cgmath_isa_parse(env) >= 0) {
+                level = _cgmath_isa_parse(env);
+        }
+
+        cgmath_isa_select(level);
+}
+
+int cgmath_isa_detected(void)
+{
+        return _cgmath_isa_max;
+}
+
+int cgmath_isa_level(void)
+{
+        return _cgmath_isa_cur;
+}
+
+int cgmath_isa_select(int level)
+{
+        if(level < CGMATH_ISA_SCALAR) {
+                level = CGMATH_ISA_SCALAR;
+        }
+        if(level > _cgmath_isa_max) {
+                level = _cgmath_isa_max;
+        }
+
+        _cgmath_isa_bind(level);
+        return level;
+}
+
+const char* cgmath_isa_name(int level)
+{
+        if(level < CGMATH_ISA_SCALAR || level > CGMATH_ISA_AVX512) {
+                return "unknown";
+        }
+        return _cgmath_isa_names[level];
+}
@@ -0,0 +1,457 @@
+/**
+ * File: grid.c
+ * Description:
+ * * Uniform grid over a vec3f point set, hashed into a
+ * * fixed power of two table. Building is a stable
+ * * parallel LSD radix sort of (cell hash, point id)
+ * * pairs: blocks of points are histogrammed and
+ * * scattered independently, and the block partition
+ * * does not depend on the thread count, so the cell
+ * * order of the points is the same on every run. The
+ * * queries count first and fill second, so their
+ * * output order is deterministic too.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_thread.h"
+
+#define GRID_ALIGN      64
+
+/* points per radix sort block, which is also the task grain */
+#define GRID_BLOCK      16384
+
+#define GRID_RADIX_BITS 11
+#define GRID_RADIX      (1 << GRID_RADIX_BITS)
+
+/* queries per task for the batched queries */
+#define GRID_QUERY_GRAIN        1024
+
+static size_t _grid_round(size_t n)
+{
+        return (n + GRID_ALIGN - 1) & ~(size_t)(GRID_ALIGN - 1);
+}
+
+static inline int _grid_coord(grid* g, float f)
+{
+        return (int)floorf(f * g->inv_cell);
+}
+
+static inline unsigned int _grid_hash(grid* g, int x, int y, int z)
+{
+        return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u) ^
+                        ((unsigned int)z * 83492791u)) & ((1u << g->bits) - 1);
+}
+
+int grid_init(grid* g, float cell, size_t capacity)
+{
+        int bits;
+        size_t blocks;
+        size_t table;
+        size_t size;
+        size_t start;
+        size_t ids;
+        size_t points;
+        size_t hist;
+        char* block;
+
+        if(!(cell > 0.0f) || capacity == 0 || capacity > 0xFFFFFFFFu - 1) {
+                return -1;
+        }
+
+        bits = 10;
+        while(bits < 26 && ((size_t)1 << bits) < capacity) {
+                bits++;
+        }
+        table = (size_t)1 << bits;
+        blocks = (capacity + GRID_BLOCK - 1) / GRID_BLOCK;
+
+        start = _grid_round((table + 1) * sizeof(unsigned int));
+        ids = _grid_round((capacity + 1) * sizeof(unsigned int));
+        points = _grid_round(capacity * sizeof(vec3f));
+        hist = _grid_round(blocks * GRID_RADIX * sizeof(unsigned int));
+        size = start + 5 * ids + points + hist;
+
+        block = aligned_alloc(GRID_ALIGN, size);
+        if(block == NULL) {
+                return -1;
+        }
+
+        g->cell = cell;
+        g->inv_cell = 1.0f / cell;
+        g->bits = bits;
+        g->count = 0;
+        g->capacity = capacity;
+        g->start = (unsigned int*)block;
+        g->index = (unsigned int*)(block + start);
+        g->key = (unsigned int*)(block + start + ids);
+        g->tmp_index = (unsigned int*)(block + start + 2 * ids);
+        g->tmp_key = (unsigned int*)(block + start + 3 * ids);
+        g->rows = (unsigned int*)(block + start + 4 * ids);
+        g->sorted = (vec3f*)(block + start + 5 * ids);
+        g->hist = (unsigned int*)(block + start + 5 * ids + points);
+        memset(g->start, 0, (table + 1) * sizeof(unsigned int));
+        return 0;
+}
+
+void grid_free(grid* g)
+{
+        free(g->start);
+        memset(g, 0, sizeof(*g));
+}
+
+typedef struct {
+        grid*           g;
+        vec3f*          points;
+        int             shift;
+} _grid_build_job;
+
+static void _grid_keys(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        grid* g;
+        vec3f* p;
+        _grid_build_job* job;
+
+        job = ctx;
+        g = job->g;
+        p = job->points;
+        for(i = begin; i < end; i++) {
+                g->tmp_key[i] = _grid_hash(g, _grid_coord(g, p[i].m[VEC_X]),
+                                _grid_coord(g, p[i].m[VEC_Y]), _grid_coord(g, p[i].m[VEC_Z]));
+                g->tmp_index[i] = (unsigned int)i;
+        }
+}
+
+static void _grid_histogram(void* ctx, size_t begin, size_t end)
+{
+        size_t b;
+        size_t i;
+        size_t e;
+        unsigned int* h;
+        _grid_build_job* job;
+
+        job = ctx;
+        for(b = begin; b < end; b += GRID_BLOCK) {
+                e = b + GRID_BLOCK < end ? b + GRID_BLOCK : end;
+                h = job->g->hist + (b / GRID_BLOCK) * GRID_RADIX;
+                memset(h, 0, GRID_RADIX * sizeof(unsigned int));
+                for(i = b; i < e; i++) {
+                        h[(job->g->tmp_key[i] >> job->shift) & (GRID_RADIX - 1)]++;
+                }
+        }
+}
+
+static void _grid_scatter(void* ctx, size_t begin, size_t end)
+{
+        size_t b;
+        size_t i;
+        size_t e;
+        unsigned int d;
+        unsigned int* h;
+        grid* g;
+        _grid_build_job* job;
+
+        job = ctx;
+        g = job->g;
+        for(b = begin; b < end; b += GRID_BLOCK) {
+                e = b + GRID_BLOCK < end ? b + GRID_BLOCK : end;
+                h = g->hist + (b / GRID_BLOCK) * GRID_RADIX;
+                for(i = b; i < e; i++) {
+                        d = h[(g->tmp_key[i] >> job->shift) & (GRID_RADIX - 1)]++;
+                        g->key[d] = g->tmp_key[i];
+                        g->index[d] = g->tmp_index[i];
+                }
+        }
+}
+
+/**
+ * start[k] is the first sorted position whose key is
+ * at least k. Each position fills the entries between
+ * its predecessor's key and its own, so the ranges
+ * written by different tasks never overlap.
+ */
+static void _grid_starts(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        unsigned int k;
+        unsigned int prev;
+        grid* g;
+        _grid_build_job* job;
+
+        job = ctx;
+        g = job->g;
+        for(i = begin; i < end; i++) {
+                prev = i == 0 ? 0 : g->key[i - 1] + 1;
+                for(k = prev; k <= g->key[i]; k++) {
+                        g->start[k] = (unsigned int)i;
+                }
+                g->sorted[i] = job->points[g->index[i]];
+        }
+}
+
+static void _grid_radix(grid* g, _grid_build_job* job)
+{
+        size_t b;
+        size_t blocks;
+        unsigned int d;
+        unsigned int sum;
+        unsigned int n;
+        unsigned int* swap;
+
+        blocks = (g->count + GRID_BLOCK - 1) / GRID_BLOCK;
+        for(job->shift = 0; job->shift < g->bits; job->shift += GRID_RADIX_BITS) {
+                _cgmath_parallel_for(g->count, GRID_BLOCK, _grid_histogram, job);
+
+                sum = 0;
+                for(d = 0; d < GRID_RADIX; d++) {
+                        for(b = 0; b < blocks; b++) {
+                                n = g->hist[b * GRID_RADIX + d];
+                                g->hist[b * GRID_RADIX + d] = sum;
+                                sum += n;
+                        }
+                }
+
+                _cgmath_parallel_for(g->count, GRID_BLOCK, _grid_scatter, job);
+
+                swap = g->key;
+                g->key = g->tmp_key;
+                g->tmp_key = swap;
+                swap = g->index;
+                g->index = g->tmp_index;
+                g->tmp_index = swap;
+        }
+
+        /* the sorted pairs are in the tmp arrays after each pass */
+        swap = g->key;
+        g->key = g->tmp_key;
+        g->tmp_key = swap;
+        swap = g->index;
+        g->index = g->tmp_index;
+        g->tmp_index = swap;
+}
+
+/**
+ * Fails with -1 if count exceeds the capacity given to
+ * grid_init(). points are copied in cell order, so the
+ * caller's array is not referenced afterwards.
+ */
+int grid_build(grid* g, vec3f* points, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(grid_build, count);
+        unsigned int k;
+        _grid_build_job job;
+
+        if(count > g->capacity) {
+                return -1;
+        }
+
+        g->count = count;
+        job.g = g;
+        job.points = points;
+
+        _cgmath_parallel_for(count, GRID_BLOCK, _grid_keys, &job);
+        _grid_radix(g, &job);
+        _cgmath_parallel_for(count, GRID_BLOCK, _grid_starts, &job);
+
+        k = count == 0 ? 0 : g->key[count - 1] + 1;
+        for(; k <= (1u << g->bits); k++) {
+                g->start[k] = (unsigned int)count;
+        }
+        return 0;
+}
+
+/**
+ * Visits the points within radius of center, cell by
+ * cell in z, y, x order and in sorted order within a
+ * cell. A bucket is shared by every cell that hashes to
+ * it, so candidates from other cells are skipped; that
+ * also keeps a point from being seen twice. Points with
+ * an id not above skip are ignored, which is how pair
+ * queries report each pair once. Returns the number of
+ * hits; the first max of them go to dest.
+ */
+static size_t _grid_visit(grid* g, float* c, float radius, long skip,
+                unsigned int* dest, size_t max)
+{
+        int x;
+        int y;
+        int z;
+        int lo[3];
+        int hi[3];
+        unsigned int i;
+        unsigned int h;
+        size_t n;
+        float dx;
+        float dy;
+        float dz;
+        float r2;
+        vec3f* p;
+
+        for(x = 0; x < 3; x++) {
+                lo[x] = _grid_coord(g, c[x] - radius);
+                hi[x] = _grid_coord(g, c[x] + radius);
+        }
+        r2 = radius * radius;
+
+        n = 0;
+        for(z = lo[2]; z <= hi[2]; z++) {
+                for(y = lo[1]; y <= hi[1]; y++) {
+                        for(x = lo[0]; x <= hi[0]; x++) {
+                                h = _grid_hash(g, x, y, z);
+                                for(i = g->start[h]; i < g->start[h + 1]; i++) {
+                                        p = &g->sorted[i];
+                                        dx = p->m[VEC_X] - c[VEC_X];
+                                        dy = p->m[VEC_Y] - c[VEC_Y];
+                                        dz = p->m[VEC_Z] - c[VEC_Z];
+                                        if(dx * dx + dy * dy + dz * dz > r2 ||
+                                                        (long)g->index[i] <= skip ||
+                                                        _grid_coord(g, p->m[VEC_X]) != x ||
+                                                        _grid_coord(g, p->m[VEC_Y]) != y ||
+                                                        _grid_coord(g, p->m[VEC_Z]) != z) {
+                                                continue;
+                                        }
+                                        if(n < max) {
+                                                dest[n] = g->index[i];
+                                        }
+                                        n++;
+                                }
+                        }
+                }
+        }
+        return n;
+}
+
+size_t grid_query_radius(grid* g, vec3f* center, float radius, unsigned int* dest, size_t max)
+{
+        CGMATH_PROFILE_SCOPE(grid_query_radius, 1);
+        return _grid_visit(g, center->m, radius, -1, dest, max);
+}
+
+typedef struct {
+        grid*           g;
+        vec3f*          centers;
+        float           radius;
+        unsigned int*   offsets;
+        unsigned int*   dest;
+        size_t          max;
+        int             fill;
+} _grid_query_job;
+
+/**
+ * Pair queries use the sorted points themselves as
+ * centers (centers == NULL) and only report partners
+ * with a higher id.
+ */
+static void _grid_query_range(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        size_t at;
+        long skip;
+        float* c;
+        _grid_query_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                if(job->centers != NULL) {
+                        c = job->centers[i].m;
+                        skip = -1;
+                } else {
+                        c = job->g->sorted[i].m;
+                        skip = job->g->index[i];
+                }
+
+                if(!job->fill) {
+                        job->offsets[i + 1] = (unsigned int)_grid_visit(job->g, c, job->radius,
+                                        skip, NULL, 0);
+                        continue;
+                }
+
+                at = job->offsets[i];
+                if(at >= job->max) {
+                        continue;
+                }
+                _grid_visit(job->g, c, job->radius, skip, job->dest + at, job->max - at);
+        }
+}
+
+static size_t _grid_query_run(_grid_query_job* job, size_t count)
+{
+        size_t i;
+
+        job->offsets[0] = 0;
+        job->fill = 0;
+        _cgmath_parallel_for(count, GRID_QUERY_GRAIN, _grid_query_range, job);
+        for(i = 0; i < count; i++) {
+                job->offsets[i + 1] += job->offsets[i];
+        }
+
+        job->fill = 1;
+        _cgmath_parallel_for(count, GRID_QUERY_GRAIN, _grid_query_range, job);
+        return job->offsets[count];
+}
+
+/**
+ * Radius queries for count centers. The ids found for
+ * center i are dest[offsets[i]] to dest[offsets[i + 1]]
+ * (offsets needs count + 1 entries). Returns the total
+ * number found; ids past max are counted but dropped.
+ */
+size_t grid_query_radius_array(grid* g, vec3f* centers, size_t count, float radius,
+                unsigned int* offsets, unsigned int* dest, size_t max)
+{
+        CGMATH_PROFILE_SCOPE(grid_query_radius_array, count);
+        _grid_query_job job;
+
+        job.g = g;
+        job.centers = centers;
+        job.radius = radius;
+        job.offsets = offsets;
+        job.dest = dest;
+        job.max = max;
+        return _grid_query_run(&job, count);
+}
+
+/**
+ * Every pair of indexed points closer than radius,
+ * once each, as (lower id, higher id) in dest[2k] and
+ * dest[2k + 1], ordered by the cell order of the first
+ * point. Returns the number of pairs; pairs past max
+ * are counted but dropped.
+ */
+size_t grid_query_pairs(grid* g, float radius, unsigned int* dest, size_t max)
+{
+        CGMATH_PROFILE_SCOPE(grid_query_pairs, g->count);
+        size_t i;
+        size_t n;
+        size_t k;
+        size_t e;
+        unsigned int* row;
+        _grid_query_job job;
+
+        job.g = g;
+        job.centers = NULL;
+        job.radius = radius;
+        job.offsets = g->rows;
+        job.dest = dest;
+        job.max = max;
+
+        /* the partners land in the first half of dest and are spread out below */
+        n = _grid_query_run(&job, g->count);
+        e = n < max ? n : max;
+
+        row = g->rows;
+        i = g->count;
+        for(k = e; k-- > 0;) {
+                while(row[i] > k) {
+                        i--;
+                }
+                dest[2 * k + 1] = dest[k];
+                dest[2 * k] = g->index[i];
+        }
+        return n;
+}
@@ -0,0 +1,727 @@
+/**
+ * File: kdtree.c
+ * Description:
+ * * Balanced k-d tree stored without pointers. A tree
+ * * of depth d over n points has 2^d leaves; the node
+ * * at heap index (2^l - 1) + j covers the points from
+ * * j * n >> l to (j + 1) * n >> l, so only the split
+ * * plane of each inner node is stored. The points are
+ * * reordered in place into x, y and z streams, which
+ * * keeps every leaf contiguous for the SIMD distance
+ * * kernels. Each level of the build is a set of
+ * * independent median selections run on the worker
+ * * pool; queries walk the tree with a fixed stack.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+#define KDTREE_ALIGN    64
+
+/* at most this many points per leaf */
+#define KDTREE_LEAF     16
+
+/* deep enough for any tree of 2^32 points */
+#define KDTREE_STACK    64
+
+/* points per build task and queries per query task */
+#define KDTREE_BUILD_GRAIN      16384
+#define KDTREE_QUERY_GRAIN      256
+
+#define KDTREE_NONE     0xFFFFFFFFu
+
+static size_t _kdtree_round(size_t n)
+{
+        return (n + KDTREE_ALIGN - 1) & ~(size_t)(KDTREE_ALIGN - 1);
+}
+
+static int _kdtree_depth(size_t count)
+{
+        int d;
+
+        d = 0;
+        while((count + ((size_t)1 << d) - 1) >> d > KDTREE_LEAF) {
+                d++;
+        }
+        return d;
+}
+
+void _kdtree_leaf_dist2_scalar(float* x, float* y, float* z, float* q, float* dest, size_t count)
+{
+        size_t i;
+        float dx;
+        float dy;
+        float dz;
+
+        for(i = 0; i < count; i++) {
+                dx = x[i] - q[VEC_X];
+                dy = y[i] - q[VEC_Y];
+                dz = z[i] - q[VEC_Z];
+                dest[i] = dx * dx + dy * dy + dz * dz;
+        }
+}
+
+/**
+ * The SIMD variants round exactly like the scalar one,
+ * as long as the compiler does not fuse the multiplies
+ * and adds (the makefile builds with -ffp-contract=off),
+ * so neighbor choices do not depend on the dispatch
+ * level.
+ */
+#if defined(CGMATH_X86)
+CGMATH_TARGET_SSE2
+void _kdtree_leaf_dist2_sse2(float* x, float* y, float* z, float* q, float* dest, size_t count)
+{
+        size_t i;
+        __m128 dx;
+        __m128 dy;
+        __m128 dz;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                dx = _mm_sub_ps(_mm_loadu_ps(x + i), _mm_set1_ps(q[VEC_X]));
+                dy = _mm_sub_ps(_mm_loadu_ps(y + i), _mm_set1_ps(q[VEC_Y]));
+                dz = _mm_sub_ps(_mm_loadu_ps(z + i), _mm_set1_ps(q[VEC_Z]));
+                _mm_storeu_ps(dest + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        }
+        _kdtree_leaf_dist2_scalar(x + i, y + i, z + i, q, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _kdtree_leaf_dist2_avx2(float* x, float* y, float* z, float* q, float* dest, size_t count)
+{
+        size_t i;
+        __m256 dx;
+        __m256 dy;
+        __m256 dz;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_set1_ps(q[VEC_X]));
+                dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), _mm256_set1_ps(q[VEC_Y]));
+                dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), _mm256_set1_ps(q[VEC_Z]));
+                _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx),
+                                _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+        }
+        _kdtree_leaf_dist2_sse2(x + i, y + i, z + i, q, dest + i, count - i);
+}
+#endif
+
+int kdtree_init(kdtree* tree, size_t capacity)
+{
+        int depth;
+        size_t nodes;
+        size_t split;
+        size_t axis;
+        size_t points;
+        size_t ids;
+        char* block;
+
+        if(capacity == 0 || capacity >= KDTREE_NONE) {
+                return -1;
+        }
+
+        depth = _kdtree_depth(capacity);
+        nodes = (size_t)1 << depth;
+        split = _kdtree_round(nodes * sizeof(float));
+        axis = _kdtree_round(nodes);
+        points = _kdtree_round(capacity * sizeof(float));
+        ids = _kdtree_round(capacity * sizeof(unsigned int));
+
+        block = aligned_alloc(KDTREE_ALIGN, split + axis + 3 * points + ids);
+        if(block == NULL) {
+                return -1;
+        }
+        memset(block, 0, split + axis);
+
+        tree->count = 0;
+        tree->capacity = capacity;
+        tree->depth = 0;
+        tree->split = (float*)block;
+        tree->axis = (unsigned char*)(block + split);
+        tree->x = (float*)(block + split + axis);
+        tree->y = (float*)(block + split + axis + points);
+        tree->z = (float*)(block + split + axis + 2 * points);
+        tree->index = (unsigned int*)(block + split + axis + 3 * points);
+        return 0;
+}
+
+void kdtree_free(kdtree* tree)
+{
+        free(tree->split);
+        memset(tree, 0, sizeof(*tree));
+}
+
+static inline void _kdtree_range(kdtree* tree, int level, size_t j, size_t* begin, size_t* end)
+{
+        *begin = (j * tree->count) >> level;
+        *end = ((j + 1) * tree->count) >> level;
+}
+
+static inline void _kdtree_swap(kdtree* tree, size_t a, size_t b)
+{
+        float f;
+        unsigned int u;
+
+        f = tree->x[a]; tree->x[a] = tree->x[b]; tree->x[b] = f;
+        f = tree->y[a]; tree->y[a] = tree->y[b]; tree->y[b] = f;
+        f = tree->z[a]; tree->z[a] = tree->z[b]; tree->z[b] = f;
+        u = tree->index[a]; tree->index[a] = tree->index[b]; tree->index[b] = u;
+}
+
+/**
+ * Quickselect on c over [begin, end): afterwards the
+ * point at nth has the value a full sort would put
+ * there, with nothing greater before it and nothing
+ * smaller after it. The median of three is moved to
+ * the front so the Hoare partition never comes back
+ * empty; pivots are picked without randomness so the
+ * build is repeatable.
+ */
+static void _kdtree_select(kdtree* tree, float* c, size_t begin, size_t end, size_t nth)
+{
+        size_t i;
+        size_t j;
+        size_t m;
+        float p;
+
+        while(end - begin > 1) {
+                m = begin + (end - begin) / 2;
+                if(c[m] < c[begin]) {
+                        _kdtree_swap(tree, m, begin);
+                }
+                if(c[end - 1] < c[m]) {
+                        _kdtree_swap(tree, end - 1, m);
+                        if(c[m] < c[begin]) {
+                                _kdtree_swap(tree, m, begin);
+                        }
+                }
+                _kdtree_swap(tree, begin, m);
+
+                p = c[begin];
+                i = begin - 1;
+                j = end;
+                for(;;) {
+                        do {
+                                i++;
+                        } while(c[i] < p);
+                        do {
+                                j--;
+                        } while(c[j] > p);
+                        if(i >= j) {
+                                break;
+                        }
+                        _kdtree_swap(tree, i, j);
+                }
+
+                if(nth <= j) {
+                        end = j + 1;
+                } else {
+                        begin = j + 1;
+                }
+        }
+}
+
+typedef struct {
+        kdtree*         tree;
+        vec3f*          points;
+        int             level;
+} _kdtree_build_job;
+
+static void _kdtree_load(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        kdtree* tree;
+        _kdtree_build_job* job;
+
+        job = ctx;
+        tree = job->tree;
+        for(i = begin; i < end; i++) {
+                tree->x[i] = job->points[i].m[VEC_X];
+                tree->y[i] = job->points[i].m[VEC_Y];
+                tree->z[i] = job->points[i].m[VEC_Z];
+                tree->index[i] = (unsigned int)i;
+        }
+}
+
+/**
+ * Splits the nodes [begin, end) of one level at the
+ * median of their widest axis.
+ */
+static void _kdtree_split(void* ctx, size_t begin, size_t end)
+{
+        int a;
+        size_t i;
+        size_t j;
+        size_t lo;
+        size_t hi;
+        size_t mid;
+        size_t node;
+        float* c[3];
+        float min[3];
+        float max[3];
+        kdtree* tree;
+        _kdtree_build_job* job;
+
+        job = ctx;
+        tree = job->tree;
+        c[VEC_X] = tree->x;
+        c[VEC_Y] = tree->y;
+        c[VEC_Z] = tree->z;
+
+        for(j = begin; j < end; j++) {
+                _kdtree_range(tree, job->level, j, &lo, &hi);
+                mid = ((2 * j + 1) * tree->count) >> (job->level + 1);
+                node = ((size_t)1 << job->level) - 1 + j;
+
+                for(a = 0; a < 3; a++) {
+                        min[a] = FLT_MAX;
+                        max[a] = -FLT_MAX;
+                        for(i = lo; i < hi; i++) {
+                                min[a] = c[a][i] < min[a] ? c[a][i] : min[a];
+                                max[a] = c[a][i] > max[a] ? c[a][i] : max[a];
+                        }
+                }
+                a = VEC_X;
+                if(max[VEC_Y] - min[VEC_Y] > max[a] - min[a]) {
+                        a = VEC_Y;
+                }
+                if(max[VEC_Z] - min[VEC_Z] > max[a] - min[a]) {
+                        a = VEC_Z;
+                }
+
+                if(mid < hi) {
+                        _kdtree_select(tree, c[a], lo, hi, mid);
+                        tree->split[node] = c[a][mid];
+                } else {
+                        tree->split[node] = max[a];
+                }
+                tree->axis[node] = (unsigned char)a;
+        }
+}
+
+/**
+ * Fails with -1 if count exceeds the capacity given to
+ * kdtree_init(). The points are copied, so the array
+ * is not referenced afterwards; queries report the
+ * positions of points in it.
+ */
+int kdtree_build(kdtree* tree, vec3f* points, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_build, count);
+        size_t nodes;
+        size_t grain;
+        _kdtree_build_job job;
+
+        if(count > tree->capacity) {
+                return -1;
+        }
+
+        tree->count = count;
+        tree->depth = _kdtree_depth(count);
+        job.tree = tree;
+        job.points = points;
+        _cgmath_parallel_for(count, KDTREE_BUILD_GRAIN, _kdtree_load, &job);
+
+        for(job.level = 0; job.level < tree->depth; job.level++) {
+                nodes = (size_t)1 << job.level;
+                grain = (KDTREE_BUILD_GRAIN * nodes) / (count + 1);
+                _cgmath_parallel_for(nodes, grain, _kdtree_split, &job);
+        }
+        return 0;
+}
+
+/**
+ * Depth first walk that visits the near child first and
+ * skips subtrees farther than *bound, which visit may
+ * shrink. visit gets the squared distances of a whole
+ * leaf from the dispatched kernel.
+ */
+typedef void (*_kdtree_visit_fn)(void* ctx, kdtree* tree, size_t begin, float* dist2,
+                size_t count, float* bound);
+
+static void _kdtree_walk(kdtree* tree, float* q, float* bound, _kdtree_visit_fn visit, void* ctx)
+{
+        int top;
+        size_t j;
+        size_t lo;
+        size_t hi;
+        size_t node;
+        size_t leaves;
+        size_t stack[KDTREE_STACK];
+        float gap[KDTREE_STACK];
+        float diff;
+        float d2[KDTREE_LEAF];
+
+        leaves = ((size_t)1 << tree->depth) - 1;
+        top = 0;
+        stack[0] = 0;
+        gap[0] = 0.0f;
+        while(top >= 0) {
+                node = stack[top];
+                if(gap[top--] > *bound) {
+                        continue;
+                }
+
+                while(node < leaves) {
+                        diff = q[tree->axis[node]] - tree->split[node];
+                        top++;
+                        stack[top] = 2 * node + (diff < 0.0f ? 2 : 1);
+                        gap[top] = diff * diff;
+                        node = 2 * node + (diff < 0.0f ? 1 : 2);
+                }
+
+                j = node - leaves;
+                _kdtree_range(tree, tree->depth, j, &lo, &hi);
+                _cgmath_kern.kdtree_leaf_dist2(tree->x + lo, tree->y + lo, tree->z + lo, q, d2, hi - lo);
+                visit(ctx, tree, lo, d2, hi - lo, bound);
+        }
+}
+
+typedef struct {
+        unsigned int    id;
+        float           dist2;
+} _kdtree_nearest_ctx;
+
+static void _kdtree_visit_nearest(void* ctx, kdtree* tree, size_t begin, float* dist2,
+                size_t count, float* bound)
+{
+        size_t i;
+        _kdtree_nearest_ctx* n;
+
+        n = ctx;
+        for(i = 0; i < count; i++) {
+                if(dist2[i] < n->dist2 ||
+                                (dist2[i] == n->dist2 && tree->index[begin + i] < n->id)) {
+                        n->dist2 = dist2[i];
+                        n->id = tree->index[begin + i];
+                }
+        }
+        *bound = n->dist2;
+}
+
+/**
+ * Returns the id of the point closest to q, the lowest
+ * one on ties, or 0xFFFFFFFF for an empty tree. The
+ * search starts at an infinite distance, so a point
+ * whose squared distance overflows is still found.
+ * dist2 may be NULL.
+ */
+unsigned int kdtree_nearest(kdtree* tree, vec3f* q, float* dist2)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_nearest, 1);
+        float bound;
+        _kdtree_nearest_ctx n;
+
+        n.id = KDTREE_NONE;
+        n.dist2 = INFINITY;
+        bound = INFINITY;
+        if(tree->count > 0) {
+                _kdtree_walk(tree, q->m, &bound, _kdtree_visit_nearest, &n);
+        }
+        if(dist2 != NULL) {
+                *dist2 = n.dist2;
+        }
+        return n.id;
+}
+
+/**
+ * Max-heap of the k best candidates so far, kept in
+ * the caller's output rows.
+ */
+typedef struct {
+        unsigned int*   id;
+        float*          dist2;
+        size_t          k;
+        size_t          size;
+} _kdtree_knn_ctx;
+
+static inline int _kdtree_worse(_kdtree_knn_ctx* h, size_t a, size_t b)
+{
+        return h->dist2[a] > h->dist2[b] || (h->dist2[a] == h->dist2[b] && h->id[a] > h->id[b]);
+}
+
+static inline void _kdtree_heap_swap(_kdtree_knn_ctx* h, size_t a, size_t b)
+{
+        float f;
+        unsigned int u;
+
+        f = h->dist2[a]; h->dist2[a] = h->dist2[b]; h->dist2[b] = f;
+        u = h->id[a]; h->id[a] = h->id[b]; h->id[b] = u;
+}
+
+static void _kdtree_heap_down(_kdtree_knn_ctx* h, size_t i, size_t size)
+{
+        size_t c;
+
+        for(;;) {
+                c = 2 * i + 1;
+                if(c >= size) {
+                        return;
+                }
+                if(c + 1 < size && _kdtree_worse(h, c + 1, c)) {
+                        c++;
+                }
+                if(!_kdtree_worse(h, c, i)) {
+                        return;
+                }
+                _kdtree_heap_swap(h, i, c);
+                i = c;
+        }
+}
+
+static void _kdtree_visit_knn(void* ctx, kdtree* tree, size_t begin, float* dist2,
+                size_t count, float* bound)
+{
+        size_t i;
+        size_t c;
+        unsigned int id;
+        _kdtree_knn_ctx* h;
+
+        h = ctx;
+        for(i = 0; i < count; i++) {
+                id = tree->index[begin + i];
+                if(h->size < h->k) {
+                        c = h->size++;
+                        h->id[c] = id;
+                        h->dist2[c] = dist2[i];
+                        while(c > 0 && _kdtree_worse(h, c, (c - 1) / 2)) {
+                                _kdtree_heap_swap(h, c, (c - 1) / 2);
+                                c = (c - 1) / 2;
+                        }
+                } else if(dist2[i] < h->dist2[0] || (dist2[i] == h->dist2[0] && id < h->id[0])) {
+                        h->id[0] = id;
+                        h->dist2[0] = dist2[i];
+                        _kdtree_heap_down(h, 0, h->size);
+                }
+        }
+        if(h->size == h->k) {
+                *bound = h->dist2[0];
+        }
+}
+
+static size_t _kdtree_knn(kdtree* tree, float* q, size_t k, unsigned int* dest, float* dist2)
+{
+        size_t i;
+        float bound;
+        _kdtree_knn_ctx h;
+
+        h.id = dest;
+        h.dist2 = dist2;
+        h.k = k;
+        h.size = 0;
+        bound = INFINITY;
+        if(tree->count > 0 && k > 0) {
+                _kdtree_walk(tree, q, &bound, _kdtree_visit_knn, &h);
+        }
+
+        /* heap sort into ascending order, then pad the row */
+        for(i = h.size; i > 1; i--) {
+                _kdtree_heap_swap(&h, 0, i - 1);
+                _kdtree_heap_down(&h, 0, i - 1);
+        }
+        for(i = h.size; i < k; i++) {
+                dest[i] = KDTREE_NONE;
+                dist2[i] = FLT_MAX;
+        }
+        return h.size;
+}
+
+/**
+ * The k points closest to q in ascending distance, ties
+ * broken by id, into dest and dist2 (k entries each).
+ * Returns how many were found; if the tree holds fewer
+ * than k points the rest of the row is padded with
+ * 0xFFFFFFFF and FLT_MAX.
+ */
+size_t kdtree_knn(kdtree* tree, vec3f* q, size_t k, unsigned int* dest, float* dist2)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_knn, 1);
+        return _kdtree_knn(tree, q->m, k, dest, dist2);
+}
+
+typedef struct {
+        unsigned int*   dest;
+        size_t          max;
+        size_t          n;
+        float           r2;
+} _kdtree_radius_ctx;
+
+static void _kdtree_visit_radius(void* ctx, kdtree* tree, size_t begin, float* dist2,
+                size_t count, float* bound)
+{
+        size_t i;
+        _kdtree_radius_ctx* r;
+
+        (void)bound;
+        r = ctx;
+        for(i = 0; i < count; i++) {
+                if(dist2[i] <= r->r2) {
+                        if(r->n < r->max) {
+                                r->dest[r->n] = tree->index[begin + i];
+                        }
+                        r->n++;
+                }
+        }
+}
+
+static size_t _kdtree_radius(kdtree* tree, float* q, float radius, unsigned int* dest, size_t max)
+{
+        float bound;
+        _kdtree_radius_ctx r;
+
+        r.dest = dest;
+        r.max = max;
+        r.n = 0;
+        r.r2 = radius * radius;
+        bound = r.r2;
+        if(tree->count > 0) {
+                _kdtree_walk(tree, q, &bound, _kdtree_visit_radius, &r);
+        }
+        return r.n;
+}
+
+size_t kdtree_query_radius(kdtree* tree, vec3f* center, float radius, unsigned int* dest, size_t max)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_query_radius, 1);
+        return _kdtree_radius(tree, center->m, radius, dest, max);
+}
+
+typedef struct {
+        kdtree*         tree;
+        vec3f*          q;
+        size_t          k;
+        float           radius;
+        unsigned int*   offsets;
+        unsigned int*   dest;
+        float*          dist2;
+        size_t          max;
+        int             fill;
+} _kdtree_query_job;
+
+static void _kdtree_nearest_range(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        float bound;
+        _kdtree_nearest_ctx n;
+        _kdtree_query_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                n.id = KDTREE_NONE;
+                n.dist2 = INFINITY;
+                bound = INFINITY;
+                if(job->tree->count > 0) {
+                        _kdtree_walk(job->tree, job->q[i].m, &bound, _kdtree_visit_nearest, &n);
+                }
+                job->dest[i] = n.id;
+                if(job->dist2 != NULL) {
+                        job->dist2[i] = n.dist2;
+                }
+        }
+}
+
+static void _kdtree_knn_range(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        _kdtree_query_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                _kdtree_knn(job->tree, job->q[i].m, job->k, job->dest + i * job->k,
+                                job->dist2 + i * job->k);
+        }
+}
+
+static void _kdtree_radius_range(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        size_t at;
+        _kdtree_query_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                if(!job->fill) {
+                        job->offsets[i + 1] = (unsigned int)_kdtree_radius(job->tree, job->q[i].m,
+                                        job->radius, NULL, 0);
+                        continue;
+                }
+
+                at = job->offsets[i];
+                if(at < job->max) {
+                        _kdtree_radius(job->tree, job->q[i].m, job->radius,
+                                        job->dest + at, job->max - at);
+                }
+        }
+}
+
+/**
+ * Nearest point to each of count queries; dist2 may be
+ * NULL.
+ */
+void kdtree_nearest_array(kdtree* tree, vec3f* q, size_t count, unsigned int* dest, float* dist2)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_nearest_array, count);
+        _kdtree_query_job job;
+
+        job.tree = tree;
+        job.q = q;
+        job.dest = dest;
+        job.dist2 = dist2;
+        _cgmath_parallel_for(count, KDTREE_QUERY_GRAIN, _kdtree_nearest_range, &job);
+}
+
+/**
+ * kdtree_knn() for count queries; row i of dest and
+ * dist2 starts at i * k.
+ */
+void kdtree_knn_array(kdtree* tree, vec3f* q, size_t count, size_t k, unsigned int* dest, float* dist2)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_knn_array, count);
+        _kdtree_query_job job;
+
+        job.tree = tree;
+        job.q = q;
+        job.k = k;
+        job.dest = dest;
+        job.dist2 = dist2;
+        _cgmath_parallel_for(count, KDTREE_QUERY_GRAIN, _kdtree_knn_range, &job);
+}
+
+/**
+ * Radius queries laid out like grid_query_radius_array():
+ * the ids for query i are dest[offsets[i]] to
+ * dest[offsets[i + 1]], and the total is returned with
+ * ids past max dropped.
+ */
+size_t kdtree_query_radius_array(kdtree* tree, vec3f* centers, size_t count, float radius,
+                unsigned int* offsets, unsigned int* dest, size_t max)
+{
+        CGMATH_PROFILE_SCOPE(kdtree_query_radius_array, count);
+        size_t i;
+        _kdtree_query_job job;
+
+        job.tree = tree;
+        job.q = centers;
+        job.radius = radius;
+        job.offsets = offsets;
+        job.dest = dest;
+        job.max = max;
+
+        offsets[0] = 0;
+        job.fill = 0;
+        _cgmath_parallel_for(count, KDTREE_QUERY_GRAIN, _kdtree_radius_range, &job);
+        for(i = 0; i < count; i++) {
+                offsets[i + 1] += offsets[i];
+        }
+
+        job.fill = 1;
+        _cgmath_parallel_for(count, KDTREE_QUERY_GRAIN, _kdtree_radius_range, &job);
+        return offsets[count];
+}
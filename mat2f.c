@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "cgmath.h"
+#include "cgmath_profile.h"
 
 #if defined(CGMATH_MATRIX_DIMS_DEFINED)
 #undef CGMATH_MATRIX_WIDTH
@@ -25,11 +26,13 @@
 
 void mat2f_zero(mat2f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_zero, 1);
         memset(mat->m, 0, CGMATH_MATRIX_SIZE);
 }
 
 void mat2f_identity(mat2f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_identity, 1);
         mat2f_zero(mat);
         mat->m[0][0] = 1.0f;
         mat->m[1][1] = 1.0f;
@@ -37,6 +40,7 @@ void mat2f_identity(mat2f* mat)
 
 void mat2f_add(mat2f* a, mat2f* b, mat2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_add, 1);
         mat2f tmp;
         memcpy(tmp.m, a->m, CGMATH_MATRIX_SIZE);
 
@@ -50,6 +54,7 @@ void mat2f_add(mat2f* a, mat2f* b, mat2f* dest)
 
 void mat2f_scale(mat2f* mat, float scalar, mat2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_scale, 1);
         mat2f tmp;
         memcpy(tmp.m, mat->m, CGMATH_MATRIX_SIZE);
 
@@ -63,6 +68,7 @@ void mat2f_scale(mat2f* mat, float scalar, mat2f* dest)
 
 void mat2f_multiply(mat2f* a, mat2f* b, mat2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_multiply, 1);
         int i;
         int j;
         vec2f row;
@@ -91,6 +97,7 @@ void mat2f_multiply(mat2f* a, mat2f* b, mat2f* dest)
 
 float mat2f_determinant(mat2f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_determinant, 1);
         float dt;
         dt = mat->m[0][0] * mat->m[1][1] - mat->m[0][1] * mat->m[1][0];
         return dt;
@@ -98,6 +105,7 @@ float mat2f_determinant(mat2f* mat)
 
 void mat2f_transpose(mat2f* mat, mat2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_transpose, 1);
         int i;
         int j;
         mat2f tmp;
@@ -112,6 +120,7 @@ void mat2f_transpose(mat2f* mat, mat2f* dest)
 
 void mat2f_inverse(mat2f* mat, mat2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_inverse, 1);
         float dt;
         mat2f tmp;
         
@@ -130,6 +139,7 @@ void mat2f_inverse(mat2f* mat, mat2f* dest)
 
 void mat2f_get_row(mat2f* mat, vec2f* dest, int row)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_get_row, 1);
         if(row > 0 && row < CGMATH_MATRIX_HEIGHT) {
                 dest->m[0] = mat->m[row][0];
                 dest->m[1] = mat->m[row][1];
@@ -138,6 +148,7 @@ void mat2f_get_row(mat2f* mat, vec2f* dest, int row)
 
 void mat2f_get_col(mat2f* mat, vec2f* dest, int col)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_get_col, 1);
         if(col > 0 && col < CGMATH_MATRIX_WIDTH) {
                 dest->m[0] = mat->m[0][col];
                 dest->m[1] = mat->m[1][col];
@@ -146,6 +157,7 @@ void mat2f_get_col(mat2f* mat, vec2f* dest, int col)
 
 void mat2f_set_row(mat2f* mat, vec2f* src, int row)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_set_row, 1);
         if(row > 0 && row < CGMATH_MATRIX_HEIGHT) {
                 mat->m[row][0] = src->m[0];
                 mat->m[row][1] = src->m[1];
@@ -154,6 +166,7 @@ void mat2f_set_row(mat2f* mat, vec2f* src, int row)
 
 void mat2f_set_col(mat2f* mat, vec2f* src, int col)
 {
+        CGMATH_PROFILE_SCOPE(mat2f_set_col, 1);
         if(col > 0 && col < CGMATH_MATRIX_WIDTH) {
                 mat->m[0][col] = src->m[0];
                 mat->m[1][col] = src->m[1];
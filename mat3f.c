@@ -5,9 +5,14 @@
  * * Implementation for a 3x3 matrix.
  */
 
+#include <float.h>
+#include <math.h>
 #include <string.h>
 
 #include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
 
 #if defined(CGMATH_MATRIX_DIMS_DEFINED)
 #undef CGMATH_MATRIX_WIDTH
@@ -23,13 +28,29 @@
 #define CGMATH_MATRIX_SIZE      (CGMATH_MATRIX_ELEMS * sizeof(float))
 #define CGMATH_MATRIX_DIMS_DEFINED
 
+/* matrices per task for the array kernels */
+#define MAT3F_ARRAY_GRAIN       4096
+
+/* matrices staged into SoA form at a time by the AoS kernels */
+#define MAT3F_ARRAY_BLOCK       64
+
+/**
+ * Cyclic Jacobi sweeps per eigen-decomposition. The
+ * off-diagonal part shrinks quadratically, and five
+ * sweeps leave it below float rounding for any input.
+ */
+#define MAT3F_JACOBI_SWEEPS     5
+#define MAT3F_JACOBI_EPS        1e-12f
+
 void mat3f_zero(mat3f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_zero, 1);
         memset(mat->m, 0, CGMATH_MATRIX_SIZE);
 }
 
 void mat3f_identity(mat3f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_identity, 1);
         mat3f_zero(mat);
         mat->m[0][0] = 1.0f;
         mat->m[1][1] = 1.0f;
@@ -38,6 +59,7 @@ void mat3f_identity(mat3f* mat)
 
 void mat3f_add(mat3f* a, mat3f* b, mat3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_add, 1);
         mat3f tmp;
         memcpy(tmp.m, a->m, CGMATH_MATRIX_SIZE);
 
@@ -56,6 +78,7 @@ void mat3f_add(mat3f* a, mat3f* b, mat3f* dest)
 
 void mat3f_scale(mat3f* mat, float scalar, mat3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_scale, 1);
         mat3f tmp;
         memcpy(tmp.m, mat->m, CGMATH_MATRIX_SIZE);
 
@@ -74,6 +97,7 @@ void mat3f_scale(mat3f* mat, float scalar, mat3f* dest)
 
 void mat3f_multiply(mat3f* a, mat3f* b, mat3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_multiply, 1);
         int i;
         int j;
         vec3f row;
@@ -119,6 +143,7 @@ void mat3f_multiply(mat3f* a, mat3f* b, mat3f* dest)
  */
 float mat3f_determinant(mat3f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_determinant, 1);
         float dt;
         mat2f sm;
 
@@ -147,6 +172,7 @@ float mat3f_determinant(mat3f* mat)
 
 void mat3f_transpose(mat3f* mat, mat3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_transpose, 1);
         int i;
         int j;
         mat3f tmp;
@@ -167,11 +193,16 @@ void mat3f_transpose(mat3f* mat, mat3f* dest)
         *(int*)&tmp.m[2][0] ^= *(int*)&tmp.m[0][2];
         *(int*)&tmp.m[0][2] ^= *(int*)&tmp.m[2][0];
 
+        *(int*)&tmp.m[1][2] ^= *(int*)&tmp.m[2][1];
+        *(int*)&tmp.m[2][1] ^= *(int*)&tmp.m[1][2];
+        *(int*)&tmp.m[1][2] ^= *(int*)&tmp.m[2][1];
+
         memcpy(dest->m, tmp.m, CGMATH_MATRIX_SIZE);
 }
 
 void mat3f_inverse(mat3f* mat, mat3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_inverse, 1);
         float dt;
         mat3f tmp;
         mat2f sm;
@@ -241,6 +272,7 @@ void mat3f_inverse(mat3f* mat, mat3f* dest)
 
 void mat3f_get_row(mat3f* mat, vec3f* dest, int row)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_get_row, 1);
         if(row > 0 && row < CGMATH_MATRIX_HEIGHT) {
                 dest->m[0] = mat->m[row][0];
                 dest->m[1] = mat->m[row][1];
@@ -250,6 +282,7 @@ void mat3f_get_row(mat3f* mat, vec3f* dest, int row)
 
 void mat3f_get_col(mat3f* mat, vec3f* dest, int col)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_get_col, 1);
         if(col > 0 && col < CGMATH_MATRIX_WIDTH) {
                 dest->m[0] = mat->m[0][col];
                 dest->m[1] = mat->m[1][col];
@@ -259,6 +292,7 @@ void mat3f_get_col(mat3f* mat, vec3f* dest, int col)
 
 void mat3f_set_row(mat3f* mat, vec3f* src, int row)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_set_row, 1);
         if(row > 0 && row < CGMATH_MATRIX_HEIGHT) {
                 mat->m[row][0] = src->m[0];
                 mat->m[row][1] = src->m[1];
@@ -268,6 +302,7 @@ void mat3f_set_row(mat3f* mat, vec3f* src, int row)
 
 void mat3f_set_col(mat3f* mat, vec3f* src, int col)
 {
+        CGMATH_PROFILE_SCOPE(mat3f_set_col, 1);
         if(col > 0 && col < CGMATH_MATRIX_WIDTH) {
                 mat->m[0][col] = src->m[0];
                 mat->m[1][col] = src->m[1];
@@ -275,3 +310,948 @@ void mat3f_set_col(mat3f* mat, vec3f* src, int col)
         }
 }
 
+/**
+ * Adjugates of one matrix per lane, written once for
+ * float, __m128 and __m256. a[3 * r + c] holds element
+ * [r][c] of each lane. The symmetric form reads only
+ * a[0], a[1], a[2], a[4], a[5] and a[8] and produces
+ * the six distinct entries of a symmetric adjugate.
+ */
+#define MAT3F_ADJUGATE_LANES(NAME, TARGET, V) \
+TARGET static inline void NAME(V* a, V* d, V* det) \
+{ \
+        d[0] = a[4] * a[8] - a[5] * a[7]; \
+        d[1] = a[2] * a[7] - a[1] * a[8]; \
+        d[2] = a[1] * a[5] - a[2] * a[4]; \
+        d[3] = a[5] * a[6] - a[3] * a[8]; \
+        d[4] = a[0] * a[8] - a[2] * a[6]; \
+        d[5] = a[2] * a[3] - a[0] * a[5]; \
+        d[6] = a[3] * a[7] - a[4] * a[6]; \
+        d[7] = a[1] * a[6] - a[0] * a[7]; \
+        d[8] = a[0] * a[4] - a[1] * a[3]; \
+        *det = a[0] * d[0] + a[1] * d[3] + a[2] * d[6]; \
+}
+
+#define MAT3F_ADJUGATE_SYM_LANES(NAME, TARGET, V) \
+TARGET static inline void NAME(V* a, V* d, V* det) \
+{ \
+        d[0] = a[4] * a[8] - a[5] * a[5]; \
+        d[1] = a[2] * a[5] - a[1] * a[8]; \
+        d[2] = a[1] * a[5] - a[2] * a[4]; \
+        d[4] = a[0] * a[8] - a[2] * a[2]; \
+        d[5] = a[1] * a[2] - a[0] * a[5]; \
+        d[8] = a[0] * a[4] - a[1] * a[1]; \
+        d[3] = d[1]; \
+        d[6] = d[2]; \
+        d[7] = d[5]; \
+        *det = a[0] * d[0] + a[1] * d[1] + a[2] * d[2]; \
+}
+
+MAT3F_ADJUGATE_LANES(_mat3f_adjugate_lanes, , float)
+MAT3F_ADJUGATE_SYM_LANES(_mat3f_adjugate_sym_lanes, , float)
+
+static const int _mat3f_upper[6] = { 0, 1, 2, 4, 5, 8 };
+
+void _mat3f_determinant_soa_scalar(mat3f_soa* mat, float* dest, size_t count)
+{
+        size_t i;
+        float** m;
+
+        m = mat->m;
+        for(i = 0; i < count; i++) {
+                dest[i] = m[0][i] * (m[4][i] * m[8][i] - m[5][i] * m[7][i]) +
+                        m[1][i] * (m[5][i] * m[6][i] - m[3][i] * m[8][i]) +
+                        m[2][i] * (m[3][i] * m[7][i] - m[4][i] * m[6][i]);
+        }
+}
+
+static size_t _mat3f_inverse_soa_lanes(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular,
+                size_t count, int sym)
+{
+        int k;
+        int flag;
+        size_t i;
+        size_t bad;
+        float a[9];
+        float d[9];
+        float dt;
+        float inv;
+
+        bad = 0;
+        for(i = 0; i < count; i++) {
+                if(sym) {
+                        for(k = 0; k < 6; k++) {
+                                a[_mat3f_upper[k]] = mat->m[_mat3f_upper[k]][i];
+                        }
+                        _mat3f_adjugate_sym_lanes(a, d, &dt);
+                } else {
+                        for(k = 0; k < 9; k++) {
+                                a[k] = mat->m[k][i];
+                        }
+                        _mat3f_adjugate_lanes(a, d, &dt);
+                }
+
+                inv = 1.0f / dt;
+                flag = !(_cgmath_absf(dt) <= FLT_MAX && _cgmath_absf(inv) <= FLT_MAX);
+                if(flag) {
+                        bad++;
+                }
+                if(singular != NULL) {
+                        singular[i] = flag;
+                }
+                for(k = 0; k < 9; k++) {
+                        dest->m[k][i] = flag ? 0.0f : d[k] * inv;
+                }
+        }
+        return bad;
+}
+
+size_t _mat3f_inverse_soa_scalar(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        return _mat3f_inverse_soa_lanes(mat, dest, singular, count, 0);
+}
+
+size_t _mat3f_inverse_sym_soa_scalar(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        return _mat3f_inverse_soa_lanes(mat, dest, singular, count, 1);
+}
+
+/**
+ * Symmetric eigen-decomposition of one matrix per lane
+ * by cyclic Jacobi rotation, written once for float,
+ * __m128 and __m256. a holds the upper triangle
+ * (a[0], a[1], a[2], a[4], a[5], a[8]) and is
+ * destroyed; v must hold the identity on entry and
+ * receives the eigenvectors as columns. Every lane
+ * runs the same fixed number of sweeps, so there are
+ * no branches. The rotation angle is computed from
+ * t = tan(theta) in the form that stays finite for
+ * a[pq] = 0. An a[pq] below MAT3F_JACOBI_EPS of the
+ * diagonal is already converged and is zeroed first;
+ * squaring it would otherwise produce denormals,
+ * which are very slow once most lanes have converged.
+ * The eigenvalues come out in
+ * descending order with the third column rebuilt as
+ * the cross product of the first two, so v is always
+ * a rotation.
+ */
+#define MAT3F_JACOBI_LANES(NAME, TARGET, V, SQRT, SIGN, KEEP, ORDER) \
+TARGET static inline void NAME##_rotate(V* a, V* v, int pp, int qq, int pq, int pr, int qr, \
+                int p, int q) \
+{ \
+        int k; \
+        V d; \
+        V t; \
+        V c; \
+        V s; \
+        V x; \
+        V y; \
+\
+        a[pq] = KEEP(a[pq], a[pp] * SIGN(a[pp]) + a[qq] * SIGN(a[qq])); \
+        d = a[qq] - a[pp]; \
+        t = (a[pq] + a[pq]) * SIGN(d) / \
+                (d * SIGN(d) + SQRT(d * d + 4.0f * a[pq] * a[pq]) + FLT_MIN); \
+        c = 1.0f / SQRT(t * t + 1.0f); \
+        s = t * c; \
+\
+        a[pp] = a[pp] - t * a[pq]; \
+        a[qq] = a[qq] + t * a[pq]; \
+        a[pq] = a[pq] * 0.0f; \
+        x = a[pr]; \
+        y = a[qr]; \
+        a[pr] = c * x - s * y; \
+        a[qr] = s * x + c * y; \
+        for(k = 0; k < 3; k++) { \
+                x = v[3 * k + p]; \
+                y = v[3 * k + q]; \
+                v[3 * k + p] = c * x - s * y; \
+                v[3 * k + q] = s * x + c * y; \
+        } \
+} \
+\
+TARGET static inline void NAME(V* a, V* w, V* v) \
+{ \
+        int sweep; \
+\
+        for(sweep = 0; sweep < MAT3F_JACOBI_SWEEPS; sweep++) { \
+                NAME##_rotate(a, v, 0, 4, 1, 2, 5, 0, 1); \
+                NAME##_rotate(a, v, 0, 8, 2, 1, 5, 0, 2); \
+                NAME##_rotate(a, v, 4, 8, 5, 1, 2, 1, 2); \
+        } \
+\
+        w[0] = a[0]; \
+        w[1] = a[4]; \
+        w[2] = a[8]; \
+        ORDER(w, v, 0, 1); \
+        ORDER(w, v, 0, 2); \
+        ORDER(w, v, 1, 2); \
+\
+        v[2] = v[3] * v[7] - v[6] * v[4]; \
+        v[5] = v[6] * v[1] - v[0] * v[7]; \
+        v[8] = v[0] * v[4] - v[3] * v[1]; \
+}
+
+static inline float _mat3f_sign(float f)
+{
+        return f < 0.0f ? -1.0f : 1.0f;
+}
+
+static inline float _mat3f_keep(float f, float diag)
+{
+        return _cgmath_absf(f) > MAT3F_JACOBI_EPS * diag ? f : 0.0f;
+}
+
+/**
+ * Scales the upper triangle of a by a power of two so
+ * the largest entry is in [1, 2) and returns the
+ * factor to apply to the eigenvalues. The scaling is
+ * exact, and keeps the squares in the rotation from
+ * overflowing or going denormal for any finite input.
+ */
+static inline float _mat3f_eigen_scale(float* a)
+{
+        int k;
+        float m;
+        unsigned int u;
+
+        m = 0.0f;
+        for(k = 0; k < 6; k++) {
+                if(_cgmath_absf(a[_mat3f_upper[k]]) > m) {
+                        m = _cgmath_absf(a[_mat3f_upper[k]]);
+                }
+        }
+        memcpy(&u, &m, sizeof(u));
+        u &= 0x7F800000u;
+        if(u == 0) {
+                u = 0x00800000u;
+        }
+        memcpy(&m, &u, sizeof(m));
+        for(k = 0; k < 6; k++) {
+                a[_mat3f_upper[k]] *= 1.0f / m;
+        }
+        return m;
+}
+
+/* swaps eigenpairs i and j where w[i] < w[j] */
+static inline void _mat3f_eigen_order(float* w, float* v, int i, int j)
+{
+        int k;
+        float t;
+
+        if(w[i] < w[j]) {
+                t = w[i]; w[i] = w[j]; w[j] = t;
+                for(k = 0; k < 3; k++) {
+                        t = v[3 * k + i]; v[3 * k + i] = v[3 * k + j]; v[3 * k + j] = t;
+                }
+        }
+}
+
+MAT3F_JACOBI_LANES(_mat3f_jacobi_lanes, , float, sqrtf, _mat3f_sign, _mat3f_keep,
+                _mat3f_eigen_order)
+
+static void _vec3f_soa_offset(vec3f_soa* soa, vec3f_soa* dest, size_t offset)
+{
+        int k;
+
+        for(k = 0; k < 3; k++) {
+                dest->m[k] = soa->m[k] + offset;
+        }
+}
+
+void _mat3f_eigen_sym_soa_scalar(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count)
+{
+        int k;
+        size_t i;
+        float a[9];
+        float w[3];
+        float v[9];
+        float scale;
+
+        for(i = 0; i < count; i++) {
+                for(k = 0; k < 9; k++) {
+                        a[k] = mat->m[k][i];
+                        v[k] = k % 4 == 0 ? 1.0f : 0.0f;
+                }
+                scale = _mat3f_eigen_scale(a);
+                _mat3f_jacobi_lanes(a, w, v);
+                for(k = 0; k < 3; k++) {
+                        values->m[k][i] = w[k] * scale;
+                }
+                for(k = 0; k < 9; k++) {
+                        vectors->m[k][i] = v[k];
+                }
+        }
+}
+
+#define MAT3F_DETERMINANT       0
+#define MAT3F_INVERSE           1
+#define MAT3F_INVERSE_SYM       2
+
+typedef struct {
+        int             op;
+        int             aos;
+        mat3f*          mat;
+        mat3f*          dest;
+        mat3f_soa       smat;
+        mat3f_soa       sdest;
+        float*          det;
+        unsigned char*  singular;
+        size_t          bad;
+} _mat3f_array_job;
+
+static size_t _mat3f_array_kernel(_mat3f_array_job* job, mat3f_soa* mat, mat3f_soa* dest,
+                float* det, unsigned char* singular, size_t count)
+{
+        switch(job->op) {
+        case MAT3F_DETERMINANT:
+                _cgmath_kern.mat3f_determinant_soa(mat, det, count);
+                return 0;
+        case MAT3F_INVERSE:
+                return _cgmath_kern.mat3f_inverse_soa(mat, dest, singular, count);
+        default:
+                return _cgmath_kern.mat3f_inverse_sym_soa(mat, dest, singular, count);
+        }
+}
+
+static void _mat3f_soa_offset(mat3f_soa* soa, mat3f_soa* dest, size_t offset)
+{
+        int k;
+
+        for(k = 0; k < 9; k++) {
+                dest->m[k] = soa->m[k] + offset;
+        }
+}
+
+/**
+ * AoS input is staged through a small SoA block on the
+ * stack so that every layout runs the same kernels.
+ */
+static size_t _mat3f_array_aos(_mat3f_array_job* job, size_t begin, size_t end)
+{
+        int k;
+        size_t i;
+        size_t n;
+        size_t bad;
+        float in[9][MAT3F_ARRAY_BLOCK] __attribute__((aligned(64)));
+        float out[9][MAT3F_ARRAY_BLOCK] __attribute__((aligned(64)));
+        mat3f_soa smat;
+        mat3f_soa sdest;
+
+        for(k = 0; k < 9; k++) {
+                smat.m[k] = in[k];
+                sdest.m[k] = out[k];
+        }
+
+        bad = 0;
+        for(; begin < end; begin += n) {
+                n = end - begin < MAT3F_ARRAY_BLOCK ? end - begin : MAT3F_ARRAY_BLOCK;
+                for(i = 0; i < n; i++) {
+                        for(k = 0; k < 9; k++) {
+                                in[k][i] = job->mat[begin + i].m[k / 3][k % 3];
+                        }
+                }
+
+                bad += _mat3f_array_kernel(job, &smat, &sdest,
+                                job->det != NULL ? job->det + begin : NULL,
+                                job->singular != NULL ? job->singular + begin : NULL, n);
+
+                if(job->op != MAT3F_DETERMINANT) {
+                        for(i = 0; i < n; i++) {
+                                for(k = 0; k < 9; k++) {
+                                        job->dest[begin + i].m[k / 3][k % 3] = out[k][i];
+                                }
+                        }
+                }
+        }
+        return bad;
+}
+
+static void _mat3f_array_range(void* ctx, size_t begin, size_t end)
+{
+        size_t bad;
+        mat3f_soa smat;
+        mat3f_soa sdest;
+        _mat3f_array_job* job;
+
+        job = ctx;
+        if(job->aos) {
+                bad = _mat3f_array_aos(job, begin, end);
+        } else {
+                _mat3f_soa_offset(&job->smat, &smat, begin);
+                if(job->op != MAT3F_DETERMINANT) {
+                        _mat3f_soa_offset(&job->sdest, &sdest, begin);
+                }
+                bad = _mat3f_array_kernel(job, &smat, &sdest,
+                                job->det != NULL ? job->det + begin : NULL,
+                                job->singular != NULL ? job->singular + begin : NULL, end - begin);
+        }
+        __atomic_fetch_add(&job->bad, bad, __ATOMIC_RELAXED);
+}
+
+static size_t _mat3f_array_run(_mat3f_array_job* job, int op, float* det,
+                unsigned char* singular, size_t count)
+{
+        job->op = op;
+        job->det = det;
+        job->singular = singular;
+        job->bad = 0;
+        _cgmath_parallel_for(count, MAT3F_ARRAY_GRAIN, _mat3f_array_range, job);
+        return job->bad;
+}
+
+static size_t _mat3f_array_aos_run(mat3f* mat, mat3f* dest, int op, float* det,
+                unsigned char* singular, size_t count)
+{
+        _mat3f_array_job job;
+
+        job.aos = 1;
+        job.mat = mat;
+        job.dest = dest;
+        return _mat3f_array_run(&job, op, det, singular, count);
+}
+
+static size_t _mat3f_array_soa_run(mat3f_soa* mat, mat3f_soa* dest, int op, float* det,
+                unsigned char* singular, size_t count)
+{
+        _mat3f_array_job job;
+
+        job.aos = 0;
+        job.smat = *mat;
+        if(dest != NULL) {
+                job.sdest = *dest;
+        }
+        return _mat3f_array_run(&job, op, det, singular, count);
+}
+
+/**
+ * Batched determinants and inverses, several matrices
+ * per instruction stream. As with mat4f_inverse_array,
+ * every dest is written: a matrix whose determinant has
+ * no finite reciprocal gets the zero matrix and a 1 in
+ * singular[i] (which may be NULL), and the number of
+ * such matrices is returned. dest may equal mat.
+ *
+ * The _sym variants are for symmetric matrices such as
+ * inertia tensors: only the upper triangle of mat is
+ * read and the adjugate needs six cofactors, not nine.
+ * For the SoA layout all nine dest pointers are still
+ * written, so a symmetric dest may alias m[3], m[6]
+ * and m[7] to m[1], m[2] and m[5].
+ */
+void mat3f_determinant_array(mat3f* mat, float* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_determinant_array, count);
+        _mat3f_array_aos_run(mat, NULL, MAT3F_DETERMINANT, dest, NULL, count);
+}
+
+size_t mat3f_inverse_array(mat3f* mat, mat3f* dest, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_inverse_array, count);
+        return _mat3f_array_aos_run(mat, dest, MAT3F_INVERSE, NULL, singular, count);
+}
+
+size_t mat3f_inverse_sym_array(mat3f* mat, mat3f* dest, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_inverse_sym_array, count);
+        return _mat3f_array_aos_run(mat, dest, MAT3F_INVERSE_SYM, NULL, singular, count);
+}
+
+void mat3f_determinant_soa(mat3f_soa* mat, float* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_determinant_soa, count);
+        _mat3f_array_soa_run(mat, NULL, MAT3F_DETERMINANT, dest, NULL, count);
+}
+
+size_t mat3f_inverse_soa(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_inverse_soa, count);
+        return _mat3f_array_soa_run(mat, dest, MAT3F_INVERSE, NULL, singular, count);
+}
+
+size_t mat3f_inverse_sym_soa(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_inverse_sym_soa, count);
+        return _mat3f_array_soa_run(mat, dest, MAT3F_INVERSE_SYM, NULL, singular, count);
+}
+
+
+typedef struct {
+        int             aos;
+        mat3f*          mat;
+        vec3f*          values;
+        mat3f*          vectors;
+        mat3f_soa       smat;
+        vec3f_soa       svalues;
+        mat3f_soa       svectors;
+} _mat3f_eigen_job;
+
+static void _mat3f_eigen_range(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        size_t i;
+        size_t n;
+        float in[9][MAT3F_ARRAY_BLOCK] __attribute__((aligned(64)));
+        float val[3][MAT3F_ARRAY_BLOCK] __attribute__((aligned(64)));
+        float vec[9][MAT3F_ARRAY_BLOCK] __attribute__((aligned(64)));
+        mat3f_soa smat;
+        vec3f_soa svalues;
+        mat3f_soa svectors;
+        _mat3f_eigen_job* job;
+
+        job = ctx;
+        if(!job->aos) {
+                _mat3f_soa_offset(&job->smat, &smat, begin);
+                _vec3f_soa_offset(&job->svalues, &svalues, begin);
+                _mat3f_soa_offset(&job->svectors, &svectors, begin);
+                _cgmath_kern.mat3f_eigen_sym_soa(&smat, &svalues, &svectors, end - begin);
+                return;
+        }
+
+        for(k = 0; k < 9; k++) {
+                smat.m[k] = in[k];
+                svectors.m[k] = vec[k];
+        }
+        for(k = 0; k < 3; k++) {
+                svalues.m[k] = val[k];
+        }
+
+        for(; begin < end; begin += n) {
+                n = end - begin < MAT3F_ARRAY_BLOCK ? end - begin : MAT3F_ARRAY_BLOCK;
+                for(i = 0; i < n; i++) {
+                        for(k = 0; k < 9; k++) {
+                                in[k][i] = job->mat[begin + i].m[k / 3][k % 3];
+                        }
+                }
+
+                _cgmath_kern.mat3f_eigen_sym_soa(&smat, &svalues, &svectors, n);
+
+                for(i = 0; i < n; i++) {
+                        for(k = 0; k < 3; k++) {
+                                job->values[begin + i].m[k] = val[k][i];
+                        }
+                        for(k = 0; k < 9; k++) {
+                                job->vectors[begin + i].m[k / 3][k % 3] = vec[k][i];
+                        }
+                }
+        }
+}
+
+/**
+ * Eigenvalues and eigenvectors of symmetric matrices
+ * such as covariances and inertia tensors; only the
+ * upper triangle is read. values gets the eigenvalues
+ * in descending order and the columns of vectors the
+ * matching unit eigenvectors, forming a rotation
+ * (determinant +1), so for a covariance the last
+ * column is the surface normal and vectors is an OBB
+ * frame as is. Eigenvalues are within 4 ulp of the
+ * largest one (see make ulp) for any finite input.
+ */
+void mat3f_eigen_sym(mat3f* mat, vec3f* values, mat3f* vectors)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_eigen_sym, 1);
+        int k;
+        float a[9];
+        float v[9];
+        float scale;
+
+        for(k = 0; k < 9; k++) {
+                a[k] = mat->m[k / 3][k % 3];
+                v[k] = k % 4 == 0 ? 1.0f : 0.0f;
+        }
+        scale = _mat3f_eigen_scale(a);
+        _mat3f_jacobi_lanes(a, values->m, v);
+        for(k = 0; k < 3; k++) {
+                values->m[k] *= scale;
+        }
+        memcpy(vectors->m, v, MAT3F_SIZE);
+}
+
+void mat3f_eigen_sym_array(mat3f* mat, vec3f* values, mat3f* vectors, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_eigen_sym_array, count);
+        _mat3f_eigen_job job;
+
+        job.aos = 1;
+        job.mat = mat;
+        job.values = values;
+        job.vectors = vectors;
+        _cgmath_parallel_for(count, MAT3F_ARRAY_GRAIN, _mat3f_eigen_range, &job);
+}
+
+void mat3f_eigen_sym_soa(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_eigen_sym_soa, count);
+        _mat3f_eigen_job job;
+
+        job.aos = 0;
+        job.smat = *mat;
+        job.svalues = *values;
+        job.svectors = *vectors;
+        _cgmath_parallel_for(count, MAT3F_ARRAY_GRAIN, _mat3f_eigen_range, &job);
+}
+
+#if defined(CGMATH_X86)
+
+MAT3F_ADJUGATE_LANES(_mat3f_adjugate_lanes_sse2, CGMATH_TARGET_SSE2, __m128)
+MAT3F_ADJUGATE_SYM_LANES(_mat3f_adjugate_sym_lanes_sse2, CGMATH_TARGET_SSE2, __m128)
+
+CGMATH_TARGET_SSE2
+void _mat3f_determinant_soa_sse2(mat3f_soa* mat, float* dest, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 a[9];
+        __m128 d[9];
+        __m128 dt;
+        mat3f_soa rest;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                for(k = 0; k < 9; k++) {
+                        a[k] = _mm_loadu_ps(mat->m[k] + i);
+                }
+                _mat3f_adjugate_lanes_sse2(a, d, &dt);
+                _mm_storeu_ps(dest + i, dt);
+        }
+
+        _mat3f_soa_offset(mat, &rest, i);
+        _mat3f_determinant_soa_scalar(&rest, dest + i, count - i);
+}
+
+CGMATH_TARGET_SSE2
+static size_t _mat3f_inverse_soa_sse2_lanes(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular,
+                size_t count, int sym)
+{
+        int k;
+        int bits;
+        size_t i;
+        size_t bad;
+        __m128 a[9];
+        __m128 d[9];
+        __m128 dt;
+        __m128 inv;
+        __m128 ok;
+        mat3f_soa src;
+        mat3f_soa dst;
+
+        bad = 0;
+        for(i = 0; i + 4 <= count; i += 4) {
+                if(sym) {
+                        for(k = 0; k < 6; k++) {
+                                a[_mat3f_upper[k]] = _mm_loadu_ps(mat->m[_mat3f_upper[k]] + i);
+                        }
+                        _mat3f_adjugate_sym_lanes_sse2(a, d, &dt);
+                } else {
+                        for(k = 0; k < 9; k++) {
+                                a[k] = _mm_loadu_ps(mat->m[k] + i);
+                        }
+                        _mat3f_adjugate_lanes_sse2(a, d, &dt);
+                }
+
+                inv = _mm_div_ps(_mm_set1_ps(1.0f), dt);
+                ok = _mm_and_ps(_mm_cmple_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), dt), _mm_set1_ps(FLT_MAX)),
+                                _mm_cmple_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), inv), _mm_set1_ps(FLT_MAX)));
+                for(k = 0; k < 9; k++) {
+                        _mm_storeu_ps(dest->m[k] + i, _mm_and_ps(_mm_mul_ps(d[k], inv), ok));
+                }
+
+                bits = ~_mm_movemask_ps(ok) & 0xF;
+                bad += __builtin_popcount(bits);
+                if(singular != NULL) {
+                        for(k = 0; k < 4; k++) {
+                                singular[i + k] = (bits >> k) & 1;
+                        }
+                }
+        }
+
+        _mat3f_soa_offset(mat, &src, i);
+        _mat3f_soa_offset(dest, &dst, i);
+        return bad + _mat3f_inverse_soa_lanes(&src, &dst,
+                        singular != NULL ? singular + i : NULL, count - i, sym);
+}
+
+CGMATH_TARGET_SSE2
+size_t _mat3f_inverse_soa_sse2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        return _mat3f_inverse_soa_sse2_lanes(mat, dest, singular, count, 0);
+}
+
+CGMATH_TARGET_SSE2
+size_t _mat3f_inverse_sym_soa_sse2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        return _mat3f_inverse_soa_sse2_lanes(mat, dest, singular, count, 1);
+}
+
+MAT3F_ADJUGATE_LANES(_mat3f_adjugate_lanes_avx2, CGMATH_TARGET_AVX2, __m256)
+MAT3F_ADJUGATE_SYM_LANES(_mat3f_adjugate_sym_lanes_avx2, CGMATH_TARGET_AVX2, __m256)
+
+CGMATH_TARGET_AVX2
+void _mat3f_determinant_soa_avx2(mat3f_soa* mat, float* dest, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 a[9];
+        __m256 d[9];
+        __m256 dt;
+        mat3f_soa rest;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(k = 0; k < 9; k++) {
+                        a[k] = _mm256_loadu_ps(mat->m[k] + i);
+                }
+                _mat3f_adjugate_lanes_avx2(a, d, &dt);
+                _mm256_storeu_ps(dest + i, dt);
+        }
+
+        _mat3f_soa_offset(mat, &rest, i);
+        _mat3f_determinant_soa_sse2(&rest, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+static size_t _mat3f_inverse_soa_avx2_lanes(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular,
+                size_t count, int sym)
+{
+        int k;
+        int bits;
+        size_t i;
+        size_t bad;
+        __m256 a[9];
+        __m256 d[9];
+        __m256 dt;
+        __m256 inv;
+        __m256 ok;
+        mat3f_soa src;
+        mat3f_soa dst;
+
+        bad = 0;
+        for(i = 0; i + 8 <= count; i += 8) {
+                if(sym) {
+                        for(k = 0; k < 6; k++) {
+                                a[_mat3f_upper[k]] = _mm256_loadu_ps(mat->m[_mat3f_upper[k]] + i);
+                        }
+                        _mat3f_adjugate_sym_lanes_avx2(a, d, &dt);
+                } else {
+                        for(k = 0; k < 9; k++) {
+                                a[k] = _mm256_loadu_ps(mat->m[k] + i);
+                        }
+                        _mat3f_adjugate_lanes_avx2(a, d, &dt);
+                }
+
+                inv = _mm256_div_ps(_mm256_set1_ps(1.0f), dt);
+                ok = _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), dt),
+                                        _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ),
+                                _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), inv),
+                                        _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ));
+                for(k = 0; k < 9; k++) {
+                        _mm256_storeu_ps(dest->m[k] + i, _mm256_and_ps(_mm256_mul_ps(d[k], inv), ok));
+                }
+
+                bits = ~_mm256_movemask_ps(ok) & 0xFF;
+                bad += __builtin_popcount(bits);
+                if(singular != NULL) {
+                        for(k = 0; k < 8; k++) {
+                                singular[i + k] = (bits >> k) & 1;
+                        }
+                }
+        }
+
+        _mat3f_soa_offset(mat, &src, i);
+        _mat3f_soa_offset(dest, &dst, i);
+        return bad + _mat3f_inverse_soa_sse2_lanes(&src, &dst,
+                        singular != NULL ? singular + i : NULL, count - i, sym);
+}
+
+CGMATH_TARGET_AVX2
+size_t _mat3f_inverse_soa_avx2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        return _mat3f_inverse_soa_avx2_lanes(mat, dest, singular, count, 0);
+}
+
+CGMATH_TARGET_AVX2
+size_t _mat3f_inverse_sym_soa_avx2(mat3f_soa* mat, mat3f_soa* dest, unsigned char* singular, size_t count)
+{
+        return _mat3f_inverse_soa_avx2_lanes(mat, dest, singular, count, 1);
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _mat3f_sign_sse2(__m128 f)
+{
+        return _mm_or_ps(_mm_and_ps(f, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f));
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _mat3f_keep_sse2(__m128 f, __m128 diag)
+{
+        return _mm_and_ps(f, _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), f),
+                        _mm_mul_ps(_mm_set1_ps(MAT3F_JACOBI_EPS), diag)));
+}
+
+CGMATH_TARGET_SSE2
+static inline void _mat3f_eigen_swap_sse2(__m128 m, __m128* a, __m128* b)
+{
+        __m128 t;
+
+        t = _mm_and_ps(m, _mm_xor_ps(*a, *b));
+        *a = _mm_xor_ps(*a, t);
+        *b = _mm_xor_ps(*b, t);
+}
+
+CGMATH_TARGET_SSE2
+static inline void _mat3f_eigen_order_sse2(__m128* w, __m128* v, int i, int j)
+{
+        int k;
+        __m128 m;
+
+        m = _mm_cmplt_ps(w[i], w[j]);
+        _mat3f_eigen_swap_sse2(m, &w[i], &w[j]);
+        for(k = 0; k < 3; k++) {
+                _mat3f_eigen_swap_sse2(m, &v[3 * k + i], &v[3 * k + j]);
+        }
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _mat3f_eigen_scale_sse2(__m128* a)
+{
+        int k;
+        __m128 m;
+
+        m = _mm_set1_ps(0.0f);
+        for(k = 0; k < 6; k++) {
+                m = _mm_max_ps(m, _mm_andnot_ps(_mm_set1_ps(-0.0f), a[_mat3f_upper[k]]));
+        }
+        m = _mm_and_ps(m, _mm_castsi128_ps(_mm_set1_epi32(0x7F800000)));
+        m = _mm_or_ps(m, _mm_and_ps(_mm_cmpeq_ps(m, _mm_setzero_ps()), _mm_castsi128_ps(_mm_set1_epi32(0x00800000))));
+        for(k = 0; k < 6; k++) {
+                a[_mat3f_upper[k]] = _mm_mul_ps(a[_mat3f_upper[k]], _mm_div_ps(_mm_set1_ps(1.0f), m));
+        }
+        return m;
+}
+
+MAT3F_JACOBI_LANES(_mat3f_jacobi_lanes_sse2, CGMATH_TARGET_SSE2, __m128, _mm_sqrt_ps,
+                _mat3f_sign_sse2, _mat3f_keep_sse2, _mat3f_eigen_order_sse2)
+
+CGMATH_TARGET_SSE2
+void _mat3f_eigen_sym_soa_sse2(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count)
+{
+        int k;
+        size_t i;
+        __m128 a[9];
+        __m128 w[3];
+        __m128 v[9];
+        __m128 scale;
+        mat3f_soa src;
+        vec3f_soa val;
+        mat3f_soa vec;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                for(k = 0; k < 6; k++) {
+                        a[_mat3f_upper[k]] = _mm_loadu_ps(mat->m[_mat3f_upper[k]] + i);
+                }
+                for(k = 0; k < 9; k++) {
+                        v[k] = _mm_set1_ps(k % 4 == 0 ? 1.0f : 0.0f);
+                }
+                scale = _mat3f_eigen_scale_sse2(a);
+                _mat3f_jacobi_lanes_sse2(a, w, v);
+                for(k = 0; k < 3; k++) {
+                        _mm_storeu_ps(values->m[k] + i, _mm_mul_ps(w[k], scale));
+                }
+                for(k = 0; k < 9; k++) {
+                        _mm_storeu_ps(vectors->m[k] + i, v[k]);
+                }
+        }
+
+        _mat3f_soa_offset(mat, &src, i);
+        _vec3f_soa_offset(values, &val, i);
+        _mat3f_soa_offset(vectors, &vec, i);
+        _mat3f_eigen_sym_soa_scalar(&src, &val, &vec, count - i);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _mat3f_sign_avx2(__m256 f)
+{
+        return _mm256_or_ps(_mm256_and_ps(f, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(1.0f));
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _mat3f_keep_avx2(__m256 f, __m256 diag)
+{
+        return _mm256_and_ps(f, _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), f),
+                        _mm256_mul_ps(_mm256_set1_ps(MAT3F_JACOBI_EPS), diag), _CMP_GT_OQ));
+}
+
+CGMATH_TARGET_AVX2
+static inline void _mat3f_eigen_order_avx2(__m256* w, __m256* v, int i, int j)
+{
+        int k;
+        __m256 m;
+        __m256 t;
+
+        m = _mm256_cmp_ps(w[i], w[j], _CMP_LT_OQ);
+        t = w[i];
+        w[i] = _mm256_blendv_ps(w[i], w[j], m);
+        w[j] = _mm256_blendv_ps(w[j], t, m);
+        for(k = 0; k < 3; k++) {
+                t = v[3 * k + i];
+                v[3 * k + i] = _mm256_blendv_ps(v[3 * k + i], v[3 * k + j], m);
+                v[3 * k + j] = _mm256_blendv_ps(v[3 * k + j], t, m);
+        }
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _mat3f_eigen_scale_avx2(__m256* a)
+{
+        int k;
+        __m256 m;
+
+        m = _mm256_set1_ps(0.0f);
+        for(k = 0; k < 6; k++) {
+                m = _mm256_max_ps(m, _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a[_mat3f_upper[k]]));
+        }
+        m = _mm256_and_ps(m, _mm256_castsi256_ps(_mm256_set1_epi32(0x7F800000)));
+        m = _mm256_or_ps(m, _mm256_and_ps(_mm256_cmp_ps(m, _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000))));
+        for(k = 0; k < 6; k++) {
+                a[_mat3f_upper[k]] = _mm256_mul_ps(a[_mat3f_upper[k]], _mm256_div_ps(_mm256_set1_ps(1.0f), m));
+        }
+        return m;
+}
+
+MAT3F_JACOBI_LANES(_mat3f_jacobi_lanes_avx2, CGMATH_TARGET_AVX2, __m256, _mm256_sqrt_ps,
+                _mat3f_sign_avx2, _mat3f_keep_avx2, _mat3f_eigen_order_avx2)
+
+CGMATH_TARGET_AVX2
+void _mat3f_eigen_sym_soa_avx2(mat3f_soa* mat, vec3f_soa* values, mat3f_soa* vectors, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 a[9];
+        __m256 w[3];
+        __m256 v[9];
+        __m256 scale;
+        mat3f_soa src;
+        vec3f_soa val;
+        mat3f_soa vec;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(k = 0; k < 6; k++) {
+                        a[_mat3f_upper[k]] = _mm256_loadu_ps(mat->m[_mat3f_upper[k]] + i);
+                }
+                for(k = 0; k < 9; k++) {
+                        v[k] = _mm256_set1_ps(k % 4 == 0 ? 1.0f : 0.0f);
+                }
+                scale = _mat3f_eigen_scale_avx2(a);
+                _mat3f_jacobi_lanes_avx2(a, w, v);
+                for(k = 0; k < 3; k++) {
+                        _mm256_storeu_ps(values->m[k] + i, _mm256_mul_ps(w[k], scale));
+                }
+                for(k = 0; k < 9; k++) {
+                        _mm256_storeu_ps(vectors->m[k] + i, v[k]);
+                }
+        }
+
+        _mat3f_soa_offset(mat, &src, i);
+        _vec3f_soa_offset(values, &val, i);
+        _mat3f_soa_offset(vectors, &vec, i);
+        _mat3f_eigen_sym_soa_sse2(&src, &val, &vec, count - i);
+}
+
+#endif
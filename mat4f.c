@@ -5,9 +5,14 @@
  * * Implementation for a 4x4 matrix.
  */
 
+#include <float.h>
+#include <math.h>
 #include <string.h>
 
 #include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
 
 #if defined(CGMATH_MATRIX_DIMS_DEFINED)
 #undef CGMATH_MATRIX_WIDTH
@@ -23,13 +28,18 @@
 #define CGMATH_MATRIX_SIZE      (CGMATH_MATRIX_ELEMS * sizeof(float))
 #define CGMATH_MATRIX_DIMS_DEFINED
 
+/* matrices per task for mat4f_inverse_array */
+#define MAT4F_INVERSE_GRAIN     1024
+
 void mat4f_zero(mat4f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_zero, 1);
         memset(mat->m, 0, CGMATH_MATRIX_SIZE);
 }
 
 void mat4f_identity(mat4f* mat)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_identity, 1);
         mat4f_zero(mat);
         mat->m[0][0] = 1.0f;
         mat->m[1][1] = 1.0f;
@@ -39,6 +49,7 @@ void mat4f_identity(mat4f* mat)
 
 void mat4f_add(mat4f* a, mat4f* b, mat4f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_add, 1);
         mat4f tmp;
         memcpy(tmp.m, a->m, CGMATH_MATRIX_SIZE);
 
@@ -64,6 +75,7 @@ void mat4f_add(mat4f* a, mat4f* b, mat4f* dest)
 
 void mat4f_scale(mat4f* mat, float scalar, mat4f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_scale, 1);
         mat4f tmp;
         memcpy(tmp.m, mat->m, CGMATH_MATRIX_SIZE);
 
@@ -79,20 +91,16 @@ void mat4f_scale(mat4f* mat, float scalar, mat4f* dest)
         tmp.m[2][1] *= scalar;
         tmp.m[2][2] *= scalar;
         tmp.m[2][3] *= scalar;
-        tmp.m[0][3] *= scalar;
-        tmp.m[1][3] *= scalar;
-        tmp.m[2][3] *= scalar;
+        tmp.m[3][0] *= scalar;
+        tmp.m[3][1] *= scalar;
+        tmp.m[3][2] *= scalar;
         tmp.m[3][3] *= scalar;
 
         memcpy(dest->m, tmp.m, CGMATH_MATRIX_SIZE);
 }
 
-void mat4f_multiply(mat4f* a, mat4f* b, mat4f* dest)
+void _mat4f_multiply_scalar(mat4f* a, mat4f* b, mat4f* dest)
 {
-        int i;
-        int j;
-        vec4f row;
-        vec4f col;
         mat4f tmp;
 
         tmp.m[0][0] =   a->m[0][0] * b->m[0][0] +
@@ -163,11 +171,17 @@ void mat4f_multiply(mat4f* a, mat4f* b, mat4f* dest)
         memcpy(dest->m, tmp.m, CGMATH_MATRIX_SIZE);
 }
 
+void mat4f_multiply(mat4f* a, mat4f* b, mat4f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_multiply, 1);
+        _cgmath_kern.mat4f_multiply(a, b, dest);
+}
+
 /**
  * How many layers of determinants are you on?
  * You are like a baby. Watch this.
  */
-float mat4f_determinant(mat4f* mat)
+float _mat4f_determinant_scalar(mat4f* mat)
 {
         float dt;
         mat3f sm;
@@ -216,15 +230,19 @@ float mat4f_determinant(mat4f* mat)
         sm.m[2][0] = mat->m[3][0];
         sm.m[2][1] = mat->m[3][1];
         sm.m[2][2] = mat->m[3][2];
-        dt += mat->m[0][3] * mat3f_determinant(&sm);
+        dt -= mat->m[0][3] * mat3f_determinant(&sm);
 
         return dt;
 }
 
-void mat4f_transpose(mat4f* mat, mat4f* dest)
+float mat4f_determinant(mat4f* mat)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_determinant, 1);
+        return _cgmath_kern.mat4f_determinant(mat);
+}
+
+void _mat4f_transpose_scalar(mat4f* mat, mat4f* dest)
 {
-        int i;
-        int j;
         mat4f tmp;
         memcpy(tmp.m, mat->m, CGMATH_MATRIX_SIZE);
 
@@ -240,202 +258,210 @@ void mat4f_transpose(mat4f* mat, mat4f* dest)
         *(int*)&tmp.m[3][0] ^= *(int*)&tmp.m[0][3];
         *(int*)&tmp.m[0][3] ^= *(int*)&tmp.m[3][0];
 
+        *(int*)&tmp.m[1][2] ^= *(int*)&tmp.m[2][1];
+        *(int*)&tmp.m[2][1] ^= *(int*)&tmp.m[1][2];
+        *(int*)&tmp.m[1][2] ^= *(int*)&tmp.m[2][1];
+
+        *(int*)&tmp.m[1][3] ^= *(int*)&tmp.m[3][1];
+        *(int*)&tmp.m[3][1] ^= *(int*)&tmp.m[1][3];
+        *(int*)&tmp.m[1][3] ^= *(int*)&tmp.m[3][1];
+
+        *(int*)&tmp.m[2][3] ^= *(int*)&tmp.m[3][2];
+        *(int*)&tmp.m[3][2] ^= *(int*)&tmp.m[2][3];
+        *(int*)&tmp.m[2][3] ^= *(int*)&tmp.m[3][2];
+
         memcpy(dest->m, tmp.m, CGMATH_MATRIX_SIZE);
 }
 
+void mat4f_transpose(mat4f* mat, mat4f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_transpose, 1);
+        _cgmath_kern.mat4f_transpose(mat, dest);
+}
+
 void mat4f_inverse(mat4f* mat, mat4f* dest)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_inverse, 1);
+        _cgmath_kern.mat4f_inverse(mat, dest);
+}
+
+/**
+ * The cofactor inverse of one matrix per lane, written
+ * once for float, __m128 and __m256 (GCC vector types
+ * take the arithmetic operators). a[4 * r + c] holds
+ * element [r][c] of each lane; d receives the adjugate
+ * and det the determinant.
+ */
+#define MAT4F_ADJUGATE_LANES(NAME, TARGET, V) \
+TARGET static inline void NAME(V* a, V* d, V* det) \
+{ \
+        V s0 = a[0] * a[5] - a[4] * a[1]; \
+        V s1 = a[0] * a[6] - a[4] * a[2]; \
+        V s2 = a[0] * a[7] - a[4] * a[3]; \
+        V s3 = a[1] * a[6] - a[5] * a[2]; \
+        V s4 = a[1] * a[7] - a[5] * a[3]; \
+        V s5 = a[2] * a[7] - a[6] * a[3]; \
+        V c0 = a[8] * a[13] - a[12] * a[9]; \
+        V c1 = a[8] * a[14] - a[12] * a[10]; \
+        V c2 = a[8] * a[15] - a[12] * a[11]; \
+        V c3 = a[9] * a[14] - a[13] * a[10]; \
+        V c4 = a[9] * a[15] - a[13] * a[11]; \
+        V c5 = a[10] * a[15] - a[14] * a[11]; \
+ \
+        *det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0; \
+ \
+        d[0] = a[5] * c5 - a[6] * c4 + a[7] * c3; \
+        d[1] = a[2] * c4 - a[1] * c5 - a[3] * c3; \
+        d[2] = a[13] * s5 - a[14] * s4 + a[15] * s3; \
+        d[3] = a[10] * s4 - a[9] * s5 - a[11] * s3; \
+        d[4] = a[6] * c2 - a[4] * c5 - a[7] * c1; \
+        d[5] = a[0] * c5 - a[2] * c2 + a[3] * c1; \
+        d[6] = a[14] * s2 - a[12] * s5 - a[15] * s1; \
+        d[7] = a[8] * s5 - a[10] * s2 + a[11] * s1; \
+        d[8] = a[4] * c4 - a[5] * c2 + a[7] * c0; \
+        d[9] = a[1] * c2 - a[0] * c4 - a[3] * c0; \
+        d[10] = a[12] * s4 - a[13] * s2 + a[15] * s0; \
+        d[11] = a[9] * s2 - a[8] * s4 - a[11] * s0; \
+        d[12] = a[5] * c1 - a[4] * c3 - a[6] * c0; \
+        d[13] = a[0] * c3 - a[1] * c1 + a[2] * c0; \
+        d[14] = a[13] * s1 - a[12] * s3 - a[14] * s0; \
+        d[15] = a[8] * s3 - a[9] * s1 + a[10] * s0; \
+}
+
+MAT4F_ADJUGATE_LANES(_mat4f_adjugate_lanes, , float)
+
+/* the six 2x2 minors of the row pair starting at r */
+static inline void _mat4f_pair_minors_scalar(float* r, float* m)
+{
+        m[0] = r[0] * r[5] - r[4] * r[1];
+        m[1] = r[0] * r[6] - r[4] * r[2];
+        m[2] = r[0] * r[7] - r[4] * r[3];
+        m[3] = r[1] * r[6] - r[5] * r[2];
+        m[4] = r[1] * r[7] - r[5] * r[3];
+        m[5] = r[2] * r[7] - r[6] * r[3];
+}
+
+/**
+ * The determinant summed in the order the SSE2 path
+ * reduces its lanes: ((s0c5 - s4c1) + s2c3) +
+ * ((s5c0 - s1c4) + s3c2).
+ */
+static float _mat4f_lanes_det_scalar(float* a)
+{
+        float s[6];
+        float c[6];
+
+        _mat4f_pair_minors_scalar(a, s);
+        _mat4f_pair_minors_scalar(a + 8, c);
+        return ((s[0] * c[5] - s[4] * c[1]) + s[2] * c[3]) +
+                ((s[5] * c[0] - s[1] * c[4]) + s[3] * c[2]);
+}
+
+/**
+ * The adjugate of the array kernels divided by the
+ * determinant as the SSE2 path sums it, so that every
+ * level returns the same bits. Leaves dest untouched
+ * when the determinant is zero.
+ */
+void _mat4f_inverse_scalar(mat4f* mat, mat4f* dest)
+{
+        int k;
+        float a[16];
+        float d[16];
         float dt;
-        mat4f tmp;
-        mat3f sm;
+        float inv;
+
+        memcpy(a, mat->m, CGMATH_MATRIX_SIZE);
+        _mat4f_adjugate_lanes(a, d, &dt);
+        dt = _mat4f_lanes_det_scalar(a);
+        if(_cgmath_absf(dt) == 0.0f) {
+                return;
+        }
 
-        dt = mat4f_determinant(mat);
-
-        if(_cgmath_absf(dt) != 0.0f) {
-                sm.m[0][0] = mat->m[1][1];
-                sm.m[0][1] = mat->m[1][2];
-                sm.m[0][2] = mat->m[1][3];
-                sm.m[1][0] = mat->m[2][1];
-                sm.m[1][1] = mat->m[2][2];
-                sm.m[1][2] = mat->m[2][3];
-                sm.m[2][0] = mat->m[3][1];
-                sm.m[2][1] = mat->m[3][2];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[0][0] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[1][0];
-                sm.m[0][1] = mat->m[1][2];
-                sm.m[0][2] = mat->m[1][3];
-                sm.m[1][0] = mat->m[2][0];
-                sm.m[1][1] = mat->m[2][2];
-                sm.m[1][2] = mat->m[2][3];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][2];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[0][1] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[1][0];
-                sm.m[0][1] = mat->m[1][1];
-                sm.m[0][2] = mat->m[1][3];
-                sm.m[1][0] = mat->m[2][0];
-                sm.m[1][1] = mat->m[2][1];
-                sm.m[1][2] = mat->m[2][3];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][1];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[0][2] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[1][0];
-                sm.m[0][1] = mat->m[1][1];
-                sm.m[0][2] = mat->m[1][2];
-                sm.m[1][0] = mat->m[2][0];
-                sm.m[1][1] = mat->m[2][1];
-                sm.m[1][2] = mat->m[2][2];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][1];
-                sm.m[2][2] = mat->m[3][2];
-                tmp.m[0][3] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][1];
-                sm.m[0][1] = mat->m[0][2];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[2][1];
-                sm.m[1][1] = mat->m[2][2];
-                sm.m[1][2] = mat->m[2][3];
-                sm.m[2][0] = mat->m[3][1];
-                sm.m[2][1] = mat->m[3][2];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[1][0] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][2];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[2][0];
-                sm.m[1][1] = mat->m[2][2];
-                sm.m[1][2] = mat->m[2][3];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][2];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[1][1] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][1];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[2][0];
-                sm.m[1][1] = mat->m[2][1];
-                sm.m[1][2] = mat->m[2][3];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][1];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[1][2] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][1];
-                sm.m[0][2] = mat->m[0][2];
-                sm.m[1][0] = mat->m[2][0];
-                sm.m[1][1] = mat->m[2][1];
-                sm.m[1][2] = mat->m[2][2];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][1];
-                sm.m[2][2] = mat->m[3][2];
-                tmp.m[1][3] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][1];
-                sm.m[0][1] = mat->m[0][2];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[1][1];
-                sm.m[1][1] = mat->m[1][2];
-                sm.m[1][2] = mat->m[1][3];
-                sm.m[2][0] = mat->m[3][1];
-                sm.m[2][1] = mat->m[3][2];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[2][0] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][2];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[1][0];
-                sm.m[1][1] = mat->m[1][2];
-                sm.m[1][2] = mat->m[1][3];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][2];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[2][1] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][1];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[1][0];
-                sm.m[1][1] = mat->m[1][1];
-                sm.m[1][2] = mat->m[1][3];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][1];
-                sm.m[2][2] = mat->m[3][3];
-                tmp.m[2][2] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][1];
-                sm.m[0][2] = mat->m[0][2];
-                sm.m[1][0] = mat->m[1][0];
-                sm.m[1][1] = mat->m[1][1];
-                sm.m[1][2] = mat->m[1][2];
-                sm.m[2][0] = mat->m[3][0];
-                sm.m[2][1] = mat->m[3][1];
-                sm.m[2][2] = mat->m[3][2];
-                tmp.m[2][3] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][1];
-                sm.m[0][1] = mat->m[0][2];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[1][1];
-                sm.m[1][1] = mat->m[1][2];
-                sm.m[1][2] = mat->m[1][3];
-                sm.m[2][0] = mat->m[2][1];
-                sm.m[2][1] = mat->m[2][2];
-                sm.m[2][2] = mat->m[2][3];
-                tmp.m[3][0] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][2];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[1][0];
-                sm.m[1][1] = mat->m[1][2];
-                sm.m[1][2] = mat->m[1][3];
-                sm.m[2][0] = mat->m[2][0];
-                sm.m[2][1] = mat->m[2][2];
-                sm.m[2][2] = mat->m[2][3];
-                tmp.m[3][1] = -1.0f * mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][1];
-                sm.m[0][2] = mat->m[0][3];
-                sm.m[1][0] = mat->m[1][0];
-                sm.m[1][1] = mat->m[1][1];
-                sm.m[1][2] = mat->m[1][3];
-                sm.m[2][0] = mat->m[2][0];
-                sm.m[2][1] = mat->m[2][1];
-                sm.m[2][2] = mat->m[2][3];
-                tmp.m[3][2] = mat3f_determinant(&sm);
-
-                sm.m[0][0] = mat->m[0][0];
-                sm.m[0][1] = mat->m[0][1];
-                sm.m[0][2] = mat->m[0][2];
-                sm.m[1][0] = mat->m[1][0];
-                sm.m[1][1] = mat->m[1][1];
-                sm.m[1][2] = mat->m[1][2];
-                sm.m[2][0] = mat->m[2][0];
-                sm.m[2][1] = mat->m[2][1];
-                sm.m[2][2] = mat->m[2][2];
-                tmp.m[3][3] = -1.0f * mat3f_determinant(&sm);
-
-                mat4f_transpose(&tmp, &tmp);
-                mat4f_scale(&tmp, 1.0f/dt, &tmp);
-                memcpy(dest->m, tmp.m, CGMATH_MATRIX_SIZE);
+        inv = 1.0f / dt;
+        for(k = 0; k < 16; k++) {
+                dest->m[k >> 2][k & 3] = d[k] * inv;
         }
 }
 
+size_t _mat4f_inverse_array_scalar(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count)
+{
+        int k;
+        size_t i;
+        size_t bad;
+        float a[16];
+        float d[16];
+        float dt;
+        float inv;
+
+        bad = 0;
+        for(i = 0; i < count; i++) {
+                memcpy(a, mat[i].m, CGMATH_MATRIX_SIZE);
+                _mat4f_adjugate_lanes(a, d, &dt);
+
+                inv = 1.0f / dt;
+                if(!(_cgmath_absf(dt) <= FLT_MAX && _cgmath_absf(inv) <= FLT_MAX)) {
+                        memset(dest[i].m, 0, CGMATH_MATRIX_SIZE);
+                        bad++;
+                        if(singular != NULL) {
+                                singular[i] = 1;
+                        }
+                        continue;
+                }
+
+                for(k = 0; k < 16; k++) {
+                        dest[i].m[k >> 2][k & 3] = d[k] * inv;
+                }
+                if(singular != NULL) {
+                        singular[i] = 0;
+                }
+        }
+        return bad;
+}
+
+typedef struct {
+        mat4f*          mat;
+        mat4f*          dest;
+        unsigned char*  singular;
+        size_t          bad;
+} _mat4f_inverse_job;
+
+static void _mat4f_inverse_range(void* ctx, size_t begin, size_t end)
+{
+        size_t bad;
+        _mat4f_inverse_job* job;
+
+        job = ctx;
+        bad = _cgmath_kern.mat4f_inverse_array(job->mat + begin, job->dest + begin,
+                        job->singular != NULL ? job->singular + begin : NULL, end - begin);
+        __atomic_fetch_add(&job->bad, bad, __ATOMIC_RELAXED);
+}
+
+/**
+ * Inverts count matrices, several per instruction
+ * stream. Unlike mat4f_inverse every dest is written:
+ * a matrix whose determinant is zero (or so small that
+ * its reciprocal overflows) gets the zero matrix and a
+ * 1 in singular[i], the others a 0. singular may be
+ * NULL and mat may equal dest. Returns the number of
+ * singular matrices.
+ */
+size_t mat4f_inverse_array(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_inverse_array, count);
+        _mat4f_inverse_job job;
+
+        job.mat = mat;
+        job.dest = dest;
+        job.singular = singular;
+        job.bad = 0;
+        _cgmath_parallel_for(count, MAT4F_INVERSE_GRAIN, _mat4f_inverse_range, &job);
+        return job.bad;
+}
+
 void mat4f_get_row(mat4f* mat, vec4f* dest, int row)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_get_row, 1);
         if(row > 0 && row < CGMATH_MATRIX_HEIGHT) {
                 dest->m[0] = mat->m[row][0];
                 dest->m[1] = mat->m[row][1];
@@ -446,6 +472,7 @@ void mat4f_get_row(mat4f* mat, vec4f* dest, int row)
 
 void mat4f_get_col(mat4f* mat, vec4f* dest, int col)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_get_col, 1);
         if(col > 0 && col < CGMATH_MATRIX_WIDTH) {
                 dest->m[0] = mat->m[0][col];
                 dest->m[1] = mat->m[1][col];
@@ -456,6 +483,7 @@ void mat4f_get_col(mat4f* mat, vec4f* dest, int col)
 
 void mat4f_set_row(mat4f* mat, vec4f* src, int row)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_set_row, 1);
         if(row > 0 && row < CGMATH_MATRIX_HEIGHT) {
                 mat->m[row][0] = src->m[0];
                 mat->m[row][1] = src->m[1];
@@ -466,6 +494,7 @@ void mat4f_set_row(mat4f* mat, vec4f* src, int row)
 
 void mat4f_set_col(mat4f* mat, vec4f* src, int col)
 {
+        CGMATH_PROFILE_SCOPE(mat4f_set_col, 1);
         if(col > 0 && col < CGMATH_MATRIX_WIDTH) {
                 mat->m[0][col] = src->m[0];
                 mat->m[1][col] = src->m[1];
@@ -474,3 +503,585 @@ void mat4f_set_col(mat4f* mat, vec4f* src, int col)
         }
 }
 
+typedef struct {
+        mat4f*  mat;
+        vec3f*  src;
+        vec3f*  dest;
+        void    (*fn)(mat4f* mat, vec3f* src, vec3f* dest, size_t count);
+} _mat4f_array_job;
+
+static void _mat4f_array_range(void* ctx, size_t begin, size_t end)
+{
+        _mat4f_array_job* job;
+
+        job = ctx;
+        job->fn(job->mat, job->src + begin, job->dest + begin, end - begin);
+}
+
+static void _mat4f_array_run(mat4f* mat, vec3f* src, vec3f* dest, size_t count,
+                void (*fn)(mat4f* mat, vec3f* src, vec3f* dest, size_t count))
+{
+        _mat4f_array_job job;
+
+        job.mat = mat;
+        job.src = src;
+        job.dest = dest;
+        job.fn = fn;
+        _cgmath_parallel_for(count, CGMATH_BATCH_GRAIN, _mat4f_array_range, &job);
+}
+
+void _mat4f_transform_point_array_scalar(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        size_t i;
+        float x;
+        float y;
+        float z;
+
+        for(i = 0; i < count; i++) {
+                x = src[i].m[VEC_X];
+                y = src[i].m[VEC_Y];
+                z = src[i].m[VEC_Z];
+                dest[i].m[VEC_X] = mat->m[0][0] * x + mat->m[0][1] * y + mat->m[0][2] * z + mat->m[0][3];
+                dest[i].m[VEC_Y] = mat->m[1][0] * x + mat->m[1][1] * y + mat->m[1][2] * z + mat->m[1][3];
+                dest[i].m[VEC_Z] = mat->m[2][0] * x + mat->m[2][1] * y + mat->m[2][2] * z + mat->m[2][3];
+        }
+}
+
+/**
+ * Treats each point as (x, y, z, 1) and ignores the
+ * bottom row, i.e. assumes an affine transform. src may
+ * equal dest. Large arrays are split across threads.
+ */
+void mat4f_transform_point_array(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_transform_point_array, count);
+        _mat4f_array_run(mat, src, dest, count, _cgmath_kern.mat4f_transform_point_array);
+}
+
+/**
+ * The transformed vector is divided by its largest
+ * component before it is squared, as in
+ * vec3f_normalize_array(), so its length can neither
+ * overflow nor underflow; zero vectors and ones with an
+ * Inf or NaN component come out as zero, the same as in
+ * the SIMD variants.
+ */
+void _mat4f_transform_normal_array_scalar(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        size_t i;
+        float x;
+        float y;
+        float z;
+        float n;
+
+        for(i = 0; i < count; i++) {
+                x = mat->m[0][0] * src[i].m[VEC_X] + mat->m[0][1] * src[i].m[VEC_Y] +
+                        mat->m[0][2] * src[i].m[VEC_Z];
+                y = mat->m[1][0] * src[i].m[VEC_X] + mat->m[1][1] * src[i].m[VEC_Y] +
+                        mat->m[1][2] * src[i].m[VEC_Z];
+                z = mat->m[2][0] * src[i].m[VEC_X] + mat->m[2][1] * src[i].m[VEC_Y] +
+                        mat->m[2][2] * src[i].m[VEC_Z];
+                if(x * 0.0f + y * 0.0f + z * 0.0f == 0.0f) {
+                        n = 1.0f / fmaxf(fmaxf(fmaxf(fabsf(x), fabsf(y)), fabsf(z)), FLT_MIN);
+                        x *= n;
+                        y *= n;
+                        z *= n;
+                } else {
+                        x = y = z = 0.0f;
+                }
+                n = x * x + y * y + z * z;
+                n = n >= FLT_MIN ? 1.0f / sqrtf(n) : 0.0f;
+                dest[i].m[VEC_X] = x * n;
+                dest[i].m[VEC_Y] = y * n;
+                dest[i].m[VEC_Z] = z * n;
+        }
+}
+
+/**
+ * Multiplies each vector by the upper 3x3 of mat and
+ * renormalizes it, whatever its length; zero vectors
+ * stay zero and ones with an Inf or NaN component
+ * become zero. mat should already be the normal matrix
+ * (the inverse transpose of the model matrix). src may
+ * equal dest. Returns -1 if the upper 3x3 is singular,
+ * in which case the normals are still written but those
+ * it flattens to zero stay zero, and 0 otherwise.
+ */
+int mat4f_transform_normal_array(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_transform_normal_array, count);
+        double dt;
+
+        _mat4f_array_run(mat, src, dest, count, _cgmath_kern.mat4f_transform_normal_array);
+
+        /* in double, so that no float matrix underflows or overflows it */
+        dt = mat->m[0][0] * ((double)mat->m[1][1] * mat->m[2][2] - (double)mat->m[1][2] * mat->m[2][1]) -
+                mat->m[0][1] * ((double)mat->m[1][0] * mat->m[2][2] - (double)mat->m[1][2] * mat->m[2][0]) +
+                mat->m[0][2] * ((double)mat->m[1][0] * mat->m[2][1] - (double)mat->m[1][1] * mat->m[2][0]);
+        return dt != 0.0 && isfinite(dt) ? 0 : -1;
+}
+
+
+#if defined(CGMATH_X86)
+
+CGMATH_TARGET_SSE2
+void _mat4f_multiply_sse2(mat4f* a, mat4f* b, mat4f* dest)
+{
+        int i;
+        __m128 b0;
+        __m128 b1;
+        __m128 b2;
+        __m128 b3;
+        __m128 r[4];
+
+        b0 = _mm_loadu_ps(b->m[0]);
+        b1 = _mm_loadu_ps(b->m[1]);
+        b2 = _mm_loadu_ps(b->m[2]);
+        b3 = _mm_loadu_ps(b->m[3]);
+
+        for(i = 0; i < CGMATH_MATRIX_HEIGHT; i++) {
+                r[i] = _mm_mul_ps(_mm_set1_ps(a->m[i][0]), b0);
+                r[i] = _mm_add_ps(r[i], _mm_mul_ps(_mm_set1_ps(a->m[i][1]), b1));
+                r[i] = _mm_add_ps(r[i], _mm_mul_ps(_mm_set1_ps(a->m[i][2]), b2));
+                r[i] = _mm_add_ps(r[i], _mm_mul_ps(_mm_set1_ps(a->m[i][3]), b3));
+        }
+
+        _mm_storeu_ps(dest->m[0], r[0]);
+        _mm_storeu_ps(dest->m[1], r[1]);
+        _mm_storeu_ps(dest->m[2], r[2]);
+        _mm_storeu_ps(dest->m[3], r[3]);
+}
+
+CGMATH_TARGET_SSE2
+void _mat4f_transpose_sse2(mat4f* mat, mat4f* dest)
+{
+        __m128 r0;
+        __m128 r1;
+        __m128 r2;
+        __m128 r3;
+
+        r0 = _mm_loadu_ps(mat->m[0]);
+        r1 = _mm_loadu_ps(mat->m[1]);
+        r2 = _mm_loadu_ps(mat->m[2]);
+        r3 = _mm_loadu_ps(mat->m[3]);
+
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+        _mm_storeu_ps(dest->m[0], r0);
+        _mm_storeu_ps(dest->m[1], r1);
+        _mm_storeu_ps(dest->m[2], r2);
+        _mm_storeu_ps(dest->m[3], r3);
+}
+
+/**
+ * Both the determinant and the inverse are built from
+ * the twelve 2x2 minors of the top and bottom row
+ * pairs, s0..s5 and c0..c5:
+ * * s = (a00a11-a10a01, a00a12-a10a02, a00a13-a10a03,
+ * *      a01a12-a11a02, a01a13-a11a03, a02a13-a12a03)
+ * * and likewise for c using rows two and three.
+ * Four lanes of each are computed at once: (s0..s3) in
+ * lo and (s4, s5) in the low half of hi.
+ */
+CGMATH_TARGET_SSE2
+static inline void _mat4f_minors_sse2(__m128 r0, __m128 r1, __m128* lo, __m128* hi)
+{
+        *lo = _mm_sub_ps(
+                _mm_mul_ps(_mm_shuffle_ps(r0, r0, _MM_SHUFFLE(1, 0, 0, 0)),
+                        _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(2, 3, 2, 1))),
+                _mm_mul_ps(_mm_shuffle_ps(r1, r1, _MM_SHUFFLE(1, 0, 0, 0)),
+                        _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(2, 3, 2, 1))));
+        *hi = _mm_sub_ps(
+                _mm_mul_ps(_mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 2, 1)),
+                        _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3))),
+                _mm_mul_ps(_mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 2, 1)),
+                        _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3))));
+}
+
+CGMATH_TARGET_SSE2
+static inline float _mat4f_minors_det_sse2(__m128 slo, __m128 shi, __m128 clo, __m128 chi)
+{
+        __m128 d;
+        __m128 c;
+
+        /* s0c5 - s1c4 + s2c3 + s3c2 - s4c1 + s5c0 */
+        c = _mm_shuffle_ps(chi, clo, _MM_SHUFFLE(2, 3, 0, 1));
+        d = _mm_mul_ps(_mm_mul_ps(slo, c), _mm_setr_ps(1.0f, -1.0f, 1.0f, 1.0f));
+        c = _mm_shuffle_ps(clo, clo, _MM_SHUFFLE(0, 0, 0, 1));
+        d = _mm_add_ps(d, _mm_mul_ps(_mm_mul_ps(shi, c),
+                        _mm_setr_ps(-1.0f, 1.0f, 0.0f, 0.0f)));
+
+        d = _mm_add_ps(d, _mm_movehl_ps(d, d));
+        d = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(d);
+}
+
+CGMATH_TARGET_SSE2
+float _mat4f_determinant_sse2(mat4f* mat)
+{
+        __m128 slo;
+        __m128 shi;
+        __m128 clo;
+        __m128 chi;
+
+        _mat4f_minors_sse2(_mm_loadu_ps(mat->m[0]), _mm_loadu_ps(mat->m[1]), &slo, &shi);
+        _mat4f_minors_sse2(_mm_loadu_ps(mat->m[2]), _mm_loadu_ps(mat->m[3]), &clo, &chi);
+        return _mat4f_minors_det_sse2(slo, shi, clo, chi);
+}
+
+/**
+ * Row i of the adjugate is a sum of three products of
+ * a sign flipped, pair swapped column of the input
+ * (k = a1j, -a0j, a3j, -a2j) with a minor broadcast as
+ * (c, c, s, s). Leaves dest untouched when singular,
+ * the same as the scalar path.
+ */
+CGMATH_TARGET_SSE2
+void _mat4f_inverse_sse2(mat4f* mat, mat4f* dest)
+{
+        float dt;
+        __m128 r0;
+        __m128 r1;
+        __m128 r2;
+        __m128 r3;
+        __m128 slo;
+        __m128 shi;
+        __m128 clo;
+        __m128 chi;
+        __m128 sgn;
+        __m128 k0;
+        __m128 k1;
+        __m128 k2;
+        __m128 k3;
+        __m128 p[6];
+        __m128 inv;
+
+        r0 = _mm_loadu_ps(mat->m[0]);
+        r1 = _mm_loadu_ps(mat->m[1]);
+        r2 = _mm_loadu_ps(mat->m[2]);
+        r3 = _mm_loadu_ps(mat->m[3]);
+
+        _mat4f_minors_sse2(r0, r1, &slo, &shi);
+        _mat4f_minors_sse2(r2, r3, &clo, &chi);
+
+        dt = _mat4f_minors_det_sse2(slo, shi, clo, chi);
+        if(_cgmath_absf(dt) == 0.0f) {
+                return;
+        }
+
+        p[0] = _mm_shuffle_ps(clo, slo, _MM_SHUFFLE(0, 0, 0, 0));
+        p[1] = _mm_shuffle_ps(clo, slo, _MM_SHUFFLE(1, 1, 1, 1));
+        p[2] = _mm_shuffle_ps(clo, slo, _MM_SHUFFLE(2, 2, 2, 2));
+        p[3] = _mm_shuffle_ps(clo, slo, _MM_SHUFFLE(3, 3, 3, 3));
+        p[4] = _mm_shuffle_ps(chi, shi, _MM_SHUFFLE(0, 0, 0, 0));
+        p[5] = _mm_shuffle_ps(chi, shi, _MM_SHUFFLE(1, 1, 1, 1));
+
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        sgn = _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f);
+        k0 = _mm_xor_ps(_mm_shuffle_ps(r0, r0, _MM_SHUFFLE(2, 3, 0, 1)), sgn);
+        k1 = _mm_xor_ps(_mm_shuffle_ps(r1, r1, _MM_SHUFFLE(2, 3, 0, 1)), sgn);
+        k2 = _mm_xor_ps(_mm_shuffle_ps(r2, r2, _MM_SHUFFLE(2, 3, 0, 1)), sgn);
+        k3 = _mm_xor_ps(_mm_shuffle_ps(r3, r3, _MM_SHUFFLE(2, 3, 0, 1)), sgn);
+
+        r0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(k1, p[5]), _mm_mul_ps(k2, p[4])),
+                        _mm_mul_ps(k3, p[3]));
+        r1 = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(k2, p[2]), _mm_mul_ps(k0, p[5])),
+                        _mm_mul_ps(k3, p[1]));
+        r2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(k0, p[4]), _mm_mul_ps(k1, p[2])),
+                        _mm_mul_ps(k3, p[0]));
+        r3 = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(k1, p[1]), _mm_mul_ps(k0, p[3])),
+                        _mm_mul_ps(k2, p[0]));
+
+        inv = _mm_set1_ps(1.0f / dt);
+        _mm_storeu_ps(dest->m[0], _mm_mul_ps(r0, inv));
+        _mm_storeu_ps(dest->m[1], _mm_mul_ps(r1, inv));
+        _mm_storeu_ps(dest->m[2], _mm_mul_ps(r2, inv));
+        _mm_storeu_ps(dest->m[3], _mm_mul_ps(r3, inv));
+}
+
+CGMATH_TARGET_SSE2
+void _mat4f_transform_point_array_sse2(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        int i;
+        size_t n;
+        __m128 m[12];
+        __m128 x;
+        __m128 y;
+        __m128 z;
+        __m128 r[3];
+
+        for(i = 0; i < 12; i++) {
+                m[i] = _mm_set1_ps(mat->m[i >> 2][i & 3]);
+        }
+
+        for(n = 0; n + 4 <= count; n += 4) {
+                _cgmath_load3x4_sse2(src[n].m, &x, &y, &z);
+                for(i = 0; i < 3; i++) {
+                        r[i] = _mm_add_ps(
+                                _mm_add_ps(_mm_mul_ps(m[4 * i], x), _mm_mul_ps(m[4 * i + 1], y)),
+                                _mm_add_ps(_mm_mul_ps(m[4 * i + 2], z), m[4 * i + 3]));
+                }
+                _cgmath_store3x4_sse2(dest[n].m, r[0], r[1], r[2]);
+        }
+        _mat4f_transform_point_array_scalar(mat, src + n, dest + n, count - n);
+}
+
+CGMATH_TARGET_SSE2
+void _mat4f_transform_normal_array_sse2(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        int i;
+        size_t n;
+        __m128 m[9];
+        __m128 x;
+        __m128 y;
+        __m128 z;
+        __m128 r[3];
+        __m128 l;
+        __m128 abs;
+        __m128 zero;
+        __m128 live;
+
+        for(i = 0; i < 9; i++) {
+                m[i] = _mm_set1_ps(mat->m[i / 3][i % 3]);
+        }
+
+        abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        zero = _mm_setzero_ps();
+        for(n = 0; n + 4 <= count; n += 4) {
+                _cgmath_load3x4_sse2(src[n].m, &x, &y, &z);
+                for(i = 0; i < 3; i++) {
+                        r[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[3 * i], x),
+                                        _mm_mul_ps(m[3 * i + 1], y)), _mm_mul_ps(m[3 * i + 2], z));
+                }
+                live = _mm_cmpeq_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], zero), _mm_mul_ps(r[1], zero)),
+                                _mm_mul_ps(r[2], zero)), zero);
+                l = _mm_max_ps(_mm_max_ps(_mm_and_ps(r[0], abs), _mm_and_ps(r[1], abs)), _mm_and_ps(r[2], abs));
+                l = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(l, _mm_set1_ps(FLT_MIN)));
+                for(i = 0; i < 3; i++) {
+                        r[i] = _mm_and_ps(_mm_mul_ps(r[i], l), live);
+                }
+                l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], r[0]), _mm_mul_ps(r[1], r[1])),
+                                _mm_mul_ps(r[2], r[2]));
+                l = _cgmath_rsqrt_sse2(l);
+                _cgmath_store3x4_sse2(dest[n].m, _mm_mul_ps(r[0], l),
+                                _mm_mul_ps(r[1], l), _mm_mul_ps(r[2], l));
+        }
+        _mat4f_transform_normal_array_scalar(mat, src + n, dest + n, count - n);
+}
+
+MAT4F_ADJUGATE_LANES(_mat4f_adjugate_lanes_sse2, CGMATH_TARGET_SSE2, __m128)
+
+/**
+ * Four matrices at a time: transposing row r of each
+ * of them gives elements [r][0..3] across the four.
+ */
+CGMATH_TARGET_SSE2
+size_t _mat4f_inverse_array_sse2(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count)
+{
+        int k;
+        int r;
+        int bits;
+        size_t i;
+        size_t bad;
+        __m128 a[16];
+        __m128 d[16];
+        __m128 dt;
+        __m128 inv;
+        __m128 ok;
+
+        bad = 0;
+        for(i = 0; i + 4 <= count; i += 4) {
+                for(r = 0; r < 4; r++) {
+                        a[4 * r] = _mm_loadu_ps(mat[i].m[r]);
+                        a[4 * r + 1] = _mm_loadu_ps(mat[i + 1].m[r]);
+                        a[4 * r + 2] = _mm_loadu_ps(mat[i + 2].m[r]);
+                        a[4 * r + 3] = _mm_loadu_ps(mat[i + 3].m[r]);
+                        _MM_TRANSPOSE4_PS(a[4 * r], a[4 * r + 1], a[4 * r + 2], a[4 * r + 3]);
+                }
+
+                _mat4f_adjugate_lanes_sse2(a, d, &dt);
+
+                inv = _mm_div_ps(_mm_set1_ps(1.0f), dt);
+                ok = _mm_and_ps(_mm_cmple_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), dt), _mm_set1_ps(FLT_MAX)),
+                                _mm_cmple_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), inv), _mm_set1_ps(FLT_MAX)));
+                for(k = 0; k < 16; k++) {
+                        d[k] = _mm_and_ps(_mm_mul_ps(d[k], inv), ok);
+                }
+
+                for(r = 0; r < 4; r++) {
+                        _MM_TRANSPOSE4_PS(d[4 * r], d[4 * r + 1], d[4 * r + 2], d[4 * r + 3]);
+                        _mm_storeu_ps(dest[i].m[r], d[4 * r]);
+                        _mm_storeu_ps(dest[i + 1].m[r], d[4 * r + 1]);
+                        _mm_storeu_ps(dest[i + 2].m[r], d[4 * r + 2]);
+                        _mm_storeu_ps(dest[i + 3].m[r], d[4 * r + 3]);
+                }
+
+                bits = ~_mm_movemask_ps(ok) & 0xF;
+                bad += __builtin_popcount(bits);
+                if(singular != NULL) {
+                        for(k = 0; k < 4; k++) {
+                                singular[i + k] = (bits >> k) & 1;
+                        }
+                }
+        }
+        return bad + _mat4f_inverse_array_scalar(mat + i, dest + i,
+                        singular != NULL ? singular + i : NULL, count - i);
+}
+
+/**
+ * Two rows per register; vpermilps broadcasts a[i][k]
+ * within each 128 bit lane against a duplicated b[k].
+ */
+CGMATH_TARGET_AVX2
+void _mat4f_multiply_avx2(mat4f* a, mat4f* b, mat4f* dest)
+{
+        __m256 a01;
+        __m256 a23;
+        __m256 bk;
+        __m256 r01;
+        __m256 r23;
+
+        a01 = _mm256_loadu_ps(a->m[0]);
+        a23 = _mm256_loadu_ps(a->m[2]);
+
+        bk = _mm256_broadcast_ps((__m128*)b->m[0]);
+        r01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), bk);
+        r23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), bk);
+        bk = _mm256_broadcast_ps((__m128*)b->m[1]);
+        r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0x55), bk, r01);
+        r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0x55), bk, r23);
+        bk = _mm256_broadcast_ps((__m128*)b->m[2]);
+        r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xAA), bk, r01);
+        r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xAA), bk, r23);
+        bk = _mm256_broadcast_ps((__m128*)b->m[3]);
+        r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xFF), bk, r01);
+        r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xFF), bk, r23);
+
+        _mm256_storeu_ps(dest->m[0], r01);
+        _mm256_storeu_ps(dest->m[2], r23);
+}
+
+/**
+ * The whole matrix fits in one register.
+ */
+CGMATH_TARGET_AVX512
+void _mat4f_multiply_avx512(mat4f* a, mat4f* b, mat4f* dest)
+{
+        __m512 av;
+        __m512 r;
+
+        av = _mm512_loadu_ps(a->m);
+
+        r = _mm512_mul_ps(_mm512_permute_ps(av, 0x00),
+                        _mm512_broadcast_f32x4(_mm_loadu_ps(b->m[0])));
+        r = _mm512_fmadd_ps(_mm512_permute_ps(av, 0x55),
+                        _mm512_broadcast_f32x4(_mm_loadu_ps(b->m[1])), r);
+        r = _mm512_fmadd_ps(_mm512_permute_ps(av, 0xAA),
+                        _mm512_broadcast_f32x4(_mm_loadu_ps(b->m[2])), r);
+        r = _mm512_fmadd_ps(_mm512_permute_ps(av, 0xFF),
+                        _mm512_broadcast_f32x4(_mm_loadu_ps(b->m[3])), r);
+
+        _mm512_storeu_ps(dest->m, r);
+}
+
+/**
+ * Eight points per iteration, deinterleaved as two
+ * groups of four and joined into one register.
+ */
+CGMATH_TARGET_AVX2
+void _mat4f_transform_point_array_avx2(mat4f* mat, vec3f* src, vec3f* dest, size_t count)
+{
+        int i;
+        size_t n;
+        __m128 lo[3];
+        __m128 hi[3];
+        __m256 m[12];
+        __m256 x;
+        __m256 y;
+        __m256 z;
+        __m256 r[3];
+
+        for(i = 0; i < 12; i++) {
+                m[i] = _mm256_set1_ps(mat->m[i >> 2][i & 3]);
+        }
+
+        for(n = 0; n + 8 <= count; n += 8) {
+                _cgmath_load3x4_sse2(src[n].m, &lo[0], &lo[1], &lo[2]);
+                _cgmath_load3x4_sse2(src[n + 4].m, &hi[0], &hi[1], &hi[2]);
+                x = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[0]), hi[0], 1);
+                y = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[1]), hi[1], 1);
+                z = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[2]), hi[2], 1);
+                for(i = 0; i < 3; i++) {
+                        r[i] = _mm256_fmadd_ps(m[4 * i], x, m[4 * i + 3]);
+                        r[i] = _mm256_fmadd_ps(m[4 * i + 1], y, r[i]);
+                        r[i] = _mm256_fmadd_ps(m[4 * i + 2], z, r[i]);
+                }
+                _cgmath_store3x4_sse2(dest[n].m, _mm256_castps256_ps128(r[0]),
+                                _mm256_castps256_ps128(r[1]), _mm256_castps256_ps128(r[2]));
+                _cgmath_store3x4_sse2(dest[n + 4].m, _mm256_extractf128_ps(r[0], 1),
+                                _mm256_extractf128_ps(r[1], 1), _mm256_extractf128_ps(r[2], 1));
+        }
+        _mat4f_transform_point_array_sse2(mat, src + n, dest + n, count - n);
+}
+
+MAT4F_ADJUGATE_LANES(_mat4f_adjugate_lanes_avx2, CGMATH_TARGET_AVX2, __m256)
+
+/**
+ * Eight matrices at a time. Each matrix is two rows of
+ * eight floats; an 8x8 transpose of the same half of
+ * all eight turns it into eight SoA registers.
+ */
+CGMATH_TARGET_AVX2
+size_t _mat4f_inverse_array_avx2(mat4f* mat, mat4f* dest, unsigned char* singular, size_t count)
+{
+        int k;
+        int h;
+        int bits;
+        size_t i;
+        size_t bad;
+        __m256 a[16];
+        __m256 d[16];
+        __m256 dt;
+        __m256 inv;
+        __m256 ok;
+
+        bad = 0;
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(h = 0; h < 2; h++) {
+                        for(k = 0; k < 8; k++) {
+                                a[8 * h + k] = _mm256_loadu_ps(mat[i + k].m[2 * h]);
+                        }
+                        _cgmath_transpose8_avx2(a + 8 * h);
+                }
+
+                _mat4f_adjugate_lanes_avx2(a, d, &dt);
+
+                inv = _mm256_div_ps(_mm256_set1_ps(1.0f), dt);
+                ok = _mm256_and_ps(_mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), dt),
+                                        _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ),
+                                _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), inv),
+                                        _mm256_set1_ps(FLT_MAX), _CMP_LE_OQ));
+                for(k = 0; k < 16; k++) {
+                        d[k] = _mm256_and_ps(_mm256_mul_ps(d[k], inv), ok);
+                }
+
+                for(h = 0; h < 2; h++) {
+                        _cgmath_transpose8_avx2(d + 8 * h);
+                        for(k = 0; k < 8; k++) {
+                                _mm256_storeu_ps(dest[i + k].m[2 * h], d[8 * h + k]);
+                        }
+                }
+
+                bits = ~_mm256_movemask_ps(ok) & 0xFF;
+                bad += __builtin_popcount(bits);
+                if(singular != NULL) {
+                        for(k = 0; k < 8; k++) {
+                                singular[i + k] = (bits >> k) & 1;
+                        }
+                }
+        }
+        return bad + _mat4f_inverse_array_sse2(mat + i, dest + i,
+                        singular != NULL ? singular + i : NULL, count - i);
+}
+
+#endif
@@ -0,0 +1,234 @@
+/**
+ * File: mat4f_stack.c
+ * Description:
+ * * A GL style matrix stack. Each level keeps the
+ * * transform applied since it was pushed, and the
+ * * running product down to the root is only formed
+ * * when the top is read, and only for the levels that
+ * * changed since the last read. All levels live in
+ * * one block allocated up front.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+
+#define CGMATH_STACK_ALIGN      64
+
+#define CGMATH_STACK_IDENTITY   1
+#define CGMATH_STACK_ABSOLUTE   2
+
+static void _stack_touch(mat4f_stack* s)
+{
+        if(s->clean > s->depth) {
+                s->clean = s->depth;
+        }
+}
+
+int mat4f_stack_init(mat4f_stack* s, int capacity)
+{
+        size_t mats;
+        size_t size;
+        char* block;
+
+        if(capacity <= 0) {
+                return -1;
+        }
+
+        mats = (size_t)capacity * sizeof(mat4f);
+        size = 2 * mats + ((capacity + CGMATH_STACK_ALIGN - 1) & ~(CGMATH_STACK_ALIGN - 1));
+        block = aligned_alloc(CGMATH_STACK_ALIGN, size);
+        if(block == NULL) {
+                return -1;
+        }
+
+        s->local = (mat4f*)block;
+        s->world = (mat4f*)(block + mats);
+        s->flags = (unsigned char*)(block + 2 * mats);
+        s->capacity = capacity;
+        s->depth = 0;
+        s->clean = 0;
+
+        mat4f_identity(&s->local[0]);
+        s->flags[0] = CGMATH_STACK_IDENTITY;
+        return 0;
+}
+
+void mat4f_stack_free(mat4f_stack* s)
+{
+        free(s->local);
+        memset(s, 0, sizeof(*s));
+}
+
+/**
+ * Pushing never multiplies: the new level starts as
+ * an identity on top of whatever its parent becomes.
+ */
+int mat4f_stack_push(mat4f_stack* s)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_push, 1);
+        if(s->depth + 1 >= s->capacity) {
+                return -1;
+        }
+
+        s->depth++;
+        s->flags[s->depth] = CGMATH_STACK_IDENTITY;
+        _stack_touch(s);
+        return 0;
+}
+
+int mat4f_stack_pop(mat4f_stack* s)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_pop, 1);
+        if(s->depth == 0) {
+                return -1;
+        }
+
+        s->depth--;
+        if(s->clean > s->depth + 1) {
+                s->clean = s->depth + 1;
+        }
+        return 0;
+}
+
+void mat4f_stack_load(mat4f_stack* s, mat4f* mat)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_load, 1);
+        memcpy(s->local[s->depth].m, mat->m, MAT4F_SIZE);
+        s->flags[s->depth] = CGMATH_STACK_ABSOLUTE;
+        _stack_touch(s);
+}
+
+void mat4f_stack_load_identity(mat4f_stack* s)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_load_identity, 1);
+        mat4f_identity(&s->local[s->depth]);
+        s->flags[s->depth] = CGMATH_STACK_ABSOLUTE | CGMATH_STACK_IDENTITY;
+        _stack_touch(s);
+}
+
+/**
+ * Post-multiplies the top, top = top * mat, as
+ * glMultMatrix does. An untouched level just takes a
+ * copy of mat.
+ */
+void mat4f_stack_mult(mat4f_stack* s, mat4f* mat)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_mult, 1);
+        mat4f* l;
+
+        l = &s->local[s->depth];
+        if(s->flags[s->depth] & CGMATH_STACK_IDENTITY) {
+                memcpy(l->m, mat->m, MAT4F_SIZE);
+        } else {
+                mat4f_multiply(l, mat, l);
+        }
+        s->flags[s->depth] &= ~CGMATH_STACK_IDENTITY;
+        _stack_touch(s);
+}
+
+void mat4f_stack_translate(mat4f_stack* s, float x, float y, float z)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_translate, 1);
+        int r;
+        mat4f* l;
+
+        l = &s->local[s->depth];
+        if(s->flags[s->depth] & CGMATH_STACK_IDENTITY) {
+                mat4f_identity(l);
+        }
+
+        for(r = 0; r < 4; r++) {
+                l->m[r][3] += l->m[r][0] * x + l->m[r][1] * y + l->m[r][2] * z;
+        }
+        s->flags[s->depth] &= ~CGMATH_STACK_IDENTITY;
+        _stack_touch(s);
+}
+
+void mat4f_stack_scale(mat4f_stack* s, float x, float y, float z)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_scale, 1);
+        int r;
+        mat4f* l;
+
+        l = &s->local[s->depth];
+        if(s->flags[s->depth] & CGMATH_STACK_IDENTITY) {
+                mat4f_identity(l);
+        }
+
+        for(r = 0; r < 4; r++) {
+                l->m[r][0] *= x;
+                l->m[r][1] *= y;
+                l->m[r][2] *= z;
+        }
+        s->flags[s->depth] &= ~CGMATH_STACK_IDENTITY;
+        _stack_touch(s);
+}
+
+/**
+ * Rotates by angle radians about the axis (x, y, z),
+ * which need not be normalized.
+ */
+void mat4f_stack_rotate(mat4f_stack* s, float angle, float x, float y, float z)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_rotate, 1);
+        float c;
+        float d;
+        float n;
+        float t;
+        mat4f rot;
+
+        n = x * x + y * y + z * z;
+        if(n == 0.0f) {
+                return;
+        }
+        n = 1.0f / sqrtf(n);
+        x *= n;
+        y *= n;
+        z *= n;
+
+        c = cosf(angle);
+        d = sinf(angle);
+        t = 1.0f - c;
+
+        mat4f_identity(&rot);
+        rot.m[0][0] = t * x * x + c;
+        rot.m[0][1] = t * x * y - d * z;
+        rot.m[0][2] = t * x * z + d * y;
+        rot.m[1][0] = t * x * y + d * z;
+        rot.m[1][1] = t * y * y + c;
+        rot.m[1][2] = t * y * z - d * x;
+        rot.m[2][0] = t * x * z - d * y;
+        rot.m[2][1] = t * y * z + d * x;
+        rot.m[2][2] = t * z * z + c;
+
+        mat4f_stack_mult(s, &rot);
+}
+
+/**
+ * Brings the running products up to date from the
+ * lowest level changed since the last read and
+ * returns the top. The pointer stays valid until the
+ * stack is modified.
+ */
+mat4f* mat4f_stack_top(mat4f_stack* s)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_stack_top, s->depth + 1 - s->clean);
+        int i;
+
+        for(i = s->clean; i <= s->depth; i++) {
+                if(i == 0 || (s->flags[i] & CGMATH_STACK_ABSOLUTE)) {
+                        memcpy(s->world[i].m, s->local[i].m, MAT4F_SIZE);
+                } else if(s->flags[i] & CGMATH_STACK_IDENTITY) {
+                        memcpy(s->world[i].m, s->world[i - 1].m, MAT4F_SIZE);
+                } else {
+                        mat4f_multiply(&s->world[i - 1], &s->local[i], &s->world[i]);
+                }
+        }
+
+        s->clean = s->depth + 1;
+        return &s->world[s->depth];
+}
@@ -0,0 +1,702 @@
+/**
+ * File: matf.c
+ * Description:
+ * * General row-major float matrices of any size,
+ * * viewed through matf, with a cache-blocked GEMM and
+ * * a GEMV for the small dense problems (Jacobians,
+ * * regressions, blend shape deltas) that do not
+ * * justify a BLAS.
+ * *
+ * * GEMM follows the usual packed scheme: a KC x NC
+ * * panel of op(B) is copied into slivers of MATF_NR
+ * * columns, each MC x KC block of op(A) into slivers of
+ * * MATF_MR rows, and a register micro-kernel computes
+ * * one MR x NR tile of C from one sliver of each. The
+ * * micro-kernel is mat4f_multiply() generalized:
+ * * broadcast a[i][k] and accumulate it times row k of
+ * * b into row i of the tile. Tiles of one panel are
+ * * grouped into tasks of MC rows by MATF_NB columns
+ * * and spread over the worker pool; every element of C
+ * * is summed by one task in a fixed order, so the
+ * * result does not depend on the thread count.
+ * *
+ * * The packed panels live in a workspace kept per
+ * * thread and only ever grown, so repeated products
+ * * allocate nothing after the first; it is freed when
+ * * the thread exits.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+/* tile of C held in registers by the micro-kernel */
+#define MATF_MR                 4
+#define MATF_NR                 16
+
+/* A block in L2, B panel in L3; multiples of MR and NR */
+#define MATF_MC                 64
+#define MATF_KC                 256
+#define MATF_NC                 2048
+#define MATF_NB                 128
+
+/* GEMV rows or columns per task */
+#define MATF_GEMV_GRAIN         64
+
+#define MATF_ALIGN              64
+
+/* packed panels of one thread; b is only used by the thread calling matf_gemm */
+typedef struct {
+        float*  a;
+        float*  b;
+        size_t  a_size;
+        size_t  b_size;
+} _matf_workspace;
+
+static pthread_key_t    _matf_key;
+static pthread_once_t   _matf_key_once = PTHREAD_ONCE_INIT;
+static int              _matf_key_error = 0;
+
+static void _matf_workspace_free(void* p)
+{
+        _matf_workspace* w;
+
+        w = p;
+        free(w->a);
+        free(w->b);
+        free(w);
+}
+
+static void _matf_key_create(void)
+{
+        _matf_key_error = pthread_key_create(&_matf_key, _matf_workspace_free);
+}
+
+static _matf_workspace* _matf_workspace_get(void)
+{
+        _matf_workspace* w;
+
+        pthread_once(&_matf_key_once, _matf_key_create);
+        if(_matf_key_error) {
+                return NULL;
+        }
+        w = pthread_getspecific(_matf_key);
+        if(w == NULL) {
+                w = calloc(1, sizeof(*w));
+                if(w == NULL || pthread_setspecific(_matf_key, w) != 0) {
+                        free(w);
+                        return NULL;
+                }
+        }
+        return w;
+}
+
+/* grows *buf to hold count floats, keeping it if it already does */
+static float* _matf_reserve(float** buf, size_t* size, size_t count)
+{
+        float* p;
+        size_t bytes;
+
+        if(count <= *size) {
+                return *buf;
+        }
+        bytes = (count * sizeof(float) + MATF_ALIGN - 1) & ~(size_t)(MATF_ALIGN - 1);
+        p = aligned_alloc(MATF_ALIGN, bytes);
+        if(p == NULL) {
+                return NULL;
+        }
+        free(*buf);
+        *buf = p;
+        *size = count;
+        return p;
+}
+
+/* non-negative sizes and rows that do not overlap */
+static int _matf_valid(matf* mat)
+{
+        return mat->rows >= 0 && mat->cols >= 0 && (mat->rows <= 1 || mat->stride >= mat->cols);
+}
+
+static inline float _matf_at(matf* mat, int trans, int r, int c)
+{
+        return trans ? mat->m[(size_t)c * mat->stride + r] : mat->m[(size_t)r * mat->stride + c];
+}
+
+/**
+ * C = alpha * ab + beta * C over the first m rows and n
+ * columns of an MR x NR tile; C is not read when beta
+ * is zero, so it may hold garbage.
+ */
+static void _matf_store_tile(float* ab, float alpha, float beta, float* c, int ldc, int m, int n)
+{
+        int i;
+        int j;
+
+        for(i = 0; i < m; i++) {
+                for(j = 0; j < n; j++) {
+                        if(beta == 0.0f) {
+                                c[(size_t)i * ldc + j] = alpha * ab[i * MATF_NR + j];
+                        } else {
+                                c[(size_t)i * ldc + j] = alpha * ab[i * MATF_NR + j] +
+                                        beta * c[(size_t)i * ldc + j];
+                        }
+                }
+        }
+}
+
+void _matf_gemm_kernel_scalar(int k, float* a, float* b, float alpha, float beta,
+                float* c, int ldc, int m, int n)
+{
+        int i;
+        int j;
+        int p;
+        float ab[MATF_MR * MATF_NR];
+
+        memset(ab, 0, sizeof(ab));
+        for(p = 0; p < k; p++) {
+                for(i = 0; i < MATF_MR; i++) {
+                        for(j = 0; j < MATF_NR; j++) {
+                                ab[i * MATF_NR + j] += a[p * MATF_MR + i] * b[p * MATF_NR + j];
+                        }
+                }
+        }
+        _matf_store_tile(ab, alpha, beta, c, ldc, m, n);
+}
+
+/* dest[i] = alpha * dot(row i, x) + beta * dest[i] */
+void _matf_gemv_rows_scalar(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest)
+{
+        int i;
+        int j;
+        float s;
+
+        for(i = 0; i < rows; i++) {
+                s = 0.0f;
+                for(j = 0; j < cols; j++) {
+                        s += a[(size_t)i * lda + j] * x[j];
+                }
+                dest[i] = beta == 0.0f ? alpha * s : alpha * s + beta * dest[i];
+        }
+}
+
+/* dest[j] = alpha * sum_i a[i][j] * x[i] + beta * dest[j] */
+void _matf_gemv_cols_scalar(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest)
+{
+        int i;
+        int j;
+        float s;
+
+        for(j = 0; j < cols; j++) {
+                s = 0.0f;
+                for(i = 0; i < rows; i++) {
+                        s += a[(size_t)i * lda + j] * x[i];
+                }
+                dest[j] = beta == 0.0f ? alpha * s : alpha * s + beta * dest[j];
+        }
+}
+
+/* MR row slivers of op(A)[i0 .. i0 + mc)[k0 .. k0 + kc), zero padded */
+static void _matf_pack_a(matf* a, int trans, int i0, int mc, int k0, int kc, float* dest)
+{
+        int r;
+        int p;
+        int s;
+
+        for(s = 0; s < mc; s += MATF_MR) {
+                for(p = 0; p < kc; p++) {
+                        for(r = 0; r < MATF_MR; r++) {
+                                *dest++ = s + r < mc ? _matf_at(a, trans, i0 + s + r, k0 + p) : 0.0f;
+                        }
+                }
+        }
+}
+
+/* NR column slivers of op(B)[k0 .. k0 + kc)[j0 .. j0 + nc), zero padded */
+static void _matf_pack_b(matf* b, int trans, int k0, int kc, int j0, int nc, float* dest)
+{
+        int c;
+        int p;
+        int s;
+        int n;
+
+        for(s = 0; s < nc; s += MATF_NR) {
+                n = nc - s < MATF_NR ? nc - s : MATF_NR;
+                for(p = 0; p < kc; p++) {
+                        if(!trans) {
+                                memcpy(dest, b->m + (size_t)(k0 + p) * b->stride + j0 + s, n * sizeof(float));
+                        } else {
+                                for(c = 0; c < n; c++) {
+                                        dest[c] = b->m[(size_t)(j0 + s + c) * b->stride + k0 + p];
+                                }
+                        }
+                        for(c = n; c < MATF_NR; c++) {
+                                dest[c] = 0.0f;
+                        }
+                        dest += MATF_NR;
+                }
+        }
+}
+
+typedef struct {
+        matf*   a;
+        matf*   c;
+        float*  x;
+        float*  y;
+        float*  packed_b;
+        int     trans_a;
+        int     trans;
+        int     m;
+        int     k0;
+        int     kc;
+        int     j0;
+        int     nc;
+        int     nb;
+        float   alpha;
+        float   beta;
+        int     error;
+} _matf_job;
+
+/* task t covers rows MC * (t / nb) and columns NB * (t % nb) of the panel */
+static void _matf_gemm_range(void* ctx, size_t begin, size_t end)
+{
+        int i;
+        int j;
+        int mc;
+        int i0;
+        int jb;
+        int je;
+        size_t t;
+        float* packed_a;
+        _matf_job* job;
+        _matf_workspace* w;
+
+        job = ctx;
+        w = _matf_workspace_get();
+        packed_a = w != NULL ? _matf_reserve(&w->a, &w->a_size, (size_t)MATF_MC * job->kc) : NULL;
+        if(packed_a == NULL) {
+                __atomic_store_n(&job->error, 1, __ATOMIC_RELAXED);
+                return;
+        }
+
+        for(t = begin; t < end; t++) {
+                i0 = (int)(t / job->nb) * MATF_MC;
+                mc = job->m - i0 < MATF_MC ? job->m - i0 : MATF_MC;
+                jb = (int)(t % job->nb) * MATF_NB;
+                je = jb + MATF_NB < job->nc ? jb + MATF_NB : job->nc;
+                _matf_pack_a(job->a, job->trans_a, i0, mc, job->k0, job->kc, packed_a);
+
+                for(i = 0; i < mc; i += MATF_MR) {
+                        for(j = jb; j < je; j += MATF_NR) {
+                                _cgmath_kern.matf_gemm_kernel(job->kc, packed_a + i * job->kc,
+                                                job->packed_b + j * job->kc, job->alpha, job->beta,
+                                                job->c->m + (size_t)(i0 + i) * job->c->stride + job->j0 + j,
+                                                job->c->stride,
+                                                mc - i < MATF_MR ? mc - i : MATF_MR,
+                                                je - j < MATF_NR ? je - j : MATF_NR);
+                        }
+                }
+        }
+}
+
+static void _matf_gemv_range(void* ctx, size_t begin, size_t end)
+{
+        _matf_job* job;
+        matf* a;
+
+        job = ctx;
+        a = job->a;
+        if(!job->trans) {
+                _cgmath_kern.matf_gemv_rows(a->m + begin * a->stride, a->stride, end - begin, a->cols,
+                                job->x, job->alpha, job->beta, job->y + begin);
+        } else {
+                _cgmath_kern.matf_gemv_cols(a->m + begin, a->stride, a->rows, end - begin,
+                                job->x, job->alpha, job->beta, job->y + begin);
+        }
+}
+
+/* stride may be 0 for tightly packed rows */
+void matf_view(matf* mat, float* data, int rows, int cols, int stride)
+{
+        mat->m = data;
+        mat->rows = rows;
+        mat->cols = cols;
+        mat->stride = stride > 0 ? stride : cols;
+}
+
+void matf_sub(matf* mat, int row, int col, int rows, int cols, matf* dest)
+{
+        dest->m = mat->m + (size_t)row * mat->stride + col;
+        dest->rows = rows;
+        dest->cols = cols;
+        dest->stride = mat->stride;
+}
+
+/**
+ * C = alpha * op(A) * op(B) + beta * C, where op
+ * transposes when the flag is CGMATH_TRANS. C must not
+ * overlap A or B. Returns -1 without touching C if the
+ * shapes do not agree, and -1 with C undefined if
+ * memory runs out.
+ */
+int matf_gemm(int trans_a, int trans_b, float alpha, matf* a, matf* b, float beta, matf* c)
+{
+        CGMATH_PROFILE_SCOPE(matf_gemm, (size_t)c->rows * c->cols);
+        int m;
+        int n;
+        int k;
+        int i;
+        int j;
+        int tasks;
+        int jc;
+        int pc;
+        int nc;
+        _matf_job job;
+        _matf_workspace* w;
+
+        m = trans_a ? a->cols : a->rows;
+        k = trans_a ? a->rows : a->cols;
+        n = trans_b ? b->rows : b->cols;
+        if(!_matf_valid(a) || !_matf_valid(b) || !_matf_valid(c) ||
+                        (trans_b ? b->cols : b->rows) != k || c->rows != m || c->cols != n) {
+                return -1;
+        }
+
+        /* an empty product still scales C, which is not read when beta is zero */
+        if(k == 0) {
+                for(i = 0; i < m; i++) {
+                        for(j = 0; j < n; j++) {
+                                c->m[(size_t)i * c->stride + j] = beta == 0.0f ? 0.0f :
+                                        beta * c->m[(size_t)i * c->stride + j];
+                        }
+                }
+                return 0;
+        }
+
+        /* the widest panel, in whole slivers, by the deepest */
+        memset(&job, 0, sizeof(job));
+        nc = (n < MATF_NC ? n + MATF_NR - 1 : MATF_NC) / MATF_NR * MATF_NR;
+        w = _matf_workspace_get();
+        job.packed_b = w != NULL ? _matf_reserve(&w->b, &w->b_size,
+                        (size_t)nc * (k < MATF_KC ? k : MATF_KC)) : NULL;
+        if(job.packed_b == NULL) {
+                return -1;
+        }
+        job.a = a;
+        job.c = c;
+        job.trans_a = trans_a;
+        job.m = m;
+        job.alpha = alpha;
+
+        for(jc = 0; jc < n; jc += MATF_NC) {
+                job.j0 = jc;
+                job.nc = n - jc < MATF_NC ? n - jc : MATF_NC;
+                job.nb = (job.nc + MATF_NB - 1) / MATF_NB;
+                tasks = (m + MATF_MC - 1) / MATF_MC * job.nb;
+
+                for(pc = 0; pc < k; pc += MATF_KC) {
+                        job.k0 = pc;
+                        job.kc = k - pc < MATF_KC ? k - pc : MATF_KC;
+                        job.beta = pc == 0 ? beta : 1.0f;
+                        _matf_pack_b(b, trans_b, job.k0, job.kc, jc, job.nc, job.packed_b);
+                        _cgmath_parallel_for(tasks, 1, _matf_gemm_range, &job);
+                }
+        }
+
+        return job.error ? -1 : 0;
+}
+
+int matf_multiply(matf* a, matf* b, matf* dest)
+{
+        return matf_gemm(CGMATH_NO_TRANS, CGMATH_NO_TRANS, 1.0f, a, b, 0.0f, dest);
+}
+
+/**
+ * y = alpha * op(A) * x + beta * y; y is not read when
+ * beta is zero. x and y must not overlap. nx and ny
+ * are the lengths of x and y; returns -1 without
+ * touching y if they do not match op(A).
+ */
+int matf_gemv(int trans, float alpha, matf* a, float* x, int nx, float beta, float* y, int ny)
+{
+        CGMATH_PROFILE_SCOPE(matf_gemv, (size_t)a->rows * a->cols);
+        _matf_job job;
+
+        if(!_matf_valid(a) || nx != (trans ? a->rows : a->cols) || ny != (trans ? a->cols : a->rows)) {
+                return -1;
+        }
+
+        job.a = a;
+        job.trans = trans;
+        job.x = x;
+        job.y = y;
+        job.alpha = alpha;
+        job.beta = beta;
+        _cgmath_parallel_for(ny, MATF_GEMV_GRAIN, _matf_gemv_range, &job);
+        return 0;
+}
+
+
+#if defined(CGMATH_X86)
+
+/**
+ * Eight accumulators per pass: the tile is done as two
+ * 4x8 halves so that the B loads still fit in the
+ * sixteen XMM registers.
+ */
+CGMATH_TARGET_SSE2
+void _matf_gemm_kernel_sse2(int k, float* a, float* b, float alpha, float beta,
+                float* c, int ldc, int m, int n)
+{
+        int h;
+        int i;
+        int p;
+        __m128 ai;
+        __m128 b0;
+        __m128 b1;
+        __m128 acc[MATF_MR][2];
+        float* r;
+        float ab[MATF_MR * MATF_NR];
+        int full;
+
+        full = m == MATF_MR && n == MATF_NR;
+        for(h = 0; h < MATF_NR; h += 8) {
+                for(i = 0; i < MATF_MR; i++) {
+                        acc[i][0] = _mm_setzero_ps();
+                        acc[i][1] = _mm_setzero_ps();
+                }
+                for(p = 0; p < k; p++) {
+                        b0 = _mm_load_ps(b + p * MATF_NR + h);
+                        b1 = _mm_load_ps(b + p * MATF_NR + h + 4);
+                        for(i = 0; i < MATF_MR; i++) {
+                                ai = _mm_set1_ps(a[p * MATF_MR + i]);
+                                acc[i][0] = _mm_add_ps(acc[i][0], _mm_mul_ps(ai, b0));
+                                acc[i][1] = _mm_add_ps(acc[i][1], _mm_mul_ps(ai, b1));
+                        }
+                }
+
+                for(i = 0; i < MATF_MR; i++) {
+                        acc[i][0] = _mm_mul_ps(acc[i][0], _mm_set1_ps(alpha));
+                        acc[i][1] = _mm_mul_ps(acc[i][1], _mm_set1_ps(alpha));
+                        if(!full) {
+                                _mm_storeu_ps(ab + i * MATF_NR + h, acc[i][0]);
+                                _mm_storeu_ps(ab + i * MATF_NR + h + 4, acc[i][1]);
+                                continue;
+                        }
+                        r = c + (size_t)i * ldc + h;
+                        if(beta != 0.0f) {
+                                acc[i][0] = _mm_add_ps(acc[i][0], _mm_mul_ps(_mm_set1_ps(beta), _mm_loadu_ps(r)));
+                                acc[i][1] = _mm_add_ps(acc[i][1], _mm_mul_ps(_mm_set1_ps(beta), _mm_loadu_ps(r + 4)));
+                        }
+                        _mm_storeu_ps(r, acc[i][0]);
+                        _mm_storeu_ps(r + 4, acc[i][1]);
+                }
+        }
+        if(!full) {
+                _matf_store_tile(ab, 1.0f, beta, c, ldc, m, n);
+        }
+}
+
+CGMATH_TARGET_SSE2
+static inline float _matf_hsum_sse2(__m128 v)
+{
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(v);
+}
+
+/* four rows at a time share the loads of x */
+CGMATH_TARGET_SSE2
+void _matf_gemv_rows_sse2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest)
+{
+        int i;
+        int j;
+        int r;
+        float s;
+        float* row;
+        __m128 xv;
+        __m128 acc[4];
+
+        for(i = 0; i + 4 <= rows; i += 4) {
+                for(r = 0; r < 4; r++) {
+                        acc[r] = _mm_setzero_ps();
+                }
+                for(j = 0; j + 4 <= cols; j += 4) {
+                        xv = _mm_loadu_ps(x + j);
+                        for(r = 0; r < 4; r++) {
+                                acc[r] = _mm_add_ps(acc[r], _mm_mul_ps(xv,
+                                                _mm_loadu_ps(a + (size_t)(i + r) * lda + j)));
+                        }
+                }
+                for(r = 0; r < 4; r++) {
+                        s = _matf_hsum_sse2(acc[r]);
+                        row = a + (size_t)(i + r) * lda;
+                        for(j = cols & ~3; j < cols; j++) {
+                                s += row[j] * x[j];
+                        }
+                        dest[i + r] = beta == 0.0f ? alpha * s : alpha * s + beta * dest[i + r];
+                }
+        }
+        _matf_gemv_rows_scalar(a + (size_t)i * lda, lda, rows - i, cols, x, alpha, beta, dest + i);
+}
+
+/* sixteen columns at a time, accumulated over every row */
+CGMATH_TARGET_SSE2
+void _matf_gemv_cols_sse2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest)
+{
+        int i;
+        int j;
+        int q;
+        __m128 xi;
+        __m128 acc[4];
+
+        for(j = 0; j + 16 <= cols; j += 16) {
+                for(q = 0; q < 4; q++) {
+                        acc[q] = _mm_setzero_ps();
+                }
+                for(i = 0; i < rows; i++) {
+                        xi = _mm_set1_ps(x[i]);
+                        for(q = 0; q < 4; q++) {
+                                acc[q] = _mm_add_ps(acc[q], _mm_mul_ps(xi,
+                                                _mm_loadu_ps(a + (size_t)i * lda + j + 4 * q)));
+                        }
+                }
+                for(q = 0; q < 4; q++) {
+                        acc[q] = _mm_mul_ps(acc[q], _mm_set1_ps(alpha));
+                        if(beta != 0.0f) {
+                                acc[q] = _mm_add_ps(acc[q], _mm_mul_ps(_mm_set1_ps(beta),
+                                                _mm_loadu_ps(dest + j + 4 * q)));
+                        }
+                        _mm_storeu_ps(dest + j + 4 * q, acc[q]);
+                }
+        }
+        _matf_gemv_cols_scalar(a + j, lda, rows, cols - j, x, alpha, beta, dest + j);
+}
+
+/**
+ * The whole 4x16 tile is eight YMM accumulators, enough
+ * independent FMA chains to cover their latency.
+ */
+CGMATH_TARGET_AVX2
+void _matf_gemm_kernel_avx2(int k, float* a, float* b, float alpha, float beta,
+                float* c, int ldc, int m, int n)
+{
+        int i;
+        int p;
+        __m256 ai;
+        __m256 b0;
+        __m256 b1;
+        __m256 acc[MATF_MR][2];
+        float* r;
+        float ab[MATF_MR * MATF_NR];
+
+        for(i = 0; i < MATF_MR; i++) {
+                acc[i][0] = _mm256_setzero_ps();
+                acc[i][1] = _mm256_setzero_ps();
+        }
+        for(p = 0; p < k; p++) {
+                b0 = _mm256_load_ps(b + p * MATF_NR);
+                b1 = _mm256_load_ps(b + p * MATF_NR + 8);
+                for(i = 0; i < MATF_MR; i++) {
+                        ai = _mm256_broadcast_ss(a + p * MATF_MR + i);
+                        acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+                        acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+                }
+        }
+
+        if(m != MATF_MR || n != MATF_NR) {
+                for(i = 0; i < MATF_MR; i++) {
+                        _mm256_storeu_ps(ab + i * MATF_NR, acc[i][0]);
+                        _mm256_storeu_ps(ab + i * MATF_NR + 8, acc[i][1]);
+                }
+                _matf_store_tile(ab, alpha, beta, c, ldc, m, n);
+                return;
+        }
+        for(i = 0; i < MATF_MR; i++) {
+                r = c + (size_t)i * ldc;
+                acc[i][0] = _mm256_mul_ps(acc[i][0], _mm256_set1_ps(alpha));
+                acc[i][1] = _mm256_mul_ps(acc[i][1], _mm256_set1_ps(alpha));
+                if(beta != 0.0f) {
+                        acc[i][0] = _mm256_fmadd_ps(_mm256_set1_ps(beta), _mm256_loadu_ps(r), acc[i][0]);
+                        acc[i][1] = _mm256_fmadd_ps(_mm256_set1_ps(beta), _mm256_loadu_ps(r + 8), acc[i][1]);
+                }
+                _mm256_storeu_ps(r, acc[i][0]);
+                _mm256_storeu_ps(r + 8, acc[i][1]);
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _matf_gemv_rows_avx2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest)
+{
+        int i;
+        int j;
+        int r;
+        float s;
+        float* row;
+        __m256 xv;
+        __m256 acc[4];
+
+        for(i = 0; i + 4 <= rows; i += 4) {
+                for(r = 0; r < 4; r++) {
+                        acc[r] = _mm256_setzero_ps();
+                }
+                for(j = 0; j + 8 <= cols; j += 8) {
+                        xv = _mm256_loadu_ps(x + j);
+                        for(r = 0; r < 4; r++) {
+                                acc[r] = _mm256_fmadd_ps(xv, _mm256_loadu_ps(a + (size_t)(i + r) * lda + j), acc[r]);
+                        }
+                }
+                for(r = 0; r < 4; r++) {
+                        s = _matf_hsum_sse2(_mm_add_ps(_mm256_castps256_ps128(acc[r]),
+                                                _mm256_extractf128_ps(acc[r], 1)));
+                        row = a + (size_t)(i + r) * lda;
+                        for(j = cols & ~7; j < cols; j++) {
+                                s += row[j] * x[j];
+                        }
+                        dest[i + r] = beta == 0.0f ? alpha * s : alpha * s + beta * dest[i + r];
+                }
+        }
+        _matf_gemv_rows_scalar(a + (size_t)i * lda, lda, rows - i, cols, x, alpha, beta, dest + i);
+}
+
+CGMATH_TARGET_AVX2
+void _matf_gemv_cols_avx2(float* a, int lda, int rows, int cols, float* x,
+                float alpha, float beta, float* dest)
+{
+        int i;
+        int j;
+        int q;
+        __m256 xi;
+        __m256 acc[4];
+
+        for(j = 0; j + 32 <= cols; j += 32) {
+                for(q = 0; q < 4; q++) {
+                        acc[q] = _mm256_setzero_ps();
+                }
+                for(i = 0; i < rows; i++) {
+                        xi = _mm256_broadcast_ss(x + i);
+                        for(q = 0; q < 4; q++) {
+                                acc[q] = _mm256_fmadd_ps(xi, _mm256_loadu_ps(a + (size_t)i * lda + j + 8 * q), acc[q]);
+                        }
+                }
+                for(q = 0; q < 4; q++) {
+                        acc[q] = _mm256_mul_ps(acc[q], _mm256_set1_ps(alpha));
+                        if(beta != 0.0f) {
+                                acc[q] = _mm256_fmadd_ps(_mm256_set1_ps(beta), _mm256_loadu_ps(dest + j + 8 * q), acc[q]);
+                        }
+                        _mm256_storeu_ps(dest + j + 8 * q, acc[q]);
+                }
+        }
+        _matf_gemv_cols_sse2(a + j, lda, rows, cols - j, x, alpha, beta, dest + j);
+}
+
+#endif
@@ -0,0 +1,506 @@
+/**
+ * File: mesh.c
+ * Description:
+ * * Vertex normals and tangents from an indexed
+ * * triangle list. mesh_init() sorts the corners of
+ * * the index buffer by vertex once; after that every
+ * * pass is two parallel loops without atomics: one
+ * * over triangles that writes what each corner adds
+ * * to its vertex, and one over vertices that sums its
+ * * corners in triangle order and normalizes. The sums
+ * * never depend on the thread count, so neither does
+ * * the output, and per frame recomputation of a
+ * * deforming mesh does not allocate.
+ * *
+ * * Tangents follow MikkTSpace: each corner adds the
+ * * triangle's UV derivative directions projected into
+ * * the plane of the vertex normal, weighted by the
+ * * corner angle in that plane, and the bitangent sign
+ * * is the UV orientation. Unlike MikkTSpace, vertices
+ * * are not split where the triangles around them
+ * * disagree, so UV seams and mirrored halves must
+ * * already be separate vertices in the index buffer,
+ * * as exporters write them.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+#define MESH_ALIGN      64
+
+/* triangles or vertices per task */
+#define MESH_GRAIN      CGMATH_BATCH_GRAIN
+
+static size_t _mesh_round(size_t n)
+{
+        return (n + MESH_ALIGN - 1) & ~(size_t)(MESH_ALIGN - 1);
+}
+
+static inline void _mesh_sub(float* a, float* b, float* dest)
+{
+        dest[0] = a[0] - b[0];
+        dest[1] = a[1] - b[1];
+        dest[2] = a[2] - b[2];
+}
+
+static inline float _mesh_dot(float* a, float* b)
+{
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void _mesh_cross(float* a, float* b, float* dest)
+{
+        dest[0] = a[1] * b[2] - a[2] * b[1];
+        dest[1] = a[2] * b[0] - a[0] * b[2];
+        dest[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/**
+ * Scales by the largest component before squaring, as
+ * vec3f_normalize_array() does, so that long edges do
+ * not overflow; zero and non-finite vectors become
+ * zero.
+ */
+static inline void _mesh_normalize(float* v)
+{
+        float n;
+
+        if(v[0] * 0.0f + v[1] * 0.0f + v[2] * 0.0f != 0.0f) {
+                v[0] = v[1] = v[2] = 0.0f;
+                return;
+        }
+        n = 1.0f / fmaxf(fmaxf(fmaxf(fabsf(v[0]), fabsf(v[1])), fabsf(v[2])), FLT_MIN);
+        v[0] *= n;
+        v[1] *= n;
+        v[2] *= n;
+        n = _mesh_dot(v, v);
+        n = n >= FLT_MIN ? 1.0f / sqrtf(n) : 0.0f;
+        v[0] *= n;
+        v[1] *= n;
+        v[2] *= n;
+}
+
+/* removes from v its component along the unit vector n */
+static inline void _mesh_reject(float* v, float* n)
+{
+        float d;
+
+        d = _mesh_dot(n, v);
+        v[0] -= n[0] * d;
+        v[1] -= n[1] * d;
+        v[2] -= n[2] * d;
+}
+
+static inline void _mesh_project(float* v, float* n, float* dest)
+{
+        memcpy(dest, v, 3 * sizeof(float));
+        _mesh_reject(dest, n);
+        _mesh_normalize(dest);
+}
+
+static inline float _mesh_clamp(float c)
+{
+        return c > 1.0f ? 1.0f : (c < -1.0f ? -1.0f : c);
+}
+
+typedef struct {
+        mesh*           m;
+        unsigned int*   indices;
+        int             bad;
+} _mesh_init_job;
+
+static void _mesh_count(void* ctx, size_t begin, size_t end)
+{
+        size_t c;
+        unsigned int v;
+        _mesh_init_job* job;
+
+        job = ctx;
+        for(c = begin; c < end; c++) {
+                v = job->indices[c];
+                if(v >= job->m->vertices) {
+                        __atomic_store_n(&job->bad, 1, __ATOMIC_RELAXED);
+                        continue;
+                }
+                job->m->index[c] = v;
+                __atomic_fetch_add(&job->m->start[v + 1], 1, __ATOMIC_RELAXED);
+        }
+}
+
+/* afterwards start[v] holds where the corners of v end */
+static void _mesh_scatter(void* ctx, size_t begin, size_t end)
+{
+        size_t c;
+        unsigned int e;
+        mesh* m;
+
+        m = ((_mesh_init_job*)ctx)->m;
+        for(c = begin; c < end; c++) {
+                e = __atomic_fetch_add(&m->start[m->index[c]], 1, __ATOMIC_RELAXED);
+                m->corner[e] = (unsigned int)c;
+        }
+}
+
+/* the scatter order depends on the threads, so sort it away */
+static void _mesh_sort(void* ctx, size_t begin, size_t end)
+{
+        size_t v;
+        unsigned int i;
+        unsigned int j;
+        unsigned int c;
+        mesh* m;
+
+        m = ((_mesh_init_job*)ctx)->m;
+        for(v = begin; v < end; v++) {
+                for(i = m->start[v] + 1; i < m->start[v + 1]; i++) {
+                        c = m->corner[i];
+                        for(j = i; j > m->start[v] && m->corner[j - 1] > c; j--) {
+                                m->corner[j] = m->corner[j - 1];
+                        }
+                        m->corner[j] = c;
+                }
+        }
+}
+
+/**
+ * Copies triangles * 3 indices and sorts the corners
+ * by vertex. Returns -1 if an index is not below
+ * vertices, the mesh is too large for 32 bit indices,
+ * or allocation fails.
+ */
+int mesh_init(mesh* m, unsigned int* indices, size_t triangles, size_t vertices)
+{
+        CGMATH_PROFILE_SCOPE(mesh_init, triangles);
+        size_t v;
+        size_t corners;
+        size_t start;
+        size_t index;
+        size_t contrib;
+        size_t weight;
+        char* block;
+        _mesh_init_job job;
+
+        memset(m, 0, sizeof(*m));
+        corners = 3 * triangles;
+        if(vertices == 0 || vertices >= 0xFFFFFFFFu || triangles >= 0xFFFFFFFFu / 3) {
+                return -1;
+        }
+
+        start = _mesh_round((vertices + 1) * sizeof(unsigned int));
+        index = _mesh_round(corners * sizeof(unsigned int));
+        contrib = _mesh_round(triangles * sizeof(vec3f));
+        weight = _mesh_round(corners * sizeof(float));
+        block = aligned_alloc(MESH_ALIGN, start + 2 * index + 2 * contrib + weight);
+        if(block == NULL) {
+                return -1;
+        }
+
+        m->vertices = vertices;
+        m->triangles = triangles;
+        m->start = (unsigned int*)block;
+        m->index = (unsigned int*)(block + start);
+        m->corner = (unsigned int*)(block + start + index);
+        m->a = (vec3f*)(block + start + 2 * index);
+        m->b = (vec3f*)(block + start + 2 * index + contrib);
+        m->weight = (float*)(block + start + 2 * index + 2 * contrib);
+        memset(m->start, 0, (vertices + 1) * sizeof(unsigned int));
+
+        job.m = m;
+        job.indices = indices;
+        job.bad = 0;
+        _cgmath_parallel_for(corners, MESH_GRAIN, _mesh_count, &job);
+        if(job.bad) {
+                mesh_free(m);
+                return -1;
+        }
+        for(v = 0; v < vertices; v++) {
+                m->start[v + 1] += m->start[v];
+        }
+        _cgmath_parallel_for(corners, MESH_GRAIN, _mesh_scatter, &job);
+        memmove(m->start + 1, m->start, vertices * sizeof(unsigned int));
+        m->start[0] = 0;
+        _cgmath_parallel_for(vertices, MESH_GRAIN, _mesh_sort, &job);
+        return 0;
+}
+
+void mesh_free(mesh* m)
+{
+        free(m->start);
+        memset(m, 0, sizeof(*m));
+}
+
+typedef struct {
+        mesh*           m;
+        vec3f*          pos;
+        vec3f*          normals;
+        vec2f*          uv;
+        int             weight;
+        void*           dest;
+} _mesh_job;
+
+/**
+ * Stores the face normal of each triangle in a:
+ * unnormalized for area weighting, where its length is
+ * twice the area, and unit length for angle weighting,
+ * which also stores the corner angles in weight. Edge
+ * k runs from corner k to the next one, so corner k
+ * lies between edge k and the reverse of edge k - 1;
+ * note that cross(e[2], e[0]) equals
+ * cross(p1 - p0, p2 - p0). The cosines of a whole
+ * range are turned into angles by one batched acos.
+ * For angle weighting the edges are first scaled by a
+ * power of two that brings the largest component
+ * below one. That leaves the directions and cosines
+ * as they were but keeps long edges from overflowing
+ * the cross product and squared lengths; non-finite
+ * ones get no weight, like degenerate triangles.
+ */
+static void _mesh_face_normals(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        int j;
+        size_t t;
+        float* p[3];
+        float e[3][3];
+        float l[3];
+        float d;
+        float s;
+        mesh* m;
+        _mesh_job* job;
+
+        job = ctx;
+        m = job->m;
+        for(t = begin; t < end; t++) {
+                for(k = 0; k < 3; k++) {
+                        p[k] = job->pos[m->index[3 * t + k]].m;
+                }
+                for(k = 0; k < 3; k++) {
+                        _mesh_sub(p[k == 2 ? 0 : k + 1], p[k], e[k]);
+                }
+                if(job->weight == CGMATH_MESH_ANGLE) {
+                        s = 0.0f;
+                        for(k = 0; k < 9; k++) {
+                                s = fmaxf(s, fabsf(e[k / 3][k % 3]));
+                        }
+                        frexpf(s, &j);
+                        s = ldexpf(1.0f, -j);
+                        for(k = 0; k < 9; k++) {
+                                e[k / 3][k % 3] *= s;
+                        }
+                        _mesh_cross(e[2], e[0], m->a[t].m);
+                        _mesh_normalize(m->a[t].m);
+                        for(k = 0; k < 3; k++) {
+                                l[k] = _mesh_dot(e[k], e[k]);
+                        }
+                        for(k = 0; k < 3; k++) {
+                                j = k == 0 ? 2 : k - 1;
+                                d = l[k] * l[j];
+                                m->weight[3 * t + k] = d > 0.0f && d <= FLT_MAX ?
+                                        _mesh_clamp(-_mesh_dot(e[k], e[j]) / sqrtf(d)) : 1.0f;
+                        }
+                } else {
+                        _mesh_cross(e[2], e[0], m->a[t].m);
+                }
+        }
+
+        if(job->weight == CGMATH_MESH_ANGLE) {
+                _cgmath_kern.acos_array(m->weight + 3 * begin, m->weight + 3 * begin, 3 * (end - begin));
+        }
+}
+
+static void _mesh_vertex_normals(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        size_t v;
+        unsigned int e;
+        unsigned int c;
+        float n[3];
+        float w;
+        vec3f* dest;
+        mesh* m;
+        _mesh_job* job;
+
+        job = ctx;
+        m = job->m;
+        dest = job->dest;
+        for(v = begin; v < end; v++) {
+                n[0] = n[1] = n[2] = 0.0f;
+                for(e = m->start[v]; e < m->start[v + 1]; e++) {
+                        c = m->corner[e];
+                        w = job->weight == CGMATH_MESH_ANGLE ? m->weight[c] : 1.0f;
+                        for(k = 0; k < 3; k++) {
+                                n[k] += m->a[c / 3].m[k] * w;
+                        }
+                }
+                memcpy(dest[v].m, n, sizeof(n));
+        }
+        _cgmath_kern.vec3f_normalize_array(dest + begin, dest + begin, end - begin);
+}
+
+/**
+ * Unit vertex normals from pos, weighted by triangle
+ * area (CGMATH_MESH_AREA) or corner angle
+ * (CGMATH_MESH_ANGLE). Vertices used by no triangle,
+ * or only by degenerate ones, get a zero normal.
+ */
+void mesh_normals(mesh* m, vec3f* pos, int weight, vec3f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mesh_normals, m->triangles);
+        _mesh_job job;
+
+        job.m = m;
+        job.pos = pos;
+        job.normals = NULL;
+        job.uv = NULL;
+        job.weight = weight;
+        job.dest = dest;
+        _cgmath_parallel_for(m->triangles, MESH_GRAIN, _mesh_face_normals, &job);
+        _cgmath_parallel_for(m->vertices, MESH_GRAIN, _mesh_vertex_normals, &job);
+}
+
+/**
+ * The UV derivatives of a triangle are
+ * (t2.y * d1 - t1.y * d2) / det and
+ * (t1.x * d2 - t2.x * d1) / det, with d and t the
+ * position and UV edges from the first corner. Only
+ * their directions matter, so a and b get them times
+ * |det|, and triangles without UV area get zero.
+ * weight gets the corner angles in the plane of the
+ * vertex normal.
+ */
+static void _mesh_face_tangents(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        size_t t;
+        unsigned int i[3];
+        float* p[3];
+        float* n;
+        float d1[3];
+        float d2[3];
+        float e1[3];
+        float e2[3];
+        float t1[2];
+        float t2[2];
+        float det;
+        float sign;
+        float d;
+        mesh* m;
+        _mesh_job* job;
+
+        job = ctx;
+        m = job->m;
+        for(t = begin; t < end; t++) {
+                for(k = 0; k < 3; k++) {
+                        i[k] = m->index[3 * t + k];
+                        p[k] = job->pos[i[k]].m;
+                }
+                _mesh_sub(p[1], p[0], d1);
+                _mesh_sub(p[2], p[0], d2);
+                t1[0] = job->uv[i[1]].m[VEC_X] - job->uv[i[0]].m[VEC_X];
+                t1[1] = job->uv[i[1]].m[VEC_Y] - job->uv[i[0]].m[VEC_Y];
+                t2[0] = job->uv[i[2]].m[VEC_X] - job->uv[i[0]].m[VEC_X];
+                t2[1] = job->uv[i[2]].m[VEC_Y] - job->uv[i[0]].m[VEC_Y];
+                det = t1[0] * t2[1] - t1[1] * t2[0];
+                sign = det > 0.0f ? 1.0f : (det < 0.0f ? -1.0f : 0.0f);
+                for(k = 0; k < 3; k++) {
+                        m->a[t].m[k] = sign * (t2[1] * d1[k] - t1[1] * d2[k]);
+                        m->b[t].m[k] = sign * (t1[0] * d2[k] - t2[0] * d1[k]);
+                }
+
+                for(k = 0; k < 3; k++) {
+                        n = job->normals[i[k]].m;
+                        _mesh_sub(p[(k + 2) % 3], p[k], e1);
+                        _mesh_sub(p[(k + 1) % 3], p[k], e2);
+                        _mesh_reject(e1, n);
+                        _mesh_reject(e2, n);
+                        d = _mesh_dot(e1, e1) * _mesh_dot(e2, e2);
+                        m->weight[3 * t + k] = d >= FLT_MIN && d <= FLT_MAX ?
+                                _mesh_clamp(_mesh_dot(e1, e2) / sqrtf(d)) : 0.0f;
+                }
+        }
+
+        _cgmath_kern.acos_array(m->weight + 3 * begin, m->weight + 3 * begin, 3 * (end - begin));
+}
+
+/**
+ * Each corner adds the directions of its triangle
+ * projected into the plane of the vertex normal, unit
+ * length and weighted by the corner angle. A vertex
+ * whose triangles all lack UV area still gets a unit
+ * tangent perpendicular to its normal, built from the
+ * axis least aligned with it.
+ */
+static void _mesh_vertex_tangents(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        size_t v;
+        unsigned int e;
+        unsigned int c;
+        float* n;
+        float s[3];
+        float u[3];
+        float w[3];
+        float ps[3];
+        float pu[3];
+        vec4f* dest;
+        mesh* m;
+        _mesh_job* job;
+
+        job = ctx;
+        m = job->m;
+        dest = job->dest;
+        for(v = begin; v < end; v++) {
+                n = job->normals[v].m;
+                s[0] = s[1] = s[2] = 0.0f;
+                u[0] = u[1] = u[2] = 0.0f;
+                for(e = m->start[v]; e < m->start[v + 1]; e++) {
+                        c = m->corner[e];
+                        _mesh_project(m->a[c / 3].m, n, ps);
+                        _mesh_project(m->b[c / 3].m, n, pu);
+                        for(k = 0; k < 3; k++) {
+                                s[k] += ps[k] * m->weight[c];
+                                u[k] += pu[k] * m->weight[c];
+                        }
+                }
+
+                _mesh_normalize(s);
+                if(s[0] == 0.0f && s[1] == 0.0f && s[2] == 0.0f) {
+                        w[0] = w[1] = w[2] = 0.0f;
+                        k = fabsf(n[0]) <= fabsf(n[1]) ? 0 : 1;
+                        k = fabsf(n[k]) <= fabsf(n[2]) ? k : 2;
+                        w[k] = 1.0f;
+                        _mesh_project(w, n, s);
+                }
+                _mesh_cross(n, s, w);
+                memcpy(dest[v].m, s, sizeof(s));
+                dest[v].m[VEC_W] = _mesh_dot(w, u) < 0.0f ? -1.0f : 1.0f;
+        }
+}
+
+/**
+ * Unit tangents in xyz and the bitangent sign in w,
+ * so the bitangent is w * cross(normal, tangent).
+ * normals should be unit length, e.g. from
+ * mesh_normals().
+ */
+void mesh_tangents(mesh* m, vec3f* pos, vec3f* normals, vec2f* uv, vec4f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mesh_tangents, m->triangles);
+        _mesh_job job;
+
+        job.m = m;
+        job.pos = pos;
+        job.normals = normals;
+        job.uv = uv;
+        job.weight = CGMATH_MESH_ANGLE;
+        job.dest = dest;
+        _cgmath_parallel_for(m->triangles, MESH_GRAIN, _mesh_face_tangents, &job);
+        _cgmath_parallel_for(m->vertices, MESH_GRAIN, _mesh_vertex_tangents, &job);
+}
@@ -0,0 +1,557 @@
+/**
+ * File: pack.c
+ * Description:
+ * * Versioned binary container for vector and matrix
+ * * arrays. A file is a 64 byte header, the sections'
+ * * data, each plane aligned to CGMATH_PACK_ALIGN, and a
+ * * table of section records at the end. Data is stored
+ * * in the writer's native layout, so the reader maps
+ * * the file and hands out pointers into the mapping
+ * * without copying or converting anything; a file from
+ * * a host of the other byte order is rejected.
+ * *
+ * * Checksums are a two word Fletcher sum over 32 bit
+ * * words, mod 2^64. The sum of a concatenation is a
+ * * cheap function of the sums of its parts, so large
+ * * sections are summed in 1 MiB blocks on the worker
+ * * pool and merged in order, which gives the same
+ * * value for any thread count.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_thread.h"
+
+#define PACK_MAGIC              "CGMPACK"
+#define PACK_ENDIAN             0x01020304u
+#define PACK_VERSION            1
+#define PACK_BLOCK_WORDS        (256 * 1024)
+
+typedef struct {
+        char            magic[8];
+        uint32_t        endian;
+        uint16_t        version;
+        uint16_t        align;
+        uint32_t        sections;
+        uint32_t        reserved;
+        uint64_t        table;
+        uint64_t        size;
+        uint64_t        pad[2];
+        uint64_t        checksum;
+} _pack_header;
+
+/**
+ * planes is 1 for the packed types; the planes of a
+ * SoA section are plane bytes apart.
+ */
+typedef struct {
+        char            name[CGMATH_PACK_NAME];
+        uint32_t        type;
+        uint32_t        planes;
+        uint64_t        count;
+        uint64_t        offset;
+        uint64_t        plane;
+        uint64_t        checksum;
+        uint64_t        reserved;
+} _pack_section;
+
+typedef char _pack_header_size[sizeof(_pack_header) == 64 ? 1 : -1];
+typedef char _pack_section_size[sizeof(_pack_section) == 96 ? 1 : -1];
+
+typedef struct {
+        uint64_t        a;
+        uint64_t        b;
+        uint64_t        n;
+} _pack_sum;
+
+/* bytes per element of one plane, and planes per type */
+static const struct {
+        size_t  size;
+        int     planes;
+} _pack_types[CGMATH_PACK_TYPES] = {
+        { sizeof(float), 1 },
+        { sizeof(vec2f), 1 },
+        { sizeof(vec3f), 1 },
+        { sizeof(vec4f), 1 },
+        { sizeof(quat), 1 },
+        { sizeof(mat2f), 1 },
+        { sizeof(mat3f), 1 },
+        { sizeof(mat4f), 1 },
+        { sizeof(affine2f), 1 },
+        { sizeof(float), 3 },
+        { sizeof(float), 4 },
+        { sizeof(float), 4 },
+        { sizeof(float), 9 }
+};
+
+static size_t _pack_align(size_t n)
+{
+        return (n + CGMATH_PACK_ALIGN - 1) & ~(size_t)(CGMATH_PACK_ALIGN - 1);
+}
+
+/**
+ * b weights each word by its distance from the end, so
+ * eight words at a time add 8a plus their own weights.
+ */
+static void _pack_sum_words(const uint32_t* w, size_t n, _pack_sum* s)
+{
+        size_t i;
+        uint64_t a;
+        uint64_t b;
+
+        a = 0;
+        b = 0;
+        for(i = 0; i + 8 <= n; i += 8) {
+                b += 8 * a + 8 * (uint64_t)w[i] + 7 * (uint64_t)w[i + 1] +
+                        6 * (uint64_t)w[i + 2] + 5 * (uint64_t)w[i + 3] +
+                        4 * (uint64_t)w[i + 4] + 3 * (uint64_t)w[i + 5] +
+                        2 * (uint64_t)w[i + 6] + (uint64_t)w[i + 7];
+                a += (uint64_t)w[i] + w[i + 1] + w[i + 2] + w[i + 3] +
+                        w[i + 4] + w[i + 5] + w[i + 6] + w[i + 7];
+        }
+        for(; i < n; i++) {
+                a += w[i];
+                b += a;
+        }
+
+        s->a = a;
+        s->b = b;
+        s->n = n;
+}
+
+/* s = s followed by t */
+static void _pack_sum_append(_pack_sum* s, _pack_sum* t)
+{
+        s->b += t->b + t->n * s->a;
+        s->a += t->a;
+        s->n += t->n;
+}
+
+static uint64_t _pack_sum_final(_pack_sum* s)
+{
+        return s->a ^ (s->b * 0x9e3779b97f4a7c15ull);
+}
+
+typedef struct {
+        const uint32_t* words;
+        size_t          count;
+        _pack_sum*      blocks;
+} _pack_sum_job;
+
+static void _pack_sum_range(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        size_t n;
+        _pack_sum_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                n = job->count - i * PACK_BLOCK_WORDS;
+                if(n > PACK_BLOCK_WORDS) {
+                        n = PACK_BLOCK_WORDS;
+                }
+                _pack_sum_words(job->words + i * PACK_BLOCK_WORDS, n, &job->blocks[i]);
+        }
+}
+
+/* appends the sum of bytes (a multiple of 4) at src to s */
+static void _pack_sum_bytes(const void* src, size_t bytes, _pack_sum* s)
+{
+        size_t i;
+        size_t nblocks;
+        _pack_sum t;
+        _pack_sum_job job;
+
+        job.words = src;
+        job.count = bytes / sizeof(uint32_t);
+        nblocks = (job.count + PACK_BLOCK_WORDS - 1) / PACK_BLOCK_WORDS;
+        job.blocks = nblocks > 1 ? malloc(nblocks * sizeof(_pack_sum)) : NULL;
+
+        if(job.blocks == NULL) {
+                _pack_sum_words(job.words, job.count, &t);
+                _pack_sum_append(s, &t);
+                return;
+        }
+
+        _cgmath_parallel_for(nblocks, 1, _pack_sum_range, &job);
+        for(i = 0; i < nblocks; i++) {
+                _pack_sum_append(s, &job.blocks[i]);
+        }
+        free(job.blocks);
+}
+
+static int _pack_write(int fd, const void* buf, size_t len, off_t off)
+{
+        ssize_t n;
+        const unsigned char* p;
+
+        p = buf;
+        while(len > 0) {
+                n = pwrite(fd, p, len, off);
+                if(n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if(n <= 0) {
+                        return -1;
+                }
+                p += n;
+                len -= n;
+                off += n;
+        }
+        return 0;
+}
+
+int pack_writer_init(pack_writer* w, const char* path)
+{
+        memset(w, 0, sizeof(*w));
+        w->path = malloc(strlen(path) + 1);
+        if(w->path == NULL) {
+                return -1;
+        }
+        strcpy(w->path, path);
+
+        w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(w->fd < 0) {
+                free(w->path);
+                w->path = NULL;
+                return -1;
+        }
+        w->size = sizeof(_pack_header);
+        return 0;
+}
+
+/**
+ * src is the array for the packed types, and a pointer
+ * to the vec3f_soa, vec4f_soa, quat_soa or mat3f_soa
+ * view for the SoA ones.
+ */
+int pack_write(pack_writer* w, const char* name, int type, const void* src, size_t count)
+{
+        int p;
+        int i;
+        size_t bytes;
+        const void* data;
+        _pack_section* sec;
+        _pack_section* table;
+        _pack_sum sum;
+
+        if(w->error || type < 0 || type >= CGMATH_PACK_TYPES ||
+                        strlen(name) >= CGMATH_PACK_NAME) {
+                return -1;
+        }
+        table = w->table;
+        for(i = 0; i < w->sections; i++) {
+                if(strcmp(table[i].name, name) == 0) {
+                        return -1;
+                }
+        }
+
+        if(w->sections == w->capacity) {
+                w->capacity = w->capacity > 0 ? 2 * w->capacity : 16;
+                table = realloc(w->table, w->capacity * sizeof(_pack_section));
+                if(table == NULL) {
+                        w->error = 1;
+                        return -1;
+                }
+                w->table = table;
+        }
+
+        sec = &table[w->sections];
+        memset(sec, 0, sizeof(*sec));
+        strcpy(sec->name, name);
+        sec->type = type;
+        sec->planes = _pack_types[type].planes;
+        sec->count = count;
+        sec->offset = _pack_align(w->size);
+        bytes = count * _pack_types[type].size;
+        sec->plane = _pack_align(bytes);
+
+        memset(&sum, 0, sizeof(sum));
+        for(p = 0; p < _pack_types[type].planes; p++) {
+                data = sec->planes > 1 ? ((float* const*)src)[p] : src;
+                if(bytes > 0 && _pack_write(w->fd, data, bytes, sec->offset + p * sec->plane) != 0) {
+                        w->error = 1;
+                        return -1;
+                }
+                _pack_sum_bytes(data, bytes, &sum);
+        }
+        sec->checksum = _pack_sum_final(&sum);
+
+        w->size = sec->offset + (sec->planes - 1) * sec->plane + bytes;
+        w->sections++;
+        return 0;
+}
+
+/**
+ * Writes the table and header and closes the file. If
+ * any write failed the file is removed instead.
+ */
+int pack_writer_finish(pack_writer* w)
+{
+        int ret;
+        _pack_header h;
+        _pack_sum sum;
+
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+        h.endian = PACK_ENDIAN;
+        h.version = PACK_VERSION;
+        h.align = CGMATH_PACK_ALIGN;
+        h.sections = w->sections;
+        h.table = _pack_align(w->size);
+        h.size = h.table + w->sections * sizeof(_pack_section);
+
+        memset(&sum, 0, sizeof(sum));
+        _pack_sum_bytes(&h, sizeof(h), &sum);
+        _pack_sum_bytes(w->table, w->sections * sizeof(_pack_section), &sum);
+        h.checksum = _pack_sum_final(&sum);
+
+        ret = w->error ? -1 : 0;
+        if(ret == 0 && w->sections > 0 &&
+                        _pack_write(w->fd, w->table, w->sections * sizeof(_pack_section), h.table) != 0) {
+                ret = -1;
+        }
+        if(ret == 0 && _pack_write(w->fd, &h, sizeof(h), 0) != 0) {
+                ret = -1;
+        }
+        if(ret == 0 && ftruncate(w->fd, h.size) != 0) {
+                ret = -1;
+        }
+        if(close(w->fd) != 0) {
+                ret = -1;
+        }
+        if(ret != 0) {
+                unlink(w->path);
+        }
+
+        free(w->table);
+        free(w->path);
+        memset(w, 0, sizeof(*w));
+        w->fd = -1;
+        return ret;
+}
+
+/* rejects records that point outside the data area */
+static int _pack_check_section(_pack_section* sec, uint64_t limit)
+{
+        uint64_t bytes;
+
+        if(sec->type >= CGMATH_PACK_TYPES ||
+                        sec->planes != (uint32_t)_pack_types[sec->type].planes ||
+                        sec->name[CGMATH_PACK_NAME - 1] != '\0' ||
+                        sec->offset % CGMATH_PACK_ALIGN != 0 ||
+                        sec->plane % CGMATH_PACK_ALIGN != 0 ||
+                        sec->count > limit / _pack_types[sec->type].size) {
+                return -1;
+        }
+
+        bytes = sec->count * _pack_types[sec->type].size;
+        if(sec->plane < bytes || sec->offset > limit ||
+                        sec->plane > (limit - sec->offset) / sec->planes ||
+                        sec->offset + (sec->planes - 1) * sec->plane + bytes > limit) {
+                return -1;
+        }
+        return 0;
+}
+
+static int _pack_verify_section(pack_file* f, const _pack_section* sec)
+{
+        uint32_t p;
+        size_t bytes;
+        _pack_sum sum;
+
+        memset(&sum, 0, sizeof(sum));
+        bytes = sec->count * _pack_types[sec->type].size;
+        for(p = 0; p < sec->planes; p++) {
+                _pack_sum_bytes(f->map + sec->offset + p * sec->plane, bytes, &sum);
+        }
+        return _pack_sum_final(&sum) == sec->checksum ? 0 : -1;
+}
+
+/**
+ * The header and table are always checked; section
+ * data only with CGMATH_PACK_VERIFY, since that reads
+ * the whole file.
+ */
+int pack_open(pack_file* f, const char* path, int flags)
+{
+        CGMATH_PROFILE_SCOPE(pack_open, 1);
+        int fd;
+        uint32_t i;
+        struct stat st;
+        _pack_header h;
+        _pack_section* table;
+        _pack_sum sum;
+
+        memset(f, 0, sizeof(*f));
+        fd = open(path, O_RDONLY);
+        if(fd < 0) {
+                return -1;
+        }
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(h)) {
+                close(fd);
+                return -1;
+        }
+
+        f->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(f->map == MAP_FAILED) {
+                f->map = NULL;
+                return -1;
+        }
+        f->size = st.st_size;
+
+        memcpy(&h, f->map, sizeof(h));
+        if(memcmp(h.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+                        h.endian != PACK_ENDIAN || h.version != PACK_VERSION ||
+                        h.align != CGMATH_PACK_ALIGN || h.size != f->size ||
+                        h.table % CGMATH_PACK_ALIGN != 0 || h.table > h.size ||
+                        h.sections > (h.size - h.table) / sizeof(_pack_section)) {
+                pack_close(f);
+                return -1;
+        }
+
+        table = (_pack_section*)(f->map + h.table);
+        memset(&sum, 0, sizeof(sum));
+        h.checksum = 0;
+        _pack_sum_bytes(&h, sizeof(h), &sum);
+        _pack_sum_bytes(table, h.sections * sizeof(_pack_section), &sum);
+        if(_pack_sum_final(&sum) != ((_pack_header*)f->map)->checksum) {
+                pack_close(f);
+                return -1;
+        }
+
+        for(i = 0; i < h.sections; i++) {
+                if(_pack_check_section(&table[i], h.table) != 0 ||
+                                ((flags & CGMATH_PACK_VERIFY) && _pack_verify_section(f, &table[i]) != 0)) {
+                        pack_close(f);
+                        return -1;
+                }
+        }
+
+        f->sections = h.sections;
+        f->table = table;
+        return 0;
+}
+
+void pack_close(pack_file* f)
+{
+        if(f->map != NULL) {
+                munmap(f->map, f->size);
+        }
+        memset(f, 0, sizeof(*f));
+}
+
+int pack_find(pack_file* f, const char* name)
+{
+        int i;
+        const _pack_section* table;
+
+        table = f->table;
+        for(i = 0; i < f->sections; i++) {
+                if(strcmp(table[i].name, name) == 0) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+/* name, type and count may be NULL */
+int pack_section_info(pack_file* f, int section, const char** name, int* type, size_t* count)
+{
+        const _pack_section* sec;
+
+        if(section < 0 || section >= f->sections) {
+                return -1;
+        }
+        sec = (const _pack_section*)f->table + section;
+        if(name != NULL) {
+                *name = sec->name;
+        }
+        if(type != NULL) {
+                *type = sec->type;
+        }
+        if(count != NULL) {
+                *count = sec->count;
+        }
+        return 0;
+}
+
+/**
+ * NULL unless section name exists and holds exactly
+ * type, which must be one of the packed types.
+ */
+const void* pack_view(pack_file* f, const char* name, int type, size_t* count)
+{
+        int i;
+        const _pack_section* sec;
+
+        i = pack_find(f, name);
+        if(i < 0) {
+                return NULL;
+        }
+        sec = (const _pack_section*)f->table + i;
+        if(sec->type != (uint32_t)type || sec->planes != 1) {
+                return NULL;
+        }
+        if(count != NULL) {
+                *count = sec->count;
+        }
+        return f->map + sec->offset;
+}
+
+/**
+ * Fills planes, e.g. the m of a vec3f_soa, with
+ * pointers into the read only mapping.
+ */
+int pack_view_soa(pack_file* f, const char* name, int type, float** planes, size_t* count)
+{
+        int i;
+        uint32_t p;
+        const _pack_section* sec;
+
+        i = pack_find(f, name);
+        if(i < 0) {
+                return -1;
+        }
+        sec = (const _pack_section*)f->table + i;
+        if(sec->type != (uint32_t)type || sec->planes == 1) {
+                return -1;
+        }
+        for(p = 0; p < sec->planes; p++) {
+                planes[p] = (float*)(f->map + sec->offset + p * sec->plane);
+        }
+        if(count != NULL) {
+                *count = sec->count;
+        }
+        return 0;
+}
+
+/* every section when name is NULL */
+int pack_verify(pack_file* f, const char* name)
+{
+        CGMATH_PROFILE_SCOPE(pack_verify, 1);
+        int i;
+        const _pack_section* table;
+
+        table = f->table;
+        if(name != NULL) {
+                i = pack_find(f, name);
+                return i >= 0 ? _pack_verify_section(f, &table[i]) : -1;
+        }
+        for(i = 0; i < f->sections; i++) {
+                if(_pack_verify_section(f, &table[i]) != 0) {
+                        return -1;
+                }
+        }
+        return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * File: profile.c
+ * Description:
+ * * Per-thread call counters and cycle histograms for
+ * * every public entry point. Only built into the
+ * * library when CGMATH_PROFILE is defined.
+ */
+
+#if defined(CGMATH_PROFILE)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+struct _cgmath_prof_counter {
+        unsigned long long calls;
+        unsigned long long elems;
+        unsigned long long cycles;
+        unsigned long long hist[CGMATH_PROFILE_BUCKETS];
+};
+
+/**
+ * Each thread owns one block and is its only writer.
+ * Blocks are never freed so that counts survive the
+ * thread that produced them; readers and reset() go
+ * through relaxed atomics so no lock is ever taken
+ * on the hot path.
+ */
+struct _cgmath_prof_thread {
+        struct _cgmath_prof_counter c[CGMATH_PROF_COUNT];
+        struct _cgmath_prof_thread* next;
+};
+
+#define CGMATH_PROFILE_NAME(f) #f,
+static const char* _cgmath_prof_names[CGMATH_PROF_COUNT] = {
+        CGMATH_PROFILE_FUNCS(CGMATH_PROFILE_NAME)
+};
+#undef CGMATH_PROFILE_NAME
+
+static struct _cgmath_prof_thread* _cgmath_prof_head = NULL;
+static __thread struct _cgmath_prof_thread* _cgmath_prof_self = NULL;
+
+static inline unsigned long long _cgmath_prof_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static struct _cgmath_prof_thread* _cgmath_prof_attach(void)
+{
+        struct _cgmath_prof_thread* t;
+
+        t = calloc(1, sizeof(*t));
+        if(t == NULL) {
+                return NULL;
+        }
+
+        t->next = __atomic_load_n(&_cgmath_prof_head, __ATOMIC_ACQUIRE);
+        while(!__atomic_compare_exchange_n(&_cgmath_prof_head, &t->next, t, 1,
+                                __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        }
+
+        _cgmath_prof_self = t;
+        return t;
+}
+
+struct _cgmath_prof_scope _cgmath_prof_enter(int id, unsigned long long elems)
+{
+        struct _cgmath_prof_scope scope;
+        struct _cgmath_prof_thread* t;
+
+        t = _cgmath_prof_self;
+        if(t == NULL) {
+                t = _cgmath_prof_attach();
+        }
+
+        if(t != NULL) {
+                __atomic_fetch_add(&t->c[id].calls, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&t->c[id].elems, elems, __ATOMIC_RELAXED);
+        }
+
+        scope.id = id;
+        scope.t0 = _cgmath_prof_ticks();
+        return scope;
+}
+
+void _cgmath_prof_leave(struct _cgmath_prof_scope* scope)
+{
+        int b;
+        unsigned long long dt;
+        struct _cgmath_prof_thread* t;
+
+        dt = _cgmath_prof_ticks() - scope->t0;
+        t = _cgmath_prof_self;
+        if(t == NULL) {
+                return;
+        }
+
+        b = dt ? 63 - __builtin_clzll(dt) : 0;
+        if(b >= CGMATH_PROFILE_BUCKETS) {
+                b = CGMATH_PROFILE_BUCKETS - 1;
+        }
+
+        __atomic_fetch_add(&t->c[scope->id].cycles, dt, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->c[scope->id].hist[b], 1, __ATOMIC_RELAXED);
+}
+
+int cgmath_profile_count(void)
+{
+        return CGMATH_PROF_COUNT;
+}
+
+int cgmath_profile_find(const char* name)
+{
+        int i;
+
+        for(i = 0; i < CGMATH_PROF_COUNT; i++) {
+                if(strcmp(_cgmath_prof_names[i], name) == 0) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+int cgmath_profile_get(int index, cgmath_profile_stats* dest)
+{
+        int b;
+        struct _cgmath_prof_thread* t;
+        struct _cgmath_prof_counter* c;
+
+        if(index < 0 || index >= CGMATH_PROF_COUNT) {
+                return -1;
+        }
+
+        memset(dest, 0, sizeof(*dest));
+        dest->name = _cgmath_prof_names[index];
+
+        t = __atomic_load_n(&_cgmath_prof_head, __ATOMIC_ACQUIRE);
+        for(; t != NULL; t = t->next) {
+                c = &t->c[index];
+                dest->calls += __atomic_load_n(&c->calls, __ATOMIC_RELAXED);
+                dest->elems += __atomic_load_n(&c->elems, __ATOMIC_RELAXED);
+                dest->cycles += __atomic_load_n(&c->cycles, __ATOMIC_RELAXED);
+                for(b = 0; b < CGMATH_PROFILE_BUCKETS; b++) {
+                        dest->hist[b] += __atomic_load_n(&c->hist[b], __ATOMIC_RELAXED);
+                }
+        }
+        return 0;
+}
+
+void cgmath_profile_reset(void)
+{
+        int i;
+        int b;
+        struct _cgmath_prof_thread* t;
+        struct _cgmath_prof_counter* c;
+
+        t = __atomic_load_n(&_cgmath_prof_head, __ATOMIC_ACQUIRE);
+        for(; t != NULL; t = t->next) {
+                for(i = 0; i < CGMATH_PROF_COUNT; i++) {
+                        c = &t->c[i];
+                        __atomic_store_n(&c->calls, 0, __ATOMIC_RELAXED);
+                        __atomic_store_n(&c->elems, 0, __ATOMIC_RELAXED);
+                        __atomic_store_n(&c->cycles, 0, __ATOMIC_RELAXED);
+                        for(b = 0; b < CGMATH_PROFILE_BUCKETS; b++) {
+                                __atomic_store_n(&c->hist[b], 0, __ATOMIC_RELAXED);
+                        }
+                }
+        }
+}
+
+/**
+ * Functions that were never called are left out of
+ * both formats to keep the dumps readable. Histogram
+ * bucket b counts calls that took [2^b, 2^(b+1)) ticks.
+ */
+void cgmath_profile_dump(FILE* stream, int format)
+{
+        int i;
+        int b;
+        int first;
+        cgmath_profile_stats s;
+
+        if(format == CGMATH_PROFILE_JSON) {
+                fprintf(stream, "{\"functions\":[");
+        } else {
+                fprintf(stream, "%-28s %14s %14s %16s %12s\n",
+                        "function", "calls", "elements", "ticks", "ticks/call");
+        }
+
+        first = 1;
+        for(i = 0; i < CGMATH_PROF_COUNT; i++) {
+                cgmath_profile_get(i, &s);
+                if(s.calls == 0) {
+                        continue;
+                }
+
+                if(format != CGMATH_PROFILE_JSON) {
+                        fprintf(stream, "%-28s %14llu %14llu %16llu %12.1f\n",
+                                s.name, s.calls, s.elems, s.cycles,
+                                (double)s.cycles / (double)s.calls);
+                        continue;
+                }
+
+                fprintf(stream, "%s{\"name\":\"%s\",\"calls\":%llu,"
+                        "\"elements\":%llu,\"ticks\":%llu,\"histogram\":[",
+                        first ? "" : ",", s.name, s.calls, s.elems, s.cycles);
+                for(b = 0; b < CGMATH_PROFILE_BUCKETS; b++) {
+                        fprintf(stream, "%s%llu", b ? "," : "", s.hist[b]);
+                }
+                fprintf(stream, "]}");
+                first = 0;
+        }
+
+        if(format == CGMATH_PROFILE_JSON) {
+                fprintf(stream, "]}\n");
+        }
+}
+
+#endif
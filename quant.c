@@ -0,0 +1,1012 @@
+/**
+ * File: quant.c
+ * Description:
+ * * Compressed storage for rotations and directions,
+ * * with batch encode and decode kernels that handle
+ * * four (SSE2) or eight (AVX2) elements at a time.
+ * *
+ * * Smallest three quaternions drop the component of
+ * * largest magnitude, flip the sign so it is positive,
+ * * and store its index in 2 bits and the other three,
+ * * which lie in [-1/sqrt(2), 1/sqrt(2)], in 10 bits
+ * * (32 bit form) or 15 bits (48 bit form) each, on an
+ * * odd number of levels so that 0 is exact. Inputs
+ * * must be unit length; the decoded quaternion may be
+ * * the negation of the input, which is the same
+ * * rotation. Worst case over 2^22 random and 2^22
+ * * adversarial unit quaternions, as measured by
+ * * bin/test/ulp.c (ulp -n 524288 -f encode, eight per
+ * * sample): 32 bit, 1.9e-3 per component and 0.26
+ * * degrees of rotation; 48 bit, 6.1e-5 and 0.0081
+ * * degrees.
+ * *
+ * * Octahedral unit vectors project onto the octahedron
+ * * |x| + |y| + |z| = 1, fold the lower half over the
+ * * upper, and store the two coordinates as snorm8
+ * * (16 bit) or snorm16 (32 bit). Decoding normalizes,
+ * * and the zero vector decodes as +z. Worst case angle
+ * * over the same run: 16 bit, 0.96 degrees; 32 bit,
+ * * 0.0038 degrees.
+ * *
+ * * Half floats round to nearest even and keep
+ * * subnormals, infinities and NaNs, so a decoded value
+ * * is within 2^-11 relative of the input when it is in
+ * * the normal half range (about 6.1e-5 to 65504).
+ * * Scalar and SSE2 convert in software, AVX2 with F16C;
+ * * they agree on every input except NaN payloads. The
+ * * harness checks every level against exact rounding.
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+#define QUANT_SQRT1_2           0.707106781186547524f
+#define QUANT_SQRT2             1.41421356237309505f
+
+/* bits per stored component */
+#define QUANT_Q32_BITS          10
+#define QUANT_Q48_BITS          15
+
+#define QUANT_QUAT_ENCODE       0
+#define QUANT_QUAT_DECODE       1
+#define QUANT_OCT_ENCODE        2
+#define QUANT_OCT_DECODE        3
+#define QUANT_HALF_ENCODE       4
+#define QUANT_HALF_DECODE       5
+
+static inline float _quant_bits_float(int32_t u)
+{
+        union { int32_t u; float f; } b;
+
+        b.u = u;
+        return b.f;
+}
+
+static inline int32_t _quant_float_bits(float f)
+{
+        union { int32_t u; float f; } b;
+
+        b.f = f;
+        return b.u;
+}
+
+static inline uint32_t _quant_pack32(int* f)
+{
+        return (uint32_t)f[0] << 30 | (uint32_t)f[1] << 20 | (uint32_t)f[2] << 10 | (uint32_t)f[3];
+}
+
+static inline void _quant_unpack32(uint32_t v, int* f)
+{
+        f[0] = v >> 30;
+        f[1] = (v >> 20) & 0x3ff;
+        f[2] = (v >> 10) & 0x3ff;
+        f[3] = v & 0x3ff;
+}
+
+/* 2 + 3 * 15 bits over three words, low word first */
+static inline void _quant_pack48(int* f, uint16_t* m)
+{
+        m[0] = (f[3] | f[2] << 15) & 0xffff;
+        m[1] = (f[2] >> 1 | f[1] << 14) & 0xffff;
+        m[2] = f[1] >> 2 | f[0] << 13;
+}
+
+static inline void _quant_unpack48(uint16_t* m, int* f)
+{
+        f[0] = m[2] >> 13;
+        f[1] = m[1] >> 14 | (m[2] & 0x1fff) << 2;
+        f[2] = m[0] >> 15 | (m[1] & 0x3fff) << 1;
+        f[3] = m[0] & 0x7fff;
+}
+
+/* f[0] is the dropped index, f[1..3] the kept fields */
+static void _quant_quat_encode(float* q, int bits, int* f)
+{
+        int j;
+        int k;
+        float m;
+        float v;
+        float a[4];
+        float t[3];
+        float maxq;
+
+        maxq = (float)((1 << bits) - 2);
+        for(j = 0; j < 4; j++) {
+                a[j] = fabsf(q[j]);
+        }
+        m = fmaxf(fmaxf(a[0], a[1]), fmaxf(a[2], a[3]));
+        k = a[0] == m ? 0 : a[1] == m ? 1 : a[2] == m ? 2 : 3;
+
+        t[0] = k == 0 ? q[1] : q[0];
+        t[1] = k <= 1 ? q[2] : q[1];
+        t[2] = k <= 2 ? q[3] : q[2];
+        f[0] = k;
+        for(j = 0; j < 3; j++) {
+                v = signbit(q[k]) ? -t[j] : t[j];
+                v = v * (maxq * QUANT_SQRT1_2) + maxq * 0.5f;
+                v = v < 0.0f ? 0.0f : v;
+                v = v > maxq ? maxq : v;
+                f[j + 1] = (int)(v + 0.5f);
+        }
+}
+
+static void _quant_quat_decode(int* f, int bits, float* q)
+{
+        int j;
+        float d;
+        float a[3];
+        float maxq;
+
+        maxq = (float)((1 << bits) - 2);
+        for(j = 0; j < 3; j++) {
+                a[j] = ((float)f[j + 1] - maxq * 0.5f) * (QUANT_SQRT2 / maxq);
+        }
+        d = 1.0f - a[0] * a[0] - a[1] * a[1] - a[2] * a[2];
+        d = sqrtf(d < 0.0f ? 0.0f : d);
+
+        q[0] = f[0] == 0 ? d : a[0];
+        q[1] = f[0] == 0 ? a[0] : f[0] == 1 ? d : a[1];
+        q[2] = f[0] <= 1 ? a[1] : f[0] == 2 ? d : a[2];
+        q[3] = f[0] == 3 ? d : a[2];
+}
+
+static void _quant_oct_encode(float* v, float maxs, int* qx, int* qy)
+{
+        float s;
+        float px;
+        float py;
+        float t;
+
+        s = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+        s = s == 0.0f ? 1.0f : s;
+        px = v[0] / s;
+        py = v[1] / s;
+        if(v[2] < 0.0f) {
+                t = px;
+                px = copysignf(1.0f - fabsf(py), t);
+                py = copysignf(1.0f - fabsf(t), py);
+        }
+
+        t = px * maxs;
+        *qx = (int)(t + copysignf(0.5f, t));
+        t = py * maxs;
+        *qy = (int)(t + copysignf(0.5f, t));
+}
+
+static void _quant_oct_decode(int qx, int qy, float maxs, float* v)
+{
+        float t;
+        float len;
+
+        v[0] = (float)qx / maxs;
+        v[1] = (float)qy / maxs;
+        v[2] = 1.0f - fabsf(v[0]) - fabsf(v[1]);
+        t = v[2] < 0.0f ? -v[2] : 0.0f;
+        v[0] = v[0] - copysignf(t, v[0]);
+        v[1] = v[1] - copysignf(t, v[1]);
+
+        len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        v[0] = v[0] / len;
+        v[1] = v[1] / len;
+        v[2] = v[2] / len;
+}
+
+/**
+ * Round to nearest even by letting the FPU do it:
+ * subnormal results by adding a magic number whose
+ * ulp is the half subnormal step, normal ones with the
+ * rounding bias on the bits.
+ */
+static uint16_t _quant_half_from_float(float f)
+{
+        int32_t u;
+        int32_t o;
+        int32_t sign;
+
+        u = _quant_float_bits(f);
+        sign = u & ~0x7fffffff;
+        u ^= sign;
+
+        if(u >= (127 + 16) << 23) {
+                o = u > 0x7f800000 ? 0x7e00 : 0x7c00;
+        } else if(u < (127 - 14) << 23) {
+                o = _quant_float_bits(_quant_bits_float(u) + 0.5f) - (126 << 23);
+        } else {
+                o = (u - ((127 - 15) << 23) + 0xfff + ((u >> 13) & 1)) >> 13;
+        }
+        return (uint16_t)(o | (uint32_t)sign >> 16);
+}
+
+static float _quant_float_from_half(uint16_t h)
+{
+        int32_t o;
+        int32_t e;
+        float f;
+
+        o = (h & 0x7fff) << 13;
+        e = o & (0x7c00 << 13);
+        o += (127 - 15) << 23;
+        if(e == 0x7c00 << 13) {
+                o += (128 - 16) << 23;
+        } else if(e == 0) {
+                o += 1 << 23;
+                f = _quant_bits_float(o) - 6.103515625e-05f;
+                o = _quant_float_bits(f);
+        }
+        return _quant_bits_float(o | (h & 0x8000) << 16);
+}
+
+void _quat_encode_array_scalar(quat* src, void* dest, int bits, size_t count)
+{
+        int f[4];
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                if(bits == 32) {
+                        _quant_quat_encode(src[i].m, QUANT_Q32_BITS, f);
+                        ((uint32_t*)dest)[i] = _quant_pack32(f);
+                } else {
+                        _quant_quat_encode(src[i].m, QUANT_Q48_BITS, f);
+                        _quant_pack48(f, ((quat48*)dest)[i].m);
+                }
+        }
+}
+
+void _quat_decode_array_scalar(void* src, quat* dest, int bits, size_t count)
+{
+        int f[4];
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                if(bits == 32) {
+                        _quant_unpack32(((uint32_t*)src)[i], f);
+                        _quant_quat_decode(f, QUANT_Q32_BITS, dest[i].m);
+                } else {
+                        _quant_unpack48(((quat48*)src)[i].m, f);
+                        _quant_quat_decode(f, QUANT_Q48_BITS, dest[i].m);
+                }
+        }
+}
+
+void _oct_encode_array_scalar(vec3f* src, void* dest, int bits, size_t count)
+{
+        int qx;
+        int qy;
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                if(bits == 16) {
+                        _quant_oct_encode(src[i].m, 127.0f, &qx, &qy);
+                        ((uint16_t*)dest)[i] = (qx & 0xff) | (qy & 0xff) << 8;
+                } else {
+                        _quant_oct_encode(src[i].m, 32767.0f, &qx, &qy);
+                        ((uint32_t*)dest)[i] = (qx & 0xffff) | (uint32_t)qy << 16;
+                }
+        }
+}
+
+void _oct_decode_array_scalar(void* src, vec3f* dest, int bits, size_t count)
+{
+        size_t i;
+        uint16_t h;
+        uint32_t w;
+
+        for(i = 0; i < count; i++) {
+                if(bits == 16) {
+                        h = ((uint16_t*)src)[i];
+                        _quant_oct_decode((int8_t)(h & 0xff), (int8_t)(h >> 8), 127.0f, dest[i].m);
+                } else {
+                        w = ((uint32_t*)src)[i];
+                        _quant_oct_decode((int16_t)(w & 0xffff), (int16_t)(w >> 16), 32767.0f, dest[i].m);
+                }
+        }
+}
+
+void _half_from_float_array_scalar(float* src, uint16_t* dest, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                dest[i] = _quant_half_from_float(src[i]);
+        }
+}
+
+void _float_from_half_array_scalar(uint16_t* src, float* dest, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                dest[i] = _quant_float_from_half(src[i]);
+        }
+}
+
+typedef struct {
+        int     op;
+        int     bits;
+        void*   src;
+        void*   dest;
+} _quant_job;
+
+/* bytes per element of each packed format */
+static size_t _quant_size(int op, int bits)
+{
+        switch(op) {
+        case QUANT_QUAT_ENCODE:
+        case QUANT_QUAT_DECODE:
+                return bits == 32 ? sizeof(uint32_t) : sizeof(quat48);
+        case QUANT_OCT_ENCODE:
+        case QUANT_OCT_DECODE:
+                return bits == 16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        }
+        return sizeof(uint16_t);
+}
+
+static void _quant_range(void* ctx, size_t begin, size_t end)
+{
+        size_t n;
+        size_t size;
+        _quant_job* job;
+        unsigned char* packed;
+
+        job = ctx;
+        n = end - begin;
+        size = _quant_size(job->op, job->bits);
+
+        switch(job->op) {
+        case QUANT_QUAT_ENCODE:
+                packed = (unsigned char*)job->dest + begin * size;
+                _cgmath_kern.quat_encode_array((quat*)job->src + begin, packed, job->bits, n);
+                break;
+        case QUANT_QUAT_DECODE:
+                packed = (unsigned char*)job->src + begin * size;
+                _cgmath_kern.quat_decode_array(packed, (quat*)job->dest + begin, job->bits, n);
+                break;
+        case QUANT_OCT_ENCODE:
+                packed = (unsigned char*)job->dest + begin * size;
+                _cgmath_kern.oct_encode_array((vec3f*)job->src + begin, packed, job->bits, n);
+                break;
+        case QUANT_OCT_DECODE:
+                packed = (unsigned char*)job->src + begin * size;
+                _cgmath_kern.oct_decode_array(packed, (vec3f*)job->dest + begin, job->bits, n);
+                break;
+        case QUANT_HALF_ENCODE:
+                _cgmath_kern.half_from_float_array((float*)job->src + begin,
+                                (uint16_t*)job->dest + begin, n);
+                break;
+        case QUANT_HALF_DECODE:
+                _cgmath_kern.float_from_half_array((uint16_t*)job->src + begin,
+                                (float*)job->dest + begin, n);
+                break;
+        }
+}
+
+static void _quant_run(int op, int bits, void* src, void* dest, size_t count)
+{
+        _quant_job job;
+
+        job.op = op;
+        job.bits = bits;
+        job.src = src;
+        job.dest = dest;
+        _cgmath_parallel_for(count, CGMATH_BATCH_GRAIN, _quant_range, &job);
+}
+
+void quat_encode32_array(quat* src, uint32_t* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(quat_encode32_array, count);
+        _quant_run(QUANT_QUAT_ENCODE, 32, src, dest, count);
+}
+
+void quat_decode32_array(uint32_t* src, quat* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(quat_decode32_array, count);
+        _quant_run(QUANT_QUAT_DECODE, 32, src, dest, count);
+}
+
+void quat_encode48_array(quat* src, quat48* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(quat_encode48_array, count);
+        _quant_run(QUANT_QUAT_ENCODE, 48, src, dest, count);
+}
+
+void quat_decode48_array(quat48* src, quat* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(quat_decode48_array, count);
+        _quant_run(QUANT_QUAT_DECODE, 48, src, dest, count);
+}
+
+void vec3f_encode_oct16_array(vec3f* src, uint16_t* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_encode_oct16_array, count);
+        _quant_run(QUANT_OCT_ENCODE, 16, src, dest, count);
+}
+
+void vec3f_decode_oct16_array(uint16_t* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_decode_oct16_array, count);
+        _quant_run(QUANT_OCT_DECODE, 16, src, dest, count);
+}
+
+void vec3f_encode_oct32_array(vec3f* src, uint32_t* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_encode_oct32_array, count);
+        _quant_run(QUANT_OCT_ENCODE, 32, src, dest, count);
+}
+
+void vec3f_decode_oct32_array(uint32_t* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_decode_oct32_array, count);
+        _quant_run(QUANT_OCT_DECODE, 32, src, dest, count);
+}
+
+void vec3f_to_half_array(vec3f* src, vec3h* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_to_half_array, count);
+        _quant_run(QUANT_HALF_ENCODE, 0, src, dest, 3 * count);
+}
+
+void vec3f_from_half_array(vec3h* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_from_half_array, count);
+        _quant_run(QUANT_HALF_DECODE, 0, src, dest, 3 * count);
+}
+
+void vec4f_to_half_array(vec4f* src, vec4h* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec4f_to_half_array, count);
+        _quant_run(QUANT_HALF_ENCODE, 0, src, dest, 4 * count);
+}
+
+void vec4f_from_half_array(vec4h* src, vec4f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec4f_from_half_array, count);
+        _quant_run(QUANT_HALF_DECODE, 0, src, dest, 4 * count);
+}
+
+
+#if defined(CGMATH_X86)
+
+typedef int32_t _quant_v4si __attribute__((vector_size(16)));
+typedef int32_t _quant_v8si __attribute__((vector_size(32)));
+
+/* m ? a : b lane by lane, m being a comparison result */
+#define QUANT_SEL(VI, V, m, a, b) ((V)(((VI)(a) & (m)) | ((VI)(b) & ~(m))))
+#define QUANT_ABS(VI, V, a)       ((V)((VI)(a) & 0x7fffffff))
+#define QUANT_SIGN(VI, a)         ((VI)(a) & ~0x7fffffff)
+
+/**
+ * The lane versions of the scalar helpers above, over
+ * GCC vectors of floats V and int32 VI. SQRT is the
+ * per ISA square root.
+ */
+#define QUANT_QUAT_ENCODE_LANES(NAME, TARGET, V, VI) \
+TARGET static inline void NAME(V* q, int bits, VI* f) \
+{ \
+        int j; \
+        V m; \
+        V v; \
+        V a[4]; \
+        V t[3]; \
+        V l; \
+        VI k; \
+        VI s; \
+        float maxq; \
+\
+        maxq = (float)((1 << bits) - 2); \
+        for(j = 0; j < 4; j++) { \
+                a[j] = QUANT_ABS(VI, V, q[j]); \
+        } \
+        m = QUANT_SEL(VI, V, a[0] < a[1], a[1], a[0]); \
+        v = QUANT_SEL(VI, V, a[2] < a[3], a[3], a[2]); \
+        m = QUANT_SEL(VI, V, m < v, v, m); \
+\
+        k = (VI){} + 3; \
+        k = QUANT_SEL(VI, VI, a[2] == m, (VI){} + 2, k); \
+        k = QUANT_SEL(VI, VI, a[1] == m, (VI){} + 1, k); \
+        k = QUANT_SEL(VI, VI, a[0] == m, (VI){}, k); \
+        l = QUANT_SEL(VI, V, k == 2, q[2], q[3]); \
+        l = QUANT_SEL(VI, V, k == 1, q[1], l); \
+        l = QUANT_SEL(VI, V, k == 0, q[0], l); \
+        s = QUANT_SIGN(VI, l); \
+\
+        t[0] = QUANT_SEL(VI, V, k == 0, q[1], q[0]); \
+        t[1] = QUANT_SEL(VI, V, k <= 1, q[2], q[1]); \
+        t[2] = QUANT_SEL(VI, V, k <= 2, q[3], q[2]); \
+        f[0] = k; \
+        for(j = 0; j < 3; j++) { \
+                v = (V)((VI)t[j] ^ s); \
+                v = v * (maxq * QUANT_SQRT1_2) + maxq * 0.5f; \
+                v = QUANT_SEL(VI, V, v < 0.0f, (V){}, v); \
+                v = QUANT_SEL(VI, V, v > maxq, (V){} + maxq, v); \
+                f[j + 1] = __builtin_convertvector(v + 0.5f, VI); \
+        } \
+}
+
+#define QUANT_QUAT_DECODE_LANES(NAME, TARGET, V, VI, SQRT) \
+TARGET static inline void NAME(VI* f, int bits, V* q) \
+{ \
+        int j; \
+        V d; \
+        V a[3]; \
+        float maxq; \
+\
+        maxq = (float)((1 << bits) - 2); \
+        for(j = 0; j < 3; j++) { \
+                a[j] = (__builtin_convertvector(f[j + 1], V) - maxq * 0.5f) * (QUANT_SQRT2 / maxq); \
+        } \
+        d = 1.0f - a[0] * a[0] - a[1] * a[1] - a[2] * a[2]; \
+        d = SQRT(QUANT_SEL(VI, V, d < 0.0f, (V){}, d)); \
+\
+        q[0] = QUANT_SEL(VI, V, f[0] == 0, d, a[0]); \
+        q[1] = QUANT_SEL(VI, V, f[0] == 0, a[0], QUANT_SEL(VI, V, f[0] == 1, d, a[1])); \
+        q[2] = QUANT_SEL(VI, V, f[0] <= 1, a[1], QUANT_SEL(VI, V, f[0] == 2, d, a[2])); \
+        q[3] = QUANT_SEL(VI, V, f[0] == 3, d, a[2]); \
+}
+
+#define QUANT_OCT_ENCODE_LANES(NAME, TARGET, V, VI) \
+TARGET static inline void NAME(V* v, float maxs, VI* qx, VI* qy) \
+{ \
+        V s; \
+        V px; \
+        V py; \
+        V fx; \
+        V fy; \
+        V t; \
+        VI neg; \
+\
+        s = QUANT_ABS(VI, V, v[0]) + QUANT_ABS(VI, V, v[1]) + QUANT_ABS(VI, V, v[2]); \
+        s = QUANT_SEL(VI, V, s == 0.0f, (V){} + 1.0f, s); \
+        px = v[0] / s; \
+        py = v[1] / s; \
+        fx = (V)((VI)(1.0f - QUANT_ABS(VI, V, py)) | QUANT_SIGN(VI, px)); \
+        fy = (V)((VI)(1.0f - QUANT_ABS(VI, V, px)) | QUANT_SIGN(VI, py)); \
+        neg = v[2] < 0.0f; \
+        px = QUANT_SEL(VI, V, neg, fx, px); \
+        py = QUANT_SEL(VI, V, neg, fy, py); \
+\
+        t = px * maxs; \
+        *qx = __builtin_convertvector(t + (V)(QUANT_SIGN(VI, t) | _quant_float_bits(0.5f)), VI); \
+        t = py * maxs; \
+        *qy = __builtin_convertvector(t + (V)(QUANT_SIGN(VI, t) | _quant_float_bits(0.5f)), VI); \
+}
+
+#define QUANT_OCT_DECODE_LANES(NAME, TARGET, V, VI, SQRT) \
+TARGET static inline void NAME(VI qx, VI qy, float maxs, V* v) \
+{ \
+        V t; \
+        V len; \
+\
+        v[0] = __builtin_convertvector(qx, V) / maxs; \
+        v[1] = __builtin_convertvector(qy, V) / maxs; \
+        v[2] = 1.0f - QUANT_ABS(VI, V, v[0]) - QUANT_ABS(VI, V, v[1]); \
+        t = QUANT_SEL(VI, V, v[2] < 0.0f, -v[2], (V){}); \
+        v[0] = v[0] - (V)((VI)t | QUANT_SIGN(VI, v[0])); \
+        v[1] = v[1] - (V)((VI)t | QUANT_SIGN(VI, v[1])); \
+\
+        len = SQRT(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]); \
+        v[0] = v[0] / len; \
+        v[1] = v[1] / len; \
+        v[2] = v[2] / len; \
+}
+
+/* the low 16 bits of each lane hold the half */
+#define QUANT_HALF_FROM_FLOAT_LANES(NAME, TARGET, V, VI) \
+TARGET static inline VI NAME(V f) \
+{ \
+        VI u; \
+        VI o; \
+        VI sign; \
+        VI big; \
+        VI sub; \
+        VI norm; \
+\
+        u = (VI)f; \
+        sign = QUANT_SIGN(VI, u); \
+        u ^= sign; \
+        big = QUANT_SEL(VI, VI, u > 0x7f800000, (VI){} + 0x7e00, (VI){} + 0x7c00); \
+        sub = (VI)((V)u + 0.5f) - (126 << 23); \
+        norm = (u - ((127 - 15) << 23) + 0xfff + ((u >> 13) & 1)) >> 13; \
+        o = QUANT_SEL(VI, VI, u < (127 - 14) << 23, sub, norm); \
+        o = QUANT_SEL(VI, VI, u >= (127 + 16) << 23, big, o); \
+        return o | ((sign >> 16) & 0x8000); \
+}
+
+#define QUANT_FLOAT_FROM_HALF_LANES(NAME, TARGET, V, VI) \
+TARGET static inline V NAME(VI h) \
+{ \
+        VI o; \
+        VI e; \
+        VI zero; \
+        V f; \
+\
+        o = (h & 0x7fff) << 13; \
+        e = o & (0x7c00 << 13); \
+        o += (127 - 15) << 23; \
+        o += (e == 0x7c00 << 13) & ((128 - 16) << 23); \
+        zero = e == 0; \
+        o += zero & (1 << 23); \
+        f = QUANT_SEL(VI, V, zero, (V)o - 6.103515625e-05f, (V)o); \
+        return (V)((VI)f | (h & 0x8000) << 16); \
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _quant_sqrt_sse2(__m128 x)
+{
+        return _mm_sqrt_ps(x);
+}
+
+QUANT_QUAT_ENCODE_LANES(_quant_quat_encode_sse2, CGMATH_TARGET_SSE2, __m128, _quant_v4si)
+QUANT_QUAT_DECODE_LANES(_quant_quat_decode_sse2, CGMATH_TARGET_SSE2, __m128, _quant_v4si, _quant_sqrt_sse2)
+QUANT_OCT_ENCODE_LANES(_quant_oct_encode_sse2, CGMATH_TARGET_SSE2, __m128, _quant_v4si)
+QUANT_OCT_DECODE_LANES(_quant_oct_decode_sse2, CGMATH_TARGET_SSE2, __m128, _quant_v4si, _quant_sqrt_sse2)
+QUANT_HALF_FROM_FLOAT_LANES(_quant_half_from_float_sse2, CGMATH_TARGET_SSE2, __m128, _quant_v4si)
+QUANT_FLOAT_FROM_HALF_LANES(_quant_float_from_half_sse2, CGMATH_TARGET_SSE2, __m128, _quant_v4si)
+
+/* four lanes holding 16 bit values to four uint16_t */
+CGMATH_TARGET_SSE2
+static inline void _quant_store16_sse2(uint16_t* dest, _quant_v4si v)
+{
+        __m128i s;
+
+        s = _mm_srai_epi32(_mm_slli_epi32((__m128i)v, 16), 16);
+        _mm_storel_epi64((__m128i*)dest, _mm_packs_epi32(s, s));
+}
+
+CGMATH_TARGET_SSE2
+static inline _quant_v4si _quant_load16_sse2(uint16_t* src)
+{
+        return (_quant_v4si)_mm_unpacklo_epi16(_mm_loadl_epi64((__m128i*)src), _mm_setzero_si128());
+}
+
+CGMATH_TARGET_SSE2
+void _quat_encode_array_sse2(quat* src, void* dest, int bits, size_t count)
+{
+        int j;
+        int k;
+        int w[4];
+        size_t i;
+        __m128 q[4];
+        _quant_v4si f[4];
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                for(k = 0; k < 4; k++) {
+                        q[k] = _mm_loadu_ps(src[i + k].m);
+                }
+                _MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+                if(bits == 32) {
+                        _quant_quat_encode_sse2(q, QUANT_Q32_BITS, f);
+                        _mm_storeu_si128((__m128i*)((uint32_t*)dest + i),
+                                        (__m128i)(f[0] << 30 | f[1] << 20 | f[2] << 10 | f[3]));
+                        continue;
+                }
+                _quant_quat_encode_sse2(q, QUANT_Q48_BITS, f);
+                for(j = 0; j < 4; j++) {
+                        for(k = 0; k < 4; k++) {
+                                w[k] = f[k][j];
+                        }
+                        _quant_pack48(w, ((quat48*)dest)[i + j].m);
+                }
+        }
+        if(bits == 32) {
+                _quat_encode_array_scalar(src + i, (uint32_t*)dest + i, bits, count - i);
+        } else {
+                _quat_encode_array_scalar(src + i, (quat48*)dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _quat_decode_array_sse2(void* src, quat* dest, int bits, size_t count)
+{
+        int j;
+        int k;
+        int w[4];
+        size_t i;
+        __m128 q[4];
+        _quant_v4si v;
+        _quant_v4si f[4];
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                if(bits == 32) {
+                        v = (_quant_v4si)_mm_loadu_si128((__m128i*)((uint32_t*)src + i));
+                        f[0] = (v >> 30) & 3;
+                        f[1] = (v >> 20) & 0x3ff;
+                        f[2] = (v >> 10) & 0x3ff;
+                        f[3] = v & 0x3ff;
+                        _quant_quat_decode_sse2(f, QUANT_Q32_BITS, q);
+                } else {
+                        for(j = 0; j < 4; j++) {
+                                _quant_unpack48(((quat48*)src)[i + j].m, w);
+                                for(k = 0; k < 4; k++) {
+                                        f[k][j] = w[k];
+                                }
+                        }
+                        _quant_quat_decode_sse2(f, QUANT_Q48_BITS, q);
+                }
+                _MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+                for(k = 0; k < 4; k++) {
+                        _mm_storeu_ps(dest[i + k].m, q[k]);
+                }
+        }
+        if(bits == 32) {
+                _quat_decode_array_scalar((uint32_t*)src + i, dest + i, bits, count - i);
+        } else {
+                _quat_decode_array_scalar((quat48*)src + i, dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _oct_encode_array_sse2(vec3f* src, void* dest, int bits, size_t count)
+{
+        size_t i;
+        __m128 v[3];
+        _quant_v4si qx;
+        _quant_v4si qy;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                _cgmath_load3x4_sse2(src[i].m, &v[0], &v[1], &v[2]);
+                if(bits == 16) {
+                        _quant_oct_encode_sse2(v, 127.0f, &qx, &qy);
+                        _quant_store16_sse2((uint16_t*)dest + i, (qx & 0xff) | (qy & 0xff) << 8);
+                } else {
+                        _quant_oct_encode_sse2(v, 32767.0f, &qx, &qy);
+                        _mm_storeu_si128((__m128i*)((uint32_t*)dest + i), (__m128i)((qx & 0xffff) | qy << 16));
+                }
+        }
+        if(bits == 16) {
+                _oct_encode_array_scalar(src + i, (uint16_t*)dest + i, bits, count - i);
+        } else {
+                _oct_encode_array_scalar(src + i, (uint32_t*)dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _oct_decode_array_sse2(void* src, vec3f* dest, int bits, size_t count)
+{
+        size_t i;
+        __m128 v[3];
+        _quant_v4si w;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                if(bits == 16) {
+                        w = _quant_load16_sse2((uint16_t*)src + i);
+                        _quant_oct_decode_sse2((w << 24) >> 24, (w << 16) >> 24, 127.0f, v);
+                } else {
+                        w = (_quant_v4si)_mm_loadu_si128((__m128i*)((uint32_t*)src + i));
+                        _quant_oct_decode_sse2((w << 16) >> 16, w >> 16, 32767.0f, v);
+                }
+                _cgmath_store3x4_sse2(dest[i].m, v[0], v[1], v[2]);
+        }
+        if(bits == 16) {
+                _oct_decode_array_scalar((uint16_t*)src + i, dest + i, bits, count - i);
+        } else {
+                _oct_decode_array_scalar((uint32_t*)src + i, dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _half_from_float_array_sse2(float* src, uint16_t* dest, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                _quant_store16_sse2(dest + i, _quant_half_from_float_sse2(_mm_loadu_ps(src + i)));
+        }
+        _half_from_float_array_scalar(src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_SSE2
+void _float_from_half_array_sse2(uint16_t* src, float* dest, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i + 4 <= count; i += 4) {
+                _mm_storeu_ps(dest + i, _quant_float_from_half_sse2(_quant_load16_sse2(src + i)));
+        }
+        _float_from_half_array_scalar(src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _quant_sqrt_avx2(__m256 x)
+{
+        return _mm256_sqrt_ps(x);
+}
+
+QUANT_QUAT_ENCODE_LANES(_quant_quat_encode_avx2, CGMATH_TARGET_AVX2, __m256, _quant_v8si)
+QUANT_QUAT_DECODE_LANES(_quant_quat_decode_avx2, CGMATH_TARGET_AVX2, __m256, _quant_v8si, _quant_sqrt_avx2)
+QUANT_OCT_ENCODE_LANES(_quant_oct_encode_avx2, CGMATH_TARGET_AVX2, __m256, _quant_v8si)
+QUANT_OCT_DECODE_LANES(_quant_oct_decode_avx2, CGMATH_TARGET_AVX2, __m256, _quant_v8si, _quant_sqrt_avx2)
+
+/**
+ * Quats i and i + 4 share a register, so one in-lane
+ * 4x4 transpose turns eight quats into x, y, z, w and
+ * back.
+ */
+CGMATH_TARGET_AVX2
+static inline void _quant_transpose4_avx2(__m256* r)
+{
+        __m256 t[4];
+
+        t[0] = _mm256_unpacklo_ps(r[0], r[1]);
+        t[1] = _mm256_unpackhi_ps(r[0], r[1]);
+        t[2] = _mm256_unpacklo_ps(r[2], r[3]);
+        t[3] = _mm256_unpackhi_ps(r[2], r[3]);
+        r[0] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(1, 0, 1, 0));
+        r[1] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(3, 2, 3, 2));
+        r[2] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(1, 0, 1, 0));
+        r[3] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+CGMATH_TARGET_AVX2
+static inline void _quant_store16_avx2(uint16_t* dest, _quant_v8si v)
+{
+        __m256i s;
+
+        s = _mm256_srai_epi32(_mm256_slli_epi32((__m256i)v, 16), 16);
+        _mm_storeu_si128((__m128i*)dest, _mm_packs_epi32(_mm256_castsi256_si128(s),
+                        _mm256_extracti128_si256(s, 1)));
+}
+
+CGMATH_TARGET_AVX2
+void _quat_encode_array_avx2(quat* src, void* dest, int bits, size_t count)
+{
+        int j;
+        int k;
+        int w[4];
+        size_t i;
+        __m256 q[4];
+        _quant_v8si f[4];
+        _quant_v8si v;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(k = 0; k < 4; k++) {
+                        q[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src[i + k].m)),
+                                        _mm_loadu_ps(src[i + k + 4].m), 1);
+                }
+                _quant_transpose4_avx2(q);
+                if(bits == 32) {
+                        _quant_quat_encode_avx2(q, QUANT_Q32_BITS, f);
+                        v = f[0] << 30 | f[1] << 20 | f[2] << 10 | f[3];
+                        _mm256_storeu_si256((__m256i*)((uint32_t*)dest + i), (__m256i)v);
+                        continue;
+                }
+                _quant_quat_encode_avx2(q, QUANT_Q48_BITS, f);
+                for(j = 0; j < 8; j++) {
+                        for(k = 0; k < 4; k++) {
+                                w[k] = f[k][j];
+                        }
+                        _quant_pack48(w, ((quat48*)dest)[i + j].m);
+                }
+        }
+        if(bits == 32) {
+                _quat_encode_array_sse2(src + i, (uint32_t*)dest + i, bits, count - i);
+        } else {
+                _quat_encode_array_sse2(src + i, (quat48*)dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _quat_decode_array_avx2(void* src, quat* dest, int bits, size_t count)
+{
+        int j;
+        int k;
+        int w[4];
+        size_t i;
+        __m256 q[4];
+        _quant_v8si v;
+        _quant_v8si f[4];
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                if(bits == 32) {
+                        v = (_quant_v8si)_mm256_loadu_si256((__m256i*)((uint32_t*)src + i));
+                        f[0] = (v >> 30) & 3;
+                        f[1] = (v >> 20) & 0x3ff;
+                        f[2] = (v >> 10) & 0x3ff;
+                        f[3] = v & 0x3ff;
+                        _quant_quat_decode_avx2(f, QUANT_Q32_BITS, q);
+                } else {
+                        for(j = 0; j < 8; j++) {
+                                _quant_unpack48(((quat48*)src)[i + j].m, w);
+                                for(k = 0; k < 4; k++) {
+                                        f[k][j] = w[k];
+                                }
+                        }
+                        _quant_quat_decode_avx2(f, QUANT_Q48_BITS, q);
+                }
+                _quant_transpose4_avx2(q);
+                for(k = 0; k < 4; k++) {
+                        _mm_storeu_ps(dest[i + k].m, _mm256_castps256_ps128(q[k]));
+                        _mm_storeu_ps(dest[i + k + 4].m, _mm256_extractf128_ps(q[k], 1));
+                }
+        }
+        if(bits == 32) {
+                _quat_decode_array_sse2((uint32_t*)src + i, dest + i, bits, count - i);
+        } else {
+                _quat_decode_array_sse2((quat48*)src + i, dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _oct_encode_array_avx2(vec3f* src, void* dest, int bits, size_t count)
+{
+        size_t i;
+        __m256 v[3];
+        _quant_v8si qx;
+        _quant_v8si qy;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                _cgmath_load3x8_avx2(src + i, v);
+                if(bits == 16) {
+                        _quant_oct_encode_avx2(v, 127.0f, &qx, &qy);
+                        _quant_store16_avx2((uint16_t*)dest + i, (qx & 0xff) | (qy & 0xff) << 8);
+                } else {
+                        _quant_oct_encode_avx2(v, 32767.0f, &qx, &qy);
+                        _mm256_storeu_si256((__m256i*)((uint32_t*)dest + i), (__m256i)((qx & 0xffff) | qy << 16));
+                }
+        }
+        if(bits == 16) {
+                _oct_encode_array_sse2(src + i, (uint16_t*)dest + i, bits, count - i);
+        } else {
+                _oct_encode_array_sse2(src + i, (uint32_t*)dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _oct_decode_array_avx2(void* src, vec3f* dest, int bits, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 v[3];
+        _quant_v8si w;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                if(bits == 16) {
+                        w = (_quant_v8si)_mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)((uint16_t*)src + i)));
+                        _quant_oct_decode_avx2((w << 24) >> 24, (w << 16) >> 24, 127.0f, v);
+                } else {
+                        w = (_quant_v8si)_mm256_loadu_si256((__m256i*)((uint32_t*)src + i));
+                        _quant_oct_decode_avx2((w << 16) >> 16, w >> 16, 32767.0f, v);
+                }
+                _cgmath_store3x4_sse2(dest[i].m, _mm256_castps256_ps128(v[0]),
+                                _mm256_castps256_ps128(v[1]), _mm256_castps256_ps128(v[2]));
+                for(k = 0; k < 3; k++) {
+                        v[k] = _mm256_permute2f128_ps(v[k], v[k], 0x01);
+                }
+                _cgmath_store3x4_sse2(dest[i + 4].m, _mm256_castps256_ps128(v[0]),
+                                _mm256_castps256_ps128(v[1]), _mm256_castps256_ps128(v[2]));
+        }
+        if(bits == 16) {
+                _oct_decode_array_sse2((uint16_t*)src + i, dest + i, bits, count - i);
+        } else {
+                _oct_decode_array_sse2((uint32_t*)src + i, dest + i, bits, count - i);
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _half_from_float_array_avx2(float* src, uint16_t* dest, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                _mm_storeu_si128((__m128i*)(dest + i),
+                                _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+        _half_from_float_array_sse2(src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _float_from_half_array_avx2(uint16_t* src, float* dest, size_t count)
+{
+        size_t i;
+
+        for(i = 0; i + 8 <= count; i += 8) {
+                _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(_mm_loadu_si128((__m128i*)(src + i))));
+        }
+        _float_from_half_array_sse2(src + i, dest + i, count - i);
+}
+
+#endif
@@ -0,0 +1,1000 @@
+/**
+ * File: raster.c
+ * Description:
+ * * Depth-only software rasterizer for occlusion culling.
+ * * Occluder triangles are transformed, clipped by
+ * * vec4f_clip_triangles() and set up as three edge
+ * * functions and a depth plane in pixel space; back
+ * * faces and triangles that cover no pixel center are
+ * * dropped there. The setup is sorted into
+ * * RASTER_BIN x RASTER_BIN pixel bins and the bins are
+ * * rasterized in parallel, one thread each, so no
+ * * pixel is shared between threads. The SIMD kernel
+ * * walks the span of each row a tile row at a time and
+ * * keeps the nearest depth, which does not depend on
+ * * the order of the triangles in a bin, so neither
+ * * does the output.
+ * *
+ * * Depth is stored in 8 x 8 tiles of 64 floats, with
+ * * hiz holding the farthest depth of each tile. A box
+ * * is tested by projecting its corners with a second
+ * * kernel: its screen rectangle and nearest depth are
+ * * compared against hiz, and only tiles that do not
+ * * hide it on their own are read pixel by pixel.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+#define RASTER_ALIGN    64
+
+/* bin size in pixels, a multiple of the tile size */
+#define RASTER_BIN      32
+
+#define RASTER_TILE     8
+
+/* triangles per transform task and boxes per test chunk */
+#define RASTER_GRAIN    4096
+#define RASTER_CHUNK    256
+
+/**
+ * Screen triangle: three edge functions e = a x + b y + c
+ * that are not negative inside, the depth plane in the
+ * same form, and the inclusive pixel box x0 y0 x1 y1.
+ * One cache line each.
+ */
+typedef struct {
+        float           e[12];
+        int             box[4];
+} _raster_tri;
+
+typedef struct {
+        depth_buffer*   db;
+        mat4f*          mat;
+        vec3f*          pos;
+        size_t          vertices;
+        unsigned int*   indices;
+        vec4f*          clip;
+        vec4f*          screen;
+        _raster_tri*    tris;
+        unsigned int*   refs;
+        aabb*           boxes;
+        unsigned char*  visible;
+        size_t          count;
+} _raster_job;
+
+static size_t _raster_round(size_t n)
+{
+        return (n + RASTER_ALIGN - 1) & ~(size_t)(RASTER_ALIGN - 1);
+}
+
+/* the reciprocals of the x slopes of the edges, for _raster_span() */
+static inline void _raster_inverse(float* t, float* inv)
+{
+        int k;
+
+        for(k = 0; k < 3; k++) {
+                inv[k] = t[3 * k] != 0.0f ? -1.0f / t[3 * k] : 0.0f;
+        }
+}
+
+/**
+ * The pixels x0 <= x <= x1 of row yc whose centers may
+ * be inside all three edges, widened by a pixel against
+ * rounding. Returns 0 if there are none.
+ */
+static inline int _raster_span(float* t, float* inv, float yc, int x0, int x1, int* l, int* r)
+{
+        int k;
+        float a;
+        float v;
+        float lo;
+        float hi;
+
+        lo = (float)x0;
+        hi = (float)x1;
+        for(k = 0; k < 3; k++) {
+                a = t[3 * k];
+                v = t[3 * k + 1] * yc + t[3 * k + 2];
+                if(a > 0.0f) {
+                        v = v * inv[k] - 1.5f;
+                        lo = v > lo ? v : lo;
+                } else if(a < 0.0f) {
+                        v = v * inv[k] + 0.5f;
+                        hi = v < hi ? v : hi;
+                } else if(v < 0.0f) {
+                        return 0;
+                }
+        }
+        if(!(lo <= hi)) {
+                return 0;
+        }
+        *l = (int)ceilf(lo);
+        *r = (int)floorf(hi);
+        return *l <= *r;
+}
+
+/* the depth of pixel row y in tile column 0 */
+static inline float* _raster_row(float* depth, int tiles_x, int y)
+{
+        return depth + ((size_t)(y >> 3) * tiles_x * 64 + (y & 7) * 8);
+}
+
+void _raster_tri_scalar(float* depth, int tiles_x, float* t, int x0, int y0, int x1, int y1)
+{
+        int x;
+        int y;
+        int l;
+        int r;
+        float xc;
+        float yc;
+        float inv[3];
+        float z;
+        float* row;
+        float* p;
+
+        _raster_inverse(t, inv);
+        for(y = y0; y <= y1; y++) {
+                yc = (float)y + 0.5f;
+                if(!_raster_span(t, inv, yc, x0, x1, &l, &r)) {
+                        continue;
+                }
+                row = _raster_row(depth, tiles_x, y);
+                for(x = l; x <= r; x++) {
+                        xc = (float)x + 0.5f;
+                        if(t[0] * xc + t[1] * yc + t[2] >= 0.0f &&
+                                        t[3] * xc + t[4] * yc + t[5] >= 0.0f &&
+                                        t[6] * xc + t[7] * yc + t[8] >= 0.0f) {
+                                z = t[9] * xc + t[10] * yc + t[11];
+                                p = row + (x >> 3) * 64 + (x & 7);
+                                *p = z < *p ? z : *p;
+                        }
+                }
+        }
+}
+
+/* clip space corner c of box, with bit 0 selecting max x, 1 max y and 2 max z, and its outcode */
+static inline int _raster_corner(mat4f* mat, aabb* box, int c, float* p)
+{
+        int k;
+        float q[3];
+
+        q[0] = (c & 1) ? box->max.m[VEC_X] : box->min.m[VEC_X];
+        q[1] = (c & 2) ? box->max.m[VEC_Y] : box->min.m[VEC_Y];
+        q[2] = (c & 4) ? box->max.m[VEC_Z] : box->min.m[VEC_Z];
+        for(k = 0; k < 4; k++) {
+                p[k] = mat->m[k][0] * q[0] + mat->m[k][1] * q[1] + mat->m[k][2] * q[2] + mat->m[k][3];
+        }
+        return (!(p[0] >= -p[3])) | ((!(p[0] <= p[3])) << 1) |
+                ((!(p[1] >= -p[3])) << 2) | ((!(p[1] <= p[3])) << 3) |
+                ((!(p[2] >= -p[3])) << 4) | ((!(p[2] <= p[3])) << 5);
+}
+
+/**
+ * Projects the eight corners of each box and writes its
+ * normalized device rectangle x0 y0 x1 y1 and nearest z,
+ * or z = +inf if all corners are outside one plane, or
+ * the whole screen at z = -1 if a corner is in front of
+ * the near plane. NaN counts as outside every plane, as
+ * in clip.c.
+ */
+void _raster_boxes_scalar(mat4f* mat, aabb* boxes, float* dest, size_t count)
+{
+        int c;
+        int k;
+        int all;
+        int any;
+        int code;
+        size_t i;
+        float p[8][4];
+        float r;
+        float* b;
+
+        for(i = 0; i < count; i++) {
+                b = dest + 5 * i;
+                all = 0x3F;
+                any = 0;
+                for(c = 0; c < 8; c++) {
+                        code = _raster_corner(mat, boxes + i, c, p[c]);
+                        all &= code;
+                        any |= code;
+                }
+                if(any & 16) {
+                        b[0] = b[1] = b[4] = -1.0f;
+                        b[2] = b[3] = 1.0f;
+                } else {
+                        b[0] = b[1] = b[4] = FLT_MAX;
+                        b[2] = b[3] = -FLT_MAX;
+                        for(c = 0; c < 8; c++) {
+                                r = 1.0f / p[c][3];
+                                for(k = 0; k < 2; k++) {
+                                        b[k] = fminf(b[k], p[c][k] * r);
+                                        b[k + 2] = fmaxf(b[k + 2], p[c][k] * r);
+                                }
+                                b[4] = fminf(b[4], p[c][2] * r);
+                        }
+                }
+                if(all) {
+                        b[4] = INFINITY;
+                }
+        }
+}
+
+#if defined(CGMATH_X86)
+CGMATH_TARGET_SSE2
+void _raster_tri_sse2(float* depth, int tiles_x, float* t, int x0, int y0, int x1, int y1)
+{
+        int y;
+        int l;
+        int r;
+        int xb;
+        float yc;
+        float inv[3];
+        float* row;
+        float* p;
+        __m128 a[4];
+        __m128 c[4];
+        __m128 xs;
+        __m128 m;
+        __m128 z;
+        __m128 d;
+        __m128 zero;
+
+        zero = _mm_setzero_ps();
+        for(l = 0; l < 4; l++) {
+                a[l] = _mm_set1_ps(t[3 * l]);
+        }
+        _raster_inverse(t, inv);
+        for(y = y0; y <= y1; y++) {
+                yc = (float)y + 0.5f;
+                if(!_raster_span(t, inv, yc, x0, x1, &l, &r)) {
+                        continue;
+                }
+                for(xb = 0; xb < 4; xb++) {
+                        c[xb] = _mm_set1_ps(t[3 * xb + 1] * yc + t[3 * xb + 2]);
+                }
+                row = _raster_row(depth, tiles_x, y);
+                for(xb = l & ~3; xb <= r; xb += 4) {
+                        xs = _mm_add_ps(_mm_set1_ps((float)xb), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+                        m = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], xs), c[0]), zero);
+                        m = _mm_and_ps(m, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], xs), c[1]), zero));
+                        m = _mm_and_ps(m, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], xs), c[2]), zero));
+                        if(_mm_movemask_ps(m) == 0) {
+                                continue;
+                        }
+                        z = _mm_add_ps(_mm_mul_ps(a[3], xs), c[3]);
+                        p = row + (xb >> 3) * 64 + (xb & 4);
+                        d = _mm_load_ps(p);
+                        z = _mm_and_ps(m, _mm_min_ps(z, d));
+                        _mm_store_ps(p, _mm_or_ps(z, _mm_andnot_ps(m, d)));
+                }
+        }
+}
+
+/* the minimum and the maximum of the lanes of a */
+CGMATH_TARGET_SSE2
+static inline float _raster_hmin_sse2(__m128 a)
+{
+        a = _mm_min_ps(a, _mm_movehl_ps(a, a));
+        a = _mm_min_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(a);
+}
+
+CGMATH_TARGET_SSE2
+static inline float _raster_hmax_sse2(__m128 a)
+{
+        a = _mm_max_ps(a, _mm_movehl_ps(a, a));
+        a = _mm_max_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(a);
+}
+
+/**
+ * Outcodes of the four corners in c as six four bit
+ * masks, plane k in bits 4k .. 4k + 3.
+ */
+CGMATH_TARGET_SSE2
+static inline int _raster_codes_sse2(__m128* c)
+{
+        __m128 n;
+
+        n = _mm_sub_ps(_mm_setzero_ps(), c[3]);
+        return _mm_movemask_ps(_mm_cmpnge_ps(c[0], n)) |
+                _mm_movemask_ps(_mm_cmpnle_ps(c[0], c[3])) << 4 |
+                _mm_movemask_ps(_mm_cmpnge_ps(c[1], n)) << 8 |
+                _mm_movemask_ps(_mm_cmpnle_ps(c[1], c[3])) << 12 |
+                _mm_movemask_ps(_mm_cmpnge_ps(c[2], n)) << 16 |
+                _mm_movemask_ps(_mm_cmpnle_ps(c[2], c[3])) << 20;
+}
+
+/* the corners with z at min in lo and at max in hi */
+CGMATH_TARGET_SSE2
+void _raster_boxes_sse2(mat4f* mat, aabb* boxes, float* dest, size_t count)
+{
+        int k;
+        int lc;
+        int hc;
+        size_t i;
+        float* b;
+        __m128 x;
+        __m128 y;
+        __m128 z;
+        __m128 r;
+        __m128 lo[4];
+        __m128 hi[4];
+
+        for(i = 0; i < count; i++) {
+                b = dest + 5 * i;
+                x = _mm_setr_ps(boxes[i].min.m[VEC_X], boxes[i].max.m[VEC_X],
+                                boxes[i].min.m[VEC_X], boxes[i].max.m[VEC_X]);
+                y = _mm_setr_ps(boxes[i].min.m[VEC_Y], boxes[i].min.m[VEC_Y],
+                                boxes[i].max.m[VEC_Y], boxes[i].max.m[VEC_Y]);
+                for(k = 0; k < 4; k++) {
+                        z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mat->m[k][0]), x),
+                                        _mm_mul_ps(_mm_set1_ps(mat->m[k][1]), y));
+                        z = _mm_add_ps(z, _mm_set1_ps(mat->m[k][3]));
+                        lo[k] = _mm_add_ps(z, _mm_set1_ps(mat->m[k][2] * boxes[i].min.m[VEC_Z]));
+                        hi[k] = _mm_add_ps(z, _mm_set1_ps(mat->m[k][2] * boxes[i].max.m[VEC_Z]));
+                }
+                lc = _raster_codes_sse2(lo);
+                hc = _raster_codes_sse2(hi);
+                if((lc | hc) & 0xF0000) {
+                        b[0] = b[1] = b[4] = -1.0f;
+                        b[2] = b[3] = 1.0f;
+                } else {
+                        r = _mm_div_ps(_mm_set1_ps(1.0f), lo[3]);
+                        z = _mm_div_ps(_mm_set1_ps(1.0f), hi[3]);
+                        for(k = 0; k < 3; k++) {
+                                lo[k] = _mm_mul_ps(lo[k], r);
+                                hi[k] = _mm_mul_ps(hi[k], z);
+                        }
+                        b[0] = _raster_hmin_sse2(_mm_min_ps(lo[0], hi[0]));
+                        b[1] = _raster_hmin_sse2(_mm_min_ps(lo[1], hi[1]));
+                        b[2] = _raster_hmax_sse2(_mm_max_ps(lo[0], hi[0]));
+                        b[3] = _raster_hmax_sse2(_mm_max_ps(lo[1], hi[1]));
+                        b[4] = _raster_hmin_sse2(_mm_min_ps(lo[2], hi[2]));
+                }
+                lc &= hc;
+                for(k = 0; k < 24; k += 4) {
+                        if(((lc >> k) & 0xF) == 0xF) {
+                                b[4] = INFINITY;
+                        }
+                }
+        }
+}
+
+CGMATH_TARGET_AVX2
+void _raster_tri_avx2(float* depth, int tiles_x, float* t, int x0, int y0, int x1, int y1)
+{
+        int y;
+        int l;
+        int r;
+        int xb;
+        float yc;
+        float inv[3];
+        float* row;
+        float* p;
+        __m256 a[4];
+        __m256 c[4];
+        __m256 lane;
+        __m256 xs;
+        __m256 m;
+        __m256 z;
+        __m256 d;
+        __m256 zero;
+
+        zero = _mm256_setzero_ps();
+        lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        for(l = 0; l < 4; l++) {
+                a[l] = _mm256_set1_ps(t[3 * l]);
+        }
+        _raster_inverse(t, inv);
+        for(y = y0; y <= y1; y++) {
+                yc = (float)y + 0.5f;
+                if(!_raster_span(t, inv, yc, x0, x1, &l, &r)) {
+                        continue;
+                }
+                for(xb = 0; xb < 4; xb++) {
+                        c[xb] = _mm256_set1_ps(t[3 * xb + 1] * yc + t[3 * xb + 2]);
+                }
+                row = _raster_row(depth, tiles_x, y);
+                for(xb = l & ~7; xb <= r; xb += 8) {
+                        xs = _mm256_add_ps(_mm256_set1_ps((float)xb), lane);
+                        m = _mm256_cmp_ps(_mm256_fmadd_ps(a[0], xs, c[0]), zero, _CMP_GE_OQ);
+                        m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_fmadd_ps(a[1], xs, c[1]),
+                                                zero, _CMP_GE_OQ));
+                        m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_fmadd_ps(a[2], xs, c[2]),
+                                                zero, _CMP_GE_OQ));
+                        if(_mm256_movemask_ps(m) == 0) {
+                                continue;
+                        }
+                        z = _mm256_fmadd_ps(a[3], xs, c[3]);
+                        p = row + (xb >> 3) * 64;
+                        d = _mm256_load_ps(p);
+                        _mm256_store_ps(p, _mm256_blendv_ps(d, _mm256_min_ps(z, d), m));
+                }
+        }
+}
+
+CGMATH_TARGET_AVX2
+static inline float _raster_hmin_avx2(__m256 a)
+{
+        return _raster_hmin_sse2(_mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+
+CGMATH_TARGET_AVX2
+static inline float _raster_hmax_avx2(__m256 a)
+{
+        return _raster_hmax_sse2(_mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+
+/* corner c in lane c, with bit 0 selecting max x, 1 max y and 2 max z */
+CGMATH_TARGET_AVX2
+void _raster_boxes_avx2(mat4f* mat, aabb* boxes, float* dest, size_t count)
+{
+        int k;
+        size_t i;
+        float* b;
+        __m256 m[16];
+        __m256 p[3];
+        __m256 c[4];
+        __m256 n;
+        __m256 r;
+
+        for(k = 0; k < 16; k++) {
+                m[k] = _mm256_set1_ps(mat->m[k >> 2][k & 3]);
+        }
+        for(i = 0; i < count; i++) {
+                b = dest + 5 * i;
+                p[0] = _mm256_blend_ps(_mm256_set1_ps(boxes[i].min.m[VEC_X]),
+                                _mm256_set1_ps(boxes[i].max.m[VEC_X]), 0xAA);
+                p[1] = _mm256_blend_ps(_mm256_set1_ps(boxes[i].min.m[VEC_Y]),
+                                _mm256_set1_ps(boxes[i].max.m[VEC_Y]), 0xCC);
+                p[2] = _mm256_blend_ps(_mm256_set1_ps(boxes[i].min.m[VEC_Z]),
+                                _mm256_set1_ps(boxes[i].max.m[VEC_Z]), 0xF0);
+                for(k = 0; k < 4; k++) {
+                        c[k] = _mm256_fmadd_ps(m[4 * k], p[0], m[4 * k + 3]);
+                        c[k] = _mm256_fmadd_ps(m[4 * k + 1], p[1], c[k]);
+                        c[k] = _mm256_fmadd_ps(m[4 * k + 2], p[2], c[k]);
+                }
+                n = _mm256_sub_ps(_mm256_setzero_ps(), c[3]);
+                if(_mm256_movemask_ps(_mm256_cmp_ps(c[2], n, _CMP_NGE_UQ)) != 0) {
+                        b[0] = b[1] = b[4] = -1.0f;
+                        b[2] = b[3] = 1.0f;
+                } else {
+                        r = _mm256_div_ps(_mm256_set1_ps(1.0f), c[3]);
+                        for(k = 0; k < 3; k++) {
+                                p[k] = _mm256_mul_ps(c[k], r);
+                        }
+                        b[0] = _raster_hmin_avx2(p[0]);
+                        b[1] = _raster_hmin_avx2(p[1]);
+                        b[2] = _raster_hmax_avx2(p[0]);
+                        b[3] = _raster_hmax_avx2(p[1]);
+                        b[4] = _raster_hmin_avx2(p[2]);
+                }
+                if(_mm256_movemask_ps(_mm256_cmp_ps(c[0], n, _CMP_NGE_UQ)) == 0xFF ||
+                                _mm256_movemask_ps(_mm256_cmp_ps(c[0], c[3], _CMP_NLE_UQ)) == 0xFF ||
+                                _mm256_movemask_ps(_mm256_cmp_ps(c[1], n, _CMP_NGE_UQ)) == 0xFF ||
+                                _mm256_movemask_ps(_mm256_cmp_ps(c[1], c[3], _CMP_NLE_UQ)) == 0xFF ||
+                                _mm256_movemask_ps(_mm256_cmp_ps(c[2], n, _CMP_NGE_UQ)) == 0xFF ||
+                                _mm256_movemask_ps(_mm256_cmp_ps(c[2], c[3], _CMP_NLE_UQ)) == 0xFF) {
+                        b[4] = INFINITY;
+                }
+        }
+}
+#endif
+
+/**
+ * Allocates a width x height depth buffer, both
+ * multiples of 8, and clears it. Returns -1 if the size
+ * is not valid or allocation fails.
+ */
+int depth_buffer_init(depth_buffer* db, int width, int height)
+{
+        size_t depth;
+        size_t hiz;
+        size_t bins;
+        char* block;
+
+        memset(db, 0, sizeof(*db));
+        if(width <= 0 || height <= 0 || (width & 7) || (height & 7) ||
+                        (size_t)width * height > 0x7FFFFFFFu) {
+                return -1;
+        }
+        db->width = width;
+        db->height = height;
+        db->tiles_x = width / RASTER_TILE;
+        db->tiles_y = height / RASTER_TILE;
+        db->bins_x = (width + RASTER_BIN - 1) / RASTER_BIN;
+        db->bins_y = (height + RASTER_BIN - 1) / RASTER_BIN;
+
+        depth = _raster_round((size_t)width * height * sizeof(float));
+        hiz = _raster_round((size_t)db->tiles_x * db->tiles_y * sizeof(float));
+        bins = _raster_round((2 * (size_t)db->bins_x * db->bins_y + 1) * sizeof(unsigned int));
+        block = aligned_alloc(RASTER_ALIGN, depth + hiz + bins);
+        if(block == NULL) {
+                memset(db, 0, sizeof(*db));
+                return -1;
+        }
+        db->depth = (float*)block;
+        db->hiz = (float*)(block + depth);
+        db->bins = (unsigned int*)(block + depth + hiz);
+        depth_buffer_clear(db);
+        return 0;
+}
+
+void depth_buffer_free(depth_buffer* db)
+{
+        free(db->depth);
+        free(db->scratch);
+        memset(db, 0, sizeof(*db));
+}
+
+/* sets every pixel to the far plane */
+void depth_buffer_clear(depth_buffer* db)
+{
+        size_t i;
+        size_t n;
+
+        n = (size_t)db->width * db->height;
+        for(i = 0; i < n; i++) {
+                db->depth[i] = 1.0f;
+        }
+        n = (size_t)db->tiles_x * db->tiles_y;
+        for(i = 0; i < n; i++) {
+                db->hiz[i] = 1.0f;
+        }
+}
+
+/* depth at pixel x y, 0 at the near plane and 1 at the far plane */
+float depth_buffer_read(depth_buffer* db, int x, int y)
+{
+        return _raster_row(db->depth, db->tiles_x, y)[(x >> 3) * 64 + (x & 7)];
+}
+
+/**
+ * Grows the scratch block to size bytes, keeping its
+ * first keep bytes.
+ */
+static int _raster_reserve(depth_buffer* db, size_t size, size_t keep)
+{
+        char* block;
+
+        if(size <= db->scratch_size) {
+                return 0;
+        }
+        size = _raster_round(size + size / 4);
+        block = aligned_alloc(RASTER_ALIGN, size);
+        if(block == NULL) {
+                return -1;
+        }
+        if(keep > 0) {
+                memcpy(block, db->scratch, keep);
+        }
+        free(db->scratch);
+        db->scratch = block;
+        db->scratch_size = size;
+        return 0;
+}
+
+/* a triangle with an index out of range gets NaN corners, which the clipper drops */
+static void _raster_transform(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        int r;
+        size_t t;
+        unsigned int v;
+        float* p;
+        float* q;
+        _raster_job* job;
+
+        job = ctx;
+        for(t = begin; t < end; t++) {
+                for(k = 0; k < 3; k++) {
+                        v = job->indices[3 * t + k];
+                        q = job->clip[3 * t + k].m;
+                        if(v >= job->vertices) {
+                                q[0] = q[1] = q[2] = q[3] = NAN;
+                                continue;
+                        }
+                        p = job->pos[v].m;
+                        for(r = 0; r < 4; r++) {
+                                q[r] = job->mat->m[r][0] * p[0] + job->mat->m[r][1] * p[1] +
+                                        job->mat->m[r][2] * p[2] + job->mat->m[r][3];
+                        }
+                }
+        }
+}
+
+static inline int _raster_clamp(float f, int hi)
+{
+        return f <= 0.0f ? 0 : (f >= (float)hi ? hi : (int)f);
+}
+
+/**
+ * Edge functions and depth plane of each clipped
+ * triangle in pixel space, counter-clockwise triangles
+ * being front facing. Dropped triangles get an empty
+ * box.
+ */
+static void _raster_setup(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        int u;
+        int v;
+        int flip;
+        size_t t;
+        float hw;
+        float hh;
+        float x[3];
+        float y[3];
+        float z[3];
+        float minx;
+        float maxx;
+        float miny;
+        float maxy;
+        float area;
+        float* e;
+        _raster_tri* tri;
+        _raster_job* job;
+
+        job = ctx;
+        hw = 0.5f * (float)job->db->width;
+        hh = 0.5f * (float)job->db->height;
+        for(t = begin; t < end; t++) {
+                tri = job->tris + t;
+                tri->box[0] = 1;
+                tri->box[2] = 0;
+                for(k = 0; k < 3; k++) {
+                        x[k] = job->screen[3 * t + k].m[VEC_X] * hw + hw;
+                        y[k] = job->screen[3 * t + k].m[VEC_Y] * hh + hh;
+                        z[k] = job->screen[3 * t + k].m[VEC_Z] * 0.5f + 0.5f;
+                }
+                area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+                if(!(area > 0.0f && area <= FLT_MAX)) {
+                        continue;
+                }
+                minx = fminf(x[0], fminf(x[1], x[2]));
+                maxx = fmaxf(x[0], fmaxf(x[1], x[2]));
+                miny = fminf(y[0], fminf(y[1], y[2]));
+                maxy = fmaxf(y[0], fmaxf(y[1], y[2]));
+                tri->box[0] = _raster_clamp(ceilf(minx - 0.5f), job->db->width);
+                tri->box[1] = _raster_clamp(ceilf(miny - 0.5f), job->db->height);
+                tri->box[2] = _raster_clamp(floorf(maxx - 0.5f), job->db->width - 1);
+                tri->box[3] = _raster_clamp(floorf(maxy - 0.5f), job->db->height - 1);
+                if(maxx - 0.5f < 0.0f || maxy - 0.5f < 0.0f || tri->box[1] > tri->box[3]) {
+                        tri->box[0] = 1;
+                        tri->box[2] = 0;
+                        continue;
+                }
+
+                /*
+                 * An edge is set up from its lower end, and negated
+                 * if the triangle runs the other way, so the two
+                 * triangles sharing it evaluate exactly opposite
+                 * values and no pixel center falls between them.
+                 */
+                e = tri->e;
+                for(k = 0; k < 3; k++) {
+                        u = k;
+                        v = (k + 1) % 3;
+                        flip = y[v] < y[u] || (y[v] == y[u] && x[v] < x[u]);
+                        if(flip) {
+                                u = v;
+                                v = k;
+                        }
+                        e[3 * k] = y[u] - y[v];
+                        e[3 * k + 1] = x[v] - x[u];
+                        e[3 * k + 2] = -(e[3 * k] * x[u] + e[3 * k + 1] * y[u]);
+                        if(flip) {
+                                e[3 * k] = -e[3 * k];
+                                e[3 * k + 1] = -e[3 * k + 1];
+                                e[3 * k + 2] = -e[3 * k + 2];
+                        }
+                }
+                e[9] = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+                e[10] = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+                e[11] = z[0] - e[9] * x[0] - e[10] * y[0];
+        }
+}
+
+static void _raster_bin_count(void* ctx, size_t begin, size_t end)
+{
+        int bx;
+        int by;
+        size_t t;
+        int* box;
+        _raster_job* job;
+
+        job = ctx;
+        for(t = begin; t < end; t++) {
+                box = job->tris[t].box;
+                if(box[0] > box[2]) {
+                        continue;
+                }
+                for(by = box[1] / RASTER_BIN; by <= box[3] / RASTER_BIN; by++) {
+                        for(bx = box[0] / RASTER_BIN; bx <= box[2] / RASTER_BIN; bx++) {
+                                __atomic_fetch_add(&job->db->bins[by * job->db->bins_x + bx + 1],
+                                                1, __ATOMIC_RELAXED);
+                        }
+                }
+        }
+}
+
+/* cursors follow the bin starts in bins */
+static void _raster_bin_fill(void* ctx, size_t begin, size_t end)
+{
+        int bx;
+        int by;
+        size_t t;
+        unsigned int e;
+        unsigned int* cursor;
+        int* box;
+        _raster_job* job;
+
+        job = ctx;
+        cursor = job->db->bins + (size_t)job->db->bins_x * job->db->bins_y + 1;
+        for(t = begin; t < end; t++) {
+                box = job->tris[t].box;
+                if(box[0] > box[2]) {
+                        continue;
+                }
+                for(by = box[1] / RASTER_BIN; by <= box[3] / RASTER_BIN; by++) {
+                        for(bx = box[0] / RASTER_BIN; bx <= box[2] / RASTER_BIN; bx++) {
+                                e = __atomic_fetch_add(&cursor[by * job->db->bins_x + bx],
+                                                1, __ATOMIC_RELAXED);
+                                job->refs[e] = (unsigned int)t;
+                        }
+                }
+        }
+}
+
+/* rasterizes the triangles of each bin, then refreshes its tiles in hiz */
+static void _raster_bins(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+        int tx;
+        int ty;
+        size_t b;
+        unsigned int i;
+        float m;
+        float* p;
+        int* box;
+        depth_buffer* db;
+        _raster_job* job;
+
+        job = ctx;
+        db = job->db;
+        for(b = begin; b < end; b++) {
+                if(db->bins[b] == db->bins[b + 1]) {
+                        continue;
+                }
+                x0 = (int)(b % db->bins_x) * RASTER_BIN;
+                y0 = (int)(b / db->bins_x) * RASTER_BIN;
+                x1 = x0 + RASTER_BIN - 1 < db->width - 1 ? x0 + RASTER_BIN - 1 : db->width - 1;
+                y1 = y0 + RASTER_BIN - 1 < db->height - 1 ? y0 + RASTER_BIN - 1 : db->height - 1;
+                for(i = db->bins[b]; i < db->bins[b + 1]; i++) {
+                        box = job->tris[job->refs[i]].box;
+                        _cgmath_kern.raster_tri(db->depth, db->tiles_x, job->tris[job->refs[i]].e,
+                                        box[0] > x0 ? box[0] : x0, box[1] > y0 ? box[1] : y0,
+                                        box[2] < x1 ? box[2] : x1, box[3] < y1 ? box[3] : y1);
+                }
+                for(ty = y0 / RASTER_TILE; ty <= y1 / RASTER_TILE; ty++) {
+                        for(tx = x0 / RASTER_TILE; tx <= x1 / RASTER_TILE; tx++) {
+                                p = db->depth + ((size_t)ty * db->tiles_x + tx) * 64;
+                                m = p[0];
+                                for(k = 1; k < 64; k++) {
+                                        m = p[k] > m ? p[k] : m;
+                                }
+                                db->hiz[(size_t)ty * db->tiles_x + tx] = m;
+                        }
+                }
+        }
+}
+
+/**
+ * Renders triangles * 3 indices into pos as occluders,
+ * keeping the nearest depth. mat takes pos to clip space,
+ * so each mesh is drawn with its own view projection
+ * times model matrix. Counter-clockwise triangles face
+ * the viewer and the others are culled; a triangle
+ * with an index not below vertices is skipped. Scratch
+ * grows on demand and is kept for the next call.
+ * Returns -1 if scratch cannot be allocated.
+ */
+int depth_buffer_render(depth_buffer* db, mat4f* mat, vec3f* pos, size_t vertices,
+                unsigned int* indices, size_t triangles)
+{
+        CGMATH_PROFILE_SCOPE(depth_buffer_render, triangles);
+        size_t b;
+        size_t n;
+        size_t cap;
+        size_t clip;
+        size_t tris;
+        size_t bins;
+        unsigned int c;
+        unsigned int sum;
+        _raster_job job;
+
+        if(triangles == 0) {
+                return 0;
+        }
+        if(triangles >= 0xFFFFFFFFu / 16) {
+                return -1;
+        }
+
+        /* scratch is the clip space corners, the clipped triangles, their setup and the bin refs */
+        clip = _raster_round(3 * triangles * sizeof(vec4f));
+        cap = triangles + triangles / 8 + 16;
+        tris = clip + _raster_round(3 * cap * sizeof(vec4f));
+        if(_raster_reserve(db, tris + cap * sizeof(_raster_tri), 0) != 0) {
+                return -1;
+        }
+        job.db = db;
+        job.mat = mat;
+        job.pos = pos;
+        job.vertices = vertices;
+        job.indices = indices;
+        job.clip = (vec4f*)db->scratch;
+        _cgmath_parallel_for(triangles, RASTER_GRAIN, _raster_transform, &job);
+
+        n = vec4f_clip_triangles(job.clip, triangles, (vec4f*)((char*)db->scratch + clip), NULL, cap);
+        if(n > cap) {
+                cap = n;
+                tris = clip + _raster_round(3 * cap * sizeof(vec4f));
+                if(_raster_reserve(db, tris + cap * sizeof(_raster_tri), clip) != 0) {
+                        return -1;
+                }
+                job.clip = (vec4f*)db->scratch;
+                vec4f_clip_triangles(job.clip, triangles, (vec4f*)((char*)db->scratch + clip), NULL, cap);
+        }
+        if(n == 0) {
+                return 0;
+        }
+        job.screen = (vec4f*)((char*)db->scratch + clip);
+        job.tris = (_raster_tri*)((char*)db->scratch + tris);
+        _cgmath_parallel_for(n, RASTER_GRAIN, _raster_setup, &job);
+
+        bins = (size_t)db->bins_x * db->bins_y;
+        memset(db->bins, 0, (bins + 1) * sizeof(unsigned int));
+        _cgmath_parallel_for(n, RASTER_GRAIN, _raster_bin_count, &job);
+        sum = 0;
+        for(b = 0; b < bins; b++) {
+                c = db->bins[b + 1];
+                db->bins[b] = sum;
+                db->bins[bins + 1 + b] = sum;
+                sum += c;
+        }
+        db->bins[bins] = sum;
+
+        tris += cap * sizeof(_raster_tri);
+        if(_raster_reserve(db, tris + (size_t)sum * sizeof(unsigned int), tris) != 0) {
+                return -1;
+        }
+        job.tris = (_raster_tri*)((char*)db->scratch + tris - cap * sizeof(_raster_tri));
+        job.refs = (unsigned int*)((char*)db->scratch + tris);
+        _cgmath_parallel_for(n, RASTER_GRAIN, _raster_bin_fill, &job);
+        _cgmath_parallel_for(bins, 1, _raster_bins, &job);
+        return 0;
+}
+
+static inline int _raster_pixel(float f, int hi)
+{
+        f = floorf(f);
+        return f <= 0.0f ? 0 : (f >= (float)hi ? hi : (int)f);
+}
+
+/**
+ * Whether the box with projected rectangle r may be
+ * seen: some pixel it overlaps is not nearer than its
+ * nearest corner. Tiles whose farthest depth is nearer
+ * are skipped without reading their pixels.
+ */
+static int _raster_visible(depth_buffer* db, aabb* box, float* r)
+{
+        int k;
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+        int x;
+        int y;
+        int tx;
+        int ty;
+        float z;
+        float hw;
+        float hh;
+        float* row;
+
+        for(k = 0; k < 3; k++) {
+                if(box->min.m[k] > box->max.m[k]) {
+                        return 0;
+                }
+        }
+        if(!(r[4] <= 1.0f)) {
+                return 0;
+        }
+        hw = 0.5f * (float)db->width;
+        hh = 0.5f * (float)db->height;
+        x0 = _raster_pixel(r[0] * hw + hw, db->width - 1);
+        y0 = _raster_pixel(r[1] * hh + hh, db->height - 1);
+        x1 = _raster_pixel(r[2] * hw + hw, db->width - 1);
+        y1 = _raster_pixel(r[3] * hh + hh, db->height - 1);
+        z = r[4] * 0.5f + 0.5f;
+
+        for(ty = y0 >> 3; ty <= y1 >> 3; ty++) {
+                for(tx = x0 >> 3; tx <= x1 >> 3; tx++) {
+                        if(z > db->hiz[(size_t)ty * db->tiles_x + tx]) {
+                                continue;
+                        }
+                        for(y = ty * 8 > y0 ? ty * 8 : y0; y <= ty * 8 + 7 && y <= y1; y++) {
+                                row = _raster_row(db->depth, db->tiles_x, y) + tx * 64;
+                                for(x = tx * 8 > x0 ? tx * 8 : x0; x <= tx * 8 + 7 && x <= x1; x++) {
+                                        if(z <= row[x & 7]) {
+                                                return 1;
+                                        }
+                                }
+                        }
+                }
+        }
+        return 0;
+}
+
+static void _raster_test(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        size_t j;
+        size_t n;
+        size_t seen;
+        float rect[5 * RASTER_CHUNK];
+        _raster_job* job;
+
+        job = ctx;
+        seen = 0;
+        for(i = begin; i < end; i += n) {
+                n = end - i < RASTER_CHUNK ? end - i : RASTER_CHUNK;
+                _cgmath_kern.raster_boxes(job->mat, job->boxes + i, rect, n);
+                for(j = 0; j < n; j++) {
+                        job->visible[i + j] = (unsigned char)_raster_visible(job->db,
+                                        job->boxes + i + j, rect + 5 * j);
+                        seen += job->visible[i + j];
+                }
+        }
+        __atomic_fetch_add(&job->count, seen, __ATOMIC_RELAXED);
+}
+
+/**
+ * Sets visible[i] to 1 if box i may be seen through the
+ * occluders rendered so far and 0 if it is hidden behind
+ * them, empty, or outside the view volume; mat takes the
+ * boxes to clip space. The test is conservative for the
+ * rendered depth: a box crossing the near plane is
+ * visible, and one is hidden only if every pixel its
+ * screen rectangle overlaps is nearer than its nearest
+ * corner. Occluders are sampled at pixel centers, so a
+ * gap narrower than a pixel may not let a box through.
+ * Returns the number of visible boxes.
+ */
+size_t depth_buffer_test_aabb(depth_buffer* db, mat4f* mat, aabb* boxes, unsigned char* visible, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(depth_buffer_test_aabb, count);
+        _raster_job job;
+
+        job.db = db;
+        job.mat = mat;
+        job.boxes = boxes;
+        job.visible = visible;
+        job.count = 0;
+        _cgmath_parallel_for(count, RASTER_GRAIN, _raster_test, &job);
+        return job.count;
+}
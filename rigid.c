@@ -0,0 +1,308 @@
+/**
+ * File: rigid.c
+ * Description:
+ * * Semi-implicit Euler integration over SoA body
+ * * streams. Each step reads and writes every stream
+ * * once; groups of four (SSE2) or eight (AVX2) bodies
+ * * go through the same per-lane formulas as the scalar
+ * * path, and large body counts are split across the
+ * * worker pool.
+ */
+
+#include <math.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+/**
+ * One step for one body per lane. p, v, q and w are
+ * updated in place; a and aw hold the linear and
+ * angular accelerations. With h = dt / 2,
+ *   q' = q + h * (w, 0) * q
+ * which for q = (u, s) is (s * w + w x u, -w . u).
+ */
+#define RIGID_STEP_LANES(NAME, TARGET, V, RSQRT) \
+TARGET static inline void NAME(V* p, V* v, V* a, V* q, V* w, V* aw, V dt, V h) \
+{ \
+        V x; \
+        V y; \
+        V z; \
+        V s; \
+        V n; \
+ \
+        v[0] = v[0] + a[0] * dt; \
+        v[1] = v[1] + a[1] * dt; \
+        v[2] = v[2] + a[2] * dt; \
+        p[0] = p[0] + v[0] * dt; \
+        p[1] = p[1] + v[1] * dt; \
+        p[2] = p[2] + v[2] * dt; \
+ \
+        w[0] = w[0] + aw[0] * dt; \
+        w[1] = w[1] + aw[1] * dt; \
+        w[2] = w[2] + aw[2] * dt; \
+ \
+        x = q[0] + h * (q[3] * w[0] + w[1] * q[2] - w[2] * q[1]); \
+        y = q[1] + h * (q[3] * w[1] + w[2] * q[0] - w[0] * q[2]); \
+        z = q[2] + h * (q[3] * w[2] + w[0] * q[1] - w[1] * q[0]); \
+        s = q[3] - h * (w[0] * q[0] + w[1] * q[1] + w[2] * q[2]); \
+ \
+        n = RSQRT(x * x + y * y + z * z + s * s); \
+        q[0] = x * n; \
+        q[1] = y * n; \
+        q[2] = z * n; \
+        q[3] = s * n; \
+}
+
+/**
+ * The rotation of unit q and the translation p as the
+ * 16 elements of a row-major mat4f, one body per lane.
+ */
+#define RIGID_WORLD_LANES(NAME, TARGET, V) \
+TARGET static inline void NAME(V* p, V* q, V one, V zero, V* m) \
+{ \
+        V x2 = q[0] + q[0]; \
+        V y2 = q[1] + q[1]; \
+        V z2 = q[2] + q[2]; \
+ \
+        m[0] = one - (q[1] * y2 + q[2] * z2); \
+        m[1] = q[0] * y2 - q[3] * z2; \
+        m[2] = q[0] * z2 + q[3] * y2; \
+        m[3] = p[0]; \
+        m[4] = q[0] * y2 + q[3] * z2; \
+        m[5] = one - (q[0] * x2 + q[2] * z2); \
+        m[6] = q[1] * z2 - q[3] * x2; \
+        m[7] = p[1]; \
+        m[8] = q[0] * z2 - q[3] * y2; \
+        m[9] = q[1] * z2 + q[3] * x2; \
+        m[10] = one - (q[0] * x2 + q[1] * y2); \
+        m[11] = p[2]; \
+        m[12] = zero; \
+        m[13] = zero; \
+        m[14] = zero; \
+        m[15] = one; \
+}
+
+static inline float _rigid_rsqrt(float d)
+{
+        return d > 0.0f ? 1.0f / sqrtf(d) : 0.0f;
+}
+
+RIGID_STEP_LANES(_rigid_step_lanes, , float, _rigid_rsqrt)
+RIGID_WORLD_LANES(_rigid_world_lanes, , float)
+
+void _rigid_integrate_scalar(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                size_t begin, size_t end)
+{
+        int k;
+        size_t i;
+        float p[3];
+        float v[3];
+        float a[3];
+        float q[4];
+        float w[3];
+        float aw[3];
+        float m[16];
+
+        for(i = begin; i < end; i++) {
+                for(k = 0; k < 3; k++) {
+                        p[k] = b->position.m[k][i];
+                        v[k] = b->velocity.m[k][i];
+                        a[k] = gravity->m[k];
+                        if(b->accel.m[VEC_X] != NULL) {
+                                a[k] += b->accel.m[k][i];
+                        }
+                        w[k] = b->angular.m[k][i];
+                        aw[k] = b->angular_accel.m[VEC_X] != NULL ? b->angular_accel.m[k][i] : 0.0f;
+                }
+                for(k = 0; k < 4; k++) {
+                        q[k] = b->orientation.m[k][i];
+                }
+
+                _rigid_step_lanes(p, v, a, q, w, aw, dt, 0.5f * dt);
+
+                for(k = 0; k < 3; k++) {
+                        b->position.m[k][i] = p[k];
+                        b->velocity.m[k][i] = v[k];
+                        b->angular.m[k][i] = w[k];
+                }
+                for(k = 0; k < 4; k++) {
+                        b->orientation.m[k][i] = q[k];
+                }
+
+                if(world != NULL) {
+                        _rigid_world_lanes(p, q, 1.0f, 0.0f, m);
+                        for(k = 0; k < 16; k++) {
+                                world[i].m[k >> 2][k & 3] = m[k];
+                        }
+                }
+        }
+}
+
+typedef struct {
+        rigid_bodies*   bodies;
+        vec3f*          gravity;
+        float           dt;
+        mat4f*          world;
+} _rigid_job;
+
+static void _rigid_range(void* ctx, size_t begin, size_t end)
+{
+        _rigid_job* job;
+
+        job = ctx;
+        _cgmath_kern.rigid_integrate(job->bodies, job->gravity, job->dt, job->world, begin, end);
+}
+
+void rigid_integrate(rigid_bodies* bodies, vec3f* gravity, float dt, mat4f* world)
+{
+        CGMATH_PROFILE_SCOPE(rigid_integrate, bodies->count);
+        _rigid_job job;
+
+        job.bodies = bodies;
+        job.gravity = gravity;
+        job.dt = dt;
+        job.world = world;
+        _cgmath_parallel_for(bodies->count, CGMATH_BATCH_GRAIN, _rigid_range, &job);
+}
+
+
+#if defined(CGMATH_X86)
+
+RIGID_STEP_LANES(_rigid_step_lanes_sse2, CGMATH_TARGET_SSE2, __m128, _cgmath_rsqrt_sse2)
+RIGID_WORLD_LANES(_rigid_world_lanes_sse2, CGMATH_TARGET_SSE2, __m128)
+
+CGMATH_TARGET_SSE2
+void _rigid_integrate_sse2(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                size_t begin, size_t end)
+{
+        int k;
+        int r;
+        size_t i;
+        __m128 p[3];
+        __m128 v[3];
+        __m128 a[3];
+        __m128 q[4];
+        __m128 w[3];
+        __m128 aw[3];
+        __m128 m[16];
+        __m128 g[3];
+        __m128 vdt;
+        __m128 h;
+
+        for(k = 0; k < 3; k++) {
+                g[k] = _mm_set1_ps(gravity->m[k]);
+        }
+        vdt = _mm_set1_ps(dt);
+        h = _mm_set1_ps(0.5f * dt);
+
+        for(i = begin; i + 4 <= end; i += 4) {
+                for(k = 0; k < 3; k++) {
+                        p[k] = _mm_loadu_ps(b->position.m[k] + i);
+                        v[k] = _mm_loadu_ps(b->velocity.m[k] + i);
+                        a[k] = g[k];
+                        if(b->accel.m[VEC_X] != NULL) {
+                                a[k] = _mm_add_ps(a[k], _mm_loadu_ps(b->accel.m[k] + i));
+                        }
+                        w[k] = _mm_loadu_ps(b->angular.m[k] + i);
+                        aw[k] = b->angular_accel.m[VEC_X] != NULL ?
+                                _mm_loadu_ps(b->angular_accel.m[k] + i) : _mm_setzero_ps();
+                }
+                for(k = 0; k < 4; k++) {
+                        q[k] = _mm_loadu_ps(b->orientation.m[k] + i);
+                }
+
+                _rigid_step_lanes_sse2(p, v, a, q, w, aw, vdt, h);
+
+                for(k = 0; k < 3; k++) {
+                        _mm_storeu_ps(b->position.m[k] + i, p[k]);
+                        _mm_storeu_ps(b->velocity.m[k] + i, v[k]);
+                        _mm_storeu_ps(b->angular.m[k] + i, w[k]);
+                }
+                for(k = 0; k < 4; k++) {
+                        _mm_storeu_ps(b->orientation.m[k] + i, q[k]);
+                }
+
+                if(world != NULL) {
+                        _rigid_world_lanes_sse2(p, q, _mm_set1_ps(1.0f), _mm_setzero_ps(), m);
+                        for(r = 0; r < 4; r++) {
+                                _MM_TRANSPOSE4_PS(m[4 * r], m[4 * r + 1], m[4 * r + 2], m[4 * r + 3]);
+                                _mm_storeu_ps(world[i].m[r], m[4 * r]);
+                                _mm_storeu_ps(world[i + 1].m[r], m[4 * r + 1]);
+                                _mm_storeu_ps(world[i + 2].m[r], m[4 * r + 2]);
+                                _mm_storeu_ps(world[i + 3].m[r], m[4 * r + 3]);
+                        }
+                }
+        }
+        _rigid_integrate_scalar(b, gravity, dt, world, i, end);
+}
+
+RIGID_STEP_LANES(_rigid_step_lanes_avx2, CGMATH_TARGET_AVX2, __m256, _cgmath_rsqrt_avx2)
+RIGID_WORLD_LANES(_rigid_world_lanes_avx2, CGMATH_TARGET_AVX2, __m256)
+
+CGMATH_TARGET_AVX2
+void _rigid_integrate_avx2(rigid_bodies* b, vec3f* gravity, float dt, mat4f* world,
+                size_t begin, size_t end)
+{
+        int k;
+        int j;
+        size_t i;
+        __m256 p[3];
+        __m256 v[3];
+        __m256 a[3];
+        __m256 q[4];
+        __m256 w[3];
+        __m256 aw[3];
+        __m256 m[16];
+        __m256 g[3];
+        __m256 vdt;
+        __m256 h;
+
+        for(k = 0; k < 3; k++) {
+                g[k] = _mm256_set1_ps(gravity->m[k]);
+        }
+        vdt = _mm256_set1_ps(dt);
+        h = _mm256_set1_ps(0.5f * dt);
+
+        for(i = begin; i + 8 <= end; i += 8) {
+                for(k = 0; k < 3; k++) {
+                        p[k] = _mm256_loadu_ps(b->position.m[k] + i);
+                        v[k] = _mm256_loadu_ps(b->velocity.m[k] + i);
+                        a[k] = g[k];
+                        if(b->accel.m[VEC_X] != NULL) {
+                                a[k] = _mm256_add_ps(a[k], _mm256_loadu_ps(b->accel.m[k] + i));
+                        }
+                        w[k] = _mm256_loadu_ps(b->angular.m[k] + i);
+                        aw[k] = b->angular_accel.m[VEC_X] != NULL ?
+                                _mm256_loadu_ps(b->angular_accel.m[k] + i) : _mm256_setzero_ps();
+                }
+                for(k = 0; k < 4; k++) {
+                        q[k] = _mm256_loadu_ps(b->orientation.m[k] + i);
+                }
+
+                _rigid_step_lanes_avx2(p, v, a, q, w, aw, vdt, h);
+
+                for(k = 0; k < 3; k++) {
+                        _mm256_storeu_ps(b->position.m[k] + i, p[k]);
+                        _mm256_storeu_ps(b->velocity.m[k] + i, v[k]);
+                        _mm256_storeu_ps(b->angular.m[k] + i, w[k]);
+                }
+                for(k = 0; k < 4; k++) {
+                        _mm256_storeu_ps(b->orientation.m[k] + i, q[k]);
+                }
+
+                if(world != NULL) {
+                        _rigid_world_lanes_avx2(p, q, _mm256_set1_ps(1.0f), _mm256_setzero_ps(), m);
+                        for(j = 0; j < 2; j++) {
+                                _cgmath_transpose8_avx2(m + 8 * j);
+                                for(k = 0; k < 8; k++) {
+                                        _mm256_storeu_ps(world[i + k].m[2 * j], m[8 * j + k]);
+                                }
+                        }
+                }
+        }
+        _rigid_integrate_sse2(b, gravity, dt, world, i, end);
+}
+
+#endif
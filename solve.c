@@ -0,0 +1,838 @@
+/**
+ * File: solve.c
+ * Description:
+ * * Direct solves of mat * x = b for mat2f, mat3f and
+ * * mat4f, with x and b as columns, by LU with partial
+ * * pivoting or, for symmetric positive definite
+ * * matrices, by Cholesky. Nothing forms the inverse.
+ * *
+ * * The batch kernels solve one system per lane, four
+ * * (SSE2) or eight (AVX2) at a time. Pivot rows are
+ * * exchanged with selects instead of branches: each
+ * * row below the diagonal is compared with the current
+ * * pivot row and swapped in if its entry is strictly
+ * * larger in magnitude, so the pivot is always the
+ * * largest entry of its column, and the single matrix
+ * * factorizations make the same choice in the same
+ * * order. A system fails when an LU pivot is zero, a
+ * * Cholesky pivot is not positive, or the solution is
+ * * not finite.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
+
+/* systems per task for the array solves */
+#define SOLVE_ARRAY_GRAIN       4096
+
+/* systems staged into SoA form at a time */
+#define SOLVE_ARRAY_BLOCK       64
+
+/**
+ * LU and Cholesky solves of one n x n system per lane,
+ * written once for float, __m128 and __m256. a[n * r +
+ * c] holds element [r][c] and b the right hand side;
+ * both are destroyed and b receives the solution. The
+ * returned mask is set in the lanes that failed.
+ *
+ * _cholesky reads only the upper triangle of a and
+ * writes L, with a = L * L^T, over the lower triangle
+ * and the diagonal, so a can go straight on to
+ * _cholesky_solve.
+ */
+#define SOLVE_LANES(NAME, TARGET, V, M, ABS, GT, SEL, OR, NONPOS, NONFINITE, SQRT) \
+TARGET static inline M NAME##_finite(int n, V* b) \
+{ \
+        int k; \
+        V s; \
+ \
+        s = b[0] * 0.0f; \
+        for(k = 1; k < n; k++) { \
+                s = s + b[k] * 0.0f; \
+        } \
+        return NONFINITE(s); \
+} \
+ \
+TARGET static inline M NAME##_lu(int n, V* a, V* b) \
+{ \
+        int j; \
+        int k; \
+        int r; \
+        M m; \
+        V f; \
+        V t; \
+        V inv[4]; \
+ \
+        for(k = 0; k < n; k++) { \
+                for(r = k + 1; r < n; r++) { \
+                        m = GT(ABS(a[n * r + k]), ABS(a[n * k + k])); \
+                        for(j = k; j < n; j++) { \
+                                t = a[n * k + j]; \
+                                a[n * k + j] = SEL(m, a[n * r + j], t); \
+                                a[n * r + j] = SEL(m, t, a[n * r + j]); \
+                        } \
+                        t = b[k]; \
+                        b[k] = SEL(m, b[r], t); \
+                        b[r] = SEL(m, t, b[r]); \
+                } \
+                inv[k] = 1.0f / a[n * k + k]; \
+                for(r = k + 1; r < n; r++) { \
+                        f = a[n * r + k] / a[n * k + k]; \
+                        for(j = k + 1; j < n; j++) { \
+                                a[n * r + j] = a[n * r + j] - f * a[n * k + j]; \
+                        } \
+                        b[r] = b[r] - f * b[k]; \
+                } \
+        } \
+        for(k = n - 1; k >= 0; k--) { \
+                t = b[k]; \
+                for(j = k + 1; j < n; j++) { \
+                        t = t - a[n * k + j] * b[j]; \
+                } \
+                b[k] = t * inv[k]; \
+        } \
+        return NAME##_finite(n, b); \
+} \
+ \
+TARGET static inline M NAME##_cholesky(int n, V* a) \
+{ \
+        int i; \
+        int j; \
+        int k; \
+        M bad; \
+        V d; \
+        V t; \
+ \
+        bad = NONPOS(a[0]); \
+        for(k = 0; k < n; k++) { \
+                d = a[n * k + k]; \
+                for(i = 0; i < k; i++) { \
+                        d = d - a[n * k + i] * a[n * k + i]; \
+                } \
+                bad = OR(bad, NONPOS(d)); \
+                d = SQRT(d); \
+                a[n * k + k] = d; \
+                d = 1.0f / d; \
+                for(j = k + 1; j < n; j++) { \
+                        t = a[n * k + j]; \
+                        for(i = 0; i < k; i++) { \
+                                t = t - a[n * j + i] * a[n * k + i]; \
+                        } \
+                        a[n * j + k] = t * d; \
+                } \
+        } \
+        return bad; \
+} \
+ \
+TARGET static inline M NAME##_cholesky_solve(int n, V* a, V* b) \
+{ \
+        int j; \
+        int k; \
+        V t; \
+        V inv[4]; \
+ \
+        for(k = 0; k < n; k++) { \
+                inv[k] = 1.0f / a[n * k + k]; \
+                t = b[k]; \
+                for(j = 0; j < k; j++) { \
+                        t = t - a[n * k + j] * b[j]; \
+                } \
+                b[k] = t * inv[k]; \
+        } \
+        for(k = n - 1; k >= 0; k--) { \
+                t = b[k]; \
+                for(j = k + 1; j < n; j++) { \
+                        t = t - a[n * j + k] * b[j]; \
+                } \
+                b[k] = t * inv[k]; \
+        } \
+        return NAME##_finite(n, b); \
+} \
+ \
+TARGET static inline M NAME(int n, int spd, V* a, V* b) \
+{ \
+        M bad; \
+ \
+        if(!spd) { \
+                return NAME##_lu(n, a, b); \
+        } \
+        bad = NAME##_cholesky(n, a); \
+        return OR(bad, NAME##_cholesky_solve(n, a, b)); \
+}
+
+static inline int _solve_gt(float a, float b)
+{
+        return a > b;
+}
+
+static inline float _solve_sel(int m, float a, float b)
+{
+        return m ? a : b;
+}
+
+static inline int _solve_or(int a, int b)
+{
+        return a | b;
+}
+
+static inline int _solve_nonpos(float d)
+{
+        return !(d > 0.0f);
+}
+
+static inline int _solve_nonfinite(float s)
+{
+        return s != s;
+}
+
+SOLVE_LANES(_solve_lanes, , float, int, fabsf, _solve_gt, _solve_sel, _solve_or,
+                _solve_nonpos, _solve_nonfinite, sqrtf)
+
+static void _solve_offset(float** planes, float** dest, int count, size_t offset)
+{
+        int k;
+
+        for(k = 0; k < count; k++) {
+                dest[k] = planes[k] + offset;
+        }
+}
+
+size_t _mat_solve_soa_scalar(int n, int spd, float** a, float** b, float** x,
+                unsigned char* singular, size_t count)
+{
+        int k;
+        int flag;
+        size_t i;
+        size_t bad;
+        float va[16];
+        float vb[4];
+
+        bad = 0;
+        for(i = 0; i < count; i++) {
+                for(k = 0; k < n * n; k++) {
+                        va[k] = a[k][i];
+                }
+                for(k = 0; k < n; k++) {
+                        vb[k] = b[k][i];
+                }
+
+                flag = _solve_lanes(n, spd, va, vb);
+                for(k = 0; k < n; k++) {
+                        x[k][i] = flag ? 0.0f : vb[k];
+                }
+                bad += flag;
+                if(singular != NULL) {
+                        singular[i] = flag;
+                }
+        }
+        return bad;
+}
+
+/**
+ * The single matrix LU exchanges whole rows with a
+ * branch, but compares and eliminates in the same
+ * order as the lanes above.
+ */
+static inline int _solve_lu_factor(int n, float* mat, float* dest, int* perm)
+{
+        int j;
+        int k;
+        int r;
+        int p;
+        float a[16];
+        float f;
+        float t;
+
+        memcpy(a, mat, n * n * sizeof(float));
+        for(k = 0; k < n; k++) {
+                perm[k] = k;
+        }
+
+        for(k = 0; k < n; k++) {
+                for(r = k + 1; r < n; r++) {
+                        if(fabsf(a[n * r + k]) > fabsf(a[n * k + k])) {
+                                for(j = 0; j < n; j++) {
+                                        t = a[n * k + j];
+                                        a[n * k + j] = a[n * r + j];
+                                        a[n * r + j] = t;
+                                }
+                                p = perm[k];
+                                perm[k] = perm[r];
+                                perm[r] = p;
+                        }
+                }
+                if(!(fabsf(a[n * k + k]) > 0.0f)) {
+                        return -1;
+                }
+                for(r = k + 1; r < n; r++) {
+                        f = a[n * r + k] / a[n * k + k];
+                        for(j = k + 1; j < n; j++) {
+                                a[n * r + j] = a[n * r + j] - f * a[n * k + j];
+                        }
+                        a[n * r + k] = f;
+                }
+        }
+        memcpy(dest, a, n * n * sizeof(float));
+        return 0;
+}
+
+static inline void _solve_lu_apply(int n, float* lu, int* perm, float* b, float* x)
+{
+        int j;
+        int k;
+        float r[4];
+        float t;
+
+        for(k = 0; k < n; k++) {
+                r[k] = b[perm[k]];
+        }
+        for(k = 0; k < n; k++) {
+                for(j = k + 1; j < n; j++) {
+                        r[j] = r[j] - lu[n * j + k] * r[k];
+                }
+        }
+        for(k = n - 1; k >= 0; k--) {
+                t = r[k];
+                for(j = k + 1; j < n; j++) {
+                        t = t - lu[n * k + j] * r[j];
+                }
+                r[k] = t * (1.0f / lu[n * k + k]);
+        }
+        memcpy(x, r, n * sizeof(float));
+}
+
+static inline int _solve_cholesky_factor(int n, float* mat, float* dest)
+{
+        int j;
+        int k;
+        float a[16];
+
+        memcpy(a, mat, n * n * sizeof(float));
+        if(_solve_lanes_cholesky(n, a)) {
+                return -1;
+        }
+        for(k = 0; k < n; k++) {
+                for(j = k + 1; j < n; j++) {
+                        a[n * k + j] = 0.0f;
+                }
+                if(!(a[n * k + k] <= FLT_MAX)) {
+                        return -1;
+                }
+        }
+        memcpy(dest, a, n * n * sizeof(float));
+        return 0;
+}
+
+static inline void _solve_cholesky_apply(int n, float* l, float* b, float* x)
+{
+        float a[16];
+        float r[4];
+
+        memcpy(a, l, n * n * sizeof(float));
+        memcpy(r, b, n * sizeof(float));
+        _solve_lanes_cholesky_solve(n, a, r);
+        memcpy(x, r, n * sizeof(float));
+}
+
+/**
+ * Factoring and then solving gives the same bits as
+ * the batch kernels' scalar lanes.
+ */
+static inline int _solve_one(int n, int spd, float* mat, float* b, float* x)
+{
+        int perm[4];
+        float a[16];
+        float r[4];
+
+        if(spd) {
+                memcpy(a, mat, n * n * sizeof(float));
+                memcpy(r, b, n * sizeof(float));
+                if(_solve_lanes(n, 1, a, r)) {
+                        return -1;
+                }
+        } else {
+                if(_solve_lu_factor(n, mat, a, perm)) {
+                        return -1;
+                }
+                _solve_lu_apply(n, a, perm, b, r);
+                if(_solve_lanes_finite(n, r)) {
+                        return -1;
+                }
+        }
+        memcpy(x, r, n * sizeof(float));
+        return 0;
+}
+
+typedef struct {
+        int             n;
+        int             spd;
+        float*          mat;
+        float*          b;
+        float*          x;
+        unsigned char*  singular;
+        size_t          bad;
+} _solve_array_job;
+
+/**
+ * AoS systems are staged through a small SoA block on
+ * the stack, as in the mat3f array kernels. The copies
+ * are called with a constant n so they unroll.
+ */
+static inline void _solve_stage_in(int n, float* mat, float* b,
+                float (*in)[SOLVE_ARRAY_BLOCK], float (*rhs)[SOLVE_ARRAY_BLOCK], size_t count)
+{
+        int k;
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                for(k = 0; k < n * n; k++) {
+                        in[k][i] = mat[i * n * n + k];
+                }
+                for(k = 0; k < n; k++) {
+                        rhs[k][i] = b[i * n + k];
+                }
+        }
+}
+
+static inline void _solve_stage_out(int n, float (*out)[SOLVE_ARRAY_BLOCK], float* x, size_t count)
+{
+        int k;
+        size_t i;
+
+        for(i = 0; i < count; i++) {
+                for(k = 0; k < n; k++) {
+                        x[i * n + k] = out[k][i];
+                }
+        }
+}
+
+static void _solve_array_range(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        int n;
+        int nn;
+        size_t c;
+        size_t bad;
+        float* mat;
+        float* rb;
+        float* rx;
+        float in[16][SOLVE_ARRAY_BLOCK] __attribute__((aligned(64)));
+        float rhs[4][SOLVE_ARRAY_BLOCK] __attribute__((aligned(64)));
+        float out[4][SOLVE_ARRAY_BLOCK] __attribute__((aligned(64)));
+        float* a[16];
+        float* b[4];
+        float* x[4];
+        _solve_array_job* job;
+
+        job = ctx;
+        n = job->n;
+        nn = n * n;
+        for(k = 0; k < nn; k++) {
+                a[k] = in[k];
+        }
+        for(k = 0; k < n; k++) {
+                b[k] = rhs[k];
+                x[k] = out[k];
+        }
+
+        bad = 0;
+        for(; begin < end; begin += c) {
+                c = end - begin < SOLVE_ARRAY_BLOCK ? end - begin : SOLVE_ARRAY_BLOCK;
+                mat = job->mat + begin * nn;
+                rb = job->b + begin * n;
+                switch(n) {
+                case 2:
+                        _solve_stage_in(2, mat, rb, in, rhs, c);
+                        break;
+                case 3:
+                        _solve_stage_in(3, mat, rb, in, rhs, c);
+                        break;
+                default:
+                        _solve_stage_in(4, mat, rb, in, rhs, c);
+                        break;
+                }
+
+                bad += _cgmath_kern.mat_solve_soa(n, job->spd, a, b, x,
+                                job->singular != NULL ? job->singular + begin : NULL, c);
+
+                rx = job->x + begin * n;
+                switch(n) {
+                case 2:
+                        _solve_stage_out(2, out, rx, c);
+                        break;
+                case 3:
+                        _solve_stage_out(3, out, rx, c);
+                        break;
+                default:
+                        _solve_stage_out(4, out, rx, c);
+                        break;
+                }
+        }
+        __atomic_fetch_add(&job->bad, bad, __ATOMIC_RELAXED);
+}
+
+static size_t _solve_array(int n, int spd, float* mat, float* b, float* x,
+                unsigned char* singular, size_t count)
+{
+        _solve_array_job job;
+
+        job.n = n;
+        job.spd = spd;
+        job.mat = mat;
+        job.b = b;
+        job.x = x;
+        job.singular = singular;
+        job.bad = 0;
+        _cgmath_parallel_for(count, SOLVE_ARRAY_GRAIN, _solve_array_range, &job);
+        return job.bad;
+}
+
+/**
+ * mat*_lu() factors mat so that rows perm[0..n-1] of
+ * mat equal L * U, with the unit diagonal of L
+ * implied, and mat*_cholesky() factors a symmetric
+ * positive definite mat as L * L^T, reading only its
+ * upper triangle; dest may equal mat. Both return -1,
+ * leaving dest and perm unspecified, when the matrix is
+ * singular or not positive definite. The _solve()
+ * functions that take a factor reuse it for any number
+ * of right hand sides.
+ *
+ * mat*_solve() and mat*_solve_spd() factor and solve
+ * in one call and return -1, leaving x unchanged, on
+ * failure. x may equal b.
+ */
+int mat2f_lu(mat2f* mat, mat2f* dest, int* perm)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_lu, 1);
+        return _solve_lu_factor(2, (float*)mat->m, (float*)dest->m, perm);
+}
+
+void mat2f_lu_solve(mat2f* lu, int* perm, vec2f* b, vec2f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_lu_solve, 1);
+        _solve_lu_apply(2, (float*)lu->m, perm, b->m, x->m);
+}
+
+int mat2f_cholesky(mat2f* mat, mat2f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_cholesky, 1);
+        return _solve_cholesky_factor(2, (float*)mat->m, (float*)dest->m);
+}
+
+void mat2f_cholesky_solve(mat2f* l, vec2f* b, vec2f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_cholesky_solve, 1);
+        _solve_cholesky_apply(2, (float*)l->m, b->m, x->m);
+}
+
+int mat2f_solve(mat2f* mat, vec2f* b, vec2f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_solve, 1);
+        return _solve_one(2, 0, (float*)mat->m, b->m, x->m);
+}
+
+int mat2f_solve_spd(mat2f* mat, vec2f* b, vec2f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_solve_spd, 1);
+        return _solve_one(2, 1, (float*)mat->m, b->m, x->m);
+}
+
+int mat3f_lu(mat3f* mat, mat3f* dest, int* perm)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_lu, 1);
+        return _solve_lu_factor(3, (float*)mat->m, (float*)dest->m, perm);
+}
+
+void mat3f_lu_solve(mat3f* lu, int* perm, vec3f* b, vec3f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_lu_solve, 1);
+        _solve_lu_apply(3, (float*)lu->m, perm, b->m, x->m);
+}
+
+int mat3f_cholesky(mat3f* mat, mat3f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_cholesky, 1);
+        return _solve_cholesky_factor(3, (float*)mat->m, (float*)dest->m);
+}
+
+void mat3f_cholesky_solve(mat3f* l, vec3f* b, vec3f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_cholesky_solve, 1);
+        _solve_cholesky_apply(3, (float*)l->m, b->m, x->m);
+}
+
+int mat3f_solve(mat3f* mat, vec3f* b, vec3f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_solve, 1);
+        return _solve_one(3, 0, (float*)mat->m, b->m, x->m);
+}
+
+int mat3f_solve_spd(mat3f* mat, vec3f* b, vec3f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_solve_spd, 1);
+        return _solve_one(3, 1, (float*)mat->m, b->m, x->m);
+}
+
+int mat4f_lu(mat4f* mat, mat4f* dest, int* perm)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_lu, 1);
+        return _solve_lu_factor(4, (float*)mat->m, (float*)dest->m, perm);
+}
+
+void mat4f_lu_solve(mat4f* lu, int* perm, vec4f* b, vec4f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_lu_solve, 1);
+        _solve_lu_apply(4, (float*)lu->m, perm, b->m, x->m);
+}
+
+int mat4f_cholesky(mat4f* mat, mat4f* dest)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_cholesky, 1);
+        return _solve_cholesky_factor(4, (float*)mat->m, (float*)dest->m);
+}
+
+void mat4f_cholesky_solve(mat4f* l, vec4f* b, vec4f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_cholesky_solve, 1);
+        _solve_cholesky_apply(4, (float*)l->m, b->m, x->m);
+}
+
+int mat4f_solve(mat4f* mat, vec4f* b, vec4f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_solve, 1);
+        return _solve_one(4, 0, (float*)mat->m, b->m, x->m);
+}
+
+int mat4f_solve_spd(mat4f* mat, vec4f* b, vec4f* x)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_solve_spd, 1);
+        return _solve_one(4, 1, (float*)mat->m, b->m, x->m);
+}
+
+/**
+ * Batched solves, one system per lane. As with
+ * mat4f_inverse_array, every x is written: a system
+ * that fails gets the zero vector and a 1 in
+ * singular[i] (which may be NULL), and the number of
+ * failures is returned. x may equal b. The _spd
+ * variants use Cholesky and read only the upper
+ * triangle of each matrix.
+ */
+size_t mat2f_solve_array(mat2f* mat, vec2f* b, vec2f* x, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_solve_array, count);
+        return _solve_array(2, 0, (float*)mat->m, b->m, x->m, singular, count);
+}
+
+size_t mat2f_solve_spd_array(mat2f* mat, vec2f* b, vec2f* x, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat2f_solve_spd_array, count);
+        return _solve_array(2, 1, (float*)mat->m, b->m, x->m, singular, count);
+}
+
+size_t mat3f_solve_array(mat3f* mat, vec3f* b, vec3f* x, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_solve_array, count);
+        return _solve_array(3, 0, (float*)mat->m, b->m, x->m, singular, count);
+}
+
+size_t mat3f_solve_spd_array(mat3f* mat, vec3f* b, vec3f* x, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat3f_solve_spd_array, count);
+        return _solve_array(3, 1, (float*)mat->m, b->m, x->m, singular, count);
+}
+
+size_t mat4f_solve_array(mat4f* mat, vec4f* b, vec4f* x, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_solve_array, count);
+        return _solve_array(4, 0, (float*)mat->m, b->m, x->m, singular, count);
+}
+
+size_t mat4f_solve_spd_array(mat4f* mat, vec4f* b, vec4f* x, unsigned char* singular, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(mat4f_solve_spd_array, count);
+        return _solve_array(4, 1, (float*)mat->m, b->m, x->m, singular, count);
+}
+
+#if defined(CGMATH_X86)
+
+CGMATH_TARGET_SSE2
+static inline __m128 _solve_abs_sse2(__m128 f)
+{
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), f);
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _solve_sel_sse2(__m128 m, __m128 a, __m128 b)
+{
+        return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _solve_nonpos_sse2(__m128 d)
+{
+        return _mm_cmpngt_ps(d, _mm_setzero_ps());
+}
+
+CGMATH_TARGET_SSE2
+static inline __m128 _solve_nonfinite_sse2(__m128 s)
+{
+        return _mm_cmpunord_ps(s, s);
+}
+
+SOLVE_LANES(_solve_lanes_sse2, CGMATH_TARGET_SSE2, __m128, __m128, _solve_abs_sse2,
+                _mm_cmpgt_ps, _solve_sel_sse2, _mm_or_ps, _solve_nonpos_sse2,
+                _solve_nonfinite_sse2, _mm_sqrt_ps)
+
+CGMATH_TARGET_SSE2
+size_t _mat_solve_soa_sse2(int n, int spd, float** a, float** b, float** x,
+                unsigned char* singular, size_t count)
+{
+        int k;
+        int bits;
+        size_t i;
+        size_t bad;
+        __m128 va[16];
+        __m128 vb[4];
+        __m128 fail;
+        float* ta[16];
+        float* tb[4];
+        float* tx[4];
+
+        bad = 0;
+        for(i = 0; i + 4 <= count; i += 4) {
+                for(k = 0; k < n * n; k++) {
+                        va[k] = _mm_loadu_ps(a[k] + i);
+                }
+                for(k = 0; k < n; k++) {
+                        vb[k] = _mm_loadu_ps(b[k] + i);
+                }
+
+                switch(n) {
+                case 2:
+                        fail = _solve_lanes_sse2(2, spd, va, vb);
+                        break;
+                case 3:
+                        fail = _solve_lanes_sse2(3, spd, va, vb);
+                        break;
+                default:
+                        fail = _solve_lanes_sse2(4, spd, va, vb);
+                        break;
+                }
+                for(k = 0; k < n; k++) {
+                        _mm_storeu_ps(x[k] + i, _mm_andnot_ps(fail, vb[k]));
+                }
+
+                bits = _mm_movemask_ps(fail);
+                bad += __builtin_popcount(bits);
+                if(singular != NULL) {
+                        for(k = 0; k < 4; k++) {
+                                singular[i + k] = (bits >> k) & 1;
+                        }
+                }
+        }
+
+        _solve_offset(a, ta, n * n, i);
+        _solve_offset(b, tb, n, i);
+        _solve_offset(x, tx, n, i);
+        return bad + _mat_solve_soa_scalar(n, spd, ta, tb, tx,
+                        singular != NULL ? singular + i : NULL, count - i);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _solve_abs_avx2(__m256 f)
+{
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), f);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _solve_gt_avx2(__m256 a, __m256 b)
+{
+        return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _solve_sel_avx2(__m256 m, __m256 a, __m256 b)
+{
+        return _mm256_blendv_ps(b, a, m);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _solve_nonpos_avx2(__m256 d)
+{
+        return _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_NGT_UQ);
+}
+
+CGMATH_TARGET_AVX2
+static inline __m256 _solve_nonfinite_avx2(__m256 s)
+{
+        return _mm256_cmp_ps(s, s, _CMP_UNORD_Q);
+}
+
+SOLVE_LANES(_solve_lanes_avx2, CGMATH_TARGET_AVX2, __m256, __m256, _solve_abs_avx2,
+                _solve_gt_avx2, _solve_sel_avx2, _mm256_or_ps, _solve_nonpos_avx2,
+                _solve_nonfinite_avx2, _mm256_sqrt_ps)
+
+CGMATH_TARGET_AVX2
+size_t _mat_solve_soa_avx2(int n, int spd, float** a, float** b, float** x,
+                unsigned char* singular, size_t count)
+{
+        int k;
+        int bits;
+        size_t i;
+        size_t bad;
+        __m256 va[16];
+        __m256 vb[4];
+        __m256 fail;
+        float* ta[16];
+        float* tb[4];
+        float* tx[4];
+
+        bad = 0;
+        for(i = 0; i + 8 <= count; i += 8) {
+                for(k = 0; k < n * n; k++) {
+                        va[k] = _mm256_loadu_ps(a[k] + i);
+                }
+                for(k = 0; k < n; k++) {
+                        vb[k] = _mm256_loadu_ps(b[k] + i);
+                }
+
+                switch(n) {
+                case 2:
+                        fail = _solve_lanes_avx2(2, spd, va, vb);
+                        break;
+                case 3:
+                        fail = _solve_lanes_avx2(3, spd, va, vb);
+                        break;
+                default:
+                        fail = _solve_lanes_avx2(4, spd, va, vb);
+                        break;
+                }
+                for(k = 0; k < n; k++) {
+                        _mm256_storeu_ps(x[k] + i, _mm256_andnot_ps(fail, vb[k]));
+                }
+
+                bits = _mm256_movemask_ps(fail);
+                bad += __builtin_popcount(bits);
+                if(singular != NULL) {
+                        for(k = 0; k < 8; k++) {
+                                singular[i + k] = (bits >> k) & 1;
+                        }
+                }
+        }
+
+        _solve_offset(a, ta, n * n, i);
+        _solve_offset(b, tb, n, i);
+        _solve_offset(x, tx, n, i);
+        return bad + _mat_solve_soa_sse2(n, spd, ta, tb, tx,
+                        singular != NULL ? singular + i : NULL, count - i);
+}
+
+#endif
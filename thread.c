@@ -0,0 +1,209 @@
+/**
+ * File: thread.c
+ * Description:
+ * * A small persistent worker pool for the batch
+ * * kernels. Workers are started on first use and
+ * * sleep on a condition variable between jobs; the
+ * * calling thread takes part in every job. Ranges are
+ * * handed out through an atomic counter so uneven
+ * * work balances itself.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cgmath.h"
+#include "cgmath_thread.h"
+
+#define CGMATH_MAX_THREADS      256
+
+typedef struct {
+        _cgmath_range_fn fn;
+        void*           ctx;
+        size_t          count;
+        size_t          grain;
+        size_t          next;
+        int             limit;
+} _cgmath_job;
+
+static pthread_mutex_t  _pool_submit = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t  _pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   _pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   _pool_idle = PTHREAD_COND_INITIALIZER;
+
+static _cgmath_job      _pool_job;
+static unsigned long    _pool_gen = 0;
+static int              _pool_busy = 0;
+static int              _pool_started = 0;
+static int              _pool_threads = 0;
+static __thread int     _pool_inside = 0;
+
+static void _pool_run(_cgmath_job* job)
+{
+        size_t b;
+        size_t e;
+
+        for(;;) {
+                b = __atomic_fetch_add(&job->next, job->grain, __ATOMIC_RELAXED);
+                if(b >= job->count) {
+                        break;
+                }
+                e = b + job->grain < job->count ? b + job->grain : job->count;
+                job->fn(job->ctx, b, e);
+        }
+}
+
+static void* _pool_worker(void* arg)
+{
+        int id;
+        unsigned long seen;
+
+        id = (int)(size_t)arg;
+        seen = 0;
+        _pool_inside = 1;
+
+        pthread_mutex_lock(&_pool_lock);
+        for(;;) {
+                while(_pool_gen == seen) {
+                        pthread_cond_wait(&_pool_wake, &_pool_lock);
+                }
+                seen = _pool_gen;
+                pthread_mutex_unlock(&_pool_lock);
+
+                if(id < _pool_job.limit) {
+                        _pool_run(&_pool_job);
+                }
+
+                pthread_mutex_lock(&_pool_lock);
+                if(--_pool_busy == 0) {
+                        pthread_cond_signal(&_pool_idle);
+                }
+        }
+        return NULL;
+}
+
+static int _pool_default(void)
+{
+        long n;
+        const char* env;
+
+        env = getenv("CGMATH_THREADS");
+        if(env != NULL && atoi(env) > 0) {
+                n = atoi(env);
+        } else {
+                n = sysconf(_SC_NPROCESSORS_ONLN);
+        }
+
+        if(n < 1) {
+                n = 1;
+        }
+        if(n > CGMATH_MAX_THREADS) {
+                n = CGMATH_MAX_THREADS;
+        }
+        return (int)n;
+}
+
+/**
+ * Called with _pool_submit held. Workers are spawned
+ * once, for the thread count in effect at that time;
+ * lowering the count later just idles some of them.
+ */
+static void _pool_start(void)
+{
+        int i;
+        int n;
+        pthread_t t;
+
+        n = cgmath_threads();
+        for(i = 0; i < n - 1; i++) {
+                if(pthread_create(&t, NULL, _pool_worker, (void*)(size_t)i) != 0) {
+                        break;
+                }
+                pthread_detach(t);
+        }
+        _pool_started = i + 1;
+}
+
+/**
+ * The count is read without _pool_submit, so it is only
+ * accessed atomically; the lazy default is installed
+ * with a compare and swap so that it never overwrites a
+ * concurrent cgmath_set_threads().
+ */
+int cgmath_threads(void)
+{
+        int n;
+        int d;
+
+        n = __atomic_load_n(&_pool_threads, __ATOMIC_ACQUIRE);
+        if(n == 0) {
+                d = _pool_default();
+                if(__atomic_compare_exchange_n(&_pool_threads, &n, d, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                        n = d;
+                }
+        }
+        return n;
+}
+
+void cgmath_set_threads(int count)
+{
+        pthread_mutex_lock(&_pool_submit);
+        if(count < 1) {
+                count = 1;
+        }
+        if(count > CGMATH_MAX_THREADS) {
+                count = CGMATH_MAX_THREADS;
+        }
+        __atomic_store_n(&_pool_threads, count, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&_pool_submit);
+}
+
+void _cgmath_parallel_for(size_t count, size_t grain, _cgmath_range_fn fn, void* ctx)
+{
+        if(grain == 0) {
+                grain = 1;
+        }
+
+        if(count < 2 * grain || _pool_inside || cgmath_threads() < 2 ||
+                        pthread_mutex_trylock(&_pool_submit) != 0) {
+                if(count > 0) {
+                        fn(ctx, 0, count);
+                }
+                return;
+        }
+
+        if(_pool_started == 0) {
+                _pool_start();
+        }
+        if(_pool_started < 2) {
+                pthread_mutex_unlock(&_pool_submit);
+                fn(ctx, 0, count);
+                return;
+        }
+
+        pthread_mutex_lock(&_pool_lock);
+        _pool_job.fn = fn;
+        _pool_job.ctx = ctx;
+        _pool_job.count = count;
+        _pool_job.grain = grain;
+        _pool_job.next = 0;
+        _pool_job.limit = cgmath_threads() - 1;
+        _pool_busy = _pool_started - 1;
+        _pool_gen++;
+        pthread_cond_broadcast(&_pool_wake);
+        pthread_mutex_unlock(&_pool_lock);
+
+        _pool_inside = 1;
+        _pool_run(&_pool_job);
+        _pool_inside = 0;
+
+        pthread_mutex_lock(&_pool_lock);
+        while(_pool_busy > 0) {
+                pthread_cond_wait(&_pool_idle, &_pool_lock);
+        }
+        pthread_mutex_unlock(&_pool_lock);
+
+        pthread_mutex_unlock(&_pool_submit);
+}
@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "cgmath.h"
+#include "cgmath_profile.h"
 
 #if defined(CGMATH_VECTOR_DIMS_DEFINED)
 #undef CGMATH_VECTOR_ELEMS
@@ -21,11 +22,13 @@
 
 void vec2f_zero(vec2f* vec)
 {
+        CGMATH_PROFILE_SCOPE(vec2f_zero, 1);
         memset(vec->m, 0, CGMATH_VECTOR_SIZE);
 }
 
 void vec2f_identity(vec2f* vec, int axis)
 {
+        CGMATH_PROFILE_SCOPE(vec2f_identity, 1);
         if(axis > 0 && axis < CGMATH_VECTOR_ELEMS) {
                 vec2f_zero(vec);
                 vec->m[axis] = 1.0f;
@@ -34,6 +37,7 @@ void vec2f_identity(vec2f* vec, int axis)
 
 void vec2f_add(vec2f* a, vec2f* b, vec2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec2f_add, 1);
         vec2f tmp;
         memcpy(tmp.m, a->m, CGMATH_VECTOR_SIZE);
 
@@ -45,6 +49,7 @@ void vec2f_add(vec2f* a, vec2f* b, vec2f* dest)
 
 void vec2f_scale(vec2f* vec, float scalar, vec2f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec2f_scale, 1);
         vec2f tmp;
         memcpy(tmp.m, vec->m, CGMATH_VECTOR_SIZE);
 
@@ -56,6 +61,7 @@ void vec2f_scale(vec2f* vec, float scalar, vec2f* dest)
 
 float vec2f_scalar_prod(vec2f* a, vec2f* b)
 {
+        CGMATH_PROFILE_SCOPE(vec2f_scalar_prod, 1);
         float sp;
         sp =    a->m[VEC_X] * b->m[VEC_X] +
                 a->m[VEC_Y] * b->m[VEC_Y];
@@ -64,24 +70,20 @@ float vec2f_scalar_prod(vec2f* a, vec2f* b)
 
 float vec2f_sqr_mag(vec2f* vec)
 {
+        CGMATH_PROFILE_SCOPE(vec2f_sqr_mag, 1);
         return vec2f_scalar_prod(vec, vec);
 }
 
 void vec2f_normalize(vec2f* vec, vec2f* dest)
 {
-        long i;
+        CGMATH_PROFILE_SCOPE(vec2f_normalize, 1);
         float x;
-        float x2;
         vec2f tmp;
 
         memcpy(tmp.m, vec->m, CGMATH_VECTOR_SIZE);
 
         x = vec2f_sqr_mag(vec);
-        x2 = 0.5 * x;
-        i = *(long*)&x;
-        i = 0x5f3759df - (i >> 1);
-        x = *(float*)&i;
-        x = x * (1.5f - x2 * x * x);
+        x = _cgmath_invsqrt(x);
 
         tmp.m[VEC_X] = tmp.m[VEC_X] * x;
         tmp.m[VEC_Y] = tmp.m[VEC_Y] * x;
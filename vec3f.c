@@ -4,9 +4,14 @@
  * Description:
  * * Implementation for a 3-dimensional vector.
  */
+#include <float.h>
+#include <math.h>
 #include <string.h>
 
 #include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
+#include "cgmath_thread.h"
 
 #if defined(CGMATH_VECTOR_DIMS_DEFINED)
 #undef CGMATH_VECTOR_ELEMS
@@ -18,13 +23,29 @@
 #define CGMATH_VECTOR_SIZE      (CGMATH_VECTOR_ELEMS * sizeof(float))
 #define CGMATH_VECTOR_DIMS_DEFINED
 
+/**
+ * The reductions split the input into at most this
+ * many fixed slices whose partial sums are combined in
+ * order, so the result does not depend on the thread
+ * count.
+ */
+#define VEC3F_REDUCE_SLOTS      64
+
+/* points summed in float lanes before flushing to double */
+#define VEC3F_MOMENT_FLUSH      1024
+
+/* neighborhoods per task for vec3f_covariance_gather */
+#define VEC3F_GATHER_GRAIN      1024
+
 void vec3f_zero(vec3f* vec)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_zero, 1);
         memset(vec->m, 0, CGMATH_VECTOR_SIZE);
 }
 
 void vec3f_identity(vec3f* vec, int axis)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_identity, 1);
         if(axis > 0 && axis < CGMATH_VECTOR_ELEMS) {
                 vec3f_zero(vec);
                 vec->m[axis] = 1.0f;
@@ -33,6 +54,7 @@ void vec3f_identity(vec3f* vec, int axis)
 
 void vec3f_add(vec3f* a, vec3f* b, vec3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_add, 1);
         vec3f tmp;
         memcpy(tmp.m, a->m, CGMATH_VECTOR_SIZE);
 
@@ -45,6 +67,7 @@ void vec3f_add(vec3f* a, vec3f* b, vec3f* dest)
 
 void vec3f_scale(vec3f* vec, float scalar, vec3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_scale, 1);
         vec3f tmp;
         memcpy(tmp.m, vec->m, CGMATH_VECTOR_SIZE);
 
@@ -57,6 +80,7 @@ void vec3f_scale(vec3f* vec, float scalar, vec3f* dest)
 
 float vec3f_scalar_prod(vec3f* a, vec3f* b)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_scalar_prod, 1);
         float sp;
         sp =    a->m[VEC_X] * b->m[VEC_X] +
                 a->m[VEC_Y] * b->m[VEC_Y] +
@@ -66,10 +90,11 @@ float vec3f_scalar_prod(vec3f* a, vec3f* b)
 
 void vec3f_vector_prod(vec3f* a, vec3f* b, vec3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_vector_prod, 1);
         vec3f tmp;
 
         tmp.m[VEC_X] = a->m[VEC_Y] * b->m[VEC_Z] - a->m[VEC_Z] * b->m[VEC_Y];
-        tmp.m[VEC_Y] = a->m[VEC_X] * b->m[VEC_Z] - a->m[VEC_Z] * b->m[VEC_X];
+        tmp.m[VEC_Y] = a->m[VEC_Z] * b->m[VEC_X] - a->m[VEC_X] * b->m[VEC_Z];
         tmp.m[VEC_Z] = a->m[VEC_X] * b->m[VEC_Y] - a->m[VEC_Y] * b->m[VEC_X];
 
         memcpy(dest->m, tmp.m, CGMATH_VECTOR_SIZE);
@@ -77,6 +102,7 @@ void vec3f_vector_prod(vec3f* a, vec3f* b, vec3f* dest)
 
 float vec3f_sqr_mag(vec3f* vec)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_sqr_mag, 1);
         return vec3f_scalar_prod(vec, vec);
 }
 
@@ -89,6 +115,7 @@ float vec3f_sqr_mag(vec3f* vec)
  */
 void vec3f_normalize(vec3f* vec, vec3f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec3f_normalize, 1);
         long i;
         float x;
         vec3f tmp;
@@ -106,3 +133,470 @@ void vec3f_normalize(vec3f* vec, vec3f* dest)
         memcpy(dest->m, tmp.m, CGMATH_VECTOR_SIZE);
 }
 
+/**
+ * Uses a full precision square root rather than the
+ * estimate above. Each vector is first divided by its
+ * largest component, so that no finite vector
+ * overflows or underflows the squared length; zero
+ * vectors and ones with an Inf or NaN component come
+ * out as zero, the same as in the SIMD variants.
+ */
+void _vec3f_normalize_array_scalar(vec3f* src, vec3f* dest, size_t count)
+{
+        size_t i;
+        float x;
+        float y;
+        float z;
+        float n;
+
+        for(i = 0; i < count; i++) {
+                x = src[i].m[VEC_X];
+                y = src[i].m[VEC_Y];
+                z = src[i].m[VEC_Z];
+                if(x * 0.0f + y * 0.0f + z * 0.0f == 0.0f) {
+                        n = 1.0f / fmaxf(fmaxf(fmaxf(fabsf(x), fabsf(y)), fabsf(z)), FLT_MIN);
+                        x *= n;
+                        y *= n;
+                        z *= n;
+                } else {
+                        x = y = z = 0.0f;
+                }
+                n = x * x + y * y + z * z;
+                n = n >= FLT_MIN ? 1.0f / sqrtf(n) : 0.0f;
+                dest[i].m[VEC_X] = x * n;
+                dest[i].m[VEC_Y] = y * n;
+                dest[i].m[VEC_Z] = z * n;
+        }
+}
+
+#if defined(CGMATH_X86)
+CGMATH_TARGET_SSE2
+void _vec3f_normalize_array_sse2(vec3f* src, vec3f* dest, size_t count)
+{
+        size_t i;
+        __m128 x;
+        __m128 y;
+        __m128 z;
+        __m128 n;
+        __m128 abs;
+        __m128 zero;
+        __m128 live;
+
+        abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        zero = _mm_setzero_ps();
+        for(i = 0; i + 4 <= count; i += 4) {
+                _cgmath_load3x4_sse2(src[i].m, &x, &y, &z);
+                live = _mm_cmpeq_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, zero), _mm_mul_ps(y, zero)),
+                                _mm_mul_ps(z, zero)), zero);
+                n = _mm_max_ps(_mm_max_ps(_mm_and_ps(x, abs), _mm_and_ps(y, abs)), _mm_and_ps(z, abs));
+                n = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(n, _mm_set1_ps(FLT_MIN)));
+                x = _mm_and_ps(_mm_mul_ps(x, n), live);
+                y = _mm_and_ps(_mm_mul_ps(y, n), live);
+                z = _mm_and_ps(_mm_mul_ps(z, n), live);
+                n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+                n = _cgmath_rsqrt_sse2(n);
+                _cgmath_store3x4_sse2(dest[i].m, _mm_mul_ps(x, n), _mm_mul_ps(y, n), _mm_mul_ps(z, n));
+        }
+        _vec3f_normalize_array_scalar(src + i, dest + i, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _vec3f_normalize_array_avx2(vec3f* src, vec3f* dest, size_t count)
+{
+        int k;
+        size_t i;
+        __m256 p[3];
+        __m256 n;
+        __m256 abs;
+        __m256 zero;
+        __m256 live;
+
+        abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        zero = _mm256_setzero_ps();
+        for(i = 0; i + 8 <= count; i += 8) {
+                _cgmath_load3x8_avx2(src + i, p);
+                live = _mm256_cmp_ps(_mm256_fmadd_ps(p[0], zero, _mm256_fmadd_ps(p[1], zero,
+                                _mm256_mul_ps(p[2], zero))), zero, _CMP_EQ_OQ);
+                n = _mm256_max_ps(_mm256_max_ps(_mm256_and_ps(p[0], abs), _mm256_and_ps(p[1], abs)),
+                                _mm256_and_ps(p[2], abs));
+                n = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(n, _mm256_set1_ps(FLT_MIN)));
+                for(k = 0; k < 3; k++) {
+                        p[k] = _mm256_and_ps(_mm256_mul_ps(p[k], n), live);
+                }
+                n = _mm256_fmadd_ps(p[0], p[0], _mm256_fmadd_ps(p[1], p[1], _mm256_mul_ps(p[2], p[2])));
+                n = _cgmath_rsqrt_avx2(n);
+                p[0] = _mm256_mul_ps(p[0], n);
+                p[1] = _mm256_mul_ps(p[1], n);
+                p[2] = _mm256_mul_ps(p[2], n);
+                _cgmath_store3x8_avx2(dest + i, p);
+        }
+        _vec3f_normalize_array_sse2(src + i, dest + i, count - i);
+}
+#endif
+
+typedef struct {
+        vec3f*          src;
+        vec3f*          dest;
+} _vec3f_array_job;
+
+static void _vec3f_normalize_range(void* ctx, size_t begin, size_t end)
+{
+        _vec3f_array_job* job;
+
+        job = ctx;
+        _cgmath_kern.vec3f_normalize_array(job->src + begin, job->dest + begin, end - begin);
+}
+
+/**
+ * Normalizes count vectors to full precision, scaling
+ * each by its largest component first so that any
+ * finite nonzero vector normalizes whatever its
+ * length; zero vectors and ones with an Inf or NaN
+ * component become zero. src may equal dest. Large
+ * arrays are split across threads.
+ */
+void vec3f_normalize_array(vec3f* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_normalize_array, count);
+        _vec3f_array_job job;
+
+        job.src = src;
+        job.dest = dest;
+        _cgmath_parallel_for(count, CGMATH_BATCH_GRAIN, _vec3f_normalize_range, &job);
+}
+
+/**
+ * Adds the first and (if order is 2) second moments of
+ * count points about center to dest: dest[0..2] gets
+ * the sums of p - c, dest[3..8] the sums of the xx,
+ * xy, xz, yy, yz and zz products. The SIMD variants
+ * accumulate in float lanes over short runs and flush
+ * to double, which keeps the error independent of the
+ * length of the input.
+ */
+void _vec3f_moments_scalar(vec3f* src, float* center, int order, double* dest, size_t count)
+{
+        size_t i;
+        double x;
+        double y;
+        double z;
+
+        for(i = 0; i < count; i++) {
+                x = src[i].m[VEC_X] - center[VEC_X];
+                y = src[i].m[VEC_Y] - center[VEC_Y];
+                z = src[i].m[VEC_Z] - center[VEC_Z];
+                dest[0] += x;
+                dest[1] += y;
+                dest[2] += z;
+                if(order > 1) {
+                        dest[3] += x * x;
+                        dest[4] += x * y;
+                        dest[5] += x * z;
+                        dest[6] += y * y;
+                        dest[7] += y * z;
+                        dest[8] += z * z;
+                }
+        }
+}
+
+#if defined(CGMATH_X86)
+CGMATH_TARGET_SSE2
+static void _vec3f_flush_sse2(__m128* acc, int n, double* dest)
+{
+        int k;
+        int j;
+        float lanes[4];
+
+        for(k = 0; k < n; k++) {
+                _mm_storeu_ps(lanes, acc[k]);
+                for(j = 0; j < 4; j++) {
+                        dest[k] += lanes[j];
+                }
+        }
+}
+
+CGMATH_TARGET_SSE2
+void _vec3f_moments_sse2(vec3f* src, float* center, int order, double* dest, size_t count)
+{
+        int k;
+        size_t i;
+        size_t end;
+        __m128 x;
+        __m128 y;
+        __m128 z;
+        __m128 acc[9];
+
+        for(i = 0; i + 4 <= count;) {
+                for(k = 0; k < 9; k++) {
+                        acc[k] = _mm_setzero_ps();
+                }
+                end = i + VEC3F_MOMENT_FLUSH < count ? i + VEC3F_MOMENT_FLUSH : count;
+                for(; i + 4 <= end; i += 4) {
+                        _cgmath_load3x4_sse2(src[i].m, &x, &y, &z);
+                        x = _mm_sub_ps(x, _mm_set1_ps(center[VEC_X]));
+                        y = _mm_sub_ps(y, _mm_set1_ps(center[VEC_Y]));
+                        z = _mm_sub_ps(z, _mm_set1_ps(center[VEC_Z]));
+                        acc[0] = _mm_add_ps(acc[0], x);
+                        acc[1] = _mm_add_ps(acc[1], y);
+                        acc[2] = _mm_add_ps(acc[2], z);
+                        if(order > 1) {
+                                acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(x, x));
+                                acc[4] = _mm_add_ps(acc[4], _mm_mul_ps(x, y));
+                                acc[5] = _mm_add_ps(acc[5], _mm_mul_ps(x, z));
+                                acc[6] = _mm_add_ps(acc[6], _mm_mul_ps(y, y));
+                                acc[7] = _mm_add_ps(acc[7], _mm_mul_ps(y, z));
+                                acc[8] = _mm_add_ps(acc[8], _mm_mul_ps(z, z));
+                        }
+                }
+                _vec3f_flush_sse2(acc, order > 1 ? 9 : 3, dest);
+        }
+        _vec3f_moments_scalar(src + i, center, order, dest, count - i);
+}
+
+CGMATH_TARGET_AVX2
+void _vec3f_moments_avx2(vec3f* src, float* center, int order, double* dest, size_t count)
+{
+        int k;
+        size_t i;
+        size_t end;
+        __m128 lx;
+        __m128 ly;
+        __m128 lz;
+        __m128 hx;
+        __m128 hy;
+        __m128 hz;
+        __m256 x;
+        __m256 y;
+        __m256 z;
+        __m256 acc[9];
+        __m128 half[9];
+
+        for(i = 0; i + 8 <= count;) {
+                for(k = 0; k < 9; k++) {
+                        acc[k] = _mm256_setzero_ps();
+                }
+                end = i + VEC3F_MOMENT_FLUSH < count ? i + VEC3F_MOMENT_FLUSH : count;
+                for(; i + 8 <= end; i += 8) {
+                        _cgmath_load3x4_sse2(src[i].m, &lx, &ly, &lz);
+                        _cgmath_load3x4_sse2(src[i + 4].m, &hx, &hy, &hz);
+                        x = _mm256_sub_ps(_mm256_set_m128(hx, lx), _mm256_set1_ps(center[VEC_X]));
+                        y = _mm256_sub_ps(_mm256_set_m128(hy, ly), _mm256_set1_ps(center[VEC_Y]));
+                        z = _mm256_sub_ps(_mm256_set_m128(hz, lz), _mm256_set1_ps(center[VEC_Z]));
+                        acc[0] = _mm256_add_ps(acc[0], x);
+                        acc[1] = _mm256_add_ps(acc[1], y);
+                        acc[2] = _mm256_add_ps(acc[2], z);
+                        if(order > 1) {
+                                acc[3] = _mm256_fmadd_ps(x, x, acc[3]);
+                                acc[4] = _mm256_fmadd_ps(x, y, acc[4]);
+                                acc[5] = _mm256_fmadd_ps(x, z, acc[5]);
+                                acc[6] = _mm256_fmadd_ps(y, y, acc[6]);
+                                acc[7] = _mm256_fmadd_ps(y, z, acc[7]);
+                                acc[8] = _mm256_fmadd_ps(z, z, acc[8]);
+                        }
+                }
+                for(k = 0; k < 9; k++) {
+                        half[k] = _mm_add_ps(_mm256_castps256_ps128(acc[k]),
+                                        _mm256_extractf128_ps(acc[k], 1));
+                }
+                _vec3f_flush_sse2(half, order > 1 ? 9 : 3, dest);
+        }
+        _vec3f_moments_sse2(src + i, center, order, dest, count - i);
+}
+#endif
+
+typedef struct {
+        vec3f*          src;
+        float           center[3];
+        int             order;
+        size_t          grain;
+        double          part[VEC3F_REDUCE_SLOTS][9];
+} _vec3f_reduce_job;
+
+static void _vec3f_reduce_range(void* ctx, size_t begin, size_t end)
+{
+        size_t b;
+        size_t n;
+        double* part;
+        _vec3f_reduce_job* job;
+
+        job = ctx;
+        for(b = begin; b < end; b += job->grain) {
+                n = end - b < job->grain ? end - b : job->grain;
+                part = job->part[b / job->grain];
+                memset(part, 0, 9 * sizeof(double));
+                _cgmath_kern.vec3f_moments(job->src + b, job->center, job->order, part, n);
+        }
+}
+
+static void _vec3f_reduce(vec3f* src, float* center, int order, double* dest, size_t count)
+{
+        int k;
+        size_t s;
+        size_t slots;
+        _vec3f_reduce_job job;
+
+        job.src = src;
+        job.order = order;
+        memcpy(job.center, center, CGMATH_VECTOR_SIZE);
+        job.grain = (count + VEC3F_REDUCE_SLOTS - 1) / VEC3F_REDUCE_SLOTS;
+        if(job.grain < CGMATH_BATCH_GRAIN) {
+                job.grain = CGMATH_BATCH_GRAIN;
+        }
+        _cgmath_parallel_for(count, job.grain, _vec3f_reduce_range, &job);
+
+        memset(dest, 0, 9 * sizeof(double));
+        slots = (count + job.grain - 1) / job.grain;
+        for(s = 0; s < slots; s++) {
+                for(k = 0; k < 9; k++) {
+                        dest[k] += job.part[s][k];
+                }
+        }
+}
+
+/**
+ * Sum and mean of count points, accumulated in double.
+ * The centroid of an empty set is the origin.
+ */
+void vec3f_sum_array(vec3f* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_sum_array, count);
+        int k;
+        float zero[3];
+        double m[9];
+
+        memset(zero, 0, sizeof(zero));
+        _vec3f_reduce(src, zero, 1, m, count);
+        for(k = 0; k < 3; k++) {
+                dest->m[k] = (float)m[k];
+        }
+}
+
+void vec3f_centroid_array(vec3f* src, vec3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_centroid_array, count);
+        int k;
+        float zero[3];
+        double m[9];
+
+        memset(zero, 0, sizeof(zero));
+        _vec3f_reduce(src, zero, 1, m, count);
+        for(k = 0; k < 3; k++) {
+                dest->m[k] = count > 0 ? (float)(m[k] / count) : 0.0f;
+        }
+}
+
+/**
+ * Second moments about the first-pass centroid, less
+ * the square of the residual mean, which recovers most
+ * of the rounding left in the centroid.
+ */
+static void _vec3f_covariance(double* m, size_t count, float* c, mat3f* dest)
+{
+        int r;
+        int k;
+        double n;
+        double mean[3];
+        static const int map[3][3] = { { 3, 4, 5 }, { 4, 6, 7 }, { 5, 7, 8 } };
+
+        n = count > 0 ? (double)count : 1.0;
+        for(k = 0; k < 3; k++) {
+                mean[k] = m[k] / n;
+        }
+        for(r = 0; r < 3; r++) {
+                for(k = 0; k < 3; k++) {
+                        dest->m[r][k] = (float)(m[map[r][k]] / n - mean[r] * mean[k]);
+                }
+                if(c != NULL) {
+                        c[r] = (float)(c[r] + mean[r]);
+                }
+        }
+}
+
+/**
+ * Centroid and population covariance (divided by
+ * count) of count points in two passes. centroid may
+ * be NULL.
+ */
+void vec3f_covariance_array(vec3f* src, vec3f* centroid, mat3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_covariance_array, count);
+        int k;
+        float c[3];
+        double m[9];
+
+        memset(c, 0, sizeof(c));
+        _vec3f_reduce(src, c, 1, m, count);
+        for(k = 0; k < 3; k++) {
+                c[k] = count > 0 ? (float)(m[k] / count) : 0.0f;
+        }
+
+        _vec3f_reduce(src, c, 2, m, count);
+        _vec3f_covariance(m, count, c, dest);
+        if(centroid != NULL) {
+                memcpy(centroid->m, c, CGMATH_VECTOR_SIZE);
+        }
+}
+
+typedef struct {
+        vec3f*          points;
+        unsigned int*   offsets;
+        unsigned int*   ids;
+        vec3f*          centroid;
+        mat3f*          dest;
+} _vec3f_gather_job;
+
+static void _vec3f_gather_range(void* ctx, size_t begin, size_t end)
+{
+        int k;
+        size_t i;
+        size_t j;
+        float c[3];
+        float* p;
+        double m[9];
+        _vec3f_gather_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                memset(m, 0, sizeof(m));
+                for(j = job->offsets[i]; j < job->offsets[i + 1]; j++) {
+                        p = job->points[job->ids[j]].m;
+                        for(k = 0; k < 3; k++) {
+                                m[k] += p[k];
+                        }
+                }
+                j = job->offsets[i + 1] - job->offsets[i];
+                for(k = 0; k < 3; k++) {
+                        c[k] = j > 0 ? (float)(m[k] / j) : 0.0f;
+                }
+
+                memset(m, 0, sizeof(m));
+                for(j = job->offsets[i]; j < job->offsets[i + 1]; j++) {
+                        _vec3f_moments_scalar(&job->points[job->ids[j]], c, 2, m, 1);
+                }
+                _vec3f_covariance(m, job->offsets[i + 1] - job->offsets[i], c, &job->dest[i]);
+                if(job->centroid != NULL) {
+                        memcpy(job->centroid[i].m, c, CGMATH_VECTOR_SIZE);
+                }
+        }
+}
+
+/**
+ * One covariance per neighborhood, for normal
+ * estimation and local frames. Neighborhood i is
+ * points[ids[offsets[i]]] to points[ids[offsets[i + 1] - 1]],
+ * the layout written by grid_query_radius_array() and
+ * kdtree_query_radius_array(). centroid may be NULL.
+ */
+void vec3f_covariance_gather(vec3f* points, unsigned int* offsets, unsigned int* ids,
+                vec3f* centroid, mat3f* dest, size_t count)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_covariance_gather, count);
+        _vec3f_gather_job job;
+
+        job.points = points;
+        job.offsets = offsets;
+        job.ids = ids;
+        job.centroid = centroid;
+        job.dest = dest;
+        _cgmath_parallel_for(count, VEC3F_GATHER_GRAIN, _vec3f_gather_range, &job);
+}
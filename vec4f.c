@@ -7,6 +7,8 @@
 #include <string.h>
 
 #include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_simd.h"
 
 #if defined(CGMATH_VECTOR_DIMS_DEFINED)
 #undef CGMATH_VECTOR_ELEMS
@@ -20,11 +22,13 @@
 
 void vec4f_zero(vec4f* vec)
 {
+        CGMATH_PROFILE_SCOPE(vec4f_zero, 1);
         memset(vec->m, 0, CGMATH_VECTOR_SIZE);
 }
 
 void vec4f_identity(vec4f* vec, int axis)
 {
+        CGMATH_PROFILE_SCOPE(vec4f_identity, 1);
         if(axis > 0 && axis < CGMATH_VECTOR_ELEMS) {
                 vec4f_zero(vec);
                 vec->m[axis] = 1.0f;
@@ -33,6 +37,7 @@ void vec4f_identity(vec4f* vec, int axis)
 
 void vec4f_add(vec4f* a, vec4f* b, vec4f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec4f_add, 1);
         vec4f tmp;
         memcpy(tmp.m, a->m, CGMATH_VECTOR_SIZE);
 
@@ -46,6 +51,7 @@ void vec4f_add(vec4f* a, vec4f* b, vec4f* dest)
 
 void vec4f_scale(vec4f* vec, float scalar, vec4f* dest)
 {
+        CGMATH_PROFILE_SCOPE(vec4f_scale, 1);
         vec4f tmp;
         memcpy(tmp.m, vec->m, CGMATH_VECTOR_SIZE);
 
@@ -59,6 +65,7 @@ void vec4f_scale(vec4f* vec, float scalar, vec4f* dest)
 
 float vec4f_scalar_prod(vec4f* a, vec4f* b)
 {
+        CGMATH_PROFILE_SCOPE(vec4f_scalar_prod, 1);
         float sp;
         sp =    a->m[VEC_X] * b->m[VEC_X] +
                 a->m[VEC_Y] * b->m[VEC_Y] +
@@ -69,24 +76,19 @@ float vec4f_scalar_prod(vec4f* a, vec4f* b)
 
 float vec4f_sqr_mag(vec4f* vec)
 {
+        CGMATH_PROFILE_SCOPE(vec4f_sqr_mag, 1);
         return vec4f_scalar_prod(vec, vec);
 }
 
-void vec4f_normalize(vec4f* vec, vec4f* dest)
+void _vec4f_normalize_scalar(vec4f* vec, vec4f* dest)
 {
-        long i;
         float x;
-        float x2;
         vec4f tmp;
 
         memcpy(tmp.m, vec->m, CGMATH_VECTOR_SIZE);
 
         x = vec4f_sqr_mag(vec);
-        x2 = 0.5 * x;
-        i = *(long*)&x;
-        i = 0x5f3759df - (i >> 1);
-        x = *(float*)&i;
-        x = x * (1.5f - x2 * x * x);
+        x = _cgmath_invsqrt(x);
 
         tmp.m[VEC_X] = tmp.m[VEC_X] * x;
         tmp.m[VEC_Y] = tmp.m[VEC_Y] * x;
@@ -96,3 +98,37 @@ void vec4f_normalize(vec4f* vec, vec4f* dest)
         memcpy(dest->m, tmp.m, CGMATH_VECTOR_SIZE);
 }
 
+void vec4f_normalize(vec4f* vec, vec4f* dest)
+{
+        CGMATH_PROFILE_SCOPE(vec4f_normalize, 1);
+        _cgmath_kern.vec4f_normalize(vec, dest);
+}
+
+#if defined(CGMATH_X86)
+
+/**
+ * rsqrtps refined by one Newton-Raphson step, the same
+ * step the scalar path applies to its magic constant
+ * guess. A zero vector stays zero instead of NaN.
+ */
+CGMATH_TARGET_SSE2
+void _vec4f_normalize_sse2(vec4f* vec, vec4f* dest)
+{
+        __m128 v;
+        __m128 d;
+        __m128 r;
+
+        v = _mm_loadu_ps(vec->m);
+        d = _mm_mul_ps(v, v);
+        d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+        d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        r = _mm_rsqrt_ps(d);
+        r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f),
+                        _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), d), _mm_mul_ps(r, r))));
+        r = _mm_and_ps(r, _mm_cmpneq_ps(d, _mm_setzero_ps()));
+
+        _mm_storeu_ps(dest->m, _mm_mul_ps(v, r));
+}
+
+#endif
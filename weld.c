@@ -0,0 +1,402 @@
+/**
+ * File: weld.c
+ * Description:
+ * * Vertex welding. Every vertex is mapped to the
+ * * lowest numbered earlier vertex within tolerance
+ * * that was itself kept, which is the result of the
+ * * obvious sequential loop, but found in parallel:
+ * *
+ * * 1. Positions are quantized to cells four times the
+ * *    tolerance on a side and inserted into an open
+ * *    addressing table keyed by a hash of the cell, with
+ * *    a lock-free list of the vertices in each slot.
+ * *    Cells whose hashes collide share a list, which
+ * *    only adds candidates.
+ * * 2. Each vertex finds the lowest numbered vertex
+ * *    within tolerance, looking in its own cell and in
+ * *    the neighbors whose faces are within tolerance,
+ * *    3.4 cells on average.
+ * * 3. If that vertex is kept (nothing earlier is within
+ * *    tolerance of it) it is the answer. Otherwise the
+ * *    tolerance ball straddles a chain of nearby
+ * *    vertices, and those rare vertices are resolved in
+ * *    order on one thread against the kept vertices.
+ * * 4. Kept vertices are numbered by a blocked prefix
+ * *    sum and compacted in their original order.
+ * *
+ * * None of the steps depends on the thread count or
+ * * on the order of the cell lists, so the output is
+ * * the same on every run.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgmath.h"
+#include "cgmath_profile.h"
+#include "cgmath_thread.h"
+
+#define WELD_ALIGN      64
+
+/* vertices per task */
+#define WELD_GRAIN      16384
+
+#define WELD_EMPTY      0xFFFFFFFFu
+
+/* cell coordinates are clamped to this so they fit an int */
+#define WELD_COORD_MAX  1073741824.0f
+
+typedef struct {
+        vec3f*          src;
+        vec3f*          dest;
+        unsigned int*   remap;
+        float           inv_cell;
+        float           tol2;
+        int             exact;
+        unsigned int    mask;
+        unsigned int*   table;
+        unsigned int*   next;
+        unsigned char*  chain;
+        size_t          count;
+        size_t          blocks;
+} _weld_job;
+
+static size_t _weld_round(size_t n)
+{
+        return (n + WELD_ALIGN - 1) & ~(size_t)(WELD_ALIGN - 1);
+}
+
+static inline int _weld_coord(float f)
+{
+        f = floorf(f);
+        if(!(f >= -WELD_COORD_MAX)) {
+                f = -WELD_COORD_MAX;
+        } else if(f > WELD_COORD_MAX) {
+                f = WELD_COORD_MAX;
+        }
+        return (int)f;
+}
+
+/**
+ * With zero tolerance the cell is the position itself,
+ * bit for bit, except that -0 and +0 share a cell.
+ */
+static inline void _weld_cell(_weld_job* job, float* p, int* c)
+{
+        int k;
+        union { float f; int i; } b;
+
+        for(k = 0; k < 3; k++) {
+                if(job->exact) {
+                        b.f = p[k] + 0.0f;
+                        c[k] = b.i;
+                } else {
+                        c[k] = _weld_coord(p[k] * job->inv_cell);
+                }
+        }
+}
+
+/* nonzero hash of a cell; 0 marks an empty slot */
+static inline unsigned int _weld_key(int* c)
+{
+        unsigned int h;
+
+        h = (unsigned int)c[0] * 0x8DA6B343u ^ (unsigned int)c[1] * 0xD8163841u ^
+                (unsigned int)c[2] * 0xCB1AB31Fu;
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        return h != 0 ? h : 1;
+}
+
+/**
+ * Slot h is table[2 * h] (the key) and table[2 * h + 1]
+ * (the head of its list), so a lookup touches one cache
+ * line. Returns the head of the list for key, or
+ * WELD_EMPTY.
+ */
+static inline unsigned int _weld_find(_weld_job* job, unsigned int key)
+{
+        unsigned int h;
+        unsigned int k;
+
+        h = key & job->mask;
+        for(;;) {
+                k = job->table[2 * h];
+                if(k == key) {
+                        return job->table[2 * h + 1];
+                }
+                if(k == 0) {
+                        return WELD_EMPTY;
+                }
+                h = (h + 1) & job->mask;
+        }
+}
+
+static void _weld_insert(void* ctx, size_t begin, size_t end)
+{
+        int c[3];
+        size_t i;
+        unsigned int h;
+        unsigned int k;
+        unsigned int key;
+        _weld_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                _weld_cell(job, job->src[i].m, c);
+                key = _weld_key(c);
+                h = key & job->mask;
+                for(;;) {
+                        k = __atomic_load_n(&job->table[2 * h], __ATOMIC_RELAXED);
+                        if(k == 0) {
+                                __atomic_compare_exchange_n(&job->table[2 * h], &k, key,
+                                                0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+                                if(k == 0) {
+                                        break;
+                                }
+                        }
+                        if(k == key) {
+                                break;
+                        }
+                        h = (h + 1) & job->mask;
+                }
+                job->next[i] = __atomic_exchange_n(&job->table[2 * h + 1], (unsigned int)i,
+                                __ATOMIC_RELAXED);
+        }
+}
+
+static inline float _weld_dist2(float* a, float* b)
+{
+        float x;
+        float y;
+        float z;
+
+        x = a[0] - b[0];
+        y = a[1] - b[1];
+        z = a[2] - b[2];
+        return x * x + y * y + z * z;
+}
+
+/**
+ * The lowest numbered vertex below best within
+ * tolerance of vertex i, or best. With kept set only
+ * vertices that are already final and kept count.
+ */
+static unsigned int _weld_scan(_weld_job* job, size_t i, unsigned int best, int kept)
+{
+        int c[3];
+        int d[3];
+        int n[3];
+        int k;
+        float* p;
+        float f;
+        unsigned int j;
+
+        p = job->src[i].m;
+        _weld_cell(job, p, c);
+        d[0] = d[1] = d[2] = 0;
+        if(!job->exact) {
+                for(k = 0; k < 3; k++) {
+                        f = p[k] * job->inv_cell;
+                        f = f - floorf(f);
+                        d[k] = f < 0.25f ? -1 : (f > 0.75f ? 1 : 0);
+                }
+        }
+
+        for(k = 0; k < 8; k++) {
+                if(((k & 1) && d[0] == 0) || ((k & 2) && d[1] == 0) || ((k & 4) && d[2] == 0)) {
+                        continue;
+                }
+                n[0] = c[0] + ((k & 1) ? d[0] : 0);
+                n[1] = c[1] + ((k & 2) ? d[1] : 0);
+                n[2] = c[2] + ((k & 4) ? d[2] : 0);
+                for(j = _weld_find(job, _weld_key(n)); j != WELD_EMPTY; j = job->next[j]) {
+                        if(j < best && (!kept || job->remap[j] == j) &&
+                                        _weld_dist2(p, job->src[j].m) <= job->tol2) {
+                                best = j;
+                        }
+                }
+        }
+        return best;
+}
+
+static void _weld_match(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        _weld_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                job->remap[i] = _weld_scan(job, i, (unsigned int)i, 0);
+        }
+}
+
+/**
+ * remap holds the lowest numbered vertex within
+ * tolerance of each vertex. If that vertex has nothing
+ * earlier within tolerance it is kept by the sequential
+ * loop, and being the lowest it is the one chosen.
+ */
+static void _weld_classify(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        unsigned int j;
+        _weld_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                j = job->remap[i];
+                job->chain[i] = j != i && job->remap[j] != j;
+        }
+}
+
+/* number of kept vertices in each block of WELD_GRAIN */
+static void _weld_count(void* ctx, size_t begin, size_t end)
+{
+        size_t b;
+        size_t i;
+        size_t last;
+        unsigned int n;
+        _weld_job* job;
+
+        job = ctx;
+        for(b = begin; b < end; b++) {
+                n = 0;
+                last = (b + 1) * WELD_GRAIN < job->count ? (b + 1) * WELD_GRAIN : job->count;
+                for(i = b * WELD_GRAIN; i < last; i++) {
+                        n += job->remap[i] == i;
+                }
+                job->next[job->count + b] = n;
+        }
+}
+
+/**
+ * Numbers the kept vertices from the block offsets in
+ * next[count + b], storing each number in next[i], and
+ * copies them to dest.
+ */
+static void _weld_number(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        unsigned int n;
+        _weld_job* job;
+
+        job = ctx;
+        n = job->next[job->count + begin / WELD_GRAIN];
+        for(i = begin; i < end; i++) {
+                if(job->remap[i] == i) {
+                        job->next[i] = n;
+                        if(job->dest != NULL) {
+                                job->dest[n] = job->src[i];
+                        }
+                        n++;
+                }
+        }
+}
+
+static void _weld_apply(void* ctx, size_t begin, size_t end)
+{
+        size_t i;
+        _weld_job* job;
+
+        job = ctx;
+        for(i = begin; i < end; i++) {
+                job->remap[i] = job->next[job->remap[i]];
+        }
+}
+
+/**
+ * Welds count vertices: remap[i] receives the index in
+ * dest of the vertex that vertex i was merged into, and
+ * dest the kept vertices in their original order. Two
+ * vertices are merged when they are within tolerance
+ * (Euclidean); tolerance 0 merges exact duplicates, with
+ * -0 equal to +0. Each vertex is compared with the kept
+ * vertices, not with the ones merged into them, so no
+ * vertex moves by more than tolerance. dest may be NULL
+ * or equal src. Returns the number of kept vertices, or
+ * 0 if tolerance is negative or not finite, count does
+ * not fit in an unsigned int, or the table cannot be
+ * allocated.
+ */
+size_t vec3f_weld(vec3f* src, size_t count, float tolerance, unsigned int* remap, vec3f* dest)
+{
+        CGMATH_PROFILE_SCOPE(vec3f_weld, count);
+        size_t i;
+        size_t k;
+        size_t table;
+        size_t size;
+        size_t kept;
+        unsigned int n;
+        char* block;
+        _weld_job job;
+
+        if(count == 0 || count >= WELD_EMPTY || !(tolerance >= 0.0f && tolerance <= FLT_MAX)) {
+                return 0;
+        }
+
+        table = 1024;
+        while(table < 2 * count) {
+                table <<= 1;
+        }
+        job.blocks = (count + WELD_GRAIN - 1) / WELD_GRAIN;
+        size = _weld_round(2 * table * sizeof(unsigned int)) +
+                _weld_round((count + job.blocks) * sizeof(unsigned int)) +
+                _weld_round(count);
+        block = aligned_alloc(WELD_ALIGN, size);
+        if(block == NULL) {
+                return 0;
+        }
+
+        job.src = src;
+        job.dest = dest == src ? NULL : dest;
+        job.remap = remap;
+        job.exact = tolerance == 0.0f;
+        job.inv_cell = job.exact ? 0.0f : 0.25f / tolerance;
+        job.tol2 = tolerance * tolerance;
+        job.mask = (unsigned int)(table - 1);
+        job.count = count;
+        job.table = (unsigned int*)block;
+        job.next = (unsigned int*)(block + _weld_round(2 * table * sizeof(unsigned int)));
+        job.chain = (unsigned char*)job.next + _weld_round((count + job.blocks) * sizeof(unsigned int));
+        for(i = 0; i < table; i++) {
+                job.table[2 * i] = 0;
+                job.table[2 * i + 1] = WELD_EMPTY;
+        }
+
+        _cgmath_parallel_for(count, WELD_GRAIN, _weld_insert, &job);
+        _cgmath_parallel_for(count, WELD_GRAIN, _weld_match, &job);
+        _cgmath_parallel_for(count, WELD_GRAIN, _weld_classify, &job);
+
+        for(i = 0; i < count; i++) {
+                if(job.chain[i]) {
+                        remap[i] = _weld_scan(&job, i, (unsigned int)i, 1);
+                }
+        }
+
+        _cgmath_parallel_for(job.blocks, 1, _weld_count, &job);
+        kept = 0;
+        for(k = 0; k < job.blocks; k++) {
+                n = job.next[count + k];
+                job.next[count + k] = (unsigned int)kept;
+                kept += n;
+        }
+        _cgmath_parallel_for(count, WELD_GRAIN, _weld_number, &job);
+        _cgmath_parallel_for(count, WELD_GRAIN, _weld_apply, &job);
+
+        /* in place, kept vertex number k is the first i with remap[i] == k */
+        if(dest != NULL && dest == src) {
+                k = 0;
+                for(i = 0; i < count; i++) {
+                        if(remap[i] == k) {
+                                dest[k++] = src[i];
+                        }
+                }
+        }
+
+        free(block);
+        return kept;
+}
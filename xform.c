@@ -0,0 +1,395 @@
+/**
+ * File: xform.c
+ * Description:
+ * * Out-of-core vertex transform. The input file is
+ * * memory mapped and read sequentially; workers take
+ * * chunk tickets in order, copy their chunk into the
+ * * staging buffer reserved for it, and transform the
+ * * positions and normals in place with the batch
+ * * kernels. The calling thread writes the buffers out
+ * * in chunk order; chunk c reuses the buffer of chunk
+ * * c - buffers once that one is on disk, so at most
+ * * buffers chunks are ever resident and reading,
+ * * transforming and writing all overlap.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cgmath.h"
+#include "cgmath_simd.h"
+
+/* target size of one chunk, about half of a typical L2 */
+#define XFORM_CHUNK_BYTES       (256 * 1024)
+
+#define XFORM_FREE      0
+#define XFORM_BUSY      1
+#define XFORM_FULL      2
+
+typedef struct {
+        unsigned char*  data;
+        size_t          chunk;
+        size_t          bytes;
+        int             state;
+} _xform_slot;
+
+typedef struct {
+        unsigned char*  in;
+        size_t          records;
+        size_t          chunk;
+        size_t          chunks;
+        size_t          stride;
+        size_t          header;
+        int             position;
+        int             normal;
+        mat4f           mat;
+        mat4f           nrm;
+        int             fd;
+        int             nbuf;
+        _xform_slot*    slots;
+        size_t          next;
+        size_t          written;
+        int             error;
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+} _xform_ctx;
+
+static int _xform_write(int fd, unsigned char* buf, size_t len, off_t off)
+{
+        ssize_t n;
+
+        while(len > 0) {
+                n = pwrite(fd, buf, len, off);
+                if(n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if(n <= 0) {
+                        return -1;
+                }
+                buf += n;
+                len -= n;
+                off += n;
+        }
+        return 0;
+}
+
+static void _xform_advise(_xform_ctx* ctx, size_t chunk, int advice)
+{
+        size_t page;
+        size_t begin;
+        size_t end;
+
+        if(chunk >= ctx->chunks) {
+                return;
+        }
+
+        page = (size_t)sysconf(_SC_PAGESIZE);
+        begin = ctx->header + chunk * ctx->chunk * ctx->stride;
+        end = begin + ctx->chunk * ctx->stride;
+        if(end > ctx->header + ctx->records * ctx->stride) {
+                end = ctx->header + ctx->records * ctx->stride;
+        }
+
+        begin &= ~(page - 1);
+        madvise(ctx->in - ctx->header + begin, end - begin, advice);
+}
+
+/**
+ * Applies fn to the vec3f at offset in each of count
+ * records, through scratch unless the records are
+ * plain packed vec3f.
+ */
+static void _xform_apply(_xform_ctx* ctx, unsigned char* data, size_t count, int offset,
+                void (*fn)(mat4f* mat, vec3f* src, vec3f* dest, size_t count),
+                mat4f* mat, vec3f* scratch)
+{
+        size_t i;
+
+        if(ctx->stride == sizeof(vec3f) && offset == 0 && ((size_t)data & 3) == 0) {
+                fn(mat, (vec3f*)data, (vec3f*)data, count);
+                return;
+        }
+
+        for(i = 0; i < count; i++) {
+                memcpy(scratch[i].m, data + i * ctx->stride + offset, sizeof(vec3f));
+        }
+        fn(mat, scratch, scratch, count);
+        for(i = 0; i < count; i++) {
+                memcpy(data + i * ctx->stride + offset, scratch[i].m, sizeof(vec3f));
+        }
+}
+
+static void* _xform_worker(void* arg)
+{
+        size_t c;
+        size_t count;
+        vec3f* scratch;
+        _xform_ctx* ctx;
+        _xform_slot* slot;
+
+        ctx = arg;
+        scratch = malloc(ctx->chunk * sizeof(vec3f));
+
+        pthread_mutex_lock(&ctx->lock);
+        if(scratch == NULL) {
+                ctx->error = 1;
+                pthread_cond_broadcast(&ctx->cond);
+        }
+        for(;;) {
+                if(ctx->error || ctx->next >= ctx->chunks) {
+                        break;
+                }
+                c = ctx->next++;
+                slot = &ctx->slots[c % ctx->nbuf];
+                while(c >= ctx->written + ctx->nbuf && !ctx->error) {
+                        pthread_cond_wait(&ctx->cond, &ctx->lock);
+                }
+                if(ctx->error) {
+                        break;
+                }
+                slot->state = XFORM_BUSY;
+                pthread_mutex_unlock(&ctx->lock);
+
+                _xform_advise(ctx, c + ctx->nbuf, MADV_WILLNEED);
+
+                count = ctx->records - c * ctx->chunk;
+                if(count > ctx->chunk) {
+                        count = ctx->chunk;
+                }
+                memcpy(slot->data, ctx->in + c * ctx->chunk * ctx->stride, count * ctx->stride);
+                if(ctx->position >= 0) {
+                        _xform_apply(ctx, slot->data, count, ctx->position,
+                                        _cgmath_kern.mat4f_transform_point_array, &ctx->mat, scratch);
+                }
+                if(ctx->normal >= 0) {
+                        _xform_apply(ctx, slot->data, count, ctx->normal,
+                                        _cgmath_kern.mat4f_transform_normal_array, &ctx->nrm, scratch);
+                }
+
+                pthread_mutex_lock(&ctx->lock);
+                slot->chunk = c;
+                slot->bytes = count * ctx->stride;
+                slot->state = XFORM_FULL;
+                pthread_cond_broadcast(&ctx->cond);
+        }
+        pthread_mutex_unlock(&ctx->lock);
+
+        free(scratch);
+        return NULL;
+}
+
+/**
+ * Runs on the calling thread: writes chunks strictly in
+ * order and releases each slot once its data is out.
+ */
+static void _xform_writer(_xform_ctx* ctx)
+{
+        size_t c;
+        _xform_slot* slot;
+
+        for(c = 0; c < ctx->chunks; c++) {
+                slot = &ctx->slots[c % ctx->nbuf];
+
+                pthread_mutex_lock(&ctx->lock);
+                while(!(slot->state == XFORM_FULL && slot->chunk == c) && !ctx->error) {
+                        pthread_cond_wait(&ctx->cond, &ctx->lock);
+                }
+                pthread_mutex_unlock(&ctx->lock);
+                if(ctx->error) {
+                        return;
+                }
+
+                if(_xform_write(ctx->fd, slot->data, slot->bytes,
+                                (off_t)(ctx->header + c * ctx->chunk * ctx->stride)) != 0) {
+                        pthread_mutex_lock(&ctx->lock);
+                        ctx->error = 1;
+                        pthread_cond_broadcast(&ctx->cond);
+                        pthread_mutex_unlock(&ctx->lock);
+                        return;
+                }
+                _xform_advise(ctx, c, MADV_DONTNEED);
+
+                pthread_mutex_lock(&ctx->lock);
+                slot->state = XFORM_FREE;
+                ctx->written++;
+                pthread_cond_broadcast(&ctx->cond);
+                pthread_mutex_unlock(&ctx->lock);
+        }
+}
+
+static int _xform_run(_xform_ctx* ctx, int threads)
+{
+        int i;
+        int started;
+        pthread_t* tids;
+
+        ctx->slots = calloc(ctx->nbuf, sizeof(_xform_slot));
+        tids = malloc(threads * sizeof(pthread_t));
+        if(ctx->slots == NULL || tids == NULL) {
+                free(ctx->slots);
+                free(tids);
+                return -1;
+        }
+        for(i = 0; i < ctx->nbuf; i++) {
+                ctx->slots[i].data = aligned_alloc(64, (ctx->chunk * ctx->stride + 63) & ~(size_t)63);
+                if(ctx->slots[i].data == NULL) {
+                        ctx->error = 1;
+                }
+        }
+
+        pthread_mutex_init(&ctx->lock, NULL);
+        pthread_cond_init(&ctx->cond, NULL);
+
+        started = 0;
+        if(!ctx->error) {
+                for(started = 0; started < threads; started++) {
+                        if(pthread_create(&tids[started], NULL, _xform_worker, ctx) != 0) {
+                                break;
+                        }
+                }
+                if(started == 0) {
+                        ctx->error = 1;
+                }
+        }
+        if(!ctx->error) {
+                _xform_writer(ctx);
+        }
+        for(i = 0; i < started; i++) {
+                pthread_join(tids[i], NULL);
+        }
+
+        pthread_cond_destroy(&ctx->cond);
+        pthread_mutex_destroy(&ctx->lock);
+        for(i = 0; i < ctx->nbuf; i++) {
+                free(ctx->slots[i].data);
+        }
+        free(ctx->slots);
+        free(tids);
+
+        return ctx->error ? -1 : 0;
+}
+
+void xform_layout_init(xform_layout* layout, size_t stride)
+{
+        memset(layout, 0, sizeof(*layout));
+        layout->stride = stride;
+        layout->position = 0;
+        layout->normal = -1;
+}
+
+int xform_file(const char* src, const char* dest, mat4f* mat, xform_layout* layout)
+{
+        int in;
+        int ret;
+        int threads;
+        size_t tail;
+        mat4f nrm;
+        struct stat st;
+        struct stat out;
+        unsigned char* map;
+        _xform_ctx ctx;
+
+        if(layout->stride == 0 ||
+                        (layout->position >= 0 && layout->position + sizeof(vec3f) > layout->stride) ||
+                        (layout->normal >= 0 && layout->normal + sizeof(vec3f) > layout->stride)) {
+                return -1;
+        }
+
+        /* normals need the inverse transpose, so a singular mat is an error rather than an identity */
+        if(layout->normal >= 0) {
+                if(mat4f_inverse_array(mat, &nrm, NULL, 1) != 0) {
+                        errno = EDOM;
+                        return -1;
+                }
+                mat4f_transpose(&nrm, &nrm);
+        }
+
+        in = open(src, O_RDONLY);
+        if(in < 0) {
+                return -1;
+        }
+        if(fstat(in, &st) != 0 || (size_t)st.st_size < layout->header) {
+                close(in);
+                return -1;
+        }
+
+        /* truncating dest would pull the mapped input out from under the workers */
+        if(stat(dest, &out) == 0 && out.st_dev == st.st_dev && out.st_ino == st.st_ino) {
+                close(in);
+                errno = EINVAL;
+                return -1;
+        }
+
+        map = NULL;
+        if(st.st_size > 0) {
+                map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+                if(map == MAP_FAILED) {
+                        close(in);
+                        return -1;
+                }
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+        }
+        close(in);
+
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(ctx.fd < 0) {
+                if(map != NULL) {
+                        munmap(map, st.st_size);
+                }
+                return -1;
+        }
+
+        threads = layout->threads > 0 ? layout->threads : cgmath_threads();
+        ctx.in = map + layout->header;
+        ctx.stride = layout->stride;
+        ctx.header = layout->header;
+        ctx.position = layout->position;
+        ctx.normal = layout->normal;
+        ctx.records = (st.st_size - layout->header) / layout->stride;
+        ctx.chunk = layout->chunk > 0 ? layout->chunk : XFORM_CHUNK_BYTES / layout->stride;
+        if(ctx.chunk == 0) {
+                ctx.chunk = 1;
+        }
+        ctx.chunks = (ctx.records + ctx.chunk - 1) / ctx.chunk;
+        ctx.nbuf = layout->buffers > 0 ? layout->buffers : 2 * threads + 2;
+
+        memcpy(ctx.mat.m, mat->m, MAT4F_SIZE);
+        if(ctx.normal >= 0) {
+                memcpy(ctx.nrm.m, nrm.m, MAT4F_SIZE);
+        }
+
+        ret = 0;
+        if(layout->header > 0 &&
+                        _xform_write(ctx.fd, map, layout->header, 0) != 0) {
+                ret = -1;
+        }
+        tail = (st.st_size - layout->header) % layout->stride;
+        if(ret == 0 && tail > 0 &&
+                        _xform_write(ctx.fd, map + st.st_size - tail, tail, st.st_size - tail) != 0) {
+                ret = -1;
+        }
+        if(ret == 0 && ctx.chunks > 0) {
+                ret = _xform_run(&ctx, threads);
+        }
+        if(ret == 0 && ftruncate(ctx.fd, st.st_size) != 0) {
+                ret = -1;
+        }
+
+        if(close(ctx.fd) != 0) {
+                ret = -1;
+        }
+        if(map != NULL) {
+                munmap(map, st.st_size);
+        }
+        if(ret != 0) {
+                unlink(dest);
+        }
+        return ret;
+}